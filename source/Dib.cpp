@@ -130,6 +130,24 @@ void* CDIB::GetDIBBitArray() const
 
 }
 
+// Get the dimensions of the DIB
+// - Returns false if no DIB has been created
+bool CDIB::GetDIBSize(DWORD &dwWidth,DWORD &dwHeight) const
+{
+	if (!m_pDIB) return FALSE;
+	dwWidth = m_pDIB->bmiHeader.biWidth;
+	dwHeight = m_pDIB->bmiHeader.biHeight;
+	return TRUE;
+}
+
+// Exchange the bitmap with another DIB (without copying it)
+void CDIB::SwapDIB(CDIB &oDib)
+{
+	LPBITMAPINFO	pDIB = m_pDIB;
+	m_pDIB = oDib.m_pDIB;
+	oDib.m_pDIB = pDIB;
+}
+
 bool CDIB::CreateDIBFromBitmap(CDC* pDC)
 {
     if (!pDC) return FALSE;
@@ -42,6 +42,8 @@ public:
     void			InitializeColors();
     int				GetDIBCols() const;
     void*			GetDIBBitArray() const;
+	bool			GetDIBSize(DWORD &dwWidth,DWORD &dwHeight) const;
+	void			SwapDIB(CDIB &oDib);
     bool			CopyDIB(CDC* pDestDC,int x,int y,float scale=1);
 	bool			CopyDibDblBuf(CDC* pDestDC, int x, int y,CRect* rectClient, float scale);
     bool			CopyDIBsmall(CDC* pDestDC,int x,int y,float scale=1);
@@ -208,6 +208,30 @@ void CDocLog::AddLineGood(CString strTxt)
 	}
 }
 
+// Append all lines from a local log (retaining the line colors)
+// - Used to merge a log that was collected separately, such as
+//   the output of a scan decode worker (CimgDecode)
+//
+// INPUT:
+// - pLogSrc		= Local log to copy from
+//
+void CDocLog::AddLog(CDocLog* pLogSrc)
+{
+	CString		strTxt;
+	COLORREF	sCol;
+	ASSERT(pLogSrc);
+	if (m_bEn) {
+		for (unsigned nLine=0;pLogSrc->GetLineLogLocal(nLine,strTxt,sCol);nLine++) {
+			if ((m_bUseDoc) && (!m_bLogQuickMode)) {
+				CJPEGsnoopDoc*	pSnoopDoc = (CJPEGsnoopDoc*)m_pDoc;
+				pSnoopDoc->AppendToLog(strTxt,sCol);
+			} else {
+				AppendToLogLocal(strTxt,sCol);
+			}
+		}
+	}
+}
+
 // ======================================================================
 
 unsigned CDocLog::AppendToLogLocal(CString strTxt, COLORREF sColor)
@@ -37,6 +37,7 @@ public:
 	void		AddLineWarn(CString str);
 	void		AddLineErr(CString str);
 	void		AddLineGood(CString str);
+	void		AddLog(CDocLog* pLogSrc);
 
 	void		Enable();
 	void		Disable();
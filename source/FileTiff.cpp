@@ -27,6 +27,7 @@ FileTiff::FileTiff()
 	m_nPtrIfdExtra = 0;
 	m_nPtrImg = 0;
 	m_nPos = 0;
+	m_nRowBytes = 0;
 	m_pIfdExtraBuf = NULL;
 }
 
@@ -433,15 +434,67 @@ void FileTiff::WriteIfd(unsigned nSizeX,unsigned nSizeY,bool bModeYcc,bool bMode
 
 
 
+// Write a complete TIFF file from a bitmap
+// - If no bitmap is provided a placeholder gradient is written
+//
+// INPUT:
+// - sFnameOut				= Output filename
+// - bModeYcc				= Samples are YCC (otherwise RGB)
+// - bMode16b				= 16-bit samples (otherwise 8-bit)
+// - pBitmap				= Image samples already in file order (or NULL)
+// - nSizeX, nSizeY			= Image dimensions
+//
 void FileTiff::WriteFile(CString sFnameOut,bool bModeYcc,bool bMode16b,void* pBitmap,unsigned nSizeX,unsigned nSizeY)
 {
-	unsigned char*	pBitmap8;
-	unsigned short*	pBitmap16;
+	if (!WriteFileBegin(sFnameOut,bModeYcc,bMode16b,nSizeX,nSizeY)) {
+		return;
+	}
 
-	pBitmap8 = reinterpret_cast<unsigned char *>(pBitmap);
-	pBitmap16 = reinterpret_cast<unsigned short *>(pBitmap);
+	// Image Data
+	if (pBitmap) {
+		// The pBitmap arrays have already been arranged into
+		// file order, which is often reversed from memory (RGB)
+		// sequence.
+		WriteFileRows(pBitmap,nSizeY);
+	}
+
+
+	// If no image was loaded, then output a placeholder gradient image
+	if (!pBitmap) {
+		for (unsigned nIndY=0;nIndY<nSizeY;nIndY++) {
+			for (unsigned nIndX=0;nIndX<nSizeX;nIndX++) {
+				if (!bMode16b) {
+					WriteVal8(0x00 + static_cast<BYTE>(nIndX*32+nIndY*16));	// R
+					WriteVal8(0x20 + static_cast<BYTE>(nIndX*16+nIndY*16));	// G
+					WriteVal8(0x80 + static_cast<BYTE>(nIndX*8 +nIndY*16));	// B
+				} else {
+					WriteVal16(0x00 + static_cast<unsigned short>(nIndX*32+nIndY*16));	// R
+					WriteVal16(0x20 + static_cast<unsigned short>(nIndX*16+nIndY*16));	// G
+					WriteVal16(0x80 + static_cast<unsigned short>(nIndX*8 +nIndY*16));	// B
+				}
+			}
+		}
+	}
 
+	WriteFileEnd();
+}
 
+// Start writing a TIFF file whose image data is provided in rows
+// - Writes the header and IFD. The image data follows with
+//   WriteFileRows() and the file is closed by WriteFileEnd()
+// - This allows large images to be written without holding the
+//   whole bitmap in memory
+//
+// INPUT:
+// - sFnameOut				= Output filename
+// - bModeYcc				= Samples are YCC (otherwise RGB)
+// - bMode16b				= 16-bit samples (otherwise 8-bit)
+// - nSizeX, nSizeY			= Image dimensions
+// RETURN:
+// - False if the file couldn't be opened (already reported)
+//
+bool FileTiff::WriteFileBegin(CString sFnameOut,bool bModeYcc,bool bMode16b,unsigned nSizeX,unsigned nSizeY)
+{
 	ASSERT(sFnameOut != _T(""));
 
 	try
@@ -462,7 +515,7 @@ void FileTiff::WriteFile(CString sFnameOut,bool bModeYcc,bool bMode16b,void* pBi
 		AfxMessageBox(strError);
 		m_pFileOutput = NULL;
 
-		return;
+		return false;
 
 	}
 
@@ -470,6 +523,7 @@ void FileTiff::WriteFile(CString sFnameOut,bool bModeYcc,bool bMode16b,void* pBi
 
 	m_bPreCalc = false;
 	m_nPos = 0;
+	m_nRowBytes = nSizeX*3*((bMode16b)?2:1);
 
 	// This will get updated after pass 1 of WriteIfd()
 	m_nPtrImg = 0;
@@ -491,49 +545,41 @@ void FileTiff::WriteFile(CString sFnameOut,bool bModeYcc,bool bMode16b,void* pBi
 		WriteVal8(0x00);
 	}
 
-	// Image Data
-	if (pBitmap) {
-		// The pBitmap arrays have already been arranged into
-		// file order, which is often reversed from memory (RGB)
-		// sequence.
-		if (!bMode16b) {
-			m_pFileOutput->Write(pBitmap8,nSizeX*nSizeY*3*1);
-			m_nPos += nSizeX*nSizeY*3*1;
-		} else {
-			m_pFileOutput->Write(pBitmap16,nSizeX*nSizeY*3*2);
-			m_nPos += nSizeX*nSizeY*3*2;
-		}
-
-	}
+	return true;
+}
 
+// Write rows of image data
+//
+// INPUT:
+// - pRows					= Image samples already in file order
+//							  (RGB/YCC, 16-bit samples big endian)
+// - nNumRows				= Number of rows in pRows
+// PRE:
+// - WriteFileBegin()
+//
+void FileTiff::WriteFileRows(const void* pRows,unsigned nNumRows)
+{
+	ASSERT(m_pFileOutput);
+	m_pFileOutput->Write(pRows,m_nRowBytes*nNumRows);
+	m_nPos += m_nRowBytes*nNumRows;
+}
 
-	// If no image was loaded, then output a placeholder gradient image
-	if (!pBitmap) {
-		for (unsigned nIndY=0;nIndY<nSizeY;nIndY++) {
-			for (unsigned nIndX=0;nIndX<nSizeX;nIndX++) {
-				if (!bMode16b) {
-					WriteVal8(0x00 + static_cast<BYTE>(nIndX*32+nIndY*16));	// R
-					WriteVal8(0x20 + static_cast<BYTE>(nIndX*16+nIndY*16));	// G
-					WriteVal8(0x80 + static_cast<BYTE>(nIndX*8 +nIndY*16));	// B
-				} else {
-					WriteVal16(0x00 + static_cast<unsigned short>(nIndX*32+nIndY*16));	// R
-					WriteVal16(0x20 + static_cast<unsigned short>(nIndX*16+nIndY*16));	// G
-					WriteVal16(0x80 + static_cast<unsigned short>(nIndX*8 +nIndY*16));	// B
-				}
-			}
-		}
+// Finish writing the TIFF file
+//
+// PRE:
+// - WriteFileBegin()
+//
+void FileTiff::WriteFileEnd()
+{
+	if (!m_pFileOutput) {
+		return;
 	}
 
-
-
-
 	m_pFileOutput->Close();
 
 
 	// Clean up
 	// Don't really need to delete m_pFileOutput
-	if (m_pFileOutput) {
-		delete m_pFileOutput;
-		m_pFileOutput = NULL;
-	}
+	delete m_pFileOutput;
+	m_pFileOutput = NULL;
 }
\ No newline at end of file
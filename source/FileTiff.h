@@ -65,6 +65,9 @@ public:
 	~FileTiff();
 
 	void		WriteFile(CString sFnameOut,bool bModeYcc,bool bMode16b,void* pBitmap,unsigned nSizeX,unsigned nSizeY);
+	bool		WriteFileBegin(CString sFnameOut,bool bModeYcc,bool bMode16b,unsigned nSizeX,unsigned nSizeY);
+	void		WriteFileRows(const void* pRows,unsigned nNumRows);
+	void		WriteFileEnd();
 	void		WriteIfd(unsigned nSizeX,unsigned nSizeY,bool bModeYcc,bool bMode16b);
 	void		WriteIfdEntrySingle(unsigned short nTag,unsigned short nType,unsigned nValOffset);
 	void		WriteIfdEntryMult(unsigned short nTag,unsigned short nType,unsigned nNumVals,unsigned* nVals);
@@ -84,6 +87,7 @@ private:
 	unsigned	m_nPtrIfdExtra;
 	unsigned	m_nPtrImg;
 	unsigned	m_nPos;
+	unsigned	m_nRowBytes;		// Bytes per image row (WriteFileRows)
 
 	bool			m_bPreCalc;
 	unsigned short	m_nNumIfd;
@@ -21,8 +21,13 @@
 #include "ImgDecode.h"
 #include "snoop.h"
 #include <math.h>
+#include <limits.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include "JPEGsnoop.h"
+#include "Md5.h"
 
 
 // ------------------------------------------------------
@@ -31,6 +36,14 @@
 // Flag: Use fixed point arithmetic for IDCT?
 //#define IDCT_FIXEDPT
 
+// Flag: Verify every IDCT block against the reference (PrecalcIdct) matrix
+// IDCT and report any mismatches. This is very slow, only for debug use.
+//#define IDCT_SELFCHECK
+
+// Flag: Verify every SIMD kernel call (see ImgDecodeSimd.cpp) against the
+// scalar reference kernel and report any mismatches. Only for debug use.
+//#define SIMD_SELFCHECK
+
 // Flag: Do we stop during scan decode if 0xFF (but not pad)?
 // TODO: Make this a config option
 //#define SCAN_BAD_MARKER_STOP
@@ -58,15 +71,29 @@ void CimgDecode::Reset()
 	m_nImgSizeYPartMcu = 0;
 	m_nImgSizeX  = 0;
 	m_nImgSizeY  = 0;
+	m_nPixMapW   = 0;
+	m_nPixMapH   = 0;
+	m_nScaleShift = SCAN_SCALE_1;
+	m_nPixMapPrecShift = 0;
+	m_nBandMcuRows = 0;
+	m_nBandPixY = 0;
+	m_nBandShift = 0;
 	m_nMcuXMax   = 0;
 	m_nMcuYMax   = 0;
 	m_nBlkXMax   = 0;
 	m_nBlkYMax   = 0;
 
+	m_eMcuLayout = MCU_LAYOUT_GENERIC;
+	memset(m_anScanDhtTblDc,0,sizeof(m_anScanDhtTblDc));
+	memset(m_anScanDhtTblAc,0,sizeof(m_anScanDhtTblAc));
+	memset(m_anScanDqtTbl,0,sizeof(m_anScanDqtTbl));
+
 	m_bBrightValid = false;
 	m_nBrightY  = -32768;
 	m_nBrightCb = -32768;
 	m_nBrightCr = -32768;
+	m_nBrightK  = -32768;
+	m_nBrightLum = -1;
 	m_nBrightR = 0;
 	m_nBrightG = 0;
 	m_nBrightB = 0;
@@ -81,6 +108,7 @@ void CimgDecode::Reset()
 		m_pDibTemp.Kill();
 		m_bDibTempReady = false;
 	}
+	PreviewCacheClear();
 
 	if (m_bDibHistRgbReady) {
 		m_pDibHistRgb.Kill();
@@ -93,7 +121,7 @@ void CimgDecode::Reset()
 	}
 
 	if (m_pMcuFileMap) {
-		delete [] m_pMcuFileMap;
+		delete m_pMcuFileMap;
 		m_pMcuFileMap = NULL;
 	}
 
@@ -109,25 +137,33 @@ void CimgDecode::Reset()
 		delete [] m_pBlkDcValCr;
 		m_pBlkDcValCr = NULL;
 	}
-
-	if (m_pPixValY) {
-		delete [] m_pPixValY;
-		m_pPixValY = NULL;
-	}
-	if (m_pPixValCb) {
-		delete [] m_pPixValCb;
-		m_pPixValCb = NULL;
+	if (m_pBlkDcValK) {
+		delete [] m_pBlkDcValK;
+		m_pBlkDcValK = NULL;
 	}
-	if (m_pPixValCr) {
-		delete [] m_pPixValCr;
-		m_pPixValCr = NULL;
+
+	PlaneFree();
+	ScanCkptFree();
+
+	// Discard any unfinished progressive decode
+	DecodeScanProgFree();
+
+	// Discard any lossless image
+	DecodeLosslessFree();
+	if (m_pLlPixMap) {
+		delete [] m_pLlPixMap;
+		m_pLlPixMap = NULL;
 	}
+	m_bLossless = false;
 
 	// Haven't warned about anything yet
 	if (!m_bScanErrorsDisable) {
 		m_nWarnBadScanNum = 0;
 	}
 	m_nWarnYccClipNum = 0;
+	m_nWarnIdctCheckNum = 0;
+	m_nWarnSimdCheckNum = 0;
+	memset(m_anIdctPathNum,0,sizeof(m_anIdctPathNum));
 
 	// Reset the view
 	m_nPreviewPosX = 0;
@@ -138,8 +174,17 @@ void CimgDecode::Reset()
 }
 
 // Constructor for the Image Decoder
-// - This constructor is called only once by Document class
-CimgDecode::CimgDecode(CDocLog* pLog, CwindowBuf* pWBuf)
+// - The main decoder is constructed only once by Document class
+// - A worker decoder (parallel, pipelined and band decode) is given
+//   the main decoder. It shares the DQT, DHT and IDCT tables of the
+//   main decoder and is set up for its scan (see ScanWorkerAttach).
+//
+// INPUT:
+// - pLog				= Log for the decoder reports
+// - pWBuf				= File buffer of the scan data
+// - pMain				= Main decoder (worker decoder only, else NULL)
+//
+CimgDecode::CimgDecode(CDocLog* pLog, CwindowBuf* pWBuf, const CimgDecode* pMain)
 {
 	// Ideally this would be passed by constructor, but simply access
 	// directly for now.
@@ -157,6 +202,16 @@ CimgDecode::CimgDecode(CDocLog* pLog, CwindowBuf* pWBuf)
 	m_pLog = pLog;
 	m_pWBuf = pWBuf;
 
+	// The worker decoders use the tables of the main decoder
+	if (pMain) {
+		m_psTbl = pMain->m_psTbl;
+		m_bTblOwner = false;
+	} else {
+		m_psTbl = new ScanDecodeTbl;
+		m_bTblOwner = true;
+	}
+	ASSERT(m_psTbl);
+
 	m_pStatBar = NULL;
 	m_bDibTempReady = false;
 	m_bPreviewIsJpeg = false;
@@ -170,9 +225,33 @@ CimgDecode::CimgDecode(CDocLog* pLog, CwindowBuf* pWBuf)
 	m_pBlkDcValY = NULL;
 	m_pBlkDcValCb = NULL;
 	m_pBlkDcValCr = NULL;
-	m_pPixValY = NULL;
-	m_pPixValCb = NULL;
-	m_pPixValCr = NULL;
+	m_pBlkDcValK = NULL;
+	memset(m_asPixPlane,0,sizeof(m_asPixPlane));
+	memset(m_asPreviewCache,0,sizeof(m_asPreviewCache));
+	m_nPreviewCacheNum = 0;
+	m_nPreviewCacheUse = 0;
+
+	m_psPipeBatch = NULL;
+	m_nPipeIdctTbl = -1;
+	m_psPipe = NULL;
+	m_psScanCkpt = NULL;
+	m_nScanCkptMcus = 0;
+	m_nScanCkptNum = 0;
+
+	for (unsigned nComp=0;nComp<=NUM_CHAN_YCCK;nComp++) {
+		m_apProgCoef[nComp] = NULL;
+	}
+
+	for (unsigned nScanComp=0;nScanComp<=MAX_SOS_COMP_NS;nScanComp++) {
+		m_apLlRow[nScanComp] = NULL;
+	}
+	m_pLlPixMap = NULL;
+	m_bLossless = false;
+	m_bLlErrDisabled = false;
+
+	// Select the per-block kernels for this CPU
+	m_pKernels = ImgDecodeSimdInit();
+	if (DEBUG_EN) m_pAppConfig->DebugLogAdd(_T("CimgDecode::CimgDecode() Kernels: ") + ImgDecodeSimdName(m_pKernels->eLevel));
 
 	if (DEBUG_EN) m_pAppConfig->DebugLogAdd(_T("CimgDecode::CimgDecode() Checkpoint 1"));
 
@@ -200,11 +279,15 @@ CimgDecode::CimgDecode(CDocLog* pLog, CwindowBuf* pWBuf)
 
 
 	// Set up the IDCT lookup tables
-	PrecalcIdct();
+	if (m_bTblOwner) {
+		PrecalcIdct();
+	}
 
 	if (DEBUG_EN) m_pAppConfig->DebugLogAdd(_T("CimgDecode::CimgDecode() Checkpoint 3"));
 
-	GenLookupHuffMask();
+	if (m_bTblOwner) {
+		GenLookupHuffMask();
+	}
 	if (DEBUG_EN) m_pAppConfig->DebugLogAdd(_T("CimgDecode::CimgDecode() Checkpoint 4"));
 
 
@@ -224,12 +307,22 @@ CimgDecode::CimgDecode(CDocLog* pLog, CwindowBuf* pWBuf)
 	m_bViewOverlaysMcuGrid = false;
 
 	// Start off with no YCC offsets for CalcChannelPreview()
+	// - SetPreviewYccOffset() compares against the current offsets
+	m_nPreviewShiftY = 0;
+	m_nPreviewShiftCb = 0;
+	m_nPreviewShiftCr = 0;
+	m_nPreviewShiftMcuX = 0;
+	m_nPreviewShiftMcuY = 0;
 	SetPreviewYccOffset(0,0,0,0,0);
 	if (DEBUG_EN) m_pAppConfig->DebugLogAdd(_T("CimgDecode::CimgDecode() Checkpoint 7"));
 
 	SetPreviewMcuInsert(0,0,0);
 	if (DEBUG_EN) m_pAppConfig->DebugLogAdd(_T("CimgDecode::CimgDecode() Checkpoint 8"));
 
+	if (pMain) {
+		ScanWorkerAttach(pMain);
+	}
+
 	if (DEBUG_EN) m_pAppConfig->DebugLogAdd(_T("CimgDecode::CimgDecode() End"));
 }
 
@@ -239,7 +332,7 @@ CimgDecode::CimgDecode(CDocLog* pLog, CwindowBuf* pWBuf)
 CimgDecode::~CimgDecode()
 {
 	if (m_pMcuFileMap) {
-		delete [] m_pMcuFileMap;
+		delete m_pMcuFileMap;
 		m_pMcuFileMap = NULL;
 	}
 
@@ -255,20 +348,27 @@ CimgDecode::~CimgDecode()
 		delete [] m_pBlkDcValCr;
 		m_pBlkDcValCr = NULL;
 	}
-
-	if (m_pPixValY) {
-		delete [] m_pPixValY;
-		m_pPixValY = NULL;
-	}
-	if (m_pPixValCb) {
-		delete [] m_pPixValCb;
-		m_pPixValCb = NULL;
+	if (m_pBlkDcValK) {
+		delete [] m_pBlkDcValK;
+		m_pBlkDcValK = NULL;
 	}
-	if (m_pPixValCr) {
-		delete [] m_pPixValCr;
-		m_pPixValCr = NULL;
+
+	PlaneFree();
+	ScanCkptFree();
+	PreviewCacheClear();
+
+	DecodeScanProgFree();
+
+	DecodeLosslessFree();
+	if (m_pLlPixMap) {
+		delete [] m_pLlPixMap;
+		m_pLlPixMap = NULL;
 	}
 
+	if (m_bTblOwner) {
+		delete m_psTbl;
+	}
+	m_psTbl = NULL;
 }
 
 // Reset the major parameters
@@ -280,24 +380,52 @@ CimgDecode::~CimgDecode()
 // - m_bImgDetailsSet
 // - m_nNumSofComps
 // - m_nPrecision
+// - m_bColorYcck
 // - m_bScanErrorsDisable
 // - m_nMarkersBlkNum
+// - m_anSosCompInd[]
+// - m_nSosSpectralStart, m_nSosSpectralEnd
+// - m_nSosSuccApproxHigh, m_nSosSuccApproxLow
+// - m_bScanArith
+// - m_anArithDcL[], m_anArithDcU[], m_anArithAcK[]
 //
 void CimgDecode::ResetState()
 {
-	ResetDhtLookup();
-	ResetDqtTables();
+	// The tables of a worker decoder belong to the main decoder
+	if (m_bTblOwner) {
+		ResetDhtLookup();
+		ResetDqtTables();
+	} else {
+		memset(m_anDhtHisto,0,sizeof(m_anDhtHisto));
+		m_nNumSosComps = 0;
+	}
 
 	for (unsigned nCompInd=0;nCompInd<MAX_SOF_COMP_NF;nCompInd++) {
 		m_anSofSampFactH[nCompInd] = 0;
 		m_anSofSampFactV[nCompInd] = 0;
 	}
 
+	// Default to a sequential scan of the frame components in order
+	for (unsigned nScanCompInd=0;nScanCompInd<=MAX_SOS_COMP_NS;nScanCompInd++) {
+		m_anSosCompInd[nScanCompInd] = nScanCompInd;
+	}
+	SetSosProgress(0,DCT_SZ_ALL-1,0,0);
+
+	// Default to huffman coding and the default arithmetic conditioning
+	m_bScanArith = false;
+	for (unsigned nTbl=0;nTbl<MAX_DHT_DEST_ID;nTbl++) {
+		m_anArithDcL[nTbl] = ARITH_DC_L_DEF;
+		m_anArithDcU[nTbl] = ARITH_DC_U_DEF;
+		m_anArithAcK[nTbl] = ARITH_AC_K_DEF;
+	}
+
 	m_bImgDetailsSet = false;
 	m_nNumSofComps = 0;
 
 	m_nPrecision = 0; // Default to "precision not set"
 
+	m_bColorYcck = false;
+
 	m_bScanErrorsDisable = false;
 
 	// Reset the markers
@@ -337,22 +465,26 @@ void CimgDecode::SetStatusText(CString str)
 
 // Clears the DQT entries
 // POST:
-// - m_anDqtTblSel[]
-// - m_anDqtCoeff[][]
-// - m_anDqtCoeffZz[][]
+// - m_psTbl->anDqtTblSel[]
+// - m_psTbl->anDqtCoeff[][]
+// - m_psTbl->anDqtCoeffZz[][]
+// - m_psTbl->afDqtIdctMult[][]
+// - m_psTbl->anDqtIdctMult[][]
 void CimgDecode::ResetDqtTables()
 {
 	for (unsigned nDqtComp=0;nDqtComp<MAX_DQT_COMP;nDqtComp++) {
 		// Force entries to an invalid value. This makes
 		// sure that we have to get a valid SetDqtTables() call
 		// from JfifDecode first.
-		m_anDqtTblSel[nDqtComp] = -1;
+		m_psTbl->anDqtTblSel[nDqtComp] = -1;
 	}
 
 	for (unsigned nDestId=0;nDestId<MAX_DQT_DEST_ID;nDestId++) {
 		for (unsigned nCoeff=0;nCoeff<MAX_DQT_COEFF;nCoeff++) {
-			m_anDqtCoeff[nDestId][nCoeff] = 0;
-			m_anDqtCoeffZz[nDestId][nCoeff] = 0;
+			m_psTbl->anDqtCoeff[nDestId][nCoeff] = 0;
+			m_psTbl->anDqtCoeffZz[nDestId][nCoeff] = 0;
+			m_psTbl->afDqtIdctMult[nDestId][nCoeff] = 0;
+			m_psTbl->anDqtIdctMult[nDestId][nCoeff] = 0;
 		}
 	}
 
@@ -363,12 +495,10 @@ void CimgDecode::ResetDqtTables()
 // - These tables are used to speed up VLC lookups
 // - This should be called by the JFIF decoder any time we start a new file
 // POST:
-// - m_anDhtLookupSetMax[]
-// - m_anDhtLookupSize[][]
-// - m_anDhtLookup_bitlen[][][]
-// - m_anDhtLookup_bits[][][]
-// - m_anDhtLookup_code[][][]
-// - m_anDhtLookupfast[][][]
+// - m_psTbl->anDhtLookupSetMax[]
+// - m_psTbl->anDhtLookupSize[][]
+// - m_psTbl->anDhtLookupfast[][][]
+// - m_psTbl->anDhtLookupSubNum[][]
 //
 void CimgDecode::ResetDhtLookup()
 {
@@ -376,20 +506,11 @@ void CimgDecode::ResetDhtLookup()
 
 	// Use explicit loop ranges instead of memset
 	for (unsigned nClass=DHT_CLASS_DC;nClass<=DHT_CLASS_AC;nClass++) {
-		m_anDhtLookupSetMax [nClass] = 0;
+		m_psTbl->anDhtLookupSetMax [nClass] = 0;
 		// DHT table destination ID is range 0..3
 		for (unsigned nDestId=0;nDestId<MAX_DHT_DEST_ID;nDestId++) {
-			m_anDhtLookupSize[nClass][nDestId] = 0;
-			for (unsigned nCodeInd=0;nCodeInd<MAX_DHT_CODES;nCodeInd++) {
-				m_anDhtLookup_bitlen[nClass][nDestId][nCodeInd] = 0;
-				m_anDhtLookup_bits  [nClass][nDestId][nCodeInd] = 0;
-				m_anDhtLookup_mask  [nClass][nDestId][nCodeInd] = 0;
-				m_anDhtLookup_code  [nClass][nDestId][nCodeInd] = 0;
-			}
-			for (unsigned nElem=0;nElem<(2<<DHT_FAST_SIZE);nElem++) {
-				// Mark with invalid value
-				m_anDhtLookupfast[nClass][nDestId][nElem] = DHT_CODE_UNUSED;
-			}
+			m_psTbl->anDhtLookupSize[nClass][nDestId] = 0;
+			ResetDhtLookupTbl(nClass,nDestId);
 		}
 
 		for (unsigned nCompInd=0;nCompInd<1+MAX_SOS_COMP_NS;nCompInd++) {
@@ -398,13 +519,34 @@ void CimgDecode::ResetDhtLookup()
 			// from JfifDecode first.
 			// Even though nCompInd is supposed to be 1-based numbering,
 			// we start at index 0 to ensure it is marked as invalid.
-			m_anDhtTblSel[nClass][nCompInd] = -1;
+			m_psTbl->anDhtTblSel[nClass][nCompInd] = -1;
 		}
 	}
 
 	m_nNumSosComps = 0;
 }
 
+// Clear the two-level lookup for a single DHT table
+// - Called when a DHT table is (re)defined so that codes from an
+//   earlier definition of the same table can't be matched
+//
+// INPUT:
+// - nClass				= Select between DC and AC tables (0=DC, 1=AC)
+// - nDestId			= DHT destination table ID (0..3)
+// POST:
+// - m_psTbl->anDhtLookupfast[][][]
+// - m_psTbl->anDhtLookupSubNum[][]
+//
+void CimgDecode::ResetDhtLookupTbl(unsigned nClass,unsigned nDestId)
+{
+	for (unsigned nElem=0;nElem<(1<<DHT_FAST_SIZE);nElem++) {
+		// Mark with invalid value
+		m_psTbl->anDhtLookupfast[nClass][nDestId][nElem] = DHT_CODE_UNUSED;
+	}
+	// Second level tables are cleared as they are allocated
+	m_psTbl->anDhtLookupSubNum[nClass][nDestId] = 0;
+}
+
 
 // Configure an entry in a quantization table
 //
@@ -414,8 +556,10 @@ void CimgDecode::ResetDhtLookup()
 // - nIndzz			= Coeff index (zigzag order)
 // - nCoeff			= Coeff value
 // POST:
-// - m_anDqtCoeff[]
-// - m_anDqtCoeffZz[]
+// - m_psTbl->anDqtCoeff[]
+// - m_psTbl->anDqtCoeffZz[]
+// - m_psTbl->afDqtIdctMult[]
+// - m_psTbl->anDqtIdctMult[]
 // RETURN:
 // - True if params in range, false otherwise
 //
@@ -424,11 +568,14 @@ void CimgDecode::ResetDhtLookup()
 bool CimgDecode::SetDqtEntry(unsigned nTblDestId, unsigned nCoeffInd, unsigned nCoeffIndZz, unsigned short nCoeffVal)
 {
 	if ((nTblDestId < MAX_DQT_DEST_ID) && (nCoeffInd < MAX_DQT_COEFF)) {
-		m_anDqtCoeff[nTblDestId][nCoeffInd] = nCoeffVal;
+		m_psTbl->anDqtCoeff[nTblDestId][nCoeffInd] = nCoeffVal;
 
 		// Save a copy that represents the original zigzag order
 		// This is used by the IDCT logic
-		m_anDqtCoeffZz[nTblDestId][nCoeffIndZz] = nCoeffVal;
+		m_psTbl->anDqtCoeffZz[nTblDestId][nCoeffIndZz] = nCoeffVal;
+
+		// Update the IDCT dequantization multiplier
+		PrecalcIdctDqt(nTblDestId,nCoeffInd);
 
 	} else {
 		// Should never get here!
@@ -459,14 +606,14 @@ bool CimgDecode::SetDqtEntry(unsigned nTblDestId, unsigned nCoeffInd, unsigned n
 // - nTblDestId				= DQT Table Destination ID
 // - nCoeffInd				= Coefficient index in 8x8 matrix
 // PRE:
-// - m_anDqtCoeff[][]
+// - m_psTbl->anDqtCoeff[][]
 // RETURN:
 // - Returns the indexed DQT matrix entry
 //
 unsigned CimgDecode::GetDqtEntry(unsigned nTblDestId, unsigned nCoeffInd)
 {
 	if ((nTblDestId < MAX_DQT_DEST_ID) && (nCoeffInd < MAX_DQT_COEFF)) {
-		return m_anDqtCoeff[nTblDestId][nCoeffInd];
+		return m_psTbl->anDqtCoeff[nTblDestId][nCoeffInd];
 	} else {
 		// Should never get here!
 		CString strTmp;
@@ -496,7 +643,7 @@ unsigned CimgDecode::GetDqtEntry(unsigned nTblDestId, unsigned nCoeffInd)
 // - nCompInd			= Component index. Based on m_nSofNumComps_Nf-1 (ie. 0..254)
 // - nTbl				= DQT Table number. Based on SOF:Tqi (ie. 0..3)
 // POST:
-// - m_anDqtTblSel[]
+// - m_psTbl->anDqtTblSel[]
 // RETURN:
 // - Success if index and table are in range
 // NOTE:
@@ -505,7 +652,7 @@ unsigned CimgDecode::GetDqtEntry(unsigned nTblDestId, unsigned nCoeffInd)
 bool CimgDecode::SetDqtTables(unsigned nCompId, unsigned nTbl)
 {
 	if ((nCompId < MAX_SOF_COMP_NF) && (nTbl < MAX_DQT_DEST_ID)) {
-		m_anDqtTblSel[nCompId] = (int)nTbl;
+		m_psTbl->anDqtTblSel[nCompId] = (int)nTbl;
 	} else {
 		// Should never get here unless the JFIF SOF table has a bad entry!
 		CString strTmp;
@@ -521,15 +668,15 @@ bool CimgDecode::SetDqtTables(unsigned nCompId, unsigned nTbl)
 
 // Set a DHT table for a scan image component index
 // - The DHT Table select array is stored as:
-//   m_anDhtTblSel[0][1,2,3] for DC
-//   m_anDhtTblSel[1][1,2,3] for AC
+//   m_psTbl->anDhtTblSel[0][1,2,3] for DC
+//   m_psTbl->anDhtTblSel[1][1,2,3] for AC
 //
 // INPUT:
 // - nCompInd			= Component index (1-based). Range 1..4
 // - nTblDc				= DHT table index for DC elements of component
 // - nTblAc				= DHT table index for AC elements of component
 // POST:
-// - m_anDhtTblSel[][]
+// - m_psTbl->anDhtTblSel[][]
 // RETURN:
 // - Success if indices are in range
 //
@@ -537,8 +684,8 @@ bool CimgDecode::SetDhtTables(unsigned nCompInd, unsigned nTblDc, unsigned nTblA
 {
 	// Note use of (nCompInd < MAX_SOS_COMP_NS+1) as nCompInd is 1-based notation
 	if ((nCompInd>=1) && (nCompInd < MAX_SOS_COMP_NS+1) && (nTblDc < MAX_DHT_DEST_ID) && (nTblAc < MAX_DHT_DEST_ID)) {
-		m_anDhtTblSel[DHT_CLASS_DC][nCompInd] = (int)nTblDc;
-		m_anDhtTblSel[DHT_CLASS_AC][nCompInd] = (int)nTblAc;
+		m_psTbl->anDhtTblSel[DHT_CLASS_DC][nCompInd] = (int)nTblDc;
+		m_psTbl->anDhtTblSel[DHT_CLASS_AC][nCompInd] = (int)nTblAc;
 	} else {
 		// Should never get here!
 		CString strTmp;
@@ -552,6 +699,109 @@ bool CimgDecode::SetDhtTables(unsigned nCompInd, unsigned nTblDc, unsigned nTblA
 	return true;
 }
 
+// Set the frame component that a scan component refers to
+// - Only used by the progressive decode, where the scans can carry
+//   any subset of the frame components (eg. Cr alone)
+//
+// INPUT:
+// - nScanCompInd		= Scan component index (1-based). Range 1..4
+// - nCompInd			= Frame component index (1-based) with the matching Ci
+// POST:
+// - m_anSosCompInd[]
+// RETURN:
+// - Success if indices are in range
+//
+bool CimgDecode::SetSosCompInd(unsigned nScanCompInd, unsigned nCompInd)
+{
+	if ((nScanCompInd>=1) && (nScanCompInd < MAX_SOS_COMP_NS+1) && (nCompInd>=1) && (nCompInd < MAX_SOS_COMP_NS+1)) {
+		m_anSosCompInd[nScanCompInd] = nCompInd;
+	} else {
+		CString strTmp;
+		strTmp.Format(_T("ERROR: SetSosCompInd(scan comp=%u, comp=%u) out of indexed range"),
+			nScanCompInd,nCompInd);
+		m_pLog->AddLineErr(strTmp);
+		if (m_pAppConfig->bInteractive)
+			AfxMessageBox(strTmp);
+		return false;
+	}
+	return true;
+}
+
+// Select arithmetic coding for the scans of the frame
+// - Arithmetic coded frames (SOF9, SOF10) are decoded into the
+//   coefficient buffer (see DecodeScanProg)
+//
+// INPUT:
+// - bArith				= Scans are arithmetic coded?
+// POST:
+// - m_bScanArith
+//
+void CimgDecode::SetArithCoding(bool bArith)
+{
+	m_bScanArith = bArith;
+}
+
+// Set the arithmetic coding conditioning for a table
+//
+// INPUT:
+// - nClass				= DAC Table class (0=DC, 1=AC)
+// - nTbl				= DAC Table destination ID (0..3)
+// - nVal				= Conditioning table value (Cs): (U<<4)|L for DC, Kx for AC
+// POST:
+// - m_anArithDcL[], m_anArithDcU[], m_anArithAcK[]
+// RETURN:
+// - Success if the indices and value are in range
+//
+bool CimgDecode::SetDacEntry(unsigned nClass, unsigned nTbl, unsigned nVal)
+{
+	unsigned	nDcL = nVal & 0x0F;
+	unsigned	nDcU = (nVal & 0xF0) >> 4;
+	bool		bValid = (nClass < MAX_DHT_CLASS) && (nTbl < MAX_DHT_DEST_ID);
+
+	// Per Table B.6, L <= U for DC and Kx in 1..63 for AC
+	if (bValid && (nClass == DHT_CLASS_DC)) {
+		bValid = (nDcL <= nDcU);
+	} else if (bValid) {
+		bValid = (nVal >= 1) && (nVal < DCT_SZ_ALL);
+	}
+	if (!bValid) {
+		CString strTmp;
+		strTmp.Format(_T("ERROR: SetDacEntry(class=%u, tbl=%u, val=%u) out of range"),nClass,nTbl,nVal);
+		m_pLog->AddLineErr(strTmp);
+		return false;
+	}
+
+	if (nClass == DHT_CLASS_DC) {
+		m_anArithDcL[nTbl] = nDcL;
+		m_anArithDcU[nTbl] = nDcU;
+	} else {
+		m_anArithAcK[nTbl] = nVal;
+	}
+	return true;
+}
+
+// Set the spectral selection and successive approximation of a scan
+// - Sequential scans are always 0..63 with no approximation
+//
+// INPUT:
+// - nSpectralStart		= Start of spectral selection (Ss)
+// - nSpectralEnd		= End of spectral selection (Se)
+// - nSuccApproxHigh	= Successive approximation bit position high (Ah)
+// - nSuccApproxLow		= Successive approximation bit position low (Al)
+// POST:
+// - m_nSosSpectralStart
+// - m_nSosSpectralEnd
+// - m_nSosSuccApproxHigh
+// - m_nSosSuccApproxLow
+//
+void CimgDecode::SetSosProgress(unsigned nSpectralStart, unsigned nSpectralEnd, unsigned nSuccApproxHigh, unsigned nSuccApproxLow)
+{
+	m_nSosSpectralStart = nSpectralStart;
+	m_nSosSpectralEnd = nSpectralEnd;
+	m_nSosSuccApproxHigh = nSuccApproxHigh;
+	m_nSosSuccApproxLow = nSuccApproxLow;
+}
+
 
 
 // Get the precision field
@@ -566,6 +816,22 @@ void CimgDecode::SetPrecision(unsigned nPrecision)
 	m_nPrecision = nPrecision;
 }
 
+// Set the color model of a 4-component image
+// - Determined by the JFIF decoder from the APP14 (Adobe) marker
+//   transform flag. Without the marker the image is treated as CMYK.
+// - In both cases the components are stored inverted (Adobe convention),
+//   so a sample of 255 is no ink
+//
+// INPUT:
+// - bYcck				= Components are YCbCr + K (transform 2) rather than CMYK
+// POST:
+// - m_bColorYcck
+//
+void CimgDecode::SetColorYcck(bool bYcck)
+{
+	m_bColorYcck = bYcck;
+}
+
 
 // Set the general image details for the image decoder
 //
@@ -625,6 +891,8 @@ void CimgDecode::SetSofSampFactors(unsigned nCompInd,unsigned nSampFactH, unsign
 
 
 // Update the preview mode (affects channel display)
+// - Once the preview is ready, the previews of other modes are kept
+//   (PreviewCacheSwap) so that switching back doesn't convert again
 //
 // INPUT:
 // - nMode				= Mode used in channel display (eg. NONE, RGB, YCC)
@@ -634,11 +902,123 @@ void CimgDecode::SetPreviewMode(unsigned nMode)
 {
 	// Need to check to see if mode has changed. If so, we
 	// need to recalculate the temporary preview.
+	bool	bCached = (m_bDibTempReady) && (nMode != m_nPreviewMode) && (PreviewCacheSwap(nMode));
 	m_nPreviewMode = nMode;
-	CalcChannelPreview();
+	if (!bCached) {
+		CalcChannelPreview();
+	}
+}
+
+// Switch the preview DIB to another mode through the preview cache
+// - The current preview is kept in the cache (replacing the least
+//   recently used previews to stay within nPreviewCacheMax)
+// - A cached preview of the new mode (with the same level shift) is
+//   swapped in. Otherwise a new DIB is swapped in for the conversion.
+// - The detailed IDCT dump and verbose reports are printed by the
+//   conversion, so these convert every time
+//
+// INPUT:
+// - nMode				= New preview mode
+// PRE:
+// - m_nPreviewMode		= Mode of the current preview
+// - m_pDibTemp
+// POST:
+// - m_asPreviewCache[]
+// RETURN:
+// - True if m_pDibTemp now holds the preview of nMode, false if it
+//   still has to be converted
+//
+bool CimgDecode::PreviewCacheSwap(unsigned nMode)
+{
+	DWORD		dwDibW,dwDibH;
+	if ((m_bDetailVlc) || (m_bVerbose) || (!m_pDibTemp.GetDIBSize(dwDibW,dwDibH))) {
+		return false;
+	}
+
+	// All of the previews have the size of the current one
+	ULONGLONG	nDibSize = (ULONGLONG)dwDibW * dwDibH * sizeof(RGBQUAD);
+	ULONGLONG	nCacheMax = (ULONGLONG)m_pAppConfig->nPreviewCacheMax * 1024 * 1024;
+	unsigned	nEntMax = 0;
+	if (nDibSize > 0) {
+		nEntMax = (unsigned)min((ULONGLONG)PREVIEW_CACHE_MAX,nCacheMax / nDibSize);
+	}
+	if (nEntMax == 0) {
+		PreviewCacheClear();
+		return false;
+	}
+
+	// Take the preview of the new mode out of the cache, or allocate
+	// a DIB for it
+	CDIB*		pDibNew = NULL;
+	for (unsigned nEnt=0;nEnt<m_nPreviewCacheNum;nEnt++) {
+		PreviewCacheEnt*	psEnt = &m_asPreviewCache[nEnt];
+		if ((psEnt->nMode == nMode) &&
+			(psEnt->nShiftMcuX == m_nPreviewShiftMcuX) && (psEnt->nShiftMcuY == m_nPreviewShiftMcuY) &&
+			(psEnt->nShiftY == m_nPreviewShiftY) && (psEnt->nShiftCb == m_nPreviewShiftCb) &&
+			(psEnt->nShiftCr == m_nPreviewShiftCr)) {
+			pDibNew = psEnt->pDib;
+			m_asPreviewCache[nEnt] = m_asPreviewCache[--m_nPreviewCacheNum];
+			break;
+		}
+	}
+	bool		bHit = (pDibNew != NULL);
+	if (!bHit) {
+		pDibNew = new CDIB;
+		if ((!pDibNew) || (!pDibNew->CreateDIB(dwDibW,dwDibH,32))) {
+			if (pDibNew) {
+				delete pDibNew;
+			}
+			return false;
+		}
+	}
+
+	// Make room for the current preview
+	while (m_nPreviewCacheNum >= nEntMax) {
+		unsigned	nLru = 0;
+		for (unsigned nEnt=1;nEnt<m_nPreviewCacheNum;nEnt++) {
+			if (m_asPreviewCache[nEnt].nLastUse < m_asPreviewCache[nLru].nLastUse) {
+				nLru = nEnt;
+			}
+		}
+		delete m_asPreviewCache[nLru].pDib;
+		m_asPreviewCache[nLru] = m_asPreviewCache[--m_nPreviewCacheNum];
+	}
+
+	// Swap the DIBs: pDibNew now holds the current preview
+	m_pDibTemp.SwapDIB(*pDibNew);
+	PreviewCacheEnt*	psEnt = &m_asPreviewCache[m_nPreviewCacheNum++];
+	psEnt->pDib = pDibNew;
+	psEnt->nMode = m_nPreviewMode;
+	psEnt->nShiftMcuX = m_nPreviewShiftMcuX;
+	psEnt->nShiftMcuY = m_nPreviewShiftMcuY;
+	psEnt->nShiftY = m_nPreviewShiftY;
+	psEnt->nShiftCb = m_nPreviewShiftCb;
+	psEnt->nShiftCr = m_nPreviewShiftCr;
+	psEnt->nLastUse = ++m_nPreviewCacheUse;
+
+	return bHit;
+}
+
+// Release the cached previews
+// - Called whenever the preview DIB is released, as the cached
+//   previews are only valid for the same image
+//
+// POST:
+// - m_asPreviewCache[]
+//
+void CimgDecode::PreviewCacheClear()
+{
+	for (unsigned nEnt=0;nEnt<m_nPreviewCacheNum;nEnt++) {
+		delete m_asPreviewCache[nEnt].pDib;
+	}
+	m_nPreviewCacheNum = 0;
 }
 
 // Update any level shifts for the preview display
+// - Once the preview is ready, only the MCU rows that the change
+//   affects are converted again (from the pixel planes)
+// - The detailed IDCT dump and verbose reports are printed by the
+//   conversion, so they still convert the whole preview
 //
 // INPUT:
 // - nMcuX				= MCU index in X direction
@@ -649,13 +1029,82 @@ void CimgDecode::SetPreviewMode(unsigned nMode)
 //
 void CimgDecode::SetPreviewYccOffset(unsigned nMcuX,unsigned nMcuY,int nY,int nCb,int nCr)
 {
+	unsigned	nMcuY1 = 0;
+	unsigned	nMcuY2 = 0;
+	bool		bPartial = (m_bDibTempReady) && (!m_bDetailVlc) && (!m_bVerbose);
+	bool		bDirty = false;
+
+	// Only a partial reconversion needs the changed rows
+	if (bPartial) {
+		bDirty = CalcPreviewShiftDirty(nMcuX,nMcuY,nY,nCb,nCr,nMcuY1,nMcuY2);
+	}
+
 	m_nPreviewShiftY  = nY;
 	m_nPreviewShiftCb = nCb;
 	m_nPreviewShiftCr = nCr;
 	m_nPreviewShiftMcuX = nMcuX;
 	m_nPreviewShiftMcuY = nMcuY;
 
-	CalcChannelPreview();
+	if (!bPartial) {
+		CalcChannelPreview();
+	} else if (bDirty) {
+		CalcChannelPreviewMcuRows(nMcuY1,nMcuY2);
+	}
+}
+
+// Determine the MCU rows of the preview that a new level shift changes
+// - A pixel is shifted if its MCU is at or after the start of the shift
+//   in raster order (see CalcChannelPreviewRowsYcc). Between the old and
+//   the new start only the shift that starts first applies, and after
+//   both starts the pixels change if the shift amounts differ.
+// - The level shift does not apply to 4-component images
+//
+// INPUT:
+// - nMcuX				= New start of the shift (MCU x)
+// - nMcuY				= New start of the shift (MCU y)
+// - nY,nCb,nCr			= New DC shift of each component
+// PRE:
+// - m_nPreviewShift*	= Current level shift
+// OUTPUT:
+// - nMcuY1				= First MCU row that changes
+// - nMcuY2				= MCU row after the last one that changes
+// RETURN:
+// - False if no pixels change
+//
+bool CimgDecode::CalcPreviewShiftDirty(unsigned nMcuX,unsigned nMcuY,int nY,int nCb,int nCr,
+									   unsigned &nMcuY1,unsigned &nMcuY2)
+{
+	if (m_nNumSosComps == NUM_CHAN_YCCK) {
+		return false;
+	}
+
+	bool		bOfsOld = (m_nPreviewShiftY != 0) || (m_nPreviewShiftCb != 0) || (m_nPreviewShiftCr != 0);
+	bool		bOfsNew = (nY != 0) || (nCb != 0) || (nCr != 0);
+	bool		bOfsSame = (m_nPreviewShiftY == nY) && (m_nPreviewShiftCb == nCb) && (m_nPreviewShiftCr == nCr);
+	bool		bStartSame = (m_nPreviewShiftMcuX == nMcuX) && (m_nPreviewShiftMcuY == nMcuY);
+	bool		bOldFirst = (m_nPreviewShiftMcuY < nMcuY) ||
+		((m_nPreviewShiftMcuY == nMcuY) && (m_nPreviewShiftMcuX <= nMcuX));
+
+	unsigned	nFirstY = (bOldFirst) ? m_nPreviewShiftMcuY : nMcuY;
+	unsigned	nLastX  = (bOldFirst) ? nMcuX : m_nPreviewShiftMcuX;
+	unsigned	nLastY  = (bOldFirst) ? nMcuY : m_nPreviewShiftMcuY;
+
+	// Between the two starts, and after both of them
+	bool		bHeadDirty = (!bStartSame) && ((bOldFirst) ? bOfsOld : bOfsNew);
+	bool		bTailDirty = (!bOfsSame);
+
+	if (bTailDirty) {
+		nMcuY1 = (bHeadDirty) ? nFirstY : nLastY;
+		nMcuY2 = m_nMcuYMax;
+	} else if (bHeadDirty) {
+		nMcuY1 = nFirstY;
+		nMcuY2 = (nLastX > 0) ? nLastY+1 : nLastY;
+	} else {
+		return false;
+	}
+	nMcuY1 = min(nMcuY1,m_nMcuYMax);
+	nMcuY2 = min(nMcuY2,m_nMcuYMax);
+	return (nMcuY1 < nMcuY2);
 }
 
 // Fetch the current level shift setting for the preview display
@@ -723,7 +1172,16 @@ void CimgDecode::GetPreviewSize(unsigned &nX,unsigned &nY)
 }
 
 // Set a DHT table entry and associated lookup table
-// - Configures the fast lookup table for short code bitstrings
+// - Adds the code to the two-level lookup table (see DHT_LOOKUP_*)
+// - Codes up to DHT_FAST_SIZE bits are resolved by the first level. Where
+//   the code and its extra bits both fit within DHT_FAST_SIZE bits, each
+//   first level entry also carries the decoded coefficient value so that
+//   ReadScanVal() can return zero-run, size and value from a single probe
+// - Longer codes (up to MAX_DHT_CODELEN bits) are resolved by a second
+//   level table shared by all codes with the same DHT_FAST_SIZE-bit prefix
+// - Entries are expected in increasing index order, starting at 0 for
+//   each table definition. If codes overlap (corrupt DHT), the earliest
+//   entry takes precedence.
 //
 // INPUT:
 // - nDestId			= DHT destination table ID (0..3)
@@ -734,12 +1192,10 @@ void CimgDecode::GetPreviewSize(unsigned &nX,unsigned &nY)
 // - nMask				= Huffman code bit mask (left justified)
 // - nCode				= Huffman code value
 // POST:
-// - m_anDhtLookup_bitlen[][][]
-// - m_anDhtLookup_bits[][][]
-// - m_anDhtLookup_mask[][][]
-// - m_anDhtLookup_code[][][]
-// - m_anDhtLookupSetMax[]
-// - m_anDhtLookupfast[][][]
+// - m_psTbl->anDhtLookupSetMax[]
+// - m_psTbl->anDhtLookupfast[][][]
+// - m_psTbl->anDhtLookupSub[][][][]
+// - m_psTbl->anDhtLookupSubNum[][]
 // RETURN:
 // - Success if indices are in range
 // NOTE:
@@ -748,7 +1204,8 @@ void CimgDecode::GetPreviewSize(unsigned &nX,unsigned &nY)
 bool CimgDecode::SetDhtEntry(unsigned nDestId, unsigned nClass, unsigned nInd, unsigned nLen,
 							 unsigned nBits, unsigned nMask, unsigned nCode)
 {
-	if ( (nDestId >= MAX_DHT_DEST_ID) || (nClass >= MAX_DHT_CLASS) || (nInd >= MAX_DHT_CODES) ) {
+	if ( (nDestId >= MAX_DHT_DEST_ID) || (nClass >= MAX_DHT_CLASS) || (nInd >= MAX_DHT_CODES) ||
+		(nLen == 0) || (nLen > MAX_DHT_CODELEN) ) {
 		CString strTmp = _T("ERROR: Attempt to set DHT entry out of range");
 		m_pLog->AddLineErr(strTmp);
 		if (m_pAppConfig->bInteractive)
@@ -763,57 +1220,93 @@ bool CimgDecode::SetDhtEntry(unsigned nDestId, unsigned nClass, unsigned nInd, u
 #endif
 		return false;
 	}
-	m_anDhtLookup_bitlen[nClass][nDestId][nInd] = nLen;
-	m_anDhtLookup_bits[nClass][nDestId][nInd] = nBits;
-	m_anDhtLookup_mask[nClass][nDestId][nInd] = nMask;
-	m_anDhtLookup_code[nClass][nDestId][nInd] = nCode;
 
+	// The first entry of a table starts a new definition
+	if (nInd == 0) {
+		ResetDhtLookupTbl(nClass,nDestId);
+	}
 
 	// Record the highest numbered DHT set.
 	// TODO: Currently assuming that there are no missing tables in the sequence
-	if (nDestId > m_anDhtLookupSetMax[nClass]) {
-		m_anDhtLookupSetMax[nClass] = nDestId;
+	if (nDestId > m_psTbl->anDhtLookupSetMax[nClass]) {
+		m_psTbl->anDhtLookupSetMax[nClass] = nDestId;
 	}
 
+	unsigned*	panLookup = m_psTbl->anDhtLookupfast[nClass][nDestId];
 	unsigned	nBitsMsb;
 	unsigned	nBitsExtraLen;
-	unsigned	nBitsExtraVal;
 	unsigned	nBitsMax;
-	unsigned	nFastVal;
+	unsigned	nEntry;
 
-	// If the variable-length code is short enough, add it to the
-	// fast lookup table.
-	if (nLen <= DHT_FAST_SIZE) {
-		// nBits is a left-justified number (assume right-most bits are zero)
-		// nLen is number of leading bits to compare
+	// nBits is a left-justified number (assume right-most bits are zero)
+	// nLen is number of leading bits to compare
+	nBits &= nMask;
 
+	if (nLen <= DHT_FAST_SIZE) {
+		// The code fills a range of first level entries
 		//   nLen     = 5
 		//   nBits    = 32'b1011_1xxx_xxxx_xxxx_xxxx_xxxx_xxxx_xxxx  (0xB800_0000)
-		//   nBitsMsb =  8'b1011_1xxx (0xB8)
-		//   nBitsMsb =  8'b1011_1000 (0xB8)
-		//   nBitsMax =  8'b1011_1111 (0xBF)
+		//   nBitsMsb =  9'b1011_1000_0 (0x170)
+		//   nBitsMax =  9'b1011_1111_1 (0x17F)
+		nBitsMsb = nBits >> (32-DHT_FAST_SIZE);
+		nBitsExtraLen = DHT_FAST_SIZE-nLen;
+		nBitsMax = nBitsMsb + (1<<nBitsExtraLen) - 1;
 
-		//   nBitsExtraLen = 8-len = 8-5 = 3
+		// Number of extra bits (coefficient value) that follow the code
+		unsigned nValLen = nCode & 0x0F;
 
-		//   nBitsExtraVal = (1<<nBitsExtraLen) -1 = 1<<3 -1 = 8'b0000_1000 -1 = 8'b0000_0111
-		//
-		//   nBitsMax = nBitsMsb + nBitsExtraVal
-		//   nBitsMax =  8'b1011_1111
-		nBitsMsb = (nBits & nMask) >> (32-DHT_FAST_SIZE);
-		nBitsExtraLen = DHT_FAST_SIZE-nLen;
-		nBitsExtraVal = (1<<nBitsExtraLen) - 1;
-		nBitsMax = nBitsMsb + nBitsExtraVal;
+		for (unsigned ind1=nBitsMsb;ind1<=nBitsMax;ind1++) {
+			if (panLookup[ind1] != DHT_CODE_UNUSED) {
+				continue;
+			}
+			nEntry = nCode + (nLen << DHT_LOOKUP_LEN_SHIFT);
+
+			// If the extra bits are also covered by the index, then
+			// precalculate the coefficient value
+			if (nValLen <= nBitsExtraLen) {
+				signed nVal = 0;
+				if (nValLen > 0) {
+					unsigned nValBits = (ind1 >> (nBitsExtraLen-nValLen)) & ((1<<nValLen)-1);
+					nVal = HuffmanDc2Signed(nValBits,nValLen);
+				}
+				nEntry |= DHT_LOOKUP_VAL | ((unsigned)nVal << DHT_LOOKUP_VAL_SHIFT);
+			}
+			panLookup[ind1] = nEntry;
+		}
+
+	} else {
+		// Locate (or allocate) the second level table for this prefix
+		unsigned nPrefix = nBits >> (32-DHT_FAST_SIZE);
+		unsigned nSubInd;
+		nEntry = panLookup[nPrefix];
+		if (nEntry == DHT_CODE_UNUSED) {
+			nSubInd = m_psTbl->anDhtLookupSubNum[nClass][nDestId];
+			if (nSubInd >= DHT_SUB_MAX) {
+				// Only possible with a corrupt table
+				CString strTmp = _T("ERROR: DHT lookup table overflow");
+				m_pLog->AddLineErr(strTmp);
+				return false;
+			}
+			m_psTbl->anDhtLookupSubNum[nClass][nDestId]++;
+			for (unsigned nElem=0;nElem<(1<<DHT_SUB_SIZE);nElem++) {
+				m_psTbl->anDhtLookupSub[nClass][nDestId][nSubInd][nElem] = DHT_SUB_UNUSED;
+			}
+			panLookup[nPrefix] = DHT_LOOKUP_SUB | (nSubInd << DHT_LOOKUP_VAL_SHIFT);
+		} else if (nEntry & DHT_LOOKUP_SUB) {
+			nSubInd = nEntry >> DHT_LOOKUP_VAL_SHIFT;
+		} else {
+			// Prefix is already claimed by a shorter code (corrupt table)
+			return true;
+		}
 
+		// The code fills a range of second level entries
+		unsigned short*	pnSub = m_psTbl->anDhtLookupSub[nClass][nDestId][nSubInd];
+		nBitsMsb = (nBits >> (32-MAX_DHT_CODELEN)) & DHT_SUB_MASK;
+		nBitsMax = nBitsMsb + (1<<(MAX_DHT_CODELEN-nLen)) - 1;
 		for (unsigned ind1=nBitsMsb;ind1<=nBitsMax;ind1++) {
-			// The arrangement of the dht_lookupfast[] values:
-			//                         0xFFFF_FFFF = No entry, resort to slow search
-			//    m_anDhtLookupfast[nClass][nDestId] [15: 8] = nLen
-			//    m_anDhtLookupfast[nClass][nDestId] [ 7: 0] = nCode
-			//
-			//ASSERT(code <= 0xFF);
-			//ASSERT(ind1 <= 0xFF);
-			nFastVal = nCode + (nLen << 8);
-			m_anDhtLookupfast[nClass][nDestId][ind1] = nFastVal;
+			if (pnSub[ind1] == DHT_SUB_UNUSED) {
+				pnSub[ind1] = (unsigned short)(nCode + (nLen << DHT_LOOKUP_LEN_SHIFT));
+			}
 		}
 	}
 	return true;
@@ -827,7 +1320,7 @@ bool CimgDecode::SetDhtEntry(unsigned nDestId, unsigned nClass, unsigned nInd, u
 // - nClass				= Select between DC and AC tables (0=DC, 1=AC) (From DHT:Tc, range 0..1)
 // - nSize				= Number of entries in the DHT table
 // POST:
-// - m_anDhtLookupSize[][]
+// - m_psTbl->anDhtLookupSize[][]
 // RETURN:
 // - Success if indices are in range
 //
@@ -840,7 +1333,7 @@ bool CimgDecode::SetDhtSize(unsigned nDestId,unsigned nClass,unsigned nSize)
 			AfxMessageBox(strTmp);
 		return false;
 	} else {
-		m_anDhtLookupSize[nClass][nDestId] = nSize;
+		m_psTbl->anDhtLookupSize[nClass][nDestId] = nSize;
 	}
 
 	return true;
@@ -869,7 +1362,7 @@ signed CimgDecode::HuffmanDc2Signed(unsigned nVal,unsigned nBits)
 // Generate the Huffman code lookup table mask
 //
 // POST:
-// - m_anHuffMaskLookup[]
+// - m_psTbl->anHuffMaskLookup[]
 //
 void CimgDecode::GenLookupHuffMask()
 {
@@ -878,7 +1371,7 @@ void CimgDecode::GenLookupHuffMask()
 	{
 		nMask = (1 << (nLen))-1;
 		nMask <<= 32-nLen;
-		m_anHuffMaskLookup[nLen] = nMask;
+		m_psTbl->anHuffMaskLookup[nLen] = nMask;
 	}
 }
 
@@ -889,7 +1382,7 @@ void CimgDecode::GenLookupHuffMask()
 // - nWord				= The 32-bit holding register
 // - nBits				= Number of bits (leftmost) to extract from the holding register
 // PRE:
-// - m_anHuffMaskLookup[]
+// - m_psTbl->anHuffMaskLookup[]
 // RETURN:
 // - The subset of bits extracted from the holding register
 // NOTE:
@@ -898,60 +1391,27 @@ void CimgDecode::GenLookupHuffMask()
 inline unsigned CimgDecode::ExtractBits(unsigned nWord,unsigned nBits)
 {
 	unsigned nVal;
-	nVal = (nWord & m_anHuffMaskLookup[nBits]) >> (32-nBits);
+	nVal = (nWord & m_psTbl->anHuffMaskLookup[nBits]) >> (32-nBits);
 	return nVal;
 }
 
 
 // Removes bits from the holding buffer
 // - Discard the leftmost "nNumBits" of m_nScanBuff
-// - And then realign file position pointers
+// - File positions are not realigned here. They are derived on
+//   demand from m_nScanBuffLoadInd and m_nScanBuffBits (see GetScanBufInd)
 //
 // INPUT:
-// - nNumBits				= Number of left-most bits to consume
+// - nNumBits				= Number of left-most bits to consume (<= m_nScanBuffBits)
 // POST:
 // - m_nScanBuff
-// - m_nScanBuff_vacant
-// - m_nScanBuffPtr_align
-// - m_anScanBuffPtr_pos[]
-// - m_anScanBuffPtr_err[]
-// - m_nScanBuffLatchErr
-// - m_nScanBuffPtr_num
+// - m_nScanBuffBits
 //
 inline void CimgDecode::ScanBuffConsume(unsigned nNumBits)
 {
+	ASSERT(nNumBits <= m_nScanBuffBits);
 	m_nScanBuff <<= nNumBits;
-	m_nScanBuff_vacant += nNumBits;
-
-	// Need to latch any errors during consumption of multi-bytes
-	// otherwise we'll miss the error notification if we skip over
-	// it before we exit this routine! e.g if num_bytes=2 and error
-	// appears on first byte, then we want to retain it in pos[0]
-
-
-	// Now realign the file position pointers if necessary
-	unsigned nNumBytes = (m_nScanBuffPtr_align+nNumBits) / 8;
-	for (unsigned nInd=0;nInd<nNumBytes;nInd++) {
-		m_anScanBuffPtr_pos[0] = m_anScanBuffPtr_pos[1];
-		m_anScanBuffPtr_pos[1] = m_anScanBuffPtr_pos[2];
-		m_anScanBuffPtr_pos[2] = m_anScanBuffPtr_pos[3];
-		// Don't clear the last ptr position because during an overread
-		// this will be the only place that the last position was preserved
-		//m_anScanBuffPtr_pos[3] = 0;
-
-		m_anScanBuffPtr_err[0] = m_anScanBuffPtr_err[1];
-		m_anScanBuffPtr_err[1] = m_anScanBuffPtr_err[2];
-		m_anScanBuffPtr_err[2] = m_anScanBuffPtr_err[3];
-		m_anScanBuffPtr_err[3] = SCANBUF_OK;
-
-		if (m_anScanBuffPtr_err[0] != SCANBUF_OK) {
-			m_nScanBuffLatchErr = m_anScanBuffPtr_err[0];
-		}
-
-		m_nScanBuffPtr_num--;
-	}
-	m_nScanBuffPtr_align = (m_nScanBuffPtr_align+nNumBits)%8;
-
+	m_nScanBuffBits -= nNumBits;
 }
 
 
@@ -960,47 +1420,76 @@ inline void CimgDecode::ScanBuffConsume(unsigned nNumBits)
 //
 // INPUT:
 // - nNewByte			= 8-bit byte to add to buffer
-// - nPtr				= UNUSED
+// - nPtr				= File position of the byte
 // PRE:
 // - m_nScanBuff
-// - m_nScanBuff_vacant
-// - m_nScanBuffPtr_num
+// - m_nScanBuffBits
+// - m_nScanBuffLoadInd
 // POST:
 // - m_nScanBuff
-// - m_nScanBuff_vacant
-// - m_anScanBuffPtr_err[]
-// - m_anScanBuffPtr_pos[]
+// - m_nScanBuffBits
+// - m_nScanBuffLoadInd
+// - m_anScanBuffPos[]
 //
 inline void CimgDecode::ScanBuffAdd(unsigned nNewByte,unsigned nPtr)
 {
 	// Add the new byte to the buffer
 	// Assume that m_nScanBuff has already been shifted to be
-	// aligned to bit 31 as first bit.
-	m_nScanBuff += (nNewByte << (m_nScanBuff_vacant-8));
-	m_nScanBuff_vacant -= 8;
-
-	ASSERT(m_nScanBuffPtr_num<4);
-	if (m_nScanBuffPtr_num>=4) { return; } // Unexpected by design
-	m_anScanBuffPtr_err[m_nScanBuffPtr_num]   = SCANBUF_OK;
-	m_anScanBuffPtr_pos[m_nScanBuffPtr_num++] = nPtr;
+	// aligned to bit 63 as first bit.
+	ASSERT(m_nScanBuffBits <= SCANBUF_BITS-8);
+	m_nScanBuff |= ((ULONGLONG)nNewByte) << (SCANBUF_BITS-8-m_nScanBuffBits);
+	m_nScanBuffBits += 8;
 
-	// m_nScanBuffPtr_align stays the same as we add 8 bits
+	m_anScanBuffPos[m_nScanBuffLoadInd & SCANBUF_POS_MASK] = nPtr;
+	m_nScanBuffLoadInd++;
 }
 
 // Augment the current scan buffer with another byte (but mark as error)
+// - The error is latched once decoding reaches this byte
 //
 // INPUT:
 // - nNewByte			= 8-bit byte to add to buffer
-// - nPtr				= UNUSED
+// - nPtr				= File position of the byte
 // - nErr				= Error code to associate with this buffer byte
 // POST:
-// - m_anScanBuffPtr_err[]
+// - m_anScanBuffErrInd[]
+// - m_nScanBuffErrNum
 //
 inline void CimgDecode::ScanBuffAddErr(unsigned nNewByte,unsigned nPtr,unsigned nErr)
 {
+	nErr;	// Unreferenced param (only SCANBUF_BADMARK is recorded)
 	ScanBuffAdd(nNewByte,nPtr);
-	m_anScanBuffPtr_err[m_nScanBuffPtr_num-1]   = nErr;
+	if (m_nScanBuffErrNum < SCANBUF_ERR_MAX) {
+		m_anScanBuffErrInd[m_nScanBuffErrNum++] = m_nScanBuffLoadInd-1;
+	}
+}
 
+// Latch any pending byte errors that the decode position has reached
+// - Replicates the latching that used to occur during consumption
+//   but is only evaluated when a caller samples the error state
+//
+// INPUT:
+// - nByteInd			= Reservoir byte index of the current decode position
+// POST:
+// - m_nScanBuffLatchErr
+// - m_anScanBuffErrInd[]
+// - m_nScanBuffErrNum
+//
+void CimgDecode::ScanBuffLatchErr(unsigned nByteInd)
+{
+	unsigned nNumLatched = 0;
+	while ((nNumLatched < m_nScanBuffErrNum) &&
+		((int)(nByteInd - m_anScanBuffErrInd[nNumLatched]) >= 0))
+	{
+		m_nScanBuffLatchErr = SCANBUF_BADMARK;
+		nNumLatched++;
+	}
+	if (nNumLatched > 0) {
+		for (unsigned nInd=nNumLatched;nInd<m_nScanBuffErrNum;nInd++) {
+			m_anScanBuffErrInd[nInd-nNumLatched] = m_anScanBuffErrInd[nInd];
+		}
+		m_nScanBuffErrNum -= nNumLatched;
+	}
 }
 
 // Disable any further reporting of scan errors
@@ -1031,7 +1520,7 @@ void CimgDecode::ScanErrorsEnable()
 
 
 // Read in bits from the buffer and find matching huffman codes
-// - Input buffer is m_nScanBuff
+// - Input buffer is the 64-bit reservoir m_nScanBuff
 // - Perform shift in buffer afterwards
 // - Abort if there aren't enough bits (note that the scan buffer
 //   is almost empty when we reach the end of a scan segment)
@@ -1042,16 +1531,11 @@ void CimgDecode::ScanErrorsEnable()
 // PRE:
 // - Assume that dht_lookup_size[nTbl] != 0 (already checked)
 // - m_bRestartRead
-// - m_nScanBuff_vacant
+// - m_nScanBuffBits
 // - m_nScanErrMax
 // - m_nScanBuff
-// - m_anDhtLookupFast[][][]
-// - m_anDhtLookupSize[][]
-// - m_anDhtLookup_mask[][][]
-// - m_anDhtLookup_bits[][][]
-// - m_anDhtLookup_bitlen[][][]
-// - m_anDhtLookup_code[][][]
-// - m_nPrecision
+// - m_psTbl->anDhtLookupfast[][][]
+// - m_psTbl->anDhtLookupSub[][][][]
 // POST:
 // - m_nScanBitsUsed# is calculated
 // - m_bScanEnd
@@ -1069,10 +1553,14 @@ void CimgDecode::ScanErrorsEnable()
 //   but performance was same before & after (27sec).
 // - Calls unrolled: BuffTopup(), ScanBuffConsume(),
 //                   ExtractBits(), HuffmanDc2Signed()
+// - Codes of all lengths are resolved with at most two table probes
+//   (see SetDhtEntry). Short codes whose extra bits also fit within
+//   DHT_FAST_SIZE bits return the coefficient from the same probe.
+// - The reservoir is only refilled when it drops below 32 bits,
+//   which guarantees room for the longest code (16) plus the
+//   longest extra bitstring (16) without a second top-up.
 teRsvRet CimgDecode::ReadScanVal(unsigned nClass,unsigned nTbl,unsigned &rZrl,signed &rVal)
 {
-	bool		bDone = false;
-	unsigned	nInd = 0;
 	unsigned	nCode = DHT_CODE_UNUSED; // Not a valid nCode
 	unsigned	nVal;
 
@@ -1088,13 +1576,13 @@ teRsvRet CimgDecode::ReadScanVal(unsigned nClass,unsigned nTbl,unsigned &rZrl,si
 	// First check to see if we've entered here with a completely empty
 	// scan buffer with a restart marker already observed. In that case
 	// we want to exit with condition 3 (restart terminated)
-	if ( (m_nScanBuff_vacant == 32) && (m_bRestartRead) ) {
+	if ( (m_nScanBuffBits == 0) && (m_bRestartRead) ) {
 		return RSV_RST_TERM;
 	}
 
 
 	// Has the scan buffer been depleted?
-	if (m_nScanBuff_vacant >= 32) {
+	if (m_nScanBuffBits == 0) {
 		// Trying to overread end of scan segment
 
 		if (m_nWarnBadScanNum < m_nScanErrMax) {
@@ -1115,52 +1603,48 @@ teRsvRet CimgDecode::ReadScanVal(unsigned nClass,unsigned nTbl,unsigned &rZrl,si
 	}
 
 	// Top up the buffer just in case
-	BuffTopup();
+	if (m_nScanBuffBits < 32) {
+		BuffTopup();
+	}
 
-	bDone = false;
 	bool bFound = false;
 
-	// Fast search for variable-length huffman nCode
-	// Do direct lookup for any codes DHT_FAST_SIZE bits or shorter
-
-	unsigned nCodeMsb;
-	unsigned nCodeFastSearch;
-
-	// Only enable this fast search if m_nScanBuff_vacant implies
-	// that we have at least DHT_FAST_SIZE bits available in the buffer!
-	if ((32-m_nScanBuff_vacant) >= DHT_FAST_SIZE) {
-		nCodeMsb = m_nScanBuff>>(32-DHT_FAST_SIZE);
-		nCodeFastSearch = m_anDhtLookupfast[nClass][nTbl][nCodeMsb];
-		if (nCodeFastSearch != DHT_CODE_UNUSED) {
-			// We found the code!
-			m_nScanBitsUsed1 += (nCodeFastSearch>>8);
-			nCode = (nCodeFastSearch & 0xFF);
-			bDone = true;
+	// Look up the variable-length huffman nCode
+	// - Codes up to DHT_FAST_SIZE bits are resolved by the first level
+	//   lookup, longer codes by the second level lookup
+	// - Any bits beyond m_nScanBuffBits are zero, so the lookup is safe
+	//   even if the buffer is short (restart marker or end of scan), but
+	//   the code length must then be checked against the bits available
+	unsigned nEntry;
+	unsigned nBitLen;
+	nEntry = m_psTbl->anDhtLookupfast[nClass][nTbl][(unsigned)(m_nScanBuff>>(SCANBUF_BITS-DHT_FAST_SIZE))];
+	if ((nEntry != DHT_CODE_UNUSED) && (nEntry & DHT_LOOKUP_SUB)) {
+		unsigned nSubInd = nEntry >> DHT_LOOKUP_VAL_SHIFT;
+		unsigned nSubVal = m_psTbl->anDhtLookupSub[nClass][nTbl][nSubInd][(unsigned)(m_nScanBuff>>(SCANBUF_BITS-MAX_DHT_CODELEN)) & DHT_SUB_MASK];
+		nEntry = (nSubVal == DHT_SUB_UNUSED) ? DHT_CODE_UNUSED : nSubVal;
+	}
+	if (nEntry != DHT_CODE_UNUSED) {
+		nBitLen = (nEntry >> DHT_LOOKUP_LEN_SHIFT) & DHT_LOOKUP_LEN_MASK;
+		if (nBitLen <= m_nScanBuffBits) {
+			nCode = nEntry & 0xFF;
+			m_nScanBitsUsed1 = nBitLen;
 			bFound = true;
-		}
-	}
 
-
-	// Slow search for variable-length huffman nCode
-	while (!bDone) {
-		unsigned nBitLen;
-		if ((m_nScanBuff & m_anDhtLookup_mask[nClass][nTbl][nInd]) == m_anDhtLookup_bits[nClass][nTbl][nInd]) {
-
-			nBitLen = m_anDhtLookup_bitlen[nClass][nTbl][nInd];
-			// Just in case this VLC bit string is longer than the number of
-			// bits we have left in the buffer (due to restart marker or end
-			// of scan data), we need to double-check
-			if (nBitLen <= 32-m_nScanBuff_vacant) {
-				nCode = m_anDhtLookup_code[nClass][nTbl][nInd];
-				m_nScanBitsUsed1 += nBitLen;
-				bDone = true;
-				bFound = true;
+			// Combined entry: the code and extra bits have been decoded
+			// together, so return zero-run, size and value directly
+			if ((nEntry & DHT_LOOKUP_VAL) && (nBitLen + (nCode & 0x0F) <= m_nScanBuffBits)) {
+				m_nScanBitsUsed2 = nCode & 0x0F;
+				rZrl = (nCode & 0xF0) >> 4;
+				m_anDhtHisto[nClass][nTbl][m_nScanBitsUsed1]++;
+				ScanBuffConsume(m_nScanBitsUsed1+m_nScanBitsUsed2);
+				if ( (rZrl == 0) && (m_nScanBitsUsed2 == 0) ) {
+					// EOB
+					return RSV_EOB;
+				}
+				rVal = ((signed)nEntry) >> DHT_LOOKUP_VAL_SHIFT;
+				return RSV_OK;
 			}
 		}
-		nInd++;
-		if (nInd >= m_anDhtLookupSize[nClass][nTbl]) {
-			bDone = true;
-		}
 	}
 
 	// Could not find huffman nCode in table!
@@ -1195,11 +1679,11 @@ teRsvRet CimgDecode::ReadScanVal(unsigned nClass,unsigned nTbl,unsigned &rZrl,si
 	}
 
 
-	ScanBuffConsume(m_nScanBitsUsed1);
-
 	// Did we overread the scan buffer?
-	if (m_nScanBuff_vacant > 32) {
+	if (m_nScanBitsUsed1 > m_nScanBuffBits) {
 		// The nCode consumed more bits than we had!
+		m_nScanBuffOverBits = m_nScanBitsUsed1 - m_nScanBuffBits;
+		ScanBuffConsume(m_nScanBuffBits);
 		CString strTmp;
 		strTmp.Format(_T("*** ERROR: Overread scan segment (after nCode)! @ Offset: %s"),(LPCTSTR)GetScanBufPos());
 		m_pLog->AddLineErr(strTmp);
@@ -1208,9 +1692,11 @@ teRsvRet CimgDecode::ReadScanVal(unsigned nClass,unsigned nTbl,unsigned &rZrl,si
 		return RSV_UNDERFLOW;
 	}
 
-	// Replenish buffer after nCode extraction and before variable extra bits
-	// This is required because we may have a 12 bit nCode followed by a 16 bit var length bitstring
-	BuffTopup();
+	ScanBuffConsume(m_nScanBitsUsed1);
+
+	// NOTE: No need to replenish the buffer before the variable extra bits
+	// as the top-up above left at least 32 bits (unless we are at a
+	// restart marker or end of scan, which is caught by the overread check)
 
 	// Did we find the nCode?
 	if (nCode != DHT_CODE_UNUSED) {
@@ -1226,24 +1712,17 @@ teRsvRet CimgDecode::ReadScanVal(unsigned nClass,unsigned nTbl,unsigned &rZrl,si
 
 		} else {
 			// Normal nCode
-			nVal = ExtractBits(m_nScanBuff,m_nScanBitsUsed2);
+			nVal = (unsigned)(m_nScanBuff>>(SCANBUF_BITS-m_nScanBitsUsed2));
 			rVal = HuffmanDc2Signed(nVal,m_nScanBitsUsed2);
 
-			// Now handle the different precision values
-			// Treat 12-bit like 8-bit but scale values first (ie. drop precision down to 8-bit)
-			signed nPrecisionDivider = 1;
-			if (m_nPrecision >= 8) {
-				nPrecisionDivider = 1<<(m_nPrecision-8);
-				rVal /= nPrecisionDivider;
-			} else {
-				// Precision value seems out of range!
-			}
-
-			ScanBuffConsume(m_nScanBitsUsed2);
+			// NOTE: 12-bit coefficients are kept at full precision. The
+			// pixel maps hold the extra bits (see m_nPixMapPrecShift)
 
 			// Did we overread the scan buffer?
-			if (m_nScanBuff_vacant > 32) {
+			if (m_nScanBitsUsed2 > m_nScanBuffBits) {
 				// The nCode consumed more bits than we had!
+				m_nScanBuffOverBits = m_nScanBitsUsed2 - m_nScanBuffBits;
+				ScanBuffConsume(m_nScanBuffBits);
 				CString strTmp;
 				strTmp.Format(_T("*** ERROR: Overread scan segment (after bitstring)! @ Offset: %s"),(LPCTSTR)GetScanBufPos());
 				m_pLog->AddLineErr(strTmp);
@@ -1252,6 +1731,8 @@ teRsvRet CimgDecode::ReadScanVal(unsigned nClass,unsigned nTbl,unsigned &rZrl,si
 				return RSV_UNDERFLOW;
 			}
 
+			ScanBuffConsume(m_nScanBitsUsed2);
+
 			return RSV_OK;
 		}
 	} else {
@@ -1266,7 +1747,7 @@ teRsvRet CimgDecode::ReadScanVal(unsigned nClass,unsigned nTbl,unsigned &rZrl,si
 
 		if (m_nWarnBadScanNum < m_nScanErrMax) {
 			CString strTmp;
-			strTmp.Format(_T("*** ERROR: Can't find huffman bitstring @ %s, table %u, value [0x%08x]"),(LPCTSTR)GetScanBufPos(),nTbl,m_nScanBuff);
+			strTmp.Format(_T("*** ERROR: Can't find huffman bitstring @ %s, table %u, value [0x%08x]"),(LPCTSTR)GetScanBufPos(),nTbl,(unsigned)(m_nScanBuff>>32));
 			m_pLog->AddLineErr(strTmp);
 
 			m_nWarnBadScanNum++;
@@ -1287,37 +1768,130 @@ teRsvRet CimgDecode::ReadScanVal(unsigned nClass,unsigned nTbl,unsigned &rZrl,si
 
 
 
-// Refill the scan buffer as needed
+// Skip over the AC coefficients of a block without decoding them
+// - Used when only the DC coefficients are required (m_bDecodeScanAc=false)
+// - Each code is consumed using only its length and the number of extra
+//   bits, so no coefficient values are reconstructed or stored
+// - Anything out of the ordinary (invalid code, end of buffer, restart
+//   marker, marker errors pending in the buffer or coefficient overrun)
+//   is left for the caller's full ReadScanVal() path, which reports it
+//   exactly as before. The caller may then resume skipping.
 //
-void CimgDecode::BuffTopup()
+// INPUT:
+// - nTbl					= DHT Destination ID for AC table (0..3)
+// - rNumCoeffs				= Number of coefficients decoded so far in block
+// PRE:
+// - m_psTbl->anDhtLookupfast[][][]
+// - m_psTbl->anDhtLookupSub[][][][]
+// POST:
+// - m_anDhtHisto[][][]
+// OUTPUT:
+// - rNumCoeffs				= Number of coefficients decoded so far in block
+// RETURN:
+// - True if the block has been completed (EOB or 64 coefficients)
+//
+bool CimgDecode::ReadScanSkipAc(unsigned nTbl,unsigned &rNumCoeffs)
 {
-	unsigned nRetVal;
-
-	// Do we have space to load another byte?
-	bool bDone = (m_nScanBuff_vacant < 8);
-
-	// Have we already reached the end of the scan segment?
-	if (m_bScanEnd) {
-		bDone = true;
-	}
-
-	while (!bDone) {
-		nRetVal = BuffAddByte();
+	unsigned*	panLookup = m_psTbl->anDhtLookupfast[DHT_CLASS_AC][nTbl];
+	unsigned*	panHisto = m_anDhtHisto[DHT_CLASS_AC][nTbl];
+	unsigned	nEntry;
+	unsigned	nBitLen;
+	unsigned	nCode;
+	unsigned	nZrl;
 
-		// NOTE: If we have read in a restart marker, the above call will not
-		// read in any more bits into the scan buffer, so we should just simply
-		// say that we've done the best we can for the top up.
-		if (m_bRestartRead) {
-			bDone = true;
+	while (true) {
+		if (m_nScanBuffBits < 32) {
+			BuffTopup();
 		}
-
-		if (m_nScanBuff_vacant < 8) {
-			bDone = true;
+		// Marker errors must be latched at the exact code position
+		if (m_nScanBuffErrNum > 0) {
+			return false;
 		}
-		// If the buffer read returned an error or end of scan segment
-		// then stop filling buffer
-		if (nRetVal != 0) {
-			bDone = true;
+
+		nEntry = panLookup[(unsigned)(m_nScanBuff>>(SCANBUF_BITS-DHT_FAST_SIZE))];
+		if (nEntry == DHT_CODE_UNUSED) {
+			return false;
+		}
+		if (nEntry & DHT_LOOKUP_SUB) {
+			nEntry = m_psTbl->anDhtLookupSub[DHT_CLASS_AC][nTbl][nEntry >> DHT_LOOKUP_VAL_SHIFT]
+				[(unsigned)(m_nScanBuff>>(SCANBUF_BITS-MAX_DHT_CODELEN)) & DHT_SUB_MASK];
+			if (nEntry == DHT_SUB_UNUSED) {
+				return false;
+			}
+		}
+		nBitLen = (nEntry >> DHT_LOOKUP_LEN_SHIFT) & DHT_LOOKUP_LEN_MASK;
+		nCode = nEntry & 0xFF;
+		if (nBitLen + (nCode & 0x0F) > m_nScanBuffBits) {
+			return false;
+		}
+
+		nZrl = nCode >> 4;
+		if (nCode == 0x00) {
+			// EOB
+			panHisto[nBitLen]++;
+			ScanBuffConsume(nBitLen);
+			return true;
+		}
+		if (rNumCoeffs + 1 + nZrl > 64) {
+			return false;
+		}
+		panHisto[nBitLen]++;
+		ScanBuffConsume(nBitLen + (nCode & 0x0F));
+		rNumCoeffs += 1 + nZrl;
+		if (rNumCoeffs == 64) {
+			return true;
+		}
+	}
+}
+
+
+// Refill the scan buffer as needed
+// - Fills the reservoir with as many whole bytes as will fit
+// - Plain data bytes are fetched and added in bulk. Once a 0xFF is
+//   encountered (stuff byte, restart marker or other marker), that
+//   byte is handed to BuffAddByte() which handles it individually.
+//
+// PRE:
+// - m_nScanBuffPtr
+// - m_nScanBuffBits
+// POST:
+// - m_nScanBuff
+// - m_nScanBuffBits
+// - m_nScanBuffPtr
+//
+void CimgDecode::BuffTopup()
+{
+	unsigned	nRetVal;
+	unsigned	nNumBytes;
+	unsigned	nInd;
+	BYTE		anBytes[SCANBUF_BITS/8];
+
+	// NOTE: If we have read in a restart marker, BuffAddByte() will not
+	// read in any more bits into the scan buffer, so we should just simply
+	// say that we've done the best we can for the top up.
+	// Also stop if we have already reached the end of the scan segment.
+	while ((m_nScanBuffBits <= SCANBUF_BITS-8) && (!m_bRestartRead) && (!m_bScanEnd)) {
+
+		// Fetch all bytes that fit and add them until the first 0xFF
+		nNumBytes = (SCANBUF_BITS-m_nScanBuffBits)/8;
+		m_pWBuf->BufCopy(m_nScanBuffPtr,nNumBytes,anBytes);
+		for (nInd=0;nInd<nNumBytes;nInd++) {
+			if (anBytes[nInd] == 0xFF) {
+				break;
+			}
+			ScanBuffAdd(anBytes[nInd],m_nScanBuffPtr);
+			m_nScanBuffPtr++;
+		}
+
+		if (nInd < nNumBytes) {
+			// Byte stuff or marker
+			nRetVal = BuffAddByte();
+
+			// If the buffer read returned an error or end of scan segment
+			// then stop filling buffer
+			if (nRetVal != 0) {
+				break;
+			}
 		}
 	}
 }
@@ -1530,8 +2104,10 @@ unsigned CimgDecode::BuffAddByte()
 		// always happen at the end of the scan segment. Therefore, we will
 		// assume this marker is valid (ie. not bit error in scan stream)
 		// and mark the end of the scan segment.
+		// A progressive scan is normally followed by the markers of the
+		// next scan, so only the marker after the last scan is reported.
 
-		if (m_nWarnBadScanNum < m_nScanErrMax) {
+		if ((m_nWarnBadScanNum < m_nScanErrMax) && ((!IsScanProgPending()) || (nMarker == JFIF_EOI))) {
 			CString strTmp;
 			strTmp.Format(_T("  Scan Data encountered marker   0xFF%02X @ 0x%08X.0"),
 				nMarker,m_nScanBuffPtr);
@@ -1614,22 +2190,43 @@ bool CimgDecode::DecodeScanComp(unsigned nTblDhtDc,unsigned nTblDhtAc,unsigned n
 
 	unsigned nNumCoeffs = 0;
 	//unsigned nDctMax = 0;			// Maximum DCT coefficient to use for IDCT
-	unsigned nSavedBufPos = 0;
+	unsigned nSavedBufInd = 0;
 	unsigned nSavedBufErr = SCANBUF_OK;
 	unsigned nSavedBufAlign = 0;
 
+	// No IDCT is due on the block yet (pipelined decode)
+	m_nPipeIdctTbl = -1;
+
 	// Profiling: No difference noted
-	DecodeIdctClear();
+	// When skipping AC coefficients, the IDCT blocks only need clearing
+	// if the previous block set any AC coefficients
+	if ((m_bDecodeScanAc) || (m_nDctCoefMax != 0)) {
+		DecodeIdctClear();
+	} else {
+		m_anDctBlock[DCT_COEFF_DC] = 0;
+	}
 
 	while (!bDone) {
-		BuffTopup();
+		// Fast path for DC-only decode: skip over the AC coefficients.
+		// If it stops early, the next coefficient is handled below.
+		if ((!bDC) && (!m_bDecodeScanAc)) {
+			if (ReadScanSkipAc(nTblDhtAc,nNumCoeffs)) {
+				bDone = true;
+				break;
+			}
+		}
+
+		// NOTE: ReadScanVal() tops up the buffer itself
 
 		// Note that once we perform ReadScanVal(), then GetScanBufPos() will be
 		// after the decoded VLC
-		// Save old file position info in case we want accurate error positioning
-		nSavedBufPos   = m_anScanBuffPtr_pos[0];
+		// Save old reservoir position in case we want accurate error positioning.
+		// The file position is only resolved from it if we need to report.
+		GetScanBufInd(nSavedBufInd,nSavedBufAlign);
+		if (m_nScanBuffErrNum > 0) {
+			ScanBuffLatchErr(nSavedBufInd);
+		}
 		nSavedBufErr   = m_nScanBuffLatchErr;
-		nSavedBufAlign = m_nScanBuffPtr_align;
 
 		// ReadScanVal return values:
 		// - RSV_OK			OK
@@ -1688,7 +2285,7 @@ bool CimgDecode::DecodeScanComp(unsigned nTblDhtDc,unsigned nTblDhtAc,unsigned n
 			m_bScanBad = true;
 
 			if (m_nWarnBadScanNum < m_nScanErrMax) {
-				CString strPos = GetScanBufPos(nSavedBufPos,nSavedBufAlign);
+				CString strPos = GetScanBufPosAt(nSavedBufInd,nSavedBufAlign);
 				CString strTmp;
 				strTmp.Format(_T("*** ERROR: Bad marker @ %s"),(LPCTSTR)strPos);
 				m_pLog->AddLineErr(strTmp);
@@ -1738,7 +2335,7 @@ bool CimgDecode::DecodeScanComp(unsigned nTblDhtDc,unsigned nTblDhtAc,unsigned n
 			// ERROR
 
 			if (m_nWarnBadScanNum < m_nScanErrMax) {
-				CString strPos = GetScanBufPos(nSavedBufPos,nSavedBufAlign);
+				CString strPos = GetScanBufPosAt(nSavedBufInd,nSavedBufAlign);
 				CString strTmp;
 				strTmp.Format(_T("*** ERROR: Bad huffman code @ %s"),(LPCTSTR)strPos);
 				m_pLog->AddLineErr(strTmp);
@@ -1778,7 +2375,7 @@ bool CimgDecode::DecodeScanComp(unsigned nTblDhtDc,unsigned nTblDhtAc,unsigned n
 
 			if (m_nWarnBadScanNum < m_nScanErrMax) {
 				CString strTmp;
-				CString strPos = GetScanBufPos(nSavedBufPos,nSavedBufAlign);
+				CString strPos = GetScanBufPosAt(nSavedBufInd,nSavedBufAlign);
 				strTmp.Format(_T("*** ERROR: @ %s, nNumCoeffs>64 [%u]"),(LPCTSTR)strPos,nNumCoeffs);
 				m_pLog->AddLineErr(strTmp);
 
@@ -1814,20 +2411,16 @@ bool CimgDecode::DecodeScanComp(unsigned nTblDhtDc,unsigned nTblDhtAc,unsigned n
 	//   0:10   m_bDecodeScanAc=true, but DecodeIdctCalc() skipped
 	//   0:26	m_bDecodeScanAc=true and DecodeIdctCalcFixedpt()
 	//   0:27	m_bDecodeScanAc=true and DecodeIdctCalcFloat()
+	//   (above timings were with the 64x64 matrix IDCT, which has
+	//    since been replaced by the separable AAN IDCT)
 
 	if (m_bDecodeScanAc) {
-#ifdef IDCT_FIXEDPT
-		DecodeIdctCalcFixedpt();
-#else
-
-		// TODO: Select appropriate conversion routine based on performance
-//		DecodeIdctCalcFloat(nDctMax);
-//		DecodeIdctCalcFloat(nNumCoeffs);
-//		DecodeIdctCalcFloat(m_nDctCoefMax);
-		DecodeIdctCalcFloat(64);
-//		DecodeIdctCalcFloat(32);
-
-#endif
+		if (m_psPipeBatch) {
+			// Leave the IDCT to the IDCT stage (see PipeAddBlock)
+			m_nPipeIdctTbl = nTblDqt;
+		} else {
+			DecodeIdctCalc(nTblDqt);
+		}
 	}
 
 
@@ -1890,7 +2483,7 @@ bool CimgDecode::DecodeScanCompPrint(unsigned nTblDhtDc,unsigned nTblDhtAc,unsig
 	}
 
 	unsigned nNumCoeffs = 0;
-	unsigned nSavedBufPos = 0;
+	unsigned nSavedBufInd = 0;
 	unsigned nSavedBufErr = SCANBUF_OK;
 	unsigned nSavedBufAlign = 0;
 
@@ -1902,10 +2495,12 @@ bool CimgDecode::DecodeScanCompPrint(unsigned nTblDhtDc,unsigned nTblDhtAc,unsig
 		// Note that once we perform ReadScanVal(), then GetScanBufPos() will be
 		// after the decoded VLC
 
-		// Save old file position info in case we want accurate error positioning
-		nSavedBufPos   = m_anScanBuffPtr_pos[0];
+		// Save old reservoir position in case we want accurate error positioning
+		GetScanBufInd(nSavedBufInd,nSavedBufAlign);
+		if (m_nScanBuffErrNum > 0) {
+			ScanBuffLatchErr(nSavedBufInd);
+		}
 		nSavedBufErr   = m_nScanBuffLatchErr;
-		nSavedBufAlign = m_nScanBuffPtr_align;
 
 		// Return values:
 		//	0 - OK
@@ -1962,7 +2557,7 @@ bool CimgDecode::DecodeScanCompPrint(unsigned nTblDhtDc,unsigned nTblDhtAc,unsig
 			m_bScanBad = true;
 
 			if (m_nWarnBadScanNum < m_nScanErrMax) {
-				strPos = GetScanBufPos(nSavedBufPos,nSavedBufAlign);
+				strPos = GetScanBufPosAt(nSavedBufInd,nSavedBufAlign);
 				strTmp.Format(_T("*** ERROR: Bad marker @ %s"),(LPCTSTR)strPos);
 				m_pLog->AddLineErr(strTmp);
 
@@ -2011,7 +2606,7 @@ bool CimgDecode::DecodeScanCompPrint(unsigned nTblDhtDc,unsigned nTblDhtAc,unsig
 
 			if (m_nWarnBadScanNum < m_nScanErrMax) {
 				strSpecial = _T("ERROR");
-				strPos = GetScanBufPos(nSavedBufPos,nSavedBufAlign);
+				strPos = GetScanBufPosAt(nSavedBufInd,nSavedBufAlign);
 
 				strTmp.Format(_T("*** ERROR: Bad huffman code @ %s"),(LPCTSTR)strPos);
 				m_pLog->AddLineErr(strTmp);
@@ -2028,7 +2623,7 @@ bool CimgDecode::DecodeScanCompPrint(unsigned nTblDhtDc,unsigned nTblDhtAc,unsig
 
 			// Print out before we leave
 			if (bPrint) {
-				ReportVlc(nSavedBufPos,nSavedBufAlign,nZrl,nVal2,
+				ReportVlc(GetScanBufFilePos(nSavedBufInd),nSavedBufAlign,nZrl,nVal2,
 					nCoeffStart,nCoeffEnd,strSpecial);
 			}
 
@@ -2049,7 +2644,7 @@ bool CimgDecode::DecodeScanCompPrint(unsigned nTblDhtDc,unsigned nTblDhtAc,unsig
 			// ERROR
 
 			if (m_nWarnBadScanNum < m_nScanErrMax) {
-				strPos = GetScanBufPos(nSavedBufPos,nSavedBufAlign);
+				strPos = GetScanBufPosAt(nSavedBufInd,nSavedBufAlign);
 				strTmp.Format(_T("*** ERROR: @ %s, nNumCoeffs>64 [%u]"),(LPCTSTR)strPos,nNumCoeffs);
 				m_pLog->AddLineErr(strTmp);
 
@@ -2068,7 +2663,7 @@ bool CimgDecode::DecodeScanCompPrint(unsigned nTblDhtDc,unsigned nTblDhtAc,unsig
 		}
 
 		if (bPrint) {
-			ReportVlc(nSavedBufPos,nSavedBufAlign,nZrl,nVal2,
+			ReportVlc(GetScanBufFilePos(nSavedBufInd),nSavedBufAlign,nZrl,nVal2,
 				nCoeffStart,nCoeffEnd,strSpecial);
 		}
 
@@ -2078,16 +2673,11 @@ bool CimgDecode::DecodeScanCompPrint(unsigned nTblDhtDc,unsigned nTblDhtAc,unsig
 
 
 	// Now calc the IDCT matrix
-#ifdef IDCT_FIXEDPT
-	DecodeIdctCalcFixedpt();
-#else
-//	DecodeIdctCalcFloat(nNumCoeffs);
-	DecodeIdctCalcFloat(64);
-#endif
+	DecodeIdctCalc(nTblDqt);
 
 	// Now report the coefficient matrix (after zigzag reordering)
 	if (bPrint) {
-		ReportDctMatrix();
+		ReportDctMatrix(nTblDqt);
 	}
 
 	return true;
@@ -2097,11 +2687,15 @@ bool CimgDecode::DecodeScanCompPrint(unsigned nTblDhtDc,unsigned nTblDhtAc,unsig
 
 
 // Print out the DCT matrix for a given block
+// - The AC coefficients are dequantized for the report
 //
+// INPUT:
+// - nDqtTbl				= DQT table used by the block
 // PRE:
 // - m_anDctBlock[]
+// - m_psTbl->anDqtCoeff[][]
 //
-void CimgDecode::ReportDctMatrix()
+void CimgDecode::ReportDctMatrix(unsigned nDqtTbl)
 {
 	CString	strTmp;
 	CString	strLine;
@@ -2116,6 +2710,9 @@ void CimgDecode::ReportDctMatrix()
 		for (unsigned nX=0;nX<8;nX++) {
 			strTmp = _T("");
 			nCoefVal = m_anDctBlock[nY*8+nX];
+			if (nY*8+nX != DCT_COEFF_DC) {
+				nCoefVal = static_cast<short int>(nCoefVal * m_psTbl->anDqtCoeff[nDqtTbl][nY*8+nX]);
+			}
 			strTmp.Format(_T("%5d"),nCoefVal);
 			strLine.Append(strTmp);
 
@@ -2250,8 +2847,11 @@ void CimgDecode::DecodeIdctClear()
 }
 
 // Set the DCT matrix entry
-// - Fills in m_anDctBlock[] with the unquantized coefficients
-// - Reversing the quantization is done using m_anDqtCoeffZz[][]
+// - Fills in m_anDctBlock[] with the coefficients
+// - The DC coefficient is dequantized here (using m_psTbl->anDqtCoeffZz[][])
+//   as it is accumulated by the caller. The AC coefficients are left
+//   quantized as the dequantization is folded into the IDCT
+//   (see PrecalcIdctDqt)
 //
 // INPUT:
 // - nDqtTbl				=
@@ -2260,7 +2860,7 @@ void CimgDecode::DecodeIdctClear()
 // - val					=
 // PRE:
 // - glb_anZigZag[]
-// - m_anDqtCoeffZz[][]
+// - m_psTbl->anDqtCoeffZz[][]
 // - m_nDctCoefMax
 // POST:
 // - m_anDctBlock[]
@@ -2275,7 +2875,10 @@ void CimgDecode::DecodeIdctSet(unsigned nDqtTbl,unsigned num_coeffs,unsigned zrl
 		// After this call, we will likely trap the error.
 	} else {
 		unsigned nDctInd = glb_anZigZag[ind];
-		short int nValUnquant = val * m_anDqtCoeffZz[nDqtTbl][ind];
+		short int nValUnquant = val;
+		if (ind == DCT_COEFF_DC) {
+			nValUnquant = val * m_psTbl->anDqtCoeffZz[nDqtTbl][ind];
+		}
 
 		/*
 		// NOTE:
@@ -2290,68 +2893,113 @@ void CimgDecode::DecodeIdctSet(unsigned nDqtTbl,unsigned num_coeffs,unsigned zrl
 
 		m_anDctBlock[nDctInd] = nValUnquant;
 
-		// Update max DCT coef # (after unzigzag) so that we can save
-		// some work when performing IDCT.
-		// FIXME: The following doesn't seem to work when we later
-		// restrict DecodeIdctCalc() to only m_nDctCoefMax coefs!
+		// Update the last non-zero coefficient (zigzag index) so that
+		// the IDCT can skip the parts of the block that are zero.
+		// The ZRL code sets a zero coefficient, which doesn't count.
 
-//		if ( (nDctInd > m_nDctCoefMax) && (abs(nValUnquant) >= IDCT_COEF_THRESH) ) {
-		if (nDctInd > m_nDctCoefMax) {
-			m_nDctCoefMax = nDctInd;
+//		if ( (ind > m_nDctCoefMax) && (abs(nValUnquant) >= IDCT_COEF_THRESH) ) {
+		if ((ind > m_nDctCoefMax) && (nValUnquant != 0)) {
+			m_nDctCoefMax = ind;
 		}
 	}
 }
 
 // Precalculate the IDCT lookup tables
+// - m_psTbl->afIdctLookup[] is only used by the reference IDCT (DecodeIdctCalcRef,
+//   filled by ImgDecodeIdctRefInit)
+// - m_psTbl->afIdctScaleCos[] is used by the scaled decode (DecodeIdctCalcScaled)
 //
 // POST:
-// - m_afIdctLookup[]
-// - m_anIdctLookup[]
+// - m_psTbl->afIdctLookup[]
+// - m_psTbl->afIdctScaleCos[]
 // NOTE:
 // - This is 4k entries @ 4B each = 16KB
 //
 void CimgDecode::PrecalcIdct()
 {
-	unsigned	nX,nY,nU,nV;
-	unsigned	nYX,nVU;
-	float		fCu,fCv;
-	float		fCosProd;
-	float		fInsideProd;
+	unsigned	nX,nU;
+	float		fCu;
 
 	float		fPi			= (float)3.141592654;
 	float		fSqrtHalf	= (float)0.707106781;
 
-	for (nY=0;nY<DCT_SZ_Y;nY++) {
-		for (nX=0;nX<DCT_SZ_X;nX++) {
-
-			nYX = nY*DCT_SZ_X + nX;
-
-			for (nV=0;nV<DCT_SZ_Y;nV++) {
-				for (nU=0;nU<DCT_SZ_X;nU++) {
-
-					nVU = nV*DCT_SZ_X + nU;
-
-					fCu = (nU==0)?fSqrtHalf:1;
-					fCv = (nV==0)?fSqrtHalf:1;
-					fCosProd = cos((2*nX+1)*nU*fPi/16) * cos((2*nY+1)*nV*fPi/16);
-					// Note that the only part we are missing from
-					// the "Inside Product" is the "m_afDctBlock[nV*8+nU]" term
-					fInsideProd = fCu*fCv*fCosProd;
+	ImgDecodeIdctRefInit(m_psTbl->afIdctLookup);
 
-					// Store the Lookup result
-					m_afIdctLookup[nYX][nVU] = fInsideProd;
-
-					// Store a fixed point Lookup as well
-					m_anIdctLookup[nYX][nVU] = (int)(fInsideProd * (1<<10));
+	// Reduced size IDCT basis for each scale
+	// - An N-point block (N = 8>>scale) is generated from the top-left NxN
+	//   coefficients, sampling the 8-point basis at the center of each
+	//   group of output pixels: (2x+1)*u*Pi/16 becomes (2x'+1)*u*Pi/(2N)
+	for (unsigned nScale=SCAN_SCALE_1;nScale<SCAN_SCALE_END;nScale++) {
+		unsigned	nSz = DCT_SZ_X >> nScale;
+		for (nX=0;nX<DCT_SZ_X;nX++) {
+			for (nU=0;nU<DCT_SZ_X;nU++) {
+				fCu = (nU==0)?fSqrtHalf:1;
+				if ((nX < nSz) && (nU < nSz)) {
+					m_psTbl->afIdctScaleCos[nScale][nX][nU] = fCu * cos((2*nX+1)*nU*fPi/(2*nSz));
+				} else {
+					m_psTbl->afIdctScaleCos[nScale][nX][nU] = 0;
 				}
 			}
-
 		}
 	}
 }
 
 
+// Precalculate the IDCT dequantization multiplier for a DQT entry
+// - See ImgDecodeIdctMult()
+// - The x8 output scaling puts the IDCT output in the same units as the
+//   dequantized DC coefficient (see SetFullRes)
+// - The DC multiplier is zero as the DC coefficient in m_anDctBlock[]
+//   is a differential value; the DC level is applied by SetFullRes
+//
+// INPUT:
+// - nTbl					= DQT table destination ID
+// - nCoeffInd				= Coefficient index (normal order)
+// PRE:
+// - m_psTbl->anDqtCoeff[][]
+// POST:
+// - m_psTbl->afDqtIdctMult[][]
+// - m_psTbl->anDqtIdctMult[][]
+//
+void CimgDecode::PrecalcIdctDqt(unsigned nTbl,unsigned nCoeffInd)
+{
+	ImgDecodeIdctMult(m_psTbl->anDqtCoeff[nTbl][nCoeffInd],nCoeffInd,
+		m_psTbl->afDqtIdctMult[nTbl][nCoeffInd],m_psTbl->anDqtIdctMult[nTbl][nCoeffInd]);
+}
+
+
+// Perform IDCT on the current block
+// - Selects the scaled, fixed point or floating point IDCT
+//
+// INPUT:
+// - nDqtTbl				= DQT table for the block
+//
+void CimgDecode::DecodeIdctCalc(unsigned nDqtTbl)
+{
+	if (m_nScaleShift != SCAN_SCALE_1) {
+		DecodeIdctCalcScaled(nDqtTbl);
+		return;
+	}
+
+#ifdef IDCT_FIXEDPT
+	DecodeIdctCalcFixedpt(nDqtTbl);
+#else
+	DecodeIdctCalcFloat(nDqtTbl);
+#endif
+#ifdef IDCT_SELFCHECK
+	DecodeIdctCheck(nDqtTbl);
+#endif
+}
+
 // Perform IDCT
+// - Separable AAN IDCT: dequantize & prescale, then a 1-D IDCT on
+//   each column followed by each row (about 100 multiplies per block
+//   versus 4096 for the direct matrix form)
+// - The DC coefficient is excluded (see PrecalcIdctDqt)
+// - Sparse blocks (most blocks end in an early EOB) use a reduced
+//   kernel selected by the last non-zero coefficient: no IDCT for DC
+//   only, or a 2x2 / 4x4 corner IDCT. These give the same result as
+//   the full IDCT.
 //
 // Formula:
 //  See itu-t81.pdf, section A.3.3
@@ -2362,252 +3010,773 @@ void CimgDecode::PrecalcIdct()
 // Cu, Cv = 1 else
 //
 // INPUT:
-// - nCoefMax				= Maximum number of coefficients to calculate
+// - nDqtTbl				= DQT table for the block
 // PRE:
-// - m_afIdctLookup[][]
+// - m_psTbl->afDqtIdctMult[][]
 // - m_anDctBlock[]
+// - m_nDctCoefMax
 // POST:
-// - m_afIdctBlock[]
+// - m_afIdctBlock[]		= 8*s(yx) (without DC)
+// - m_anIdctPathNum[]
 //
-void CimgDecode::DecodeIdctCalcFloat(unsigned nCoefMax)
+void CimgDecode::DecodeIdctCalcFloat(unsigned nDqtTbl)
 {
-	unsigned	nYX,nVU;
-	float		fSum;
-
-	for (nYX=0;nYX<DCT_SZ_ALL;nYX++) {
-		fSum = 0;
-
-		// Skip DC coefficient!
-		for (nVU=1;nVU<nCoefMax;nVU++) {
-			fSum += m_afIdctLookup[nYX][nVU]*m_anDctBlock[nVU];
+	const float*	pfMult = m_psTbl->afDqtIdctMult[nDqtTbl];
+	teIdctPath		eIdctPath;
+
+	// Select the kernel from the last non-zero coefficient
+	if (m_nDctCoefMax == DCT_COEFF_DC) {
+		// The DC level is applied by SetFullRes() so there is no IDCT output
+		eIdctPath = IDCT_PATH_DC;
+		memset(m_afIdctBlock,0,sizeof(m_afIdctBlock));
+	} else if (m_nDctCoefMax <= IDCT_ZZ_MAX_2X2) {
+		eIdctPath = IDCT_PATH_2X2;
+		m_pKernels->pfnIdctFloat2x2(m_anDctBlock,pfMult,m_afIdctBlock);
+	} else if (m_nDctCoefMax <= IDCT_ZZ_MAX_4X4) {
+		eIdctPath = IDCT_PATH_4X4;
+		m_pKernels->pfnIdctFloat4x4(m_anDctBlock,pfMult,m_afIdctBlock);
+	} else {
+		eIdctPath = IDCT_PATH_FULL;
+		// Dequantize and prescale, then columns and rows
+		m_pKernels->pfnDequantFloat(m_anDctBlock,pfMult,m_afIdctBlock);
+#ifdef SIMD_SELFCHECK
+		float	afDequant[DCT_SZ_ALL];
+		ImgDecodeSimdGet(SIMD_LEVEL_SCALAR)->pfnDequantFloat(m_anDctBlock,pfMult,afDequant);
+		for (unsigned nInd=0;nInd<DCT_SZ_ALL;nInd++) {
+			if (afDequant[nInd] != m_afIdctBlock[nInd]) {
+				ReportSimdCheck(_T("Dequantize"),nInd);
+				break;
+			}
+		}
+#endif
+		m_pKernels->pfnIdctFloat(m_afIdctBlock);
+	}
+	m_anIdctPathNum[eIdctPath]++;
+
+#ifdef SIMD_SELFCHECK
+	// All of the kernels must match the full scalar IDCT
+	const ImgDecodeKernels*	pRef = ImgDecodeSimdGet(SIMD_LEVEL_SCALAR);
+	float	afRef[DCT_SZ_ALL];
+	pRef->pfnDequantFloat(m_anDctBlock,pfMult,afRef);
+	pRef->pfnIdctFloat(afRef);
+	for (unsigned nInd=0;nInd<DCT_SZ_ALL;nInd++) {
+		if (afRef[nInd] != m_afIdctBlock[nInd]) {
+			ReportSimdCheck(m_astrIdctPathName[eIdctPath],nInd);
+			break;
 		}
-		fSum *= 0.25;
-
-		// Store the result
-		// FIXME: Note that float->int is very slow!
-		//   Should consider using fixed point instead!
-		m_afIdctBlock[nYX] = fSum;
 	}
-
+#endif
 }
 
 // Fixed point version of DecodeIdctCalcFloat()
 //
+// INPUT:
+// - nDqtTbl				= DQT table for the block
 // PRE:
-// - m_anIdctLookup[][]
+// - m_psTbl->anDqtIdctMult[][]
 // - m_anDctBlock[]
 // POST:
-// - m_anIdctBlock[]
+// - m_anIdctBlock[]		= 8*s(yx) (without DC)
 //
-void CimgDecode::DecodeIdctCalcFixedpt()
+void CimgDecode::DecodeIdctCalcFixedpt(unsigned nDqtTbl)
 {
-	unsigned	nYX,nVU;
-	int			nSum;
+	const int*	pnMult = m_psTbl->anDqtIdctMult[nDqtTbl];
 
-	for (nYX=0;nYX<DCT_SZ_ALL;nYX++) {
-		nSum = 0;
-		// Skip DC coefficient!
-		for (nVU=1;nVU<DCT_SZ_ALL;nVU++) {
-			nSum += m_anIdctLookup[nYX][nVU] * m_anDctBlock[nVU];
-		}
+	// Blocks without AC coefficients have no IDCT output
+	// (the DC level is applied by SetFullRes)
+	if (m_nDctCoefMax == DCT_COEFF_DC) {
+		m_anIdctPathNum[IDCT_PATH_DC]++;
+		memset(m_anIdctBlock,0,sizeof(m_anIdctBlock));
+		return;
+	}
+	m_anIdctPathNum[IDCT_PATH_FULL]++;
+	m_pKernels->pfnIdctInt(m_anDctBlock,pnMult,m_anIdctBlock);
+}
+
+// Perform a reduced size IDCT for the scaled decode
+// - Only the top-left NxN coefficients (N = 8>>m_nScaleShift) are used
+//   to generate an NxN block directly, rather than decoding the full
+//   8x8 block and downsampling it
+// - Separable: rows then columns, using m_psTbl->afIdctScaleCos[][][]
+// - At 1/8 scale the block is a single pixel, which is the DC level
+//
+// INPUT:
+// - nDqtTbl				= DQT table for the block
+// PRE:
+// - m_psTbl->afIdctScaleCos[][][]
+// - m_anDctBlock[]
+// - m_psTbl->anDqtCoeff[][]
+// - m_nDctCoefMax
+// POST:
+// - m_afIdctBlock[]		= 8*s(yx) (without DC), NxN packed
+// - m_anIdctBlock[]		= Fixed point version (if IDCT_FIXEDPT)
+// - m_anIdctPathNum[]
+//
+void CimgDecode::DecodeIdctCalcScaled(unsigned nDqtTbl)
+{
+	const unsigned short*	pnDqt = m_psTbl->anDqtCoeff[nDqtTbl];
+	const float				(*pafCos)[DCT_SZ_X] = m_psTbl->afIdctScaleCos[m_nScaleShift];
+	unsigned	nSz = DCT_SZ_X >> m_nScaleShift;
+	unsigned	nX,nY,nU,nV;
+	float		afCoef[DCT_SZ_ALL];
+	float		afTmp[DCT_SZ_ALL];
+	float		fSum;
 
-		nSum /= 4;
+	// Blocks without AC coefficients have no IDCT output
+	// (the DC level is applied by SetFullRes)
+	if ((m_nDctCoefMax == DCT_COEFF_DC) || (nSz == 1)) {
+		m_anIdctPathNum[IDCT_PATH_DC]++;
+		memset(m_afIdctBlock,0,sizeof(m_afIdctBlock));
+		memset(m_anIdctBlock,0,sizeof(m_anIdctBlock));
+		return;
+	}
+	m_anIdctPathNum[IDCT_PATH_SCALED]++;
 
-		// Store the result
-		// FIXME: Note that float->int is very slow!
-		//   Should consider using fixed point instead!
-		m_anIdctBlock[nYX] = nSum >> 10;
+	// Dequantize the top-left corner
+	for (nV=0;nV<nSz;nV++) {
+		for (nU=0;nU<nSz;nU++) {
+			afCoef[nV*nSz+nU] = (float)(m_anDctBlock[nV*DCT_SZ_X+nU] * pnDqt[nV*DCT_SZ_X+nU]);
+		}
+	}
+	afCoef[DCT_COEFF_DC] = 0;
 
+	// Rows
+	for (nV=0;nV<nSz;nV++) {
+		for (nX=0;nX<nSz;nX++) {
+			fSum = 0;
+			for (nU=0;nU<nSz;nU++) {
+				fSum += afCoef[nV*nSz+nU] * pafCos[nX][nU];
+			}
+			afTmp[nV*nSz+nX] = fSum;
+		}
 	}
 
+	// Columns
+	// - The factor 2 is the 1/4 normalization with the x8 output scaling
+	for (nY=0;nY<nSz;nY++) {
+		for (nX=0;nX<nSz;nX++) {
+			fSum = 0;
+			for (nV=0;nV<nSz;nV++) {
+				fSum += afTmp[nV*nSz+nX] * pafCos[nY][nV];
+			}
+#ifdef IDCT_FIXEDPT
+			m_anIdctBlock[nY*nSz+nX] = (int)floor(fSum*2 + 0.5);
+#else
+			m_afIdctBlock[nY*nSz+nX] = fSum*2;
+#endif
+		}
+	}
 }
 
-// Clear the entire pixel image arrays for all three components (YCC)
+// Reference IDCT
+// - Direct matrix form of the IDCT (see DecodeIdctCalcFloat)
+//   using the m_psTbl->afIdctLookup[][] table (see ImgDecodeIdctRef)
+// - Only used to verify the fast IDCT
 //
 // INPUT:
-// - nWidth					= Current allocated image width
-// - nHeight				= Current allocated image height
-// POST:
-// - m_pPixValY
-// - m_pPixValCb
-// - m_pPixValCr
+// - nDqtTbl				= DQT table for the block
+// PRE:
+// - m_psTbl->afIdctLookup[][]
+// - m_anDctBlock[]
+// - m_psTbl->anDqtCoeff[][]
+// OUTPUT:
+// - pfBlock				= 8*s(yx) (without DC)
 //
-void CimgDecode::ClrFullRes(unsigned nWidth,unsigned nHeight)
+void CimgDecode::DecodeIdctCalcRef(unsigned nDqtTbl,float* pfBlock)
 {
-	ASSERT(m_pPixValY);
-	if (m_nNumSosComps == NUM_CHAN_YCC) {
-		ASSERT(m_pPixValCb);
-		ASSERT(m_pPixValCr);
-	}
-	// FIXME: Add in range checking here
-	memset(m_pPixValY,  0, (nWidth * nHeight * sizeof(short)) );
-	if (m_nNumSosComps == NUM_CHAN_YCC) {
-		memset(m_pPixValCb, 0, (nWidth * nHeight * sizeof(short)) );
-		memset(m_pPixValCr, 0, (nWidth * nHeight * sizeof(short)) );
-	}
+	ImgDecodeIdctRef(m_psTbl->afIdctLookup,m_anDctBlock,m_psTbl->anDqtCoeff[nDqtTbl],pfBlock);
 }
 
-// Generate a single component's pixel content for one MCU
-// - Fetch content from the 8x8 IDCT block (m_afIdctBlock[])
-//   for the specified component (nComp)
-// - Transfer the pixel content to the specified component's
-//   pixel map (m_pPixValY[],m_pPixValCb[],m_pPixValCr[])
-// - DC level shifting is performed (nDcOffset)
-// - Replication of pixels according to Chroma Subsampling (sampling factors)
+// Compare the fast IDCT result against the reference IDCT
+// - Called after DecodeIdctCalcFloat() or DecodeIdctCalcFixedpt()
+//   when IDCT_SELFCHECK is defined
+// - The float version should agree to well within one output unit
+//   (1/8 of a sample). The fixed point version is allowed two units
 //
 // INPUT:
-// - nMcuX					=
-// - nMcuY					=
-// - nComp					= Component index (1,2,3)
-// - nCssXInd				=
-// - nCssYInd				=
-// - nDcOffset				=
+// - nDqtTbl				= DQT table for the block
 // PRE:
-// - DecodeIdctCalc() already called on Lum AC, and Lum DC already done
+// - m_afIdctBlock[] or m_anIdctBlock[]
+// POST:
+// - m_nWarnIdctCheckNum
 //
-void CimgDecode::SetFullRes(unsigned nMcuX,unsigned nMcuY,unsigned nComp,unsigned nCssXInd,unsigned nCssYInd,short int nDcOffset)
+void CimgDecode::DecodeIdctCheck(unsigned nDqtTbl)
 {
-	unsigned	nYX;
-	float		fVal;
-	short int	nVal;
-	unsigned	nChan;
+	float		afRef[DCT_SZ_ALL];
+	float		fDiff;
+	float		fDiffMax = 0;
+	unsigned	nDiffInd = 0;
 
-	// Convert from Component index (1-based) to Channel index (0-based)
-	// Component index is direct from SOF/SOS
-	// Channel index is used for internal display representation
-	if (nComp <= 0) {
-#ifdef DEBUG_LOG
-		CString	strTmp;
-		CString	strDebug;
-		strTmp.Format(_T("SetFullRes() with nComp <= 0 [%d]"),nComp);
-		strDebug.Format(_T("## File=[%-100s] Block=[%-10s] Error=[%s]\n"),(LPCTSTR)m_pAppConfig->strCurFname,
-			_T("ImgDecode"),(LPCTSTR)strTmp);
-		OutputDebugString(strDebug);
+	DecodeIdctCalcRef(nDqtTbl,afRef);
+	for (unsigned nYX=0;nYX<DCT_SZ_ALL;nYX++) {
+#ifdef IDCT_FIXEDPT
+		fDiff = fabs(m_anIdctBlock[nYX] - afRef[nYX]);
 #else
-		ASSERT(false);
+		fDiff = fabs(m_afIdctBlock[nYX] - afRef[nYX]);
 #endif
-		return;
+		if (fDiff > fDiffMax) {
+			fDiffMax = fDiff;
+			nDiffInd = nYX;
+		}
 	}
-	nChan = nComp - 1;
-
-	unsigned	nPixMapW = m_nBlkXMax*BLK_SZ_X;	// Width of pixel map
-	unsigned	nOffsetBlkCorner;	// Linear offset to top-left corner of block
-	unsigned	nOffsetPixCorner;	// Linear offset to top-left corner of pixel (start point for expansion)
-
-	// Calculate the linear pixel offset for the top-left corner of the block in the MCU
-	nOffsetBlkCorner = ((nMcuY*m_nMcuHeight) + nCssYInd*BLK_SZ_X) * nPixMapW +
-						((nMcuX*m_nMcuWidth)  + nCssXInd*BLK_SZ_Y);
 
-	// Use the expansion factor to determine how many bits to replicate
-	// Typically for luminance (Y) this will be 1 & 1
-	// The replication factor is available in m_anExpandBitsMcuH[] and m_anExpandBitsMcuV[]
-
-	// Step through all pixels in the block
-	for (unsigned nY=0;nY<BLK_SZ_Y;nY++) {
-		for (unsigned nX=0;nX<BLK_SZ_X;nX++) {
-			nYX = nY*BLK_SZ_X+nX;
-
-			// Fetch the pixel value from the IDCT 8x8 block
-			// and perform DC level shift
 #ifdef IDCT_FIXEDPT
-			nVal = m_anIdctBlock[nYX];
-			// TODO: Why do I need AC value x8 multiplier?
-			nVal = (nVal*8) + nDcOffset;
+	if (fDiffMax > 2.0f) {
 #else
-			fVal = m_afIdctBlock[nYX];
-			// TODO: Why do I need AC value x8 multiplier?
-			nVal = ((short int)(fVal*8) + nDcOffset);
+	if (fDiffMax > 0.1f) {
 #endif
+		if (m_nWarnIdctCheckNum < m_nScanErrMax) {
+			CString strTmp;
+			strTmp.Format(_T("*** ERROR: IDCT self-check mismatch @ %s: [%u,%u] diff=%.3f ref=%.3f"),
+				(LPCTSTR)GetScanBufPos(),nDiffInd%DCT_SZ_X,nDiffInd/DCT_SZ_X,fDiffMax,afRef[nDiffInd]);
+			m_pLog->AddLineErr(strTmp);
 
-			// NOTE: These range checks were already done in DecodeScanImg()
-			ASSERT(nCssXInd<MAX_SAMP_FACT_H);
-			ASSERT(nCssYInd<MAX_SAMP_FACT_V);
-			ASSERT(nY<BLK_SZ_Y);
-			ASSERT(nX<BLK_SZ_X);
-
-			// Set the pixel value for the component
-
-			// We start with the linear offset into the pixel map for the top-left
-			// corner of the block. Then we adjust to determine the top-left corner
-			// of the pixel that we may optionally expand in subsampling scenarios.
-
-			// Calculate the top-left corner pixel linear offset after taking
-			// into account any expansion in the X direction
-			nOffsetPixCorner = nOffsetBlkCorner + nX*m_anExpandBitsMcuH[nComp];
-
-			// Replication the pixels as specified in the sampling factor
-			// This is typically done for the chrominance channels when
-			// chroma subsamping is used.
-			for (unsigned nIndV=0;nIndV<m_anExpandBitsMcuV[nComp];nIndV++) {
-				for (unsigned nIndH=0;nIndH<m_anExpandBitsMcuH[nComp];nIndH++) {
-					if (nChan == CHAN_Y) {
-						m_pPixValY[nOffsetPixCorner+(nIndV*nPixMapW)+nIndH] = nVal;
-					} else if (nChan == CHAN_CB) {
-						m_pPixValCb[nOffsetPixCorner+(nIndV*nPixMapW)+nIndH] = nVal;
-					} else if (nChan == CHAN_CR) {
-						m_pPixValCr[nOffsetPixCorner+(nIndV*nPixMapW)+nIndH] = nVal;
-					} else {
-						ASSERT(false);
-					}
-				} // nIndH
-			} // nIndV
+			m_nWarnIdctCheckNum++;
+			if (m_nWarnIdctCheckNum >= m_nScanErrMax) {
+				strTmp.Format(_T("    Only reported first %u instances of this message..."),m_nScanErrMax);
+				m_pLog->AddLineErr(strTmp);
+			}
+		}
+	}
+}
 
-		} // nX
+// Names of the IDCT kernels (teIdctPath) for reporting
+const LPCTSTR CimgDecode::m_astrIdctPathName[IDCT_PATH_NUM] = {
+	_T("DC only"),
+	_T("2x2"),
+	_T("4x4"),
+	_T("Full 8x8"),
+	_T("Scaled"),
+};
 
-		nOffsetBlkCorner += (nPixMapW * m_anExpandBitsMcuV[nComp]);
+// Report the number of blocks that used each IDCT kernel
+//
+// PRE:
+// - m_anIdctPathNum[]
+//
+void CimgDecode::ReportIdctStats()
+{
+	CString		strTmp;
+	unsigned	nTotal = 0;
 
-	} // nY
+	for (unsigned nPath=0;nPath<IDCT_PATH_NUM;nPath++) {
+		nTotal += m_anIdctPathNum[nPath];
+	}
+	if (nTotal == 0) {
+		return;
+	}
 
+	m_pLog->AddLine(_T("  IDCT block stats:"));
+	for (unsigned nPath=0;nPath<IDCT_PATH_NUM;nPath++) {
+		// Only the DC only and scaled kernels are used in a scaled decode
+		// - The preview reduction of a band decode is not an IDCT scale
+		bool	bScaledPath = (nPath == IDCT_PATH_SCALED);
+		bool	bScaled = (m_nScaleShift - m_nBandShift != SCAN_SCALE_1);
+		if ((nPath != IDCT_PATH_DC) && (bScaledPath != bScaled)) {
+			continue;
+		}
+		strTmp.Format(_T("    # blocks using %-8s IDCT: %8u (%3.0f%%)"),
+			m_astrIdctPathName[nPath],m_anIdctPathNum[nPath],(m_anIdctPathNum[nPath]*100.0)/nTotal);
+		m_pLog->AddLine(strTmp);
+	}
+	m_pLog->AddLine(_T(""));
 }
 
+// Report a mismatch between a SIMD kernel and the scalar reference kernel
+// - Only used when SIMD_SELFCHECK is defined
+//
+// INPUT:
+// - strKernel				= Kernel name
+// - nInd					= First mismatching index within the block
+// POST:
+// - m_nWarnSimdCheckNum
+//
+void CimgDecode::ReportSimdCheck(LPCTSTR strKernel,unsigned nInd)
+{
+	if (m_nWarnSimdCheckNum < m_nScanErrMax) {
+		CString strTmp;
+		strTmp.Format(_T("*** ERROR: SIMD self-check mismatch @ %s: %s kernel (%s) at [%u,%u]"),
+			(LPCTSTR)GetScanBufPos(),strKernel,(LPCTSTR)ImgDecodeSimdName(m_pKernels->eLevel),
+			nInd%DCT_SZ_X,nInd/DCT_SZ_X);
+		m_pLog->AddLineErr(strTmp);
 
+		m_nWarnSimdCheckNum++;
+		if (m_nWarnSimdCheckNum >= m_nScanErrMax) {
+			strTmp.Format(_T("    Only reported first %u instances of this message..."),m_nScanErrMax);
+			m_pLog->AddLineErr(strTmp);
+		}
+	}
+}
 
+// Clear the pixel planes of all components
+//
+// POST:
+// - m_asPixPlane[]
+//
+void CimgDecode::ClrFullRes()
+{
+	for (unsigned nChan=0;nChan<m_nNumSosComps;nChan++) {
+		PixPlane*	psPlane = &m_asPixPlane[nChan];
+		ASSERT(psPlane->pnPix);
+		if (psPlane->pnPix) {
+			memset(psPlane->pnPix, 0, (psPlane->nW * psPlane->nH * sizeof(short)) );
+		}
+	}
+}
 
-// Calculates the actual byte offset (from start of file) for
-// the current position in the m_nScanBuff.
+// Allocate the pixel plane of a component
+// - The plane covers the pixel map (m_nPixMapW x m_nPixMapH) at the
+//   sampling of the component. Components with the largest sampling
+//   factors (and all components of a preview) are at full resolution.
 //
+// INPUT:
+// - nChan					= Channel index (CHAN_Y..CHAN_K)
+// - nSampH, nSampV			= Sampling factors of the component
+// - nSampHMax, nSampVMax	= Largest sampling factors of the image
 // PRE:
-// - m_anScanBuffPtr_pos[]
-// - m_nScanBuffPtr_align
+// - m_nPixMapW, m_nPixMapH
+// POST:
+// - m_asPixPlane[nChan]
 // RETURN:
-// - File position
+// - False if the plane couldn't be allocated
 //
-CString CimgDecode::GetScanBufPos()
+bool CimgDecode::PlaneAlloc(unsigned nChan,unsigned nSampH,unsigned nSampV,unsigned nSampHMax,unsigned nSampVMax)
 {
-	return GetScanBufPos(m_anScanBuffPtr_pos[0],m_nScanBuffPtr_align);
+	PixPlane*	psPlane = &m_asPixPlane[nChan];
+	ASSERT(psPlane->pnPix == NULL);
+	ASSERT(psPlane->pnPix8 == NULL);
+
+	psPlane->nSampH = nSampH;
+	psPlane->nSampV = nSampV;
+	psPlane->nSampHMax = nSampHMax;
+	psPlane->nSampVMax = nSampVMax;
+	psPlane->nW = m_nPixMapW * nSampH / nSampHMax;
+	psPlane->nH = m_nPixMapH * nSampV / nSampVMax;
+	psPlane->pnPix = new short[psPlane->nW * psPlane->nH];
+	return (psPlane->pnPix != NULL);
 }
 
-// Generate a file position string that also indicates bit alignment
+// Release the pixel planes of all components
+//
+// POST:
+// - m_asPixPlane[]
+//
+void CimgDecode::PlaneFree()
+{
+	for (unsigned nChan=0;nChan<NUM_CHAN_YCCK;nChan++) {
+		if (m_asPixPlane[nChan].pnPix) {
+			delete [] m_asPixPlane[nChan].pnPix;
+		}
+		if (m_asPixPlane[nChan].pnPix8) {
+			delete [] m_asPixPlane[nChan].pnPix8;
+		}
+	}
+	memset(m_asPixPlane,0,sizeof(m_asPixPlane));
+}
+
+// Determine the plane offset of the top-left corner of a block
+// - In scaled decode the block is (8>>m_nScaleShift) samples square
+// - In band decode the plane starts at the top of the band
 //
 // INPUT:
-// - pos			= File position (byte)
-// - align			= File position (bit)
+// - nChan					= Channel index (CHAN_Y..CHAN_K)
+// - nBlkX, nBlkY			= Block coordinate within the component
+// PRE:
+// - m_nBandPixY
 // RETURN:
-// - Formatted string
+// - Linear offset into the pixel plane
 //
-CString CimgDecode::GetScanBufPos(unsigned pos, unsigned align)
+unsigned CimgDecode::PlaneBlkOffset(unsigned nChan,unsigned nBlkX,unsigned nBlkY)
 {
-	CString strTmp;
-	strTmp.Format(_T("0x%08X.%u"),pos,align);
-	return strTmp;
+	const PixPlane*	psPlane = &m_asPixPlane[nChan];
+	unsigned	nBlkSz = BLK_SZ_X >> m_nScaleShift;
+	unsigned	nBandY = 0;
+	if (m_nBandPixY != 0) {
+		nBandY = m_nBandPixY * psPlane->nSampV / psPlane->nSampVMax;
+	}
+	return (nBlkY*nBlkSz - nBandY) * psPlane->nW + nBlkX*nBlkSz;
 }
 
-
-// Test the scan error flag and, if set, report out the position
+// Determine the plane index of the sample that covers a pixel
 //
 // INPUT:
-// - nMcuX				= MCU x coordinate
-// - nMcuY				= MCU y coordinate
-// - nCssIndH			= Chroma subsampling (horizontal)
-// - nCssIndV			= Chroma subsampling (vertical)
-// - nComp				= Image component
+// - nChan					= Channel index (CHAN_Y..CHAN_K)
+// - nPixX, nPixY			= Pixel map coordinate
+// RETURN:
+// - Linear index into the pixel plane
 //
-void CimgDecode::CheckScanErrors(unsigned nMcuX,unsigned nMcuY,unsigned nCssIndH,unsigned nCssIndV,unsigned nComp)
+unsigned CimgDecode::PlanePixInd(unsigned nChan,unsigned nPixX,unsigned nPixY)
 {
-	//unsigned mcu_x_max = (m_nDimX/m_nMcuWidth);
-	//unsigned mcu_y_max = (m_nDimY/m_nMcuHeight);
+	const PixPlane*	psPlane = &m_asPixPlane[nChan];
+	return (nPixY * psPlane->nSampV / psPlane->nSampVMax) * psPlane->nW +
+		(nPixX * psPlane->nSampH / psPlane->nSampHMax);
+}
 
-	// Determine pixel position, taking into account sampling quadrant as well
+// Determine whether a pixel plane holds samples (16-bit or compact)
+//
+// INPUT:
+// - nChan					= Channel index (CHAN_Y..CHAN_K)
+//
+bool CimgDecode::PlaneValid(unsigned nChan)
+{
+	return (m_asPixPlane[nChan].pnPix != NULL) || (m_asPixPlane[nChan].pnPix8 != NULL);
+}
+
+// Upsample one row of a pixel plane to the pixel map width
+// - Pixel nPixX takes the sample (nPixX * nSampH / nSampHMax)
+// - Clipped 8-bit samples are converted back to pixel map units
+//
+// INPUT:
+// - pSrc					= Plane row
+// - psPlane				= Pixel plane
+// OUTPUT:
+// - pnRow					= m_nPixMapW values in pixel map units
+//
+template <typename T>
+void CimgDecode::PlaneRowUpsample(const T* pSrc,const PixPlane* psPlane,short* pnRow)
+{
+	int			nOffset = (sizeof(T) == 1) ? 128 : 0;
+	int			nMult = (sizeof(T) == 1) ? 8 : 1;
+	unsigned	nSampH = psPlane->nSampH;
+	unsigned	nSampHMax = psPlane->nSampHMax;
+
+	if (nSampH == nSampHMax) {
+		for (unsigned nPixX=0;nPixX<m_nPixMapW;nPixX++) {
+			pnRow[nPixX] = (short)((pSrc[nPixX] - nOffset) * nMult);
+		}
+	} else if (nSampH*2 == nSampHMax) {
+		for (unsigned nPixX=0;nPixX<m_nPixMapW;nPixX+=2) {
+			short	nVal = (short)((*pSrc++ - nOffset) * nMult);
+			pnRow[nPixX] = nVal;
+			pnRow[nPixX+1] = nVal;
+		}
+	} else {
+		unsigned	nAcc = 0;
+		for (unsigned nPixX=0;nPixX<m_nPixMapW;nPixX++) {
+			pnRow[nPixX] = (short)((*pSrc - nOffset) * nMult);
+			nAcc += nSampH;
+			if (nAcc >= nSampHMax) {
+				nAcc -= nSampHMax;
+				pSrc++;
+			}
+		}
+	}
+}
+
+// Fetch one row of a pixel plane at the pixel map resolution
+// - A full resolution plane that hasn't been compacted is returned
+//   in place, otherwise the row is upsampled into pnRow
+//
+// INPUT:
+// - nChan					= Channel index (CHAN_Y..CHAN_K)
+// - nPixY					= Pixel map row
+// - pnRow					= Row buffer (m_nPixMapW values)
+// RETURN:
+// - Row of m_nPixMapW values in pixel map units
+//
+const short* CimgDecode::PlaneRowGet(unsigned nChan,unsigned nPixY,short* pnRow)
+{
+	const PixPlane*	psPlane = &m_asPixPlane[nChan];
+	unsigned	nPlaneY = nPixY * psPlane->nSampV / psPlane->nSampVMax;
+
+	if (psPlane->pnPix) {
+		const short*	pSrc = &psPlane->pnPix[nPlaneY * psPlane->nW];
+		if (psPlane->nSampH == psPlane->nSampHMax) {
+			return pSrc;
+		}
+		PlaneRowUpsample(pSrc,psPlane,pnRow);
+	} else {
+		PlaneRowUpsample(&psPlane->pnPix8[nPlaneY * psPlane->nW],psPlane,pnRow);
+	}
+	return pnRow;
+}
+
+// Reduce the pixel planes of an 8-bit image to clipped 8-bit samples
+// - Called once the preview and the image statistics are complete,
+//   as these need the samples before clipping
+// - The color conversion of a clipped sample gives the same result
+//   (see ConvertYCCtoRGB), but a preview YCC adjust (level shift)
+//   would be applied after the clipping. The planes are therefore
+//   kept at 16-bit in the GUI, where the adjust can still be made.
+// - Horizontally subsampled planes are kept at 16-bit so that the
+//   preview can convert them without upsampling (see
+//   CalcChannelPreviewRowsYcc)
+// - This reduces the memory held after the decode, not the peak
+//   during the decode (which needs the 16-bit planes)
+// - Planes are left at 16-bit if the compact plane can't be allocated
+//
+// PRE:
+// - m_nPixMapPrecShift
+// POST:
+// - m_asPixPlane[]
+//
+void CimgDecode::PlaneCompact()
+{
+	if ((!m_pAppConfig->bDecodeScanPlane8) || (m_pAppConfig->bGuiMode) || (m_nPixMapPrecShift != 0)) {
+		return;
+	}
+
+	for (unsigned nChan=0;nChan<NUM_CHAN_YCCK;nChan++) {
+		PixPlane*	psPlane = &m_asPixPlane[nChan];
+		if ((!psPlane->pnPix) || (psPlane->nSampH != psPlane->nSampHMax)) {
+			continue;
+		}
+		unsigned	nNumPix = psPlane->nW * psPlane->nH;
+		psPlane->pnPix8 = new unsigned char[nNumPix];
+		if (!psPlane->pnPix8) {
+			continue;
+		}
+		for (unsigned nInd=0;nInd<nNumPix;nInd++) {
+			// Same ranging as ConvertYCCtoRGB(): -1024..+1023 -> 0..255
+			int		nVal = psPlane->pnPix[nInd] + 1024;
+			nVal = (nVal < 0) ? 0 : (nVal >> 3);
+			psPlane->pnPix8[nInd] = (unsigned char)((nVal > 255) ? 255 : nVal);
+		}
+		delete [] psPlane->pnPix;
+		psPlane->pnPix = NULL;
+	}
+}
+
+// Fetch the pixel values from the IDCT block and perform the DC level
+// shift (with clamping to the pixel map range)
+// - The IDCT output is already scaled by 8 to match the units
+//   of the (dequantized) DC coefficient
+// - In scaled decode only the first nBlkSz*nBlkSz values are used
+//
+// INPUT:
+// - nDcOffset				= DC level shift
+// PRE:
+// - DecodeIdctCalc() already called on the block
+// OUTPUT:
+// - pnPix					= Level-shifted pixels (DCT_SZ_ALL entries)
+//
+void CimgDecode::LevelShiftBlock(short int nDcOffset,short int* pnPix)
+{
+#ifdef IDCT_FIXEDPT
+	m_pKernels->pfnLevelShiftInt(m_anIdctBlock,nDcOffset,pnPix);
+#else
+	m_pKernels->pfnLevelShiftFloat(m_afIdctBlock,nDcOffset,pnPix);
+#endif
+
+#ifdef SIMD_SELFCHECK
+	short int	anRef[DCT_SZ_ALL];
+	const ImgDecodeKernels*	pRef = ImgDecodeSimdGet(SIMD_LEVEL_SCALAR);
+#ifdef IDCT_FIXEDPT
+	pRef->pfnLevelShiftInt(m_anIdctBlock,nDcOffset,anRef);
+#else
+	pRef->pfnLevelShiftFloat(m_afIdctBlock,nDcOffset,anRef);
+#endif
+	for (unsigned nInd=0;nInd<DCT_SZ_ALL;nInd++) {
+		if (anRef[nInd] != pnPix[nInd]) {
+			ReportSimdCheck(_T("Level shift"),nInd);
+			break;
+		}
+	}
+#endif
+}
+
+// Generate a single component's pixel content for one MCU
+// - Fetch content from the 8x8 IDCT block (m_afIdctBlock[])
+//   for the specified component (nComp)
+// - Transfer the pixel content to the specified component's
+//   pixel plane (m_asPixPlane[])
+// - DC level shifting and clamping is performed (nDcOffset)
+// - The plane is at the sampling of the component, so no replication
+//   of pixels is needed for Chroma Subsampling (see PlaneRowGet)
+// - In scaled decode the block is (8>>m_nScaleShift) pixels square
+//
+// INPUT:
+// - nMcuX					=
+// - nMcuY					=
+// - nComp					= Component index (1,2,3,4)
+// - nCssXInd				=
+// - nCssYInd				=
+// - nDcOffset				=
+// PRE:
+// - DecodeIdctCalc() already called on Lum AC, and Lum DC already done
+//
+void CimgDecode::SetFullRes(unsigned nMcuX,unsigned nMcuY,unsigned nComp,unsigned nCssXInd,unsigned nCssYInd,short int nDcOffset)
+{
+	unsigned	nChan;
+
+	// Convert from Component index (1-based) to Channel index (0-based)
+	// Component index is direct from SOF/SOS
+	// Channel index is used for internal display representation
+	if (nComp <= 0) {
+#ifdef DEBUG_LOG
+		CString	strTmp;
+		CString	strDebug;
+		strTmp.Format(_T("SetFullRes() with nComp <= 0 [%d]"),nComp);
+		strDebug.Format(_T("## File=[%-100s] Block=[%-10s] Error=[%s]\n"),(LPCTSTR)m_pAppConfig->strCurFname,
+			_T("ImgDecode"),(LPCTSTR)strTmp);
+		OutputDebugString(strDebug);
+#else
+		ASSERT(false);
+#endif
+		return;
+	}
+	nChan = nComp - 1;
+
+	// Select the pixel plane for the component
+	if (nChan > CHAN_K) {
+		ASSERT(false);
+		return;
+	}
+	PixPlane*	psPlane = &m_asPixPlane[nChan];
+
+	// NOTE: These range checks were already done in DecodeScanImg()
+	ASSERT(nCssXInd<MAX_SAMP_FACT_H);
+	ASSERT(nCssYInd<MAX_SAMP_FACT_V);
+
+	// Calculate the linear plane offset for the top-left corner of the block in the MCU
+	unsigned	nOffsetBlkCorner = PlaneBlkOffset(nChan,
+		nMcuX*m_anSampPerMcuH[nComp] + nCssXInd,nMcuY*m_anSampPerMcuV[nComp] + nCssYInd);
+
+	SetFullResBlk(psPlane->pnPix,nOffsetBlkCorner,psPlane->nW,nDcOffset);
+}
+
+// Transfer one level-shifted block into a component's pixel plane
+// - In scaled decode the block is (8>>m_nScaleShift) pixels square
+//
+// INPUT:
+// - pPixVal				= Pixel plane for the component
+// - nOffsetBlkCorner		= Linear offset to top-left corner of block
+// - nPlaneW				= Width of the pixel plane
+// - nDcOffset				= DC level shift
+// PRE:
+// - DecodeIdctCalc() already called on the block
+//
+void CimgDecode::SetFullResBlk(short int* pPixVal,unsigned nOffsetBlkCorner,unsigned nPlaneW,short int nDcOffset)
+{
+	short int	anPix[DCT_SZ_ALL];
+	unsigned	nBlkSz = BLK_SZ_X >> m_nScaleShift;	// Block size in pixel plane
+
+	// In the pipelined decode the IDCT is done later by the IDCT stage
+	if (m_psPipeBatch) {
+		PipeAddBlock(pPixVal,nOffsetBlkCorner,nPlaneW,nDcOffset);
+		return;
+	}
+
+	// Fetch the pixel values from the IDCT block with DC level shift
+	LevelShiftBlock(nDcOffset,anPix);
+
+	for (unsigned nY=0;nY<nBlkSz;nY++) {
+		memcpy(&pPixVal[nOffsetBlkCorner],&anPix[nY*nBlkSz],nBlkSz*sizeof(short int));
+		nOffsetBlkCorner += nPlaneW;
+	}
+}
+
+
+
+
+// Calculates the actual byte offset (from start of file) for
+// the current position in the m_nScanBuff.
+//
+// PRE:
+// - m_nScanBuffLoadInd
+// - m_nScanBuffBits
+// - m_anScanBuffPos[]
+// RETURN:
+// - File position
+//
+CString CimgDecode::GetScanBufPos()
+{
+	unsigned nByteInd;
+	unsigned nAlign;
+	GetScanBufInd(nByteInd,nAlign);
+	return GetScanBufPosAt(nByteInd,nAlign);
+}
+
+// Generate a file position string for a saved reservoir position
+//
+// INPUT:
+// - nByteInd		= Reservoir byte index (from GetScanBufInd)
+// - nAlign			= Bit alignment within the byte
+// RETURN:
+// - Formatted string
+//
+CString CimgDecode::GetScanBufPosAt(unsigned nByteInd, unsigned nAlign)
+{
+	return GetScanBufPos(GetScanBufFilePos(nByteInd),nAlign);
+}
+
+// Determine the reservoir position of the next bit to be decoded
+// - This is cheap enough to be sampled per VLC. The actual
+//   file position is resolved later via GetScanBufFilePos()
+//
+// PRE:
+// - m_nScanBuffLoadInd
+// - m_nScanBuffBits
+// OUTPUT:
+// - nByteInd		= Load index of the byte containing the next bit
+// - nAlign			= Bit alignment within that byte (0..7)
+//
+inline void CimgDecode::GetScanBufInd(unsigned &nByteInd,unsigned &nAlign)
+{
+	nByteInd = m_nScanBuffLoadInd - ((m_nScanBuffBits+7)/8);
+	// Bits requested beyond an empty reservoir still advance the alignment
+	nAlign   = (8-(m_nScanBuffBits%8)+m_nScanBuffOverBits)%8;
+}
+
+// Resolve a reservoir byte index into a file offset
+// - The byte must still be held in the position ring, which
+//   covers SCANBUF_POS_RING bytes behind the last byte loaded
+// - If the byte has not yet been loaded (ie. reservoir empty) then
+//   report the next byte to be read from the file, unless the fill
+//   has been halted by a restart marker, in which case the last byte
+//   loaded is reported (as the 32-bit buffer did)
+//
+// INPUT:
+// - nByteInd		= Load index of the byte
+// PRE:
+// - m_anScanBuffPos[]
+// - m_nScanBuffPtr
+// RETURN:
+// - File offset of the byte
+//
+unsigned CimgDecode::GetScanBufFilePos(unsigned nByteInd)
+{
+	if (nByteInd == m_nScanBuffLoadInd) {
+		if ((m_bRestartRead) && (m_nScanBuffLoadInd > 0)) {
+			return m_anScanBuffPos[(nByteInd-1) & SCANBUF_POS_MASK];
+		}
+		return m_nScanBuffPtr;
+	}
+	ASSERT(m_nScanBuffLoadInd-nByteInd <= SCANBUF_POS_RING);
+	return m_anScanBuffPos[nByteInd & SCANBUF_POS_MASK];
+}
+
+// Generate a file position string that also indicates bit alignment
+//
+// INPUT:
+// - pos			= File position (byte)
+// - align			= File position (bit)
+// RETURN:
+// - Formatted string
+//
+CString CimgDecode::GetScanBufPos(unsigned pos, unsigned align)
+{
+	CString strTmp;
+	strTmp.Format(_T("0x%08X.%u"),pos,align);
+	return strTmp;
+}
+
+
+// Test the scan error flag and, if set, report out the position
+//
+// INPUT:
+// - nMcuX				= MCU x coordinate
+// - nMcuY				= MCU y coordinate
+// - nCssIndH			= Chroma subsampling (horizontal)
+// - nCssIndV			= Chroma subsampling (vertical)
+// - nComp				= Image component
+//
+void CimgDecode::CheckScanErrors(unsigned nMcuX,unsigned nMcuY,unsigned nCssIndH,unsigned nCssIndV,unsigned nComp)
+{
+	//unsigned mcu_x_max = (m_nDimX/m_nMcuWidth);
+	//unsigned mcu_y_max = (m_nDimY/m_nMcuHeight);
+
+	// Determine pixel position, taking into account sampling quadrant as well
 	unsigned err_pos_x = m_nMcuWidth*nMcuX  + nCssIndH*BLK_SZ_X;
 	unsigned err_pos_y = m_nMcuHeight*nMcuY + nCssIndV*BLK_SZ_Y;
 
@@ -2686,19 +3855,23 @@ void CimgDecode::PrintDcCumVal(unsigned nMcuX,unsigned nMcuY,int nVal)
 // - m_nDcLum
 // - m_nDcChrCb
 // - m_nDcChrCr
+// - m_nDcK
 // - m_anDcLumCss[]
 // - m_anDcChrCbCss[]
 // - m_anDcChrCrCss[]
+// - m_anDcKCss[]
 //
 void CimgDecode::DecodeRestartDcState()
 {
 	m_nDcLum = 0;
 	m_nDcChrCb = 0;
 	m_nDcChrCr = 0;
+	m_nDcK = 0;
 	for (unsigned nInd=0;nInd<MAX_SAMP_FACT_V*MAX_SAMP_FACT_H;nInd++) {
 		m_anDcLumCss[nInd] = 0;
 		m_anDcChrCbCss[nInd] = 0;
 		m_anDcChrCrCss[nInd] = 0;
+		m_anDcKCss[nInd] = 0;
 	}
 }
 
@@ -2706,1042 +3879,5177 @@ void CimgDecode::DecodeRestartDcState()
 void CimgDecode::SetImageDimensions(unsigned nWidth,unsigned nHeight)
 {
 	m_rectImgBase = CRect(CPoint(0,0),CSize(nWidth,nHeight));
+	// The bitmap is not from a scaled decode
+	m_nScaleShift = SCAN_SCALE_1;
+	m_nPixMapPrecShift = 0;
 }
 
 
-// Process the entire scan segment and optionally render the image
-// - Reset and clear the output structures
-// - Loop through each MCU and read each component
-// - Maintain running DC level accumulator
-// - Call SetFullRes() to transfer IDCT output to YCC Pixel Map
+// Decode one MCU for any sampling layout and store its pixels
+// - Decodes each component block (with IDCT if enabled), maintains the
+//   DC accumulators, and saves the pixel map and the block DC map
+// - Generic version that handles any sampling factors and the detailed
+//   VLC reporting. The common layouts use DecodeScanMcuFixed() instead.
 //
 // INPUT:
-// - nStart					= File position at start of scan
-// - bDisplay				= Generate a preview image?
-// - bQuiet					= Disable output of certain messages during decode?
+// - nMcuX					= MCU X coordinate
+// - nMcuY					= MCU Y coordinate
+// - bDisplay				= Generate the pixel map?
+// - bVlcDump				= Report the variable length codes for this MCU?
+// PRE:
+// - m_anScanDhtTblDc[], m_anScanDhtTblAc[], m_anScanDqtTbl[]
+// RETURN:
+// - Success if all blocks in the MCU decoded without error
 //
-void CimgDecode::DecodeScanImg(unsigned nStart,bool bDisplay,bool bQuiet)
+bool CimgDecode::DecodeScanMcu(unsigned nMcuX,unsigned nMcuY,bool bDisplay,bool bVlcDump)
 {
 	CString		strTmp;
-	bool		bDieOnFirstErr = false; // FIXME: do we want this? It makes it less useful for corrupt jpegs
+	bool		bDscRet;	// Return value for DecodeScanComp()
+	bool		bRet = true;
 
+	// Luminance
+	// If there is chroma subsampling, then this block will have
+	//    (css_x * css_y) luminance blocks to process
+	// We store them all in an array m_anDcLumCss[]
 
-	// Fetch configuration values locally
-	bool		bDumpHistoY		= m_pAppConfig->bDumpHistoY;
-	bool		bDecodeScanAc;
-	unsigned	nScanErrMax		= m_pAppConfig->nErrMaxDecodeScan;
-
-	// Add some extra speed-up in hidden mode (we don't need AC)
-	if (bDisplay) {
-		bDecodeScanAc = m_pAppConfig->bDecodeScanImgAc;
-	} else {
-		bDecodeScanAc = false;
+	// Give separator line between MCUs
+	if (bVlcDump) {
+		m_pLog->AddLine(_T(""));
 	}
-	m_bHistEn		= m_pAppConfig->bHistoEn;
-	m_bStatClipEn	= m_pAppConfig->bStatClipEn;
 
+	// CSS array indices
+	unsigned	nCssIndH;
+	unsigned	nCssIndV;
+	unsigned	nComp;
 
-	unsigned	nPixMapW = 0;
-	unsigned	nPixMapH = 0;
+	// No need to reset the IDCT output matrix for this MCU
+	// since we are going to be generating it here. This help
+	// maintain performance.
 
-	// Reset the decoder state variables
-	Reset();
+	// --------------------------------------------------------------
+	nComp = SCAN_COMP_Y;
 
-	m_nScanErrMax = nScanErrMax;
-	m_bDecodeScanAc = bDecodeScanAc;
+	// Step through the sampling factors per image component
+	// TODO: Could rewrite this to use single loop across each image component
+	for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+		for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
 
-	// Detect the scenario where the image component details haven't been set yet
-	// The image details are set via SetImageDetails()
-	if (!m_bImgDetailsSet) {
-		m_pLog->AddLineErr(_T("*** ERROR: Decoding image before Image components defined ***"));
-		return;
-	}
+			if (!bVlcDump) {
+				bDscRet = DecodeScanComp(m_anScanDhtTblDc[SCAN_COMP_Y],m_anScanDhtTblAc[SCAN_COMP_Y],m_anScanDqtTbl[SCAN_COMP_Y],nMcuX,nMcuY);// Lum DC+AC
+			} else {
+				bDscRet = DecodeScanCompPrint(m_anScanDhtTblDc[SCAN_COMP_Y],m_anScanDhtTblAc[SCAN_COMP_Y],m_anScanDqtTbl[SCAN_COMP_Y],nMcuX,nMcuY);// Lum DC+AC
+			}
+			if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,nComp);
+			if (!bDscRet) bRet = false;
+
+			// The DCT Block matrix has already been dezigzagged
+			// and multiplied against quantization table entry
+			m_nDcLum += m_anDctBlock[DCT_COEFF_DC];
+
+			if (bVlcDump) {
+//						PrintDcCumVal(nMcuX,nMcuY,m_nDcLum);
+			}
 
+			// Now take a snapshot of the current cumulative DC value
+			m_anDcLumCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcLum;
 
+			// At this point we have one of the luminance comps
+			// fully decoded (with IDCT if enabled). The result is
+			// currently in the array: m_afIdctBlock[]
+			// The next step would be to move these elements into
+			// the 3-channel MCU image map
 
-	// Even though we support decoding of MAX_SOS_COMP_NS we limit
-	// the component flexibility further
-	if ( (m_nNumSosComps != NUM_CHAN_GRAYSCALE) && (m_nNumSosComps != NUM_CHAN_YCC) ) {
-		strTmp.Format(_T("  NOTE: Number of SOS components not supported [%u]"),m_nNumSosComps);
-		m_pLog->AddLineWarn(strTmp);
-#ifndef DEBUG_YCCK
-		return;
+			// Store the pixels associated with this channel into
+			// the full-res pixel map. IDCT has already been computed
+			// on the 8x8 (or larger) MCU block region.
+
+#if 1
+			if (bDisplay)
+				SetFullRes(nMcuX,nMcuY,nComp,nCssIndH,nCssIndV,m_nDcLum);
+#else
+			// FIXME
+			// Temporarily experiment with trying to handle multiple scans
+			// by converting sampling factor of luminance scan back to 1x1
+			unsigned nNewMcuX,nNewMcuY,nNewCssX,nNewCssY;
+			if (nCssIndV == 0) {
+				if (nMcuX < m_nMcuXMax/2) {
+					nNewMcuX = nMcuX;
+					nNewMcuY = nMcuY;
+					nNewCssY = 0;
+				} else {
+					nNewMcuX = nMcuX - (m_nMcuXMax/2);
+					nNewMcuY = nMcuY;
+					nNewCssY = 1;
+				}
+				nNewCssX = nCssIndH;
+				SetFullRes(nNewMcuX,nNewMcuY,SCAN_COMP_Y,nNewCssX,nNewCssY,m_nDcLum);
+			} else {
+				nNewMcuX = (nMcuX / 2) + 1;
+				nNewMcuY = (nMcuY / 2);
+				nNewCssX = nCssIndH;
+				nNewCssY = nMcuY % 2;
+			}
 #endif
+
+			// ---------------
+
+			// TODO: Counting pixels makes assumption that luminance is
+			// not subsampled, so we increment by 64.
+			m_nNumPixels += BLK_SZ_X*BLK_SZ_Y;
+
+		}
 	}
 
-	// Determine the maximum sampling factor and min sampling factor for this scan
-	m_nSosSampFactHMax = 0;
-	m_nSosSampFactVMax = 0;
-	m_nSosSampFactHMin = 0xFF;
-	m_nSosSampFactVMin = 0xFF;
+	// In a grayscale image, we don't do this part!
+	//if (m_nNumSofComps == NUM_CHAN_YCC) {
+	if (m_nNumSosComps >= NUM_CHAN_YCC) {
 
-	for (unsigned nComp=1;nComp<=m_nNumSosComps;nComp++) {
-		m_nSosSampFactHMax = max(m_nSosSampFactHMax,m_anSofSampFactH[nComp]);
-		m_nSosSampFactVMax = max(m_nSosSampFactVMax,m_anSofSampFactV[nComp]);
-		m_nSosSampFactHMin = min(m_nSosSampFactHMin,m_anSofSampFactH[nComp]);
-		m_nSosSampFactVMin = min(m_nSosSampFactVMin,m_anSofSampFactV[nComp]);
-		ASSERT(m_nSosSampFactHMin != 0);
-		ASSERT(m_nSosSampFactVMin != 0);
-	}
+		// --------------------------------------------------------------
+		nComp = SCAN_COMP_CB;
 
+		// Chrominance Cb
+		for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+			for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
 
-	// ITU-T.81 clause A.2.2 "Non-interleaved order (Ns=1)"
-	// - In some cases an image may have a single component in a scan but with sampling factors other than 1:
-	//     Number of Img components = 1
-	//       Component[1]: ID=0x01, Samp Fac=0x22 (Subsamp 1 x 1), Quant Tbl Sel=0x00 (Lum: Y)
-	// - This could either be in a 3-component SOF with multiple 1-component SOS or a 1-component SOF (monochrome image)
-	// - In general, grayscale images exhibit a sampling factor of 0x11
-	// - Per ITU-T.81 A.2.2:
-	//     When Ns = 1 (where Ns is the number of components in a scan), the order of data units
-	//     within a scan shall be left-to-right and top-to-bottom, as shown in Figure A.2. This
-	//     ordering applies whenever Ns = 1, regardless of the values of H1 and V1.
-	// - Thus, instead of the usual decoding sequence for 0x22:
-	//   [ 0 1 ] [ 4 5 ]
-	//   [ 2 3 ] [ 6 7 ]
-	// - The sequence for decode should be:
-	//   [ 0 ] [ 1 ] [ 2 ] [ 3 ] [ 4 ] ...
-	// - Which is equivalent to the non-subsampled ordering (ie. 0x11)
-	// - Apply a correction for such images to remove the sampling factor
-	if ( m_nNumSosComps == 1) {
-		// TODO: Need to confirm if component index needs to be looked up
-		// in the case of multiple SOS or if [1] is the correct index
-		if ( (m_anSofSampFactH[1] != 1) || (m_anSofSampFactV[1] != 1) ) {
-			m_pLog->AddLineWarn(_T("    Altering sampling factor for single component scan to 0x11"));
-		}
-		m_anSofSampFactH[1] = 1;
-		m_anSofSampFactV[1] = 1;
-		m_nSosSampFactHMax = 1;
-		m_nSosSampFactVMax = 1;
-		m_nSosSampFactHMin = 1;
-		m_nSosSampFactVMin = 1;
-	}
+				if (!bVlcDump) {
+					bDscRet = DecodeScanComp(m_anScanDhtTblDc[SCAN_COMP_CB],m_anScanDhtTblAc[SCAN_COMP_CB],m_anScanDqtTbl[SCAN_COMP_CB],nMcuX,nMcuY);// Chr Cb DC+AC
+				} else {
+					bDscRet = DecodeScanCompPrint(m_anScanDhtTblDc[SCAN_COMP_CB],m_anScanDhtTblAc[SCAN_COMP_CB],m_anScanDqtTbl[SCAN_COMP_CB],nMcuX,nMcuY);// Chr Cb DC+AC
+				}
+				if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,nComp);
+				if (!bDscRet) bRet = false;
 
+				m_nDcChrCb += m_anDctBlock[DCT_COEFF_DC];
 
-	// Perform additional range checks
-	if ( (m_nSosSampFactHMax==0) || (m_nSosSampFactVMax==0) || (m_nSosSampFactHMax>MAX_SAMP_FACT_H) || (m_nSosSampFactVMax>MAX_SAMP_FACT_V)) {
-		strTmp.Format(_T("  NOTE: Degree of subsampling factor not supported [HMax=%u, VMax=%u]"),m_nSosSampFactHMax,m_nSosSampFactVMax);
-		m_pLog->AddLineWarn(strTmp);
-		return;
-	}
 
-	// Calculate the MCU size for this scan. We do it here rather
-	// than at the time of SOF (ie. SetImageDetails) for the reason
-	// that under some circumstances we need to override the sampling
-	// factor in single-component scans. This is done earlier.
-	m_nMcuWidth = m_nSosSampFactHMax * BLK_SZ_X;
-	m_nMcuHeight = m_nSosSampFactVMax * BLK_SZ_Y;
+				if (bVlcDump) {
+					//PrintDcCumVal(nMcuX,nMcuY,m_nDcChrCb);
+				}
 
+				// Now take a snapshot of the current cumulative DC value
+				m_anDcChrCbCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcChrCb;
 
-	// Calculate the number of bits to replicate when we generate the pixel map
-	for (unsigned nComp=1;nComp<=m_nNumSosComps;nComp++) {
-		m_anExpandBitsMcuH[nComp] = m_nSosSampFactHMax / m_anSofSampFactH[nComp];
-		m_anExpandBitsMcuV[nComp] = m_nSosSampFactVMax / m_anSofSampFactV[nComp];
-	}
+				// Store fullres value
+				if (bDisplay)
+					SetFullRes(nMcuX,nMcuY,nComp,nCssIndH,nCssIndV,m_nDcChrCb);
 
-	// Calculate the number of component samples per MCU
-	for (unsigned nComp=1;nComp<=m_nNumSosComps;nComp++) {
-		m_anSampPerMcuH[nComp] = m_anSofSampFactH[nComp];
-		m_anSampPerMcuV[nComp] = m_anSofSampFactV[nComp];
-	}
+			}
+		}
 
+		// --------------------------------------------------------------
+		nComp = SCAN_COMP_CR;
 
-	// Determine the MCU ranges
-	m_nMcuXMax   = (m_nDimX/m_nMcuWidth);
-	m_nMcuYMax   = (m_nDimY/m_nMcuHeight);
+		// Chrominance Cr
+		for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+			for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+				if (!bVlcDump) {
+					bDscRet = DecodeScanComp(m_anScanDhtTblDc[SCAN_COMP_CR],m_anScanDhtTblAc[SCAN_COMP_CR],m_anScanDqtTbl[SCAN_COMP_CR],nMcuX,nMcuY);// Chr Cr DC+AC
+				} else {
+					bDscRet = DecodeScanCompPrint(m_anScanDhtTblDc[SCAN_COMP_CR],m_anScanDhtTblAc[SCAN_COMP_CR],m_anScanDqtTbl[SCAN_COMP_CR],nMcuX,nMcuY);// Chr Cr DC+AC
+				}
+				if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,nComp);
+				if (!bDscRet) bRet = false;
 
-	m_nImgSizeXPartMcu = m_nMcuXMax * m_nMcuWidth;
-	m_nImgSizeYPartMcu = m_nMcuYMax * m_nMcuHeight;
+				m_nDcChrCr += m_anDctBlock[DCT_COEFF_DC];
 
-	// Detect incomplete (partial) MCUs and round-up the MCU
-	// ranges if necessary.
-	if ((m_nDimX%m_nMcuWidth) != 0) m_nMcuXMax++;
-	if ((m_nDimY%m_nMcuHeight) != 0) m_nMcuYMax++;
 
-	// Save the maximum 8x8 block dimensions
-	m_nBlkXMax = m_nMcuXMax * m_nSosSampFactHMax;
-	m_nBlkYMax = m_nMcuYMax * m_nSosSampFactVMax;
 
+				if (bVlcDump) {
+					//PrintDcCumVal(nMcuX,nMcuY,m_nDcChrCr);
+				}
 
-	// Ensure the image has a size
-	if ( (m_nBlkXMax == 0) || (m_nBlkYMax == 0) ) {
-		return;
-	}
+				// Now take a snapshot of the current cumulative DC value
+				m_anDcChrCrCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcChrCr;
 
-	// Set the decoded size and before scaling
-	m_nImgSizeX = m_nMcuXMax * m_nMcuWidth;
-	m_nImgSizeY = m_nMcuYMax * m_nMcuHeight;
+				// Store fullres value
+				if (bDisplay)
+					SetFullRes(nMcuX,nMcuY,nComp,nCssIndH,nCssIndV,m_nDcChrCr);
 
-	m_rectImgBase = CRect(CPoint(0,0),CSize(m_nImgSizeX,m_nImgSizeY));
+			}
+		}
 
 
-	// Determine decoding range
-	unsigned	nDecMcuRowStart;
-	unsigned	nDecMcuRowEnd;		// End to AC scan decoding
-	unsigned	nDecMcuRowEndFinal; // End to general decoding
-	nDecMcuRowStart = 0;
-	nDecMcuRowEnd = m_nMcuYMax;
-	nDecMcuRowEndFinal = m_nMcuYMax;
+	}
+	// Black K (after Y,Cb,Cr or C,M,Y)
+	if (m_nNumSosComps == NUM_CHAN_YCCK) {
 
-	// Limit the decoding range to valid range
-	nDecMcuRowEnd = min(nDecMcuRowEnd,m_nMcuYMax);
-	nDecMcuRowEndFinal = min(nDecMcuRowEndFinal,m_nMcuYMax);
+		// --------------------------------------------------------------
+		nComp = SCAN_COMP_K;
 
+		for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+			for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+				if (!bVlcDump) {
+					bDscRet = DecodeScanComp(m_anScanDhtTblDc[SCAN_COMP_K],m_anScanDhtTblAc[SCAN_COMP_K],m_anScanDqtTbl[SCAN_COMP_K],nMcuX,nMcuY);// K DC+AC
+				} else {
+					bDscRet = DecodeScanCompPrint(m_anScanDhtTblDc[SCAN_COMP_K],m_anScanDhtTblAc[SCAN_COMP_K],m_anScanDqtTbl[SCAN_COMP_K],nMcuX,nMcuY);// K DC+AC
+				}
+				if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,nComp);
+				if (!bDscRet) bRet = false;
 
-	// Allocate the MCU File Map
-	ASSERT(m_pMcuFileMap == NULL);
-	m_pMcuFileMap = new unsigned[m_nMcuYMax*m_nMcuXMax];
-	if (!m_pMcuFileMap) {
-		strTmp = _T("ERROR: Not enough memory for Image Decoder MCU File Pos Map");
-		m_pLog->AddLineErr(strTmp);
-		if (m_pAppConfig->bInteractive)
-			AfxMessageBox(strTmp);
-		return;
-	}
-	memset(m_pMcuFileMap, 0, (m_nMcuYMax*m_nMcuXMax*sizeof(unsigned)) );
+				m_nDcK += m_anDctBlock[DCT_COEFF_DC];
 
+				// Now take a snapshot of the current cumulative DC value
+				m_anDcKCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcK;
 
-	// Allocate the 8x8 Block DC Map
-	m_pBlkDcValY  = new short[m_nBlkYMax*m_nBlkXMax];
-	if ( (!m_pBlkDcValY) ) {
-		strTmp = _T("ERROR: Not enough memory for Image Decoder Blk DC Value Map");
-		m_pLog->AddLineErr(strTmp);
-		if (m_pAppConfig->bInteractive)
-			AfxMessageBox(strTmp);
-		return;
-	}
-	if (m_nNumSosComps == NUM_CHAN_YCC) {
-		m_pBlkDcValCb = new short[m_nBlkYMax*m_nBlkXMax];
-		m_pBlkDcValCr = new short[m_nBlkYMax*m_nBlkXMax];
-		if ( (!m_pBlkDcValCb) || (!m_pBlkDcValCr) ) {
-			strTmp = _T("ERROR: Not enough memory for Image Decoder Blk DC Value Map");
-			m_pLog->AddLineErr(strTmp);
-			if (m_pAppConfig->bInteractive)
-				AfxMessageBox(strTmp);
-			return;
+				// Store fullres value
+				if (bDisplay)
+					SetFullRes(nMcuX,nMcuY,nComp,nCssIndH,nCssIndV,m_nDcK);
+
+			}
 		}
 	}
 
-	memset(m_pBlkDcValY,  0, (m_nBlkYMax*m_nBlkXMax*sizeof(short)) );
-	if (m_nNumSosComps == NUM_CHAN_YCC) {
-		memset(m_pBlkDcValCb, 0, (m_nBlkYMax*m_nBlkXMax*sizeof(short)) );
-		memset(m_pBlkDcValCr, 0, (m_nBlkYMax*m_nBlkXMax*sizeof(short)) );
-	}
+	// --------------------------------------------------------------------
 
-	// Allocate the real YCC pixel Map
-	nPixMapH = m_nBlkYMax*BLK_SZ_Y;
-	nPixMapW = m_nBlkXMax*BLK_SZ_X;
+	unsigned	nBlkXY;
 
-	// Ensure no image allocated yet
-	ASSERT(m_pPixValY==NULL);
-	if (m_nNumSosComps == NUM_CHAN_YCC) {
-		ASSERT(m_pPixValCb==NULL);
-		ASSERT(m_pPixValCr==NULL);
+	// Now save the DC YCC values (expanded per 8x8 block)
+	// without ranging or translation into RGB.
+	//
+	// We enter this code once per MCU so we need to expand
+	// out to cover all blocks in this MCU.
+
+
+	// --------------------------------------------------------------
+	nComp = SCAN_COMP_Y;
+
+	// Calculate top-left corner of MCU in block map
+	// and then linear offset into block map
+	unsigned   nBlkCornerMcuX,nBlkCornerMcuY,nBlkCornerMcuLinear;
+	nBlkCornerMcuX = nMcuX * m_anSampPerMcuH[nComp];
+	nBlkCornerMcuY = nMcuY * m_anSampPerMcuV[nComp];
+	nBlkCornerMcuLinear = (nBlkCornerMcuY * m_nBlkXMax) + nBlkCornerMcuX;
+
+	// Now step through each block in the MCU per subsampling
+	for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+		for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+			// Calculate upper-left Blk index
+			// FIXME: According to code analysis the following write assignment
+			// to m_pBlkDcValY[] can apparently exceed the buffer bounds (C6386).
+			// I have not yet determined what scenario can lead to
+			// this. So for now, add in specific clause to trap and avoid.
+			nBlkXY = nBlkCornerMcuLinear + (nCssIndV * m_nBlkXMax) + nCssIndH;
+			// FIXME: Temporarily catch any range issue
+			if (nBlkXY >= m_nBlkXMax*m_nBlkYMax) {
+#ifdef DEBUG_LOG
+			CString	strDebug;
+			strTmp.Format(_T("DecodeScanImg() with nBlkXY out of range. nBlkXY=[%u] m_nBlkXMax=[%u] m_nBlkYMax=[%u]"),nBlkXY,m_nBlkXMax,m_nBlkYMax);
+			strDebug.Format(_T("## File=[%-100s] Block=[%-10s] Error=[%s]\n"),(LPCTSTR)m_pAppConfig->strCurFname,
+				_T("ImgDecode"),(LPCTSTR)strTmp);
+			OutputDebugString(strDebug);
+#else
+			ASSERT(false);
+#endif
+			} else {
+				m_pBlkDcValY [nBlkXY] = m_anDcLumCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH];
+			}
+		}
 	}
+	// Only process the chrominance if it is YCC
+	if (m_nNumSosComps >= NUM_CHAN_YCC) {
 
+		// --------------------------------------------------------------
+		nComp = SCAN_COMP_CB;
 
-	// Allocate image (YCC)
-	m_pPixValY  = new short[nPixMapW * nPixMapH];
-	if ( (!m_pPixValY) ) {
-		strTmp = _T("ERROR: Not enough memory for Image Decoder Pixel YCC Value Map");
-		m_pLog->AddLineErr(strTmp);
-		if (m_pAppConfig->bInteractive)
-			AfxMessageBox(strTmp);
-		return;
-	}
-	if (m_nNumSosComps == NUM_CHAN_YCC) {
-		m_pPixValCb = new short[nPixMapW * nPixMapH];
-		m_pPixValCr = new short[nPixMapW * nPixMapH];
-		if ( (!m_pPixValCb) || (!m_pPixValCr) ) {
-			strTmp = _T("ERROR: Not enough memory for Image Decoder Pixel YCC Value Map");
-			m_pLog->AddLineErr(strTmp);
-			if (m_pAppConfig->bInteractive)
-				AfxMessageBox(strTmp);
-			return;
+		for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+			for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+				// Calculate upper-left Blk index
+				nBlkXY = (nMcuY*m_anExpandBitsMcuV[nComp] + nCssIndV)*m_nBlkXMax + (nMcuX*m_anExpandBitsMcuH[nComp] + nCssIndH);
+				// FIXME: Temporarily catch any range issue
+				if (nBlkXY >= m_nBlkXMax*m_nBlkYMax) {
+#ifdef DEBUG_LOG
+					CString	strDebug;
+					strTmp.Format(_T("DecodeScanImg() with nBlkXY out of range. nBlkXY=[%u] m_nBlkXMax=[%u] m_nBlkYMax=[%u]"),nBlkXY,m_nBlkXMax,m_nBlkYMax);
+					strDebug.Format(_T("## File=[%-100s] Block=[%-10s] Error=[%s]\n"),(LPCTSTR)m_pAppConfig->strCurFname,
+						_T("ImgDecode"),(LPCTSTR)strTmp);
+					OutputDebugString(strDebug);
+#else
+					ASSERT(false);
+#endif
+				} else {
+					m_pBlkDcValCb [nBlkXY] = m_anDcChrCbCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH];
+				}
+			}
 		}
-	}
 
-	// Reset pixel map
-	if (bDisplay) {
-		ClrFullRes(nPixMapW,nPixMapH);
-	}
+		// --------------------------------------------------------------
+		nComp = SCAN_COMP_CR;
 
+		for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+			for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+				// Calculate upper-left Blk index
+				nBlkXY = (nMcuY*m_anExpandBitsMcuV[nComp] + nCssIndV)*m_nBlkXMax + (nMcuX*m_anExpandBitsMcuH[nComp] + nCssIndH);
+				// FIXME: Temporarily catch any range issue
+				if (nBlkXY >= m_nBlkXMax*m_nBlkYMax) {
+#ifdef DEBUG_LOG
+					CString	strDebug;
+					strTmp.Format(_T("DecodeScanImg() with nBlkXY out of range. nBlkXY=[%u] m_nBlkXMax=[%u] m_nBlkYMax=[%u]"),nBlkXY,m_nBlkXMax,m_nBlkYMax);
+					strDebug.Format(_T("## File=[%-100s] Block=[%-10s] Error=[%s]\n"),(LPCTSTR)m_pAppConfig->strCurFname,
+						_T("ImgDecode"),(LPCTSTR)strTmp);
+					OutputDebugString(strDebug);
+#else
+					ASSERT(false);
+#endif
+				} else {
+					m_pBlkDcValCr [nBlkXY] = m_anDcChrCrCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH];
+				}
+			}
+		}
+	}
+	if (m_nNumSosComps == NUM_CHAN_YCCK) {
 
-	// -------------------------------------
-	// Allocate the device-independent bitmap (DIB)
+		// --------------------------------------------------------------
+		nComp = SCAN_COMP_K;
 
-	unsigned char *		pDibImgTmpBits = NULL;
-	unsigned			nDibImgRowBytes;
+		for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+			for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+				nBlkXY = (nMcuY*m_anExpandBitsMcuV[nComp] + nCssIndV)*m_nBlkXMax + (nMcuX*m_anExpandBitsMcuH[nComp] + nCssIndH);
+				if (nBlkXY < m_nBlkXMax*m_nBlkYMax) {
+					m_pBlkDcValK [nBlkXY] = m_anDcKCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH];
+				}
+			}
+		}
+	}
 
-	// If a previous bitmap was created, deallocate it and start fresh
-	m_pDibTemp.Kill();
-	m_bDibTempReady = false;
-	m_bPreviewIsJpeg = false;
+	return bRet;
+}
 
-	// Create the DIB
-	// Although we are creating a 32-bit DIB, it should also
-	// work to run in 16- and 8-bit modes
+// Decode one MCU for a common sampling layout and store its pixels
+// - Specialized version of DecodeScanMcu() with the sampling factors
+//   fixed at compile time so that the block loops are unrolled
+// - Chroma (if present) is always 1x1, so the chroma block of the
+//   MCU is at the MCU coordinate in the chroma planes
+// - Detailed VLC reporting is not supported (use DecodeScanMcu)
+//
+// INPUT:
+// - nMcuX					= MCU X coordinate
+// - nMcuY					= MCU Y coordinate
+// - bDisplay				= Generate the pixel map?
+// PRE:
+// - m_eMcuLayout matches the template parameters
+// - m_anScanDhtTblDc[], m_anScanDhtTblAc[], m_anScanDqtTbl[]
+// RETURN:
+// - Success if all blocks in the MCU decoded without error
+//
+template <unsigned nSampH,unsigned nSampV,bool bColor>
+bool CimgDecode::DecodeScanMcuFixed(unsigned nMcuX,unsigned nMcuY,bool bDisplay)
+{
+	bool		bRet = true;
+	unsigned	nBlkMcuX = nMcuX * nSampH;	// Top-left block of the MCU
+	unsigned	nBlkMcuY = nMcuY * nSampV;
+	PixPlane*	psPlaneY = &m_asPixPlane[CHAN_Y];
+
+	ASSERT((nBlkMcuY+nSampV-1)*m_nBlkXMax + nBlkMcuX+nSampH-1 < m_nBlkXMax*m_nBlkYMax);
+
+	// Luminance
+	for (unsigned nCssIndV=0;nCssIndV<nSampV;nCssIndV++) {
+		for (unsigned nCssIndH=0;nCssIndH<nSampH;nCssIndH++) {
+			if (!DecodeScanComp(m_anScanDhtTblDc[SCAN_COMP_Y],m_anScanDhtTblAc[SCAN_COMP_Y],m_anScanDqtTbl[SCAN_COMP_Y],nMcuX,nMcuY)) {
+				bRet = false;
+			}
+			if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,SCAN_COMP_Y);
 
-	bool bDoImage = false;	// Are we safe to set bits?
+			m_nDcLum += m_anDctBlock[DCT_COEFF_DC];
+			m_anDcLumCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcLum;
 
-	if (bDisplay) {
-		m_pDibTemp.CreateDIB(m_nImgSizeX,m_nImgSizeY,32);
-		nDibImgRowBytes = m_nImgSizeX * sizeof(RGBQUAD);
-		pDibImgTmpBits = (unsigned char*) ( m_pDibTemp.GetDIBBitArray() );
+			if (bDisplay) {
+				SetFullResBlk(psPlaneY->pnPix,PlaneBlkOffset(CHAN_Y,nBlkMcuX+nCssIndH,nBlkMcuY+nCssIndV),
+					psPlaneY->nW,m_nDcLum);
+			}
+			m_nNumPixels += BLK_SZ_X*BLK_SZ_Y;
 
-		if (pDibImgTmpBits) {
-			bDoImage = true;
-		} else {
-			// TODO: Should we be exiting here instead?
+			m_pBlkDcValY[(nBlkMcuY+nCssIndV)*m_nBlkXMax + nBlkMcuX+nCssIndH] = m_nDcLum;
 		}
-
 	}
-	// -------------------------------------
 
+	// Chrominance
+	// - One block each, which covers the whole MCU
+	for (unsigned nComp=SCAN_COMP_CB;bColor && (nComp<=SCAN_COMP_CR);nComp++) {
+		if (!DecodeScanComp(m_anScanDhtTblDc[nComp],m_anScanDhtTblAc[nComp],m_anScanDqtTbl[nComp],nMcuX,nMcuY)) {
+			bRet = false;
+		}
+		if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,0,0,nComp);
 
-	CString picStr;
+		signed short&	nDcChr = (nComp == SCAN_COMP_CB) ? m_nDcChrCb : m_nDcChrCr;
+		PixPlane*	psPlane = &m_asPixPlane[nComp-1];
+		short int*	pBlkDcVal = (nComp == SCAN_COMP_CB) ? m_pBlkDcValCb : m_pBlkDcValCr;
+		signed short*	pnDcChrCss = (nComp == SCAN_COMP_CB) ? m_anDcChrCbCss : m_anDcChrCrCss;
 
-	// Reset the DC cumulative state
-	DecodeRestartDcState();
+		nDcChr += m_anDctBlock[DCT_COEFF_DC];
+		pnDcChrCss[0] = nDcChr;
 
-	// Reset the scan buffer
-	DecodeRestartScanBuf(nStart,false);
+		if (bDisplay) {
+			SetFullResBlk(psPlane->pnPix,PlaneBlkOffset(nComp-1,nMcuX,nMcuY),psPlane->nW,nDcChr);
+		}
 
-	// Load the buffer
-	m_pWBuf->BufLoadWindow(nStart);
+		pBlkDcVal[nBlkMcuY*m_nBlkXMax + nBlkMcuX] = nDcChr;
+	}
 
-	// Expect that we start with RST0
-	m_nRestartExpectInd = 0;
-	m_nRestartLastInd = 0;
+	return bRet;
+}
 
-	// Load the first data into the scan buffer
-	// This is done so that the MCU map will already
-	// have access to the data.
-	BuffTopup();
+// Decode a range of MCUs from the scan and store their pixels
+// - Checks for the RSTn marker at the end of each restart interval
+// - If the scan data is bad, the remainder of the MCU row is skipped
+//
+// INPUT:
+// - nMcuBegin				= First MCU to decode (index in raster order)
+// - nMcuEnd				= MCU after the last one to decode
+// - bDisplay				= Generate a preview image?
+// PRE:
+// - Scan buffer and DC state are positioned at the start of nMcuBegin
+// - m_bDecodeScanAc
+// POST:
+// - m_pMcuFileMap
+// - m_psScanCkpt[]
+// - m_nRestartMcusLeft
+// RETURN:
+// - False if the decode should be aborted
+//
+bool CimgDecode::DecodeScanMcuRange(unsigned nMcuBegin,unsigned nMcuEnd,bool bDisplay)
+{
+	CString		strTmp;
+	bool		bDieOnFirstErr = false; // FIXME: do we want this? It makes it less useful for corrupt jpegs
+	bool		bMcuRet;	// Return value for DecodeScanMcu()
+	bool		bScanStop = false;
 
-	if (!bQuiet) {
-		m_pLog->AddLineHdr(_T("*** Decoding SCAN Data ***"));
-		strTmp.Format(_T("  OFFSET: 0x%08X"),nStart);
-		m_pLog->AddLine(strTmp);
-	}
+	for (unsigned nMcuXY=nMcuBegin;nMcuXY<nMcuEnd;nMcuXY++) {
 
+		unsigned	nMcuX = nMcuXY % m_nMcuXMax;
+		unsigned	nMcuY = nMcuXY / m_nMcuXMax;
 
-	// TODO: Might be more appropriate to check against m_nNumSosComps instead?
-	if ( (m_nNumSofComps != NUM_CHAN_GRAYSCALE) && (m_nNumSofComps != NUM_CHAN_YCC) ) {
-		strTmp.Format(_T("  NOTE: Number of Image Components not supported [%u]"),m_nNumSofComps);
-		m_pLog->AddLineWarn(strTmp);
-#ifndef DEBUG_YCCK
+		// Skip the rest of the row after a stop
+		if (nMcuX == 0) {
+			bScanStop = false;
+		}
+		if (bScanStop) {
+			continue;
+		}
+
+		// Check to see if we should expect a restart marker!
+		// FIXME: Should actually check to ensure that we do in
+		// fact get a restart marker, and that it was the right
+		// one!
+		if ((m_bRestartEn) && (m_nRestartMcusLeft == 0)) {
+			// The reservoir is only topped up on demand, so make sure
+			// that it has been filled up to the RST marker (if any).
+			// The marker is only in the expected place if no more
+			// than the padding bits of the last byte remain before it.
+			BuffTopup();
+			/*
+			if (m_bVerbose) {
+				strTmp.Format(_T("  Expect Restart interval elapsed @ %s"),GetScanBufPos());
+				m_pLog->AddLine(strTmp);
+			}
+			*/
+			if ((m_bRestartRead) && (m_nScanBuffBits < 8)) {
+				/*
+				// FIXME: Check for restart counter value match
+				if (m_bVerbose) {
+					strTmp.Format(_T("  Restart marker matched"));
+					m_pLog->AddLine(strTmp);
+				}
+				*/
+			} else {
+				strTmp.Format(_T("  Expect Restart interval elapsed @ %s"),(LPCTSTR)GetScanBufPos());
+				m_pLog->AddLine(strTmp);
+					strTmp.Format(_T("    ERROR: Restart marker not detected"));
+					m_pLog->AddLineErr(strTmp);
+			}
+			/*
+			if (ExpectRestart()) {
+				if (m_bVerbose) {
+					strTmp.Format(_T("  Restart marker detected"));
+					m_pLog->AddLine(strTmp);
+				}
+			} else {
+				strTmp.Format(_T("  ERROR: Restart marker expected but not found @ %s"),GetScanBufPos());
+				m_pLog->AddLineErr(strTmp);
+			}
+			*/
+
+
+		}
+
+		// Mark the start of the MCU in the file map
+		// - The region decode leaves the file map as it is
+		if (m_pMcuFileMap) {
+			unsigned nMcuBufInd,nMcuBufAlign;
+			GetScanBufInd(nMcuBufInd,nMcuBufAlign);
+			m_pMcuFileMap->Set(nMcuXY,(ULONGLONG)GetScanBufFilePos(nMcuBufInd)*8 + nMcuBufAlign);
+		}
+
+		// Save the entropy decoder state for the region decode
+		if ((m_psScanCkpt) && (nMcuXY % m_nScanCkptMcus == 0)) {
+			ScanCkptSave(nMcuXY);
+		}
+
+		// Is this an MCU that we want full printing of decode process?
+		bool		bVlcDump = false;
+		unsigned	nRangeBase;
+		unsigned	nRangeCur;
+		if (m_bDetailVlc) {
+			nRangeBase = (m_nDetailVlcY * m_nMcuXMax) + m_nDetailVlcX;
+			nRangeCur  = nMcuXY;
+			if ( (nRangeCur >= nRangeBase) && (nRangeCur < nRangeBase+m_nDetailVlcLen) ) {
+                bVlcDump = true;
+			}
+		}
+
+		// Decode the MCU and store its pixels
+		// - The detailed VLC report is only supported by the generic decode
+		if (bVlcDump) {
+			bMcuRet = DecodeScanMcu(nMcuX,nMcuY,bDisplay,bVlcDump);
+		} else {
+			switch (m_eMcuLayout) {
+			case MCU_LAYOUT_GRAY:
+				bMcuRet = DecodeScanMcuFixed<1,1,false>(nMcuX,nMcuY,bDisplay);
+				break;
+			case MCU_LAYOUT_444:
+				bMcuRet = DecodeScanMcuFixed<1,1,true>(nMcuX,nMcuY,bDisplay);
+				break;
+			case MCU_LAYOUT_422:
+				bMcuRet = DecodeScanMcuFixed<2,1,true>(nMcuX,nMcuY,bDisplay);
+				break;
+			case MCU_LAYOUT_420:
+				bMcuRet = DecodeScanMcuFixed<2,2,true>(nMcuX,nMcuY,bDisplay);
+				break;
+			default:
+				bMcuRet = DecodeScanMcu(nMcuX,nMcuY,bDisplay,false);
+				break;
+			}
+		}
+		if (!bMcuRet && bDieOnFirstErr) return false;
+
+		// Now that we finished an MCU, decrement the restart interval counter
+		if (m_bRestartEn) {
+			m_nRestartMcusLeft--;
+		}
+
+		// Check to see if we need to abort for some reason.
+		// Note that only check m_bScanEnd if we have a failure.
+		// m_bScanEnd is asserted during normal out-of-data when scan
+		// segment ends with marker. We don't want to abort early
+		// or else we'll not decode the last MCU or two!
+		if (m_bScanEnd && m_bScanBad) {
+			bScanStop = true;
+		}
+
+	} // nMcuXY
+
+	return true;
+}
+
+// Decode the scan with several threads, one range of restart intervals each
+// - The DC predictors and the bit reservoir are reset at every RSTn
+//   marker, so each restart interval can be decoded on its own once
+//   the marker positions are known
+// - A pre-pass locates the markers through the file window. Each
+//   worker range is then copied to memory (up to its closing marker,
+//   within the scan decode memory limit), and a worker decoder (with
+//   its own log and buffer on the copy) decodes the range into its MCUs
+//   of the shared pixel, block DC and MCU file maps. The last range is
+//   decoded here from the file buffer so that the decoder ends in the
+//   same state as after a serial decode.
+// - The serial decode remains the reference for all reporting. If any
+//   marker is missing or out of sequence, or any worker range reports
+//   anything at all, the result is discarded and the caller falls back
+//   to the serial decode.
+//
+// INPUT:
+// - nStart					= File position at start of scan
+// - bDisplay				= Generate a preview image?
+// PRE:
+// - Scan buffer and DC state reset to nStart
+// - m_bDecodeScanAc
+// POST:
+// - m_anDhtHisto[][][]
+// - m_anIdctPathNum[]
+// - m_nNumPixels
+// - m_nRestartRead
+// RETURN:
+// - True if the scan was decoded, false if the serial decode is required
+//
+bool CimgDecode::DecodeScanParallel(unsigned nStart,bool bDisplay)
+{
+	unsigned	nThreads = m_pAppConfig->nDecodeScanThreads;
+	if (nThreads == 0) {
+		nThreads = std::thread::hardware_concurrency();
+	}
+	nThreads = min(nThreads,(unsigned)SCAN_PAR_THREADS_MAX);
+
+	// The detailed VLC report is only supported by the serial decode
+	if ((nThreads < 2) || (!m_bRestartEn) || (m_nRestartInterval == 0) || (m_bDetailVlc)) {
+		return false;
+	}
+	unsigned	nMcuNum = m_nMcuXMax * m_nMcuYMax;
+	unsigned	nIntervalNum = (nMcuNum + m_nRestartInterval - 1) / m_nRestartInterval;
+	if (nIntervalNum < 2) {
+		return false;
+	}
+
+	// Pre-pass: locate the RSTn marker at the end of each interval
+	unsigned*	anRstPos = new unsigned[nIntervalNum];
+	if (!anRstPos) {
+		return false;
+	}
+	if (DecodeScanFindRst(nStart,nIntervalNum-1,anRstPos) != nIntervalNum-1) {
+		delete [] anRstPos;
+		// Leave the window where the serial decode expects it
+		m_pWBuf->BufLoadWindow(nStart);
+		return false;
+	}
+
+	// Split the intervals evenly into one range per thread
+	unsigned	nRangeNum = min(nThreads,nIntervalNum);
+	unsigned	anIntervalBegin[SCAN_PAR_THREADS_MAX+1];
+	for (unsigned nRange=0;nRange<=nRangeNum;nRange++) {
+		anIntervalBegin[nRange] = (unsigned)(((ULONGLONG)nIntervalNum * nRange) / nRangeNum);
+	}
+
+	// Each worker range is decoded from its own copy of the scan data,
+	// up to and including the RSTn marker that ends it. The last range
+	// is decoded from the file window, so the copies take up the scan
+	// data before it. They must fit in the scan decode memory limit,
+	// together with the worker decoders (which share the tables of
+	// this decoder).
+	unsigned	nIntervalLast = anIntervalBegin[nRangeNum-1];
+	ULONGLONG	nCopyLen = (ULONGLONG)(anRstPos[nIntervalLast-1]+2 - nStart);
+	ULONGLONG	nWorkerLen = (ULONGLONG)(nRangeNum-1) * (sizeof(CimgDecode) + sizeof(CwindowBuf) + sizeof(CDocLog));
+	if ((m_pAppConfig->nDecodeScanMemMax != 0) && (nCopyLen + nWorkerLen > ((ULONGLONG)m_pAppConfig->nDecodeScanMemMax << 20))) {
+		delete [] anRstPos;
+		m_pWBuf->BufLoadWindow(nStart);
+		return false;
+	}
+	BYTE*		apScanData[SCAN_PAR_THREADS_MAX];
+	bool		bCopyOk = true;
+	for (unsigned nRange=0;nRange<nRangeNum-1;nRange++) {
+		unsigned	nInterval = anIntervalBegin[nRange];
+		unsigned	nFilePos = (nInterval == 0) ? nStart : anRstPos[nInterval-1]+2;
+		unsigned	nRangeLen = anRstPos[anIntervalBegin[nRange+1]-1]+2 - nFilePos;
+		apScanData[nRange] = (bCopyOk) ? new BYTE[nRangeLen] : NULL;
+		if (apScanData[nRange]) {
+			m_pWBuf->BufLoadWindow(nFilePos);
+			m_pWBuf->BufCopy(nFilePos,nRangeLen,apScanData[nRange]);
+		} else {
+			bCopyOk = false;
+		}
+	}
+	if (!bCopyOk) {
+		for (unsigned nRange=0;nRange<nRangeNum-1;nRange++) {
+			if (apScanData[nRange]) {
+				delete [] apScanData[nRange];
+			}
+		}
+		delete [] anRstPos;
+		m_pWBuf->BufLoadWindow(nStart);
+		return false;
+	}
+
+	SetStatusText(_T("Decoding Scan Data..."));
+
+	// Save the stats that the serial decode would start from
+	unsigned	anDhtHisto[MAX_DHT_CLASS][MAX_DHT_DEST_ID][MAX_DHT_CODELEN+1];
+	unsigned	anIdctPathNum[IDCT_PATH_NUM];
+	unsigned	nWarnBadScanNum = m_nWarnBadScanNum;
+	unsigned	nRestartRead = m_nRestartRead;
+	memcpy(anDhtHisto,m_anDhtHisto,sizeof(anDhtHisto));
+	memcpy(anIdctPathNum,m_anIdctPathNum,sizeof(anIdctPathNum));
+	// The initial top-up may have already counted the first marker
+	if (m_bRestartRead) {
+		nRestartRead--;
+	}
+
+	CDocLog*	apLog[SCAN_PAR_THREADS_MAX];
+	CwindowBuf*	apWBuf[SCAN_PAR_THREADS_MAX];
+	CimgDecode*	apWorker[SCAN_PAR_THREADS_MAX];
+	std::thread	aThread[SCAN_PAR_THREADS_MAX];
+
+	// Start the workers on all but the last range
+	for (unsigned nRange=0;nRange<nRangeNum-1;nRange++) {
+		unsigned	nInterval = anIntervalBegin[nRange];
+		unsigned	nFilePos = (nInterval == 0) ? nStart : anRstPos[nInterval-1]+2;
+		unsigned	nMcuBegin = nInterval * m_nRestartInterval;
+		unsigned	nMcuEnd = anIntervalBegin[nRange+1] * m_nRestartInterval;
+		unsigned	nRangeLen = anRstPos[anIntervalBegin[nRange+1]-1]+2 - nFilePos;
+
+		apLog[nRange] = new CDocLog();
+		apWBuf[nRange] = new CwindowBuf();
+		apWBuf[nRange]->BufMemSet(apScanData[nRange],nFilePos,nRangeLen);
+		apWorker[nRange] = new CimgDecode(apLog[nRange],apWBuf[nRange],this);
+		apWorker[nRange]->m_pMcuFileMap = new CMcuFileMap();
+		apWorker[nRange]->m_pMcuFileMap->Alloc(nMcuBegin,nMcuEnd);
+
+		try {
+			aThread[nRange] = std::thread(&CimgDecode::DecodeScanInterval,apWorker[nRange],
+				nFilePos,nInterval,nMcuBegin,nMcuEnd,bDisplay,false);
+		} catch (...) {
+			// No thread available, so decode the range now
+			apWorker[nRange]->DecodeScanInterval(nFilePos,nInterval,nMcuBegin,nMcuEnd,bDisplay,false);
+		}
+	}
+
+	// Decode the last range here. Its log is held back until the
+	// worker ranges (which come before it) are known to be good.
+	// Each range writes its own MCU file map, as the map must be
+	// written in MCU order.
+	CDocLog		oLogLast;
+	CDocLog*	pLogMain = m_pLog;
+	CMcuFileMap*	pMcuFileMapMain = m_pMcuFileMap;
+	CMcuFileMap		oMcuFileMapLast;
+	oMcuFileMapLast.Alloc(nIntervalLast*m_nRestartInterval,nMcuNum);
+	m_pLog = &oLogLast;
+	m_pMcuFileMap = &oMcuFileMapLast;
+	DecodeScanInterval(anRstPos[nIntervalLast-1]+2,nIntervalLast,nIntervalLast*m_nRestartInterval,nMcuNum,bDisplay,true);
+	m_pMcuFileMap = pMcuFileMapMain;
+	m_pLog = pLogMain;
+
+	bool	bParallelOk = true;
+	for (unsigned nRange=0;nRange<nRangeNum-1;nRange++) {
+		if (aThread[nRange].joinable()) {
+			aThread[nRange].join();
+		}
+		if (!apWorker[nRange]->m_bScanIntervalOk) {
+			bParallelOk = false;
+		}
+	}
+
+	if (bParallelOk) {
+		// Merge the worker stats
+		for (unsigned nRange=0;nRange<nRangeNum-1;nRange++) {
+			CimgDecode*	pWorker = apWorker[nRange];
+			for (unsigned nClass=0;nClass<MAX_DHT_CLASS;nClass++) {
+				for (unsigned nTbl=0;nTbl<MAX_DHT_DEST_ID;nTbl++) {
+					for (unsigned nBitLen=0;nBitLen<=MAX_DHT_CODELEN;nBitLen++) {
+						m_anDhtHisto[nClass][nTbl][nBitLen] += pWorker->m_anDhtHisto[nClass][nTbl][nBitLen];
+					}
+				}
+			}
+			for (unsigned nPath=0;nPath<IDCT_PATH_NUM;nPath++) {
+				m_anIdctPathNum[nPath] += pWorker->m_anIdctPathNum[nPath];
+			}
+			m_nNumPixels += pWorker->m_nNumPixels;
+		}
+		// Join the MCU file maps. The first MCU of each range after the
+		// first is mapped to the end of the previous range (before its
+		// RSTn marker), as the serial decode would.
+		m_pMcuFileMap->Clear();
+		for (unsigned nRange=0;nRange<nRangeNum;nRange++) {
+			const CMcuFileMap*	pRangeMap = (nRange < nRangeNum-1) ? apWorker[nRange]->m_pMcuFileMap : &oMcuFileMapLast;
+			unsigned			nMcuBegin = anIntervalBegin[nRange] * m_nRestartInterval;
+			ULONGLONG			nBitPosFirst = (nRange == 0) ? pRangeMap->Get(nMcuBegin) : apWorker[nRange-1]->m_nScanIntervalEndPos;
+			m_pMcuFileMap->Append(pRangeMap,nBitPosFirst);
+		}
+		// Every marker before the last range was read
+		m_nRestartRead = nRestartRead + (nIntervalNum-1);
+		m_pLog->AddLog(&oLogLast);
+	} else {
+		// Discard the result and prepare for the serial decode
+		memcpy(m_anDhtHisto,anDhtHisto,sizeof(anDhtHisto));
+		memcpy(m_anIdctPathNum,anIdctPathNum,sizeof(anIdctPathNum));
+		m_nWarnBadScanNum = nWarnBadScanNum;
+		m_nRestartRead = nRestartRead;
+		m_nNumPixels = 0;
+
+		m_pMcuFileMap->Clear();
+		memset(m_pBlkDcValY,0,(m_nBlkYMax*m_nBlkXMax*sizeof(short)));
+		if (m_nNumSosComps >= NUM_CHAN_YCC) {
+			memset(m_pBlkDcValCb,0,(m_nBlkYMax*m_nBlkXMax*sizeof(short)));
+			memset(m_pBlkDcValCr,0,(m_nBlkYMax*m_nBlkXMax*sizeof(short)));
+		}
+		if (m_nNumSosComps == NUM_CHAN_YCCK) {
+			memset(m_pBlkDcValK,0,(m_nBlkYMax*m_nBlkXMax*sizeof(short)));
+		}
+		if (m_psScanCkpt) {
+			memset(m_psScanCkpt,0,(m_nScanCkptNum*sizeof(ScanCkpt)));
+		}
+		if (bDisplay) {
+			ClrFullRes();
+		}
+
+		DecodeRestartDcState();
+		DecodeRestartScanBuf(nStart,false);
+		m_pWBuf->BufLoadWindow(nStart);
+		m_nRestartExpectInd = 0;
+		m_nRestartLastInd = 0;
+		BuffTopup();
+	}
+
+	for (unsigned nRange=0;nRange<nRangeNum-1;nRange++) {
+		delete apWorker[nRange]->m_pMcuFileMap;
+		apWorker[nRange]->m_pMcuFileMap = NULL;
+		apWorker[nRange]->ScanWorkerDetach();
+		delete apWorker[nRange];
+		delete apWBuf[nRange];
+		delete apLog[nRange];
+		delete [] apScanData[nRange];
+	}
+	delete [] anRstPos;
+
+	return bParallelOk;
+}
+
+// Locate the RSTn markers in the scan data
+// - Follows the marker handling of BuffAddByte(): stuff bytes and
+//   fill bytes are skipped and any other marker ends the scan
+// - Stops after nRstMax markers or at the first marker that is
+//   out of sequence
+// - The scan data is read through the file window one chunk at a
+//   time, so only a chunk is held in memory
+//
+// INPUT:
+// - nStart					= File position at start of scan
+// - nRstMax				= Number of markers to locate
+// OUTPUT:
+// - anRstPos[]				= File position of each RSTn marker
+// RETURN:
+// - Number of markers found
+//
+unsigned CimgDecode::DecodeScanFindRst(unsigned nStart,unsigned nRstMax,unsigned* anRstPos)
+{
+	unsigned long	nPosEof = m_pWBuf->GetPosEof();
+	unsigned		nRstNum = 0;
+	unsigned		nPos = nStart;
+	bool			bDone = (nRstMax == 0);
+
+	if (nStart >= nPosEof) {
+		return 0;
+	}
+	BYTE*	pChunk = new BYTE[SCAN_PAR_COPY_CHUNK];
+	if (!pChunk) {
+		return 0;
+	}
+
+	// A 0xFF is only checked once the byte after it has been loaded, so
+	// each chunk starts at the first byte that hasn't been checked
+	while ((!bDone) && (nPos+1 < nPosEof)) {
+		unsigned	nChunkLen = min((unsigned)SCAN_PAR_COPY_CHUNK,(unsigned)(nPosEof-nPos));
+		unsigned	nInd = 0;
+		m_pWBuf->BufLoadWindow(nPos);
+		m_pWBuf->BufCopy(nPos,nChunkLen,pChunk);
+
+		while ((!bDone) && (nInd+1 < nChunkLen)) {
+			BYTE*	pFf = (BYTE*)memchr(&pChunk[nInd],0xFF,nChunkLen-1-nInd);
+			if (!pFf) {
+				nInd = nChunkLen-1;
+				break;
+			}
+			nInd = (unsigned)(pFf - pChunk);
+			BYTE	nMarker = pChunk[nInd+1];
+			if (nMarker == 0x00) {
+				// Byte stuff
+				nInd += 2;
+			} else if (nMarker == 0xFF) {
+				// Fill byte
+				nInd += 1;
+			} else if ((nMarker >= JFIF_RST0) && (nMarker <= JFIF_RST7) && (nMarker-JFIF_RST0 == nRstNum%8)) {
+				anRstPos[nRstNum++] = nPos+nInd;
+				nInd += 2;
+				bDone = (nRstNum == nRstMax);
+			} else {
+				// End of scan (or marker out of sequence)
+				bDone = true;
+			}
+		}
+		nPos += nInd;
+	}
+
+	delete [] pChunk;
+	return nRstNum;
+}
+
+// Decode a range of restart intervals (see DecodeScanParallel)
+//
+// INPUT:
+// - nFilePos				= File position of the first interval
+// - nInterval				= Index of the first interval
+// - nMcuBegin				= First MCU of the range
+// - nMcuEnd				= MCU after the last one in the range
+// - bDisplay				= Generate a preview image?
+// - bLast					= Range ends at the end of the scan?
+// POST:
+// - m_bScanIntervalOk		= Range decoded without any report and (unless
+//                            bLast) ends at the next RSTn marker
+// - m_nScanIntervalEndPos	= Position (bits) of the MCU after the range
+//
+void CimgDecode::DecodeScanInterval(unsigned nFilePos,unsigned nInterval,unsigned nMcuBegin,unsigned nMcuEnd,bool bDisplay,bool bLast)
+{
+	DecodeRestartDcState();
+	DecodeRestartScanBuf(nFilePos,true);
+	m_nRestartExpectInd = nInterval % 8;
+	m_nRestartLastInd = (nInterval + 7) % 8;
+	BuffTopup();
+
+	bool	bOk = DecodeScanMcuRange(nMcuBegin,nMcuEnd,bDisplay);
+	if (!bLast) {
+		// The range must end exactly at the next marker
+		BuffTopup();
+		if ((!m_bRestartRead) || (m_nScanBuffBits >= 8)) {
+			bOk = false;
+		}
+		// The serial decode only processes the marker when it decodes the
+		// next MCU, so it maps that MCU to the current (padding) position
+		unsigned nMcuBufInd,nMcuBufAlign;
+		GetScanBufInd(nMcuBufInd,nMcuBufAlign);
+		m_nScanIntervalEndPos = (ULONGLONG)GetScanBufFilePos(nMcuBufInd)*8 + nMcuBufAlign;
+		if (m_pLog->GetNumLinesLocal() > 0) {
+			bOk = false;
+		}
+	}
+	m_bScanIntervalOk = bOk;
+}
+
+// Prepare a worker decoder for DecodeScanInterval()
+// - Called by the constructor of a worker decoder
+// - Copies the scan parameters from the main decoder
+// - The output maps are shared with the main decoder. Each worker
+//   only writes the entries of its own MCUs.
+// - All scan errors are reported so that the worker result can be
+//   discarded on any error
+//
+// INPUT:
+// - pMain					= Main decoder, set up for the scan
+//
+void CimgDecode::ScanWorkerAttach(const CimgDecode* pMain)
+{
+	m_nPrecision = pMain->m_nPrecision;
+	m_nNumSosComps = pMain->m_nNumSosComps;
+	m_nNumSofComps = pMain->m_nNumSofComps;
+	m_nDimX = pMain->m_nDimX;
+	m_nDimY = pMain->m_nDimY;
+	m_nMcuWidth = pMain->m_nMcuWidth;
+	m_nMcuHeight = pMain->m_nMcuHeight;
+	m_nMcuXMax = pMain->m_nMcuXMax;
+	m_nMcuYMax = pMain->m_nMcuYMax;
+	m_nBlkXMax = pMain->m_nBlkXMax;
+	m_nBlkYMax = pMain->m_nBlkYMax;
+	m_nPixMapW = pMain->m_nPixMapW;
+	m_nPixMapH = pMain->m_nPixMapH;
+	m_nScaleShift = pMain->m_nScaleShift;
+	m_nPixMapPrecShift = pMain->m_nPixMapPrecShift;
+	m_eMcuLayout = pMain->m_eMcuLayout;
+	memcpy(m_anSampPerMcuH,pMain->m_anSampPerMcuH,sizeof(m_anSampPerMcuH));
+	memcpy(m_anSampPerMcuV,pMain->m_anSampPerMcuV,sizeof(m_anSampPerMcuV));
+	memcpy(m_anExpandBitsMcuH,pMain->m_anExpandBitsMcuH,sizeof(m_anExpandBitsMcuH));
+	memcpy(m_anExpandBitsMcuV,pMain->m_anExpandBitsMcuV,sizeof(m_anExpandBitsMcuV));
+	memcpy(m_anScanDhtTblDc,pMain->m_anScanDhtTblDc,sizeof(m_anScanDhtTblDc));
+	memcpy(m_anScanDhtTblAc,pMain->m_anScanDhtTblAc,sizeof(m_anScanDhtTblAc));
+	memcpy(m_anScanDqtTbl,pMain->m_anScanDqtTbl,sizeof(m_anScanDqtTbl));
+	m_bRestartEn = pMain->m_bRestartEn;
+	m_nRestartInterval = pMain->m_nRestartInterval;
+	m_bDecodeScanAc = pMain->m_bDecodeScanAc;
+
+	// The DQT, DHT and IDCT tables are shared (see the constructor)
+	m_pKernels = pMain->m_pKernels;
+
+	// Shared output maps
+	// - The MCU file map is written in order, so each worker has its own
+	m_pMcuFileMap = NULL;
+	m_pBlkDcValY = pMain->m_pBlkDcValY;
+	m_pBlkDcValCb = pMain->m_pBlkDcValCb;
+	m_pBlkDcValCr = pMain->m_pBlkDcValCr;
+	m_pBlkDcValK = pMain->m_pBlkDcValK;
+	memcpy(m_asPixPlane,pMain->m_asPixPlane,sizeof(m_asPixPlane));
+	m_psScanCkpt = pMain->m_psScanCkpt;
+	m_nScanCkptMcus = pMain->m_nScanCkptMcus;
+	m_nScanCkptNum = pMain->m_nScanCkptNum;
+
+	m_nNumPixels = 0;
+	m_nWarnBadScanNum = 0;
+	m_nScanErrMax = 1;
+	m_bScanErrorsDisable = false;
+	m_bScanIntervalOk = false;
+	m_nScanIntervalEndPos = 0;
+}
+
+// Release a worker decoder from the main decoder
+// - The shared output maps belong to the main decoder
+//
+void CimgDecode::ScanWorkerDetach()
+{
+	m_pMcuFileMap = NULL;
+	m_pBlkDcValY = NULL;
+	m_pBlkDcValCb = NULL;
+	m_pBlkDcValCr = NULL;
+	m_pBlkDcValK = NULL;
+	memset(m_asPixPlane,0,sizeof(m_asPixPlane));
+	m_psScanCkpt = NULL;
+	m_nScanCkptNum = 0;
+}
+
+// Control of the pipelined scan decode (DecodeScanPipeline)
+// - All fields are protected by mtx
+struct ScanPipe {
+	std::mutex				mtx;
+	std::condition_variable	cvQueued;		// Batch queued for the IDCT stage (or end)
+	std::condition_variable	cvFree;			// Batch released by the IDCT stage
+	std::condition_variable	cvRowDone;		// MCU row ready for the color stage (or end)
+	ScanPipeBatch			asBatch[SCAN_PIPE_BATCHES];
+	unsigned				nQueued;		// Number of batches queued so far
+	unsigned				nTaken;			// Number of batches taken by the IDCT stage
+	bool					bEnd;			// No more batches will be queued
+	bool					bAbort;			// Color stage to stop (rows will be missing)
+	bool*					abRowDone;		// Per MCU row: IDCT stage done
+	CString					strScanEndPos;	// File position at end of scan (valid with bEnd)
+};
+
+// Decode the scan as a pipeline of three stages running concurrently
+// - Entropy stage (this thread): Huffman decode of each MCU row. The
+//   blocks are queued with their coefficients (see PipeAddBlock)
+//   instead of being transformed.
+// - IDCT stage (one or more worker decoders): IDCT of the queued
+//   blocks and store into the pixel map
+// - Color stage (one worker decoder): color conversion of each MCU
+//   row of the pixel map into the DIB as soon as it is complete.
+//   This is the CalcChannelPreview() step of the serial decode.
+// - The MCU rows in flight are limited by a ring of SCAN_PIPE_BATCHES
+//   batches. The entropy stage waits for a free batch when the IDCT
+//   stage falls behind.
+// - The entropy decode is the same as the serial decode, so all of
+//   the scan reporting is unchanged. The detailed VLC report is only
+//   supported by the serial decode.
+//
+// INPUT:
+// - pLogPreview			= Log for the color stage (added to the main
+//							  log by the caller where the serial decode
+//							  would run CalcChannelPreview)
+// PRE:
+// - Scan buffer and DC state reset to the start of scan
+// - m_bDecodeScanAc
+// POST:
+// - m_pDibTemp
+// - m_anIdctPathNum[]
+// - Preview state (see PreviewStateCopy)
+// OUTPUT:
+// - bAbort					= The scan decode was aborted
+// RETURN:
+// - True if the scan was decoded (and the preview created), false if
+//   the serial decode is required
+//
+bool CimgDecode::DecodeScanPipeline(CDocLog* pLogPreview,bool &bAbort)
+{
+	bAbort = false;
+
+	unsigned	nThreads = m_pAppConfig->nDecodeScanThreads;
+	if (nThreads == 0) {
+		nThreads = std::thread::hardware_concurrency();
+	}
+	nThreads = min(nThreads,(unsigned)SCAN_PAR_THREADS_MAX);
+
+	unsigned char*	pDibBits = (unsigned char*)(m_pDibTemp.GetDIBBitArray());
+	if ((nThreads < 2) || (m_bDetailVlc) || (!pDibBits) || (m_nMcuYMax < 2)) {
+		return false;
+	}
+	// Remaining threads after the entropy and color stages
+	unsigned	nIdctNum = (nThreads > 3) ? (nThreads-2) : 1;
+
+	// Blocks per MCU row
+	unsigned	nBlkMax = 0;
+	for (unsigned nComp=1;nComp<=m_nNumSosComps;nComp++) {
+		nBlkMax += m_anSampPerMcuH[nComp] * m_anSampPerMcuV[nComp];
+	}
+	nBlkMax *= m_nMcuXMax;
+
+	ScanPipe*	psPipe = new ScanPipe;
+	psPipe->nQueued = 0;
+	psPipe->nTaken = 0;
+	psPipe->bEnd = false;
+	psPipe->bAbort = false;
+	psPipe->abRowDone = new bool[m_nMcuYMax];
+	memset(psPipe->abRowDone,0,m_nMcuYMax*sizeof(bool));
+	for (unsigned nBatch=0;nBatch<SCAN_PIPE_BATCHES;nBatch++) {
+		psPipe->asBatch[nBatch].psBlk = new ScanPipeBlk[nBlkMax];
+		psPipe->asBatch[nBatch].nBlkNum = 0;
+		psPipe->asBatch[nBatch].nBlkMax = nBlkMax;
+		psPipe->asBatch[nBatch].nMcuY = 0;
+		psPipe->asBatch[nBatch].bBusy = false;
+	}
+
+	// Stage workers
+	CDocLog*	apLog[SCAN_PAR_THREADS_MAX];
+	CimgDecode*	apWorker[SCAN_PAR_THREADS_MAX];
+	std::thread	aThread[SCAN_PAR_THREADS_MAX];
+	for (unsigned nWorker=0;nWorker<nIdctNum;nWorker++) {
+		apLog[nWorker] = new CDocLog();
+		apWorker[nWorker] = new CimgDecode(apLog[nWorker],m_pWBuf,this);
+		apWorker[nWorker]->m_nScanErrMax = m_nScanErrMax;
+	}
+	CimgDecode*	pColor = new CimgDecode(pLogPreview,m_pWBuf,this);
+	pColor->PreviewStateCopy(this);
+	pColor->m_psPipe = psPipe;
+
+	bool	bStarted = true;
+	unsigned	nThreadNum = 0;
+	try {
+		for (unsigned nWorker=0;nWorker<nIdctNum;nWorker++) {
+			aThread[nThreadNum] = std::thread(&CimgDecode::PipeIdctWorker,apWorker[nWorker],psPipe);
+			nThreadNum++;
+		}
+		aThread[nThreadNum] = std::thread(&CimgDecode::PipeColorWorker,pColor,psPipe,pDibBits);
+		nThreadNum++;
+	} catch (...) {
+		bStarted = false;
+	}
+
+	// Entropy stage
+	CString		strTmp;
+	bool		bDecodeOk = true;
+	for (unsigned nMcuY=0;(nMcuY<m_nMcuYMax)&&(bStarted);nMcuY++) {
+
+		// Set the statusbar text to Processing...
+		strTmp.Format(_T("Decoding Scan Data... Row %04u of %04u (%3.0f%%)"),nMcuY,m_nMcuYMax,nMcuY*100.0/m_nMcuYMax);
+		SetStatusText(strTmp);
+
+		// Wait for the batch to be released by the IDCT stage
+		ScanPipeBatch*	psBatch = &psPipe->asBatch[nMcuY % SCAN_PIPE_BATCHES];
+		{
+			std::unique_lock<std::mutex>	oLock(psPipe->mtx);
+			while (psBatch->bBusy) {
+				psPipe->cvFree.wait(oLock);
+			}
+		}
+
+		psBatch->nBlkNum = 0;
+		psBatch->nMcuY = nMcuY;
+		m_psPipeBatch = psBatch;
+		bDecodeOk = DecodeScanMcuRange(nMcuY*m_nMcuXMax,(nMcuY+1)*m_nMcuXMax,true);
+		m_psPipeBatch = NULL;
+
+		{
+			std::lock_guard<std::mutex>	oLock(psPipe->mtx);
+			psBatch->bBusy = true;
+			psPipe->nQueued++;
+		}
+		psPipe->cvQueued.notify_all();
+
+		if (!bDecodeOk) {
+			bAbort = true;
+			break;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex>	oLock(psPipe->mtx);
+		psPipe->strScanEndPos = GetScanBufPos();
+		psPipe->bEnd = true;
+		if ((!bStarted) || (bAbort)) {
+			psPipe->bAbort = true;
+		}
+	}
+	psPipe->cvQueued.notify_all();
+	psPipe->cvRowDone.notify_all();
+	for (unsigned nThread=0;nThread<nThreadNum;nThread++) {
+		aThread[nThread].join();
+	}
+
+	// Merge the worker stats and reports
+	for (unsigned nWorker=0;nWorker<nIdctNum;nWorker++) {
+		CimgDecode*	pWorker = apWorker[nWorker];
+		for (unsigned nPath=0;nPath<IDCT_PATH_NUM;nPath++) {
+			m_anIdctPathNum[nPath] += pWorker->m_anIdctPathNum[nPath];
+		}
+		m_nWarnIdctCheckNum += pWorker->m_nWarnIdctCheckNum;
+		m_nWarnSimdCheckNum += pWorker->m_nWarnSimdCheckNum;
+		m_pLog->AddLog(apLog[nWorker]);
+	}
+	if (bStarted) {
+		PreviewStateCopy(pColor);
+	}
+
+	for (unsigned nWorker=0;nWorker<nIdctNum;nWorker++) {
+		apWorker[nWorker]->ScanWorkerDetach();
+		delete apWorker[nWorker];
+		delete apLog[nWorker];
+	}
+	pColor->ScanWorkerDetach();
+	pColor->m_psPipe = NULL;
+	delete pColor;
+	for (unsigned nBatch=0;nBatch<SCAN_PIPE_BATCHES;nBatch++) {
+		delete [] psPipe->asBatch[nBatch].psBlk;
+	}
+	delete [] psPipe->abRowDone;
+	delete psPipe;
+
+	if (!bStarted) {
+		// No blocks were decoded, so the serial decode can start over
+		return false;
+	}
+
+	SetStatusText(_T(""));
+	return true;
+}
+
+// Queue the current block for the IDCT stage (pipelined decode)
+// - Called in place of the store to the pixel plane (SetFullResBlk)
+// - The coefficients are only kept if an IDCT is due on the block.
+//   Otherwise the block is stored with a zero IDCT output (DC only).
+//
+// INPUT:
+// - pPixVal				= Pixel plane of the component
+// - nOffsetBlkCorner		= Pixel plane offset of the top-left corner
+// - nPlaneW				= Width of the pixel plane
+// - nDcOffset				= Level shift
+// PRE:
+// - m_psPipeBatch
+// - m_nPipeIdctTbl
+// - m_anDctBlock[], m_nDctCoefMax
+//
+void CimgDecode::PipeAddBlock(short int* pPixVal,unsigned nOffsetBlkCorner,unsigned nPlaneW,short int nDcOffset)
+{
+	ScanPipeBatch*	psBatch = m_psPipeBatch;
+	ASSERT(psBatch->nBlkNum < psBatch->nBlkMax);
+	if (psBatch->nBlkNum >= psBatch->nBlkMax) {
+		return;
+	}
+
+	ScanPipeBlk*	psBlk = &psBatch->psBlk[psBatch->nBlkNum];
+	psBatch->nBlkNum++;
+	psBlk->pPixVal = pPixVal;
+	psBlk->nOffsetBlkCorner = nOffsetBlkCorner;
+	psBlk->nPlaneW = nPlaneW;
+	psBlk->nDcOffset = nDcOffset;
+	psBlk->nIdctTbl = m_nPipeIdctTbl;
+	if (m_nPipeIdctTbl >= 0) {
+		psBlk->nDctCoefMax = m_nDctCoefMax;
+		memcpy(psBlk->anDctBlock,m_anDctBlock,sizeof(psBlk->anDctBlock));
+	}
+}
+
+// IDCT stage of the pipelined decode (worker thread)
+// - Takes the queued batches in turn until the entropy stage ends
+//
+// INPUT:
+// - psPipe					= Pipeline control
+// POST:
+// - m_asPixPlane[] (shared)
+// - m_anIdctPathNum[]
+//
+void CimgDecode::PipeIdctWorker(ScanPipe* psPipe)
+{
+	// Blocks without an IDCT are stored from a zero IDCT output
+	bool	bIdctClear = false;
+
+	std::unique_lock<std::mutex>	oLock(psPipe->mtx);
+	while (true) {
+		while ((psPipe->nTaken == psPipe->nQueued) && (!psPipe->bEnd)) {
+			psPipe->cvQueued.wait(oLock);
+		}
+		if (psPipe->nTaken == psPipe->nQueued) {
+			break;
+		}
+		ScanPipeBatch*	psBatch = &psPipe->asBatch[psPipe->nTaken % SCAN_PIPE_BATCHES];
+		psPipe->nTaken++;
+		oLock.unlock();
+
+		for (unsigned nBlk=0;nBlk<psBatch->nBlkNum;nBlk++) {
+			ScanPipeBlk*	psBlk = &psBatch->psBlk[nBlk];
+			if (psBlk->nIdctTbl >= 0) {
+				memcpy(m_anDctBlock,psBlk->anDctBlock,sizeof(m_anDctBlock));
+				m_nDctCoefMax = psBlk->nDctCoefMax;
+				DecodeIdctCalc(psBlk->nIdctTbl);
+				bIdctClear = false;
+			} else if (!bIdctClear) {
+				DecodeIdctClear();
+				bIdctClear = true;
+			}
+
+			SetFullResBlk(psBlk->pPixVal,psBlk->nOffsetBlkCorner,psBlk->nPlaneW,psBlk->nDcOffset);
+		}
+
+		oLock.lock();
+		psBatch->bBusy = false;
+		psPipe->abRowDone[psBatch->nMcuY] = true;
+		psPipe->cvFree.notify_all();
+		psPipe->cvRowDone.notify_all();
+	}
+}
+
+// Color stage of the pipelined decode (worker thread)
+// - Converts each MCU row of the pixel map in order, as soon as the
+//   IDCT stage has completed it
+//
+// INPUT:
+// - psPipe					= Pipeline control
+// - pDibBits				= DIB pixel array of the main decoder
+// PRE:
+// - PreviewStateCopy()
+// POST:
+// - Preview state (see PreviewStateCopy)
+//
+void CimgDecode::PipeColorWorker(ScanPipe* psPipe,unsigned char* pDibBits)
+{
+	unsigned	nSumY = 0;
+	unsigned	nMcuPixH = m_nMcuHeight >> m_nScaleShift;
+
+	CalcChannelPreviewStart();
+	for (unsigned nMcuY=0;nMcuY<m_nMcuYMax;nMcuY++) {
+		{
+			std::unique_lock<std::mutex>	oLock(psPipe->mtx);
+			while ((!psPipe->abRowDone[nMcuY]) && (!psPipe->bAbort)) {
+				psPipe->cvRowDone.wait(oLock);
+			}
+			if (!psPipe->abRowDone[nMcuY]) {
+				return;
+			}
+		}
+		unsigned	nPixY1 = min(nMcuY*nMcuPixH,m_nPixMapH);
+		unsigned	nPixY2 = min((nMcuY+1)*nMcuPixH,m_nPixMapH);
+		CalcChannelPreviewRows(nPixY1,nPixY2,pDibBits,nSumY);
+	}
+	CalcChannelPreviewEnd(nSumY);
+}
+
+// File position for the color conversion reports
+// - As in the serial decode, this is the position at the end of the
+//   scan. The color stage of the pipelined decode waits for the
+//   entropy stage to end for it.
+//
+// RETURN:
+// - Formatted file position
+//
+CString CimgDecode::GetPreviewScanPos()
+{
+	if (!m_psPipe) {
+		return GetScanBufPos();
+	}
+	std::unique_lock<std::mutex>	oLock(m_psPipe->mtx);
+	while (!m_psPipe->bEnd) {
+		m_psPipe->cvRowDone.wait(oLock);
+	}
+	return m_psPipe->strScanEndPos;
+}
+
+// Copy the color conversion settings and results from another decoder
+// - Used to hand the preview over to and back from the color stage
+//   of the pipelined decode
+//
+// INPUT:
+// - pSrc					= Decoder to copy from
+//
+void CimgDecode::PreviewStateCopy(const CimgDecode* pSrc)
+{
+	// Settings
+	m_bHistEn = pSrc->m_bHistEn;
+	m_bStatClipEn = pSrc->m_bStatClipEn;
+	m_bVerbose = pSrc->m_bVerbose;
+	m_bDetailVlc = pSrc->m_bDetailVlc;
+	m_nImgSizeX = pSrc->m_nImgSizeX;
+	m_nPixMapPrecShift = pSrc->m_nPixMapPrecShift;
+	m_nPreviewMode = pSrc->m_nPreviewMode;
+	m_nPreviewShiftY = pSrc->m_nPreviewShiftY;
+	m_nPreviewShiftCb = pSrc->m_nPreviewShiftCb;
+	m_nPreviewShiftCr = pSrc->m_nPreviewShiftCr;
+	m_nPreviewShiftMcuX = pSrc->m_nPreviewShiftMcuX;
+	m_nPreviewShiftMcuY = pSrc->m_nPreviewShiftMcuY;
+	m_bColorYcck = pSrc->m_bColorYcck;
+
+	// Results
+	m_nWarnYccClipNum = pSrc->m_nWarnYccClipNum;
+	m_sHisto = pSrc->m_sHisto;
+	m_sStatClip = pSrc->m_sStatClip;
+	memcpy(m_anCcHisto_r,pSrc->m_anCcHisto_r,sizeof(m_anCcHisto_r));
+	memcpy(m_anCcHisto_g,pSrc->m_anCcHisto_g,sizeof(m_anCcHisto_g));
+	memcpy(m_anCcHisto_b,pSrc->m_anCcHisto_b,sizeof(m_anCcHisto_b));
+	memcpy(m_anHistoYFull,pSrc->m_anHistoYFull,sizeof(m_anHistoYFull));
+	m_nBrightY = pSrc->m_nBrightY;
+	m_nBrightCb = pSrc->m_nBrightCb;
+	m_nBrightCr = pSrc->m_nBrightCr;
+	m_nBrightK = pSrc->m_nBrightK;
+	m_nBrightLum = pSrc->m_nBrightLum;
+	m_nBrightR = pSrc->m_nBrightR;
+	m_nBrightG = pSrc->m_nBrightG;
+	m_nBrightB = pSrc->m_nBrightB;
+	m_ptBrightMcu = pSrc->m_ptBrightMcu;
+	m_bBrightValid = pSrc->m_bBrightValid;
+	m_nAvgY = pSrc->m_nAvgY;
+	m_bAvgYValid = pSrc->m_bAvgYValid;
+}
+
+// Prepare the decoder for the scan decode
+// - Fetch the decode settings from the configuration
+// - Reset the decoder state
+// - Determine the MCU geometry from the sampling factors of the
+//   components in the scan
+// - Allocate the MCU file map, block DC map, pixel map and DIB
+//
+// - If the caller supports it and the pixel maps and DIB would exceed
+//   the scan decode memory limit, the pixel maps only hold a band of
+//   MCU rows and the DIB is reduced (see DecodeScanBands)
+//
+// INPUT:
+// - bDisplay				= Generate a preview image?
+// - nScaleShiftMin			= Smallest scale allowed for the pixel maps (teScanScale)
+// - bBandEn				= Caller supports the band decode?
+// PRE:
+// - SetImageDetails()
+// - SetSofSampFactors()
+// POST:
+// - m_nBandMcuRows, m_nBandShift
+// RETURN:
+// - False if the image can't be decoded (already reported)
+//
+bool CimgDecode::DecodeScanImgInit(bool bDisplay,unsigned nScaleShiftMin,bool bBandEn)
+{
+	CString		strTmp;
+
+
+	// Fetch configuration values locally
+	bool		bDecodeScanAc;
+	unsigned	nScanErrMax		= m_pAppConfig->nErrMaxDecodeScan;
+	unsigned	nScaleShift		= min(max(m_pAppConfig->nDecodeScanScale,nScaleShiftMin),(unsigned)SCAN_SCALE_8);
+
+	// Add some extra speed-up in hidden mode (we don't need AC)
+	if (bDisplay) {
+		bDecodeScanAc = m_pAppConfig->bDecodeScanImgAc;
+	} else {
+		bDecodeScanAc = false;
+	}
+	// At 1/8 scale each block is a single pixel (the DC level),
+	// so the AC coefficients are not needed
+	if (nScaleShift == SCAN_SCALE_8) {
+		bDecodeScanAc = false;
+	}
+	m_bHistEn		= m_pAppConfig->bHistoEn;
+	m_bStatClipEn	= m_pAppConfig->bStatClipEn;
+
+
+	unsigned	nPixMapW = 0;
+	unsigned	nPixMapH = 0;
+
+	// Reset the decoder state variables
+	Reset();
+
+	m_nScanErrMax = nScanErrMax;
+	m_bDecodeScanAc = bDecodeScanAc;
+	m_nScaleShift = nScaleShift;
+
+	// 12-bit DCT images are decoded at full precision: the pixel maps
+	// hold (sample - 2048) * 8, which still fits in 16 bits. The range
+	// is only reduced to 8-bit for the preview (color conversion)
+	m_nPixMapPrecShift = (m_nPrecision > 8) ? (m_nPrecision - 8) : 0;
+
+	// Detect the scenario where the image component details haven't been set yet
+	// The image details are set via SetImageDetails()
+	if (!m_bImgDetailsSet) {
+		m_pLog->AddLineErr(_T("*** ERROR: Decoding image before Image components defined ***"));
+		return false;
+	}
+
+
+
+	// Even though we support decoding of MAX_SOS_COMP_NS we limit
+	// the component flexibility further
+	if ( (m_nNumSosComps != NUM_CHAN_GRAYSCALE) && (m_nNumSosComps != NUM_CHAN_YCC) && (m_nNumSosComps != NUM_CHAN_YCCK) ) {
+		strTmp.Format(_T("  NOTE: Number of SOS components not supported [%u]"),m_nNumSosComps);
+		m_pLog->AddLineWarn(strTmp);
+		return false;
+	}
+
+	// Determine the maximum sampling factor and min sampling factor for this scan
+	m_nSosSampFactHMax = 0;
+	m_nSosSampFactVMax = 0;
+	m_nSosSampFactHMin = 0xFF;
+	m_nSosSampFactVMin = 0xFF;
+
+	for (unsigned nComp=1;nComp<=m_nNumSosComps;nComp++) {
+		m_nSosSampFactHMax = max(m_nSosSampFactHMax,m_anSofSampFactH[nComp]);
+		m_nSosSampFactVMax = max(m_nSosSampFactVMax,m_anSofSampFactV[nComp]);
+		m_nSosSampFactHMin = min(m_nSosSampFactHMin,m_anSofSampFactH[nComp]);
+		m_nSosSampFactVMin = min(m_nSosSampFactVMin,m_anSofSampFactV[nComp]);
+		ASSERT(m_nSosSampFactHMin != 0);
+		ASSERT(m_nSosSampFactVMin != 0);
+	}
+
+
+	// ITU-T.81 clause A.2.2 "Non-interleaved order (Ns=1)"
+	// - In some cases an image may have a single component in a scan but with sampling factors other than 1:
+	//     Number of Img components = 1
+	//       Component[1]: ID=0x01, Samp Fac=0x22 (Subsamp 1 x 1), Quant Tbl Sel=0x00 (Lum: Y)
+	// - This could either be in a 3-component SOF with multiple 1-component SOS or a 1-component SOF (monochrome image)
+	// - In general, grayscale images exhibit a sampling factor of 0x11
+	// - Per ITU-T.81 A.2.2:
+	//     When Ns = 1 (where Ns is the number of components in a scan), the order of data units
+	//     within a scan shall be left-to-right and top-to-bottom, as shown in Figure A.2. This
+	//     ordering applies whenever Ns = 1, regardless of the values of H1 and V1.
+	// - Thus, instead of the usual decoding sequence for 0x22:
+	//   [ 0 1 ] [ 4 5 ]
+	//   [ 2 3 ] [ 6 7 ]
+	// - The sequence for decode should be:
+	//   [ 0 ] [ 1 ] [ 2 ] [ 3 ] [ 4 ] ...
+	// - Which is equivalent to the non-subsampled ordering (ie. 0x11)
+	// - Apply a correction for such images to remove the sampling factor
+	if ( m_nNumSosComps == 1) {
+		// TODO: Need to confirm if component index needs to be looked up
+		// in the case of multiple SOS or if [1] is the correct index
+		if ( (m_anSofSampFactH[1] != 1) || (m_anSofSampFactV[1] != 1) ) {
+			m_pLog->AddLineWarn(_T("    Altering sampling factor for single component scan to 0x11"));
+		}
+		m_anSofSampFactH[1] = 1;
+		m_anSofSampFactV[1] = 1;
+		m_nSosSampFactHMax = 1;
+		m_nSosSampFactVMax = 1;
+		m_nSosSampFactHMin = 1;
+		m_nSosSampFactVMin = 1;
+	}
+
+
+	// Perform additional range checks
+	if ( (m_nSosSampFactHMax==0) || (m_nSosSampFactVMax==0) || (m_nSosSampFactHMax>MAX_SAMP_FACT_H) || (m_nSosSampFactVMax>MAX_SAMP_FACT_V)) {
+		strTmp.Format(_T("  NOTE: Degree of subsampling factor not supported [HMax=%u, VMax=%u]"),m_nSosSampFactHMax,m_nSosSampFactVMax);
+		m_pLog->AddLineWarn(strTmp);
+		return false;
+	}
+
+	// Calculate the MCU size for this scan. We do it here rather
+	// than at the time of SOF (ie. SetImageDetails) for the reason
+	// that under some circumstances we need to override the sampling
+	// factor in single-component scans. This is done earlier.
+	m_nMcuWidth = m_nSosSampFactHMax * BLK_SZ_X;
+	m_nMcuHeight = m_nSosSampFactVMax * BLK_SZ_Y;
+
+
+	// Calculate the number of bits to replicate when we generate the pixel map
+	for (unsigned nComp=1;nComp<=m_nNumSosComps;nComp++) {
+		m_anExpandBitsMcuH[nComp] = m_nSosSampFactHMax / m_anSofSampFactH[nComp];
+		m_anExpandBitsMcuV[nComp] = m_nSosSampFactVMax / m_anSofSampFactV[nComp];
+	}
+
+	// Calculate the number of component samples per MCU
+	for (unsigned nComp=1;nComp<=m_nNumSosComps;nComp++) {
+		m_anSampPerMcuH[nComp] = m_anSofSampFactH[nComp];
+		m_anSampPerMcuV[nComp] = m_anSofSampFactV[nComp];
+	}
+
+	// Select the MCU decode for the sampling layout
+	// - The common layouts have a specialized decode (DecodeScanMcuFixed)
+	//   and everything else falls back to the generic DecodeScanMcu
+	m_eMcuLayout = MCU_LAYOUT_GENERIC;
+	if (m_nNumSosComps == 1) {
+		m_eMcuLayout = MCU_LAYOUT_GRAY;
+	} else if ((m_nNumSosComps == NUM_CHAN_YCC) &&
+		(m_anSampPerMcuH[SCAN_COMP_CB] == 1) && (m_anSampPerMcuV[SCAN_COMP_CB] == 1) &&
+		(m_anSampPerMcuH[SCAN_COMP_CR] == 1) && (m_anSampPerMcuV[SCAN_COMP_CR] == 1)) {
+		unsigned	nSampH = m_anSampPerMcuH[SCAN_COMP_Y];
+		unsigned	nSampV = m_anSampPerMcuV[SCAN_COMP_Y];
+		if ((nSampH == 1) && (nSampV == 1)) {
+			m_eMcuLayout = MCU_LAYOUT_444;
+		} else if ((nSampH == 2) && (nSampV == 1)) {
+			m_eMcuLayout = MCU_LAYOUT_422;
+		} else if ((nSampH == 2) && (nSampV == 2)) {
+			m_eMcuLayout = MCU_LAYOUT_420;
+		}
+	}
+
+
+	// Determine the MCU ranges
+	m_nMcuXMax   = (m_nDimX/m_nMcuWidth);
+	m_nMcuYMax   = (m_nDimY/m_nMcuHeight);
+
+	m_nImgSizeXPartMcu = m_nMcuXMax * m_nMcuWidth;
+	m_nImgSizeYPartMcu = m_nMcuYMax * m_nMcuHeight;
+
+	// Detect incomplete (partial) MCUs and round-up the MCU
+	// ranges if necessary.
+	if ((m_nDimX%m_nMcuWidth) != 0) m_nMcuXMax++;
+	if ((m_nDimY%m_nMcuHeight) != 0) m_nMcuYMax++;
+
+	// Save the maximum 8x8 block dimensions
+	m_nBlkXMax = m_nMcuXMax * m_nSosSampFactHMax;
+	m_nBlkYMax = m_nMcuYMax * m_nSosSampFactVMax;
+
+
+	// Ensure the image has a size
+	if ( (m_nBlkXMax == 0) || (m_nBlkYMax == 0) ) {
+		return false;
+	}
+
+	// Set the decoded size and before scaling
+	m_nImgSizeX = m_nMcuXMax * m_nMcuWidth;
+	m_nImgSizeY = m_nMcuYMax * m_nMcuHeight;
+
+	m_rectImgBase = CRect(CPoint(0,0),CSize(m_nImgSizeX,m_nImgSizeY));
+
+
+	// Allocate the MCU File Map
+	ASSERT(m_pMcuFileMap == NULL);
+	m_pMcuFileMap = new CMcuFileMap();
+	if ((!m_pMcuFileMap) || (!m_pMcuFileMap->Alloc(0,m_nMcuYMax*m_nMcuXMax))) {
+		strTmp = _T("ERROR: Not enough memory for Image Decoder MCU File Pos Map");
+		m_pLog->AddLineErr(strTmp);
+		if (m_pAppConfig->bInteractive)
+			AfxMessageBox(strTmp);
+		return false;
+	}
+
+
+	// Allocate the 8x8 Block DC Map
+	m_pBlkDcValY  = new short[m_nBlkYMax*m_nBlkXMax];
+	if ( (!m_pBlkDcValY) ) {
+		strTmp = _T("ERROR: Not enough memory for Image Decoder Blk DC Value Map");
+		m_pLog->AddLineErr(strTmp);
+		if (m_pAppConfig->bInteractive)
+			AfxMessageBox(strTmp);
+		return false;
+	}
+	if (m_nNumSosComps >= NUM_CHAN_YCC) {
+		m_pBlkDcValCb = new short[m_nBlkYMax*m_nBlkXMax];
+		m_pBlkDcValCr = new short[m_nBlkYMax*m_nBlkXMax];
+		if ( (!m_pBlkDcValCb) || (!m_pBlkDcValCr) ) {
+			strTmp = _T("ERROR: Not enough memory for Image Decoder Blk DC Value Map");
+			m_pLog->AddLineErr(strTmp);
+			if (m_pAppConfig->bInteractive)
+				AfxMessageBox(strTmp);
+			return false;
+		}
+	}
+	if (m_nNumSosComps == NUM_CHAN_YCCK) {
+		m_pBlkDcValK = new short[m_nBlkYMax*m_nBlkXMax];
+		if ( (!m_pBlkDcValK) ) {
+			strTmp = _T("ERROR: Not enough memory for Image Decoder Blk DC Value Map");
+			m_pLog->AddLineErr(strTmp);
+			if (m_pAppConfig->bInteractive)
+				AfxMessageBox(strTmp);
+			return false;
+		}
+	}
+
+	memset(m_pBlkDcValY,  0, (m_nBlkYMax*m_nBlkXMax*sizeof(short)) );
+	if (m_nNumSosComps >= NUM_CHAN_YCC) {
+		memset(m_pBlkDcValCb, 0, (m_nBlkYMax*m_nBlkXMax*sizeof(short)) );
+		memset(m_pBlkDcValCr, 0, (m_nBlkYMax*m_nBlkXMax*sizeof(short)) );
+	}
+	if (m_nNumSosComps == NUM_CHAN_YCCK) {
+		memset(m_pBlkDcValK,  0, (m_nBlkYMax*m_nBlkXMax*sizeof(short)) );
+	}
+
+	// Allocate the real YCC pixel Map
+	// - In scaled decode the pixel map is allocated at the reduced size
+	// - Each component plane is stored at its own sampling resolution
+	nPixMapH = (m_nBlkYMax*BLK_SZ_Y) >> m_nScaleShift;
+	nPixMapW = (m_nBlkXMax*BLK_SZ_X) >> m_nScaleShift;
+	m_nPixMapW = nPixMapW;
+	m_nPixMapH = nPixMapH;
+
+	// Decode in bands of MCU rows if the image doesn't fit in the
+	// scan decode memory limit
+	// - The reduced preview (pixel maps and DIB) takes up to half of
+	//   the limit and the band (pixel planes and RGB rows) the rest
+	// - The reduced preview planes are not subsampled
+	// - The MCU file map and the block DC maps are still allocated
+	//   for the whole image (1/64 of the pixel maps or less)
+	// - A whole image decode also needs the worker decoders and the
+	//   pipeline batches of the parallel and pipelined decodes (see
+	//   DecodeScanParallel, DecodeScanPipeline)
+	unsigned	nDibW = nPixMapW;
+	unsigned	nDibH = nPixMapH;
+	m_nBandMcuRows = 0;
+	m_nBandShift = 0;
+	if ((bBandEn) && (bDisplay) && (m_pAppConfig->nDecodeScanMemMax != 0)) {
+		ULONGLONG	nMemMax = (ULONGLONG)m_pAppConfig->nDecodeScanMemMax << 20;
+		ULONGLONG	nPixBytes = m_nNumSosComps*sizeof(short) + sizeof(RGBQUAD);
+		unsigned	nBlkSz = BLK_SZ_X >> m_nScaleShift;
+		ULONGLONG	nMcuBlks = 0;
+		for (unsigned nComp=1;nComp<=m_nNumSosComps;nComp++) {
+			nMcuBlks += m_anSofSampFactH[nComp] * m_anSofSampFactV[nComp];
+		}
+		ULONGLONG	nMcuBytes = (ULONGLONG)(m_nMcuWidth >> m_nScaleShift) * (m_nMcuHeight >> m_nScaleShift) * sizeof(RGBQUAD);
+		nMcuBytes += nMcuBlks * nBlkSz * nBlkSz * sizeof(short);
+		unsigned	nThreads = m_pAppConfig->nDecodeScanThreads;
+		if (nThreads == 0) {
+			nThreads = std::thread::hardware_concurrency();
+		}
+		nThreads = min(nThreads,(unsigned)SCAN_PAR_THREADS_MAX);
+		ULONGLONG	nWorkerBytes = (ULONGLONG)nThreads * (sizeof(CimgDecode) + sizeof(CDocLog)) +
+			(ULONGLONG)SCAN_PIPE_BATCHES * m_nMcuXMax * nMcuBlks * sizeof(ScanPipeBlk);
+		if ((ULONGLONG)m_nMcuXMax * m_nMcuYMax * nMcuBytes + nWorkerBytes > nMemMax) {
+			unsigned	nBandShift = 1;
+			while ((nBandShift < SCAN_BAND_SHIFT_MAX) &&
+				((ULONGLONG)(nPixMapW >> nBandShift) * (nPixMapH >> nBandShift) * nPixBytes > nMemMax/2)) {
+				nBandShift++;
+			}
+			ULONGLONG	nPreviewBytes = (ULONGLONG)(nPixMapW >> nBandShift) * (nPixMapH >> nBandShift) * nPixBytes;
+			ULONGLONG	nBandBytes = (nPreviewBytes < nMemMax) ? (nMemMax - nPreviewBytes) : 0;
+			ULONGLONG	nRowBytes = (ULONGLONG)m_nMcuXMax * nMcuBytes;
+			m_nBandMcuRows = (unsigned)min(max(nBandBytes / nRowBytes,(ULONGLONG)1),(ULONGLONG)m_nMcuYMax);
+			m_nBandShift = nBandShift;
+
+			nPixMapH = m_nBandMcuRows * (m_nMcuHeight >> m_nScaleShift);
+			m_nPixMapH = nPixMapH;
+			nDibW = nPixMapW >> nBandShift;
+			nDibH = (m_nMcuYMax * (m_nMcuHeight >> m_nScaleShift)) >> nBandShift;
+		}
+	}
+
+	// Allocate image (YCC)
+	for (unsigned nChan=0;nChan<m_nNumSosComps;nChan++) {
+		if (!PlaneAlloc(nChan,m_anSofSampFactH[nChan+1],m_anSofSampFactV[nChan+1],m_nSosSampFactHMax,m_nSosSampFactVMax)) {
+			if (nChan == CHAN_K) {
+				strTmp = _T("ERROR: Not enough memory for Image Decoder Pixel K Value Map");
+			} else {
+				strTmp = _T("ERROR: Not enough memory for Image Decoder Pixel YCC Value Map");
+			}
+			m_pLog->AddLineErr(strTmp);
+			if (m_pAppConfig->bInteractive)
+				AfxMessageBox(strTmp);
+			return false;
+		}
+	}
+
+	// Reset pixel map
+	if (bDisplay) {
+		ClrFullRes();
+	}
+
+
+	// -------------------------------------
+	// Allocate the device-independent bitmap (DIB)
+
+	unsigned char *		pDibImgTmpBits = NULL;
+	unsigned			nDibImgRowBytes;
+
+	// If a previous bitmap was created, deallocate it and start fresh
+	m_pDibTemp.Kill();
+	PreviewCacheClear();
+	m_bDibTempReady = false;
+	m_bPreviewIsJpeg = false;
+
+	// Create the DIB
+	// Although we are creating a 32-bit DIB, it should also
+	// work to run in 16- and 8-bit modes
+
+	bool bDoImage = false;	// Are we safe to set bits?
+
+	if (bDisplay) {
+		m_pDibTemp.CreateDIB(nDibW,nDibH,32);
+		nDibImgRowBytes = nDibW * sizeof(RGBQUAD);
+		pDibImgTmpBits = (unsigned char*) ( m_pDibTemp.GetDIBBitArray() );
+
+		if (pDibImgTmpBits) {
+			bDoImage = true;
+		} else {
+			// TODO: Should we be exiting here instead?
+		}
+
+	}
+	// -------------------------------------
+
+	return true;
+}
+
+// Process the entire scan segment and optionally render the image
+// - Reset and clear the output structures
+// - Loop through each MCU and read each component
+// - Maintain running DC level accumulator
+// - Call SetFullRes() to transfer IDCT output to YCC Pixel Map
+//
+// INPUT:
+// - nStart					= File position at start of scan
+// - bDisplay				= Generate a preview image?
+// - bQuiet					= Disable output of certain messages during decode?
+//
+void CimgDecode::DecodeScanImg(unsigned nStart,bool bDisplay,bool bQuiet)
+{
+	CString		strTmp;
+
+	if (!DecodeScanImgInit(bDisplay,SCAN_SCALE_1,true)) {
+		return;
+	}
+	bool		bDecodeScanAc = m_bDecodeScanAc;
+
+	// Allocate the entropy decoder checkpoints (see DecodeScanRegion)
+	// - The region decode is simply not available without them
+	ScanCkptFree();
+	if (m_pAppConfig->nDecodeScanCkptMcus != 0) {
+		m_nScanCkptMcus = m_pAppConfig->nDecodeScanCkptMcus;
+		m_nScanCkptNum = (m_nMcuXMax*m_nMcuYMax + m_nScanCkptMcus-1) / m_nScanCkptMcus;
+		m_psScanCkpt = new ScanCkpt[m_nScanCkptNum];
+		if (m_psScanCkpt) {
+			memset(m_psScanCkpt,0,(m_nScanCkptNum*sizeof(ScanCkpt)));
+		} else {
+			m_nScanCkptNum = 0;
+		}
+	}
+
+	// Determine decoding range
+	unsigned	nDecMcuRowStart;
+	unsigned	nDecMcuRowEnd;		// End to AC scan decoding
+	unsigned	nDecMcuRowEndFinal; // End to general decoding
+	nDecMcuRowStart = 0;
+	nDecMcuRowEnd = m_nMcuYMax;
+	nDecMcuRowEndFinal = m_nMcuYMax;
+
+	// Limit the decoding range to valid range
+	nDecMcuRowEnd = min(nDecMcuRowEnd,m_nMcuYMax);
+	nDecMcuRowEndFinal = min(nDecMcuRowEndFinal,m_nMcuYMax);
+
+
+	CString picStr;
+
+	// Reset the DC cumulative state
+	DecodeRestartDcState();
+
+	// Reset the scan buffer
+	DecodeRestartScanBuf(nStart,false);
+
+	// Load the buffer
+	m_pWBuf->BufLoadWindow(nStart);
+
+	// Expect that we start with RST0
+	m_nRestartExpectInd = 0;
+	m_nRestartLastInd = 0;
+
+	// Load the first data into the scan buffer
+	// This is done so that the MCU map will already
+	// have access to the data.
+	BuffTopup();
+
+	if (!bQuiet) {
+		m_pLog->AddLineHdr(_T("*** Decoding SCAN Data ***"));
+		strTmp.Format(_T("  OFFSET: 0x%08X"),nStart);
+		m_pLog->AddLine(strTmp);
+	}
+
+
+	// TODO: Might be more appropriate to check against m_nNumSosComps instead?
+	if ( (m_nNumSofComps != NUM_CHAN_GRAYSCALE) && (m_nNumSofComps != NUM_CHAN_YCC) && (m_nNumSofComps != NUM_CHAN_YCCK) ) {
+		strTmp.Format(_T("  NOTE: Number of Image Components not supported [%u]"),m_nNumSofComps);
+		m_pLog->AddLineWarn(strTmp);
+		return;
+	}
+
+	// Check DQT tables
+	// We need to ensure that the DQT Table selection has already
+	// been done (via a call from JfifDec to SetDqtTables() ).
+	bool		bDqtReady = true;
+	for (unsigned ind=1;ind<=m_nNumSosComps;ind++) {
+		if (m_psTbl->anDqtTblSel[ind]<0) bDqtReady = false;
+	}
+	if (!bDqtReady)
+	{
+		m_pLog->AddLineErr(_T("*** ERROR: Decoding image before DQT Table Selection via JFIF_SOF ***"));
+		// TODO: Is more error handling required?
+		return;
+	} else {
+		// FIXME: Not sure that we can always depend on the indices to appear
+		// in this order. May need another layer of indirection to get at the
+		// frame image component index.
+		m_anScanDqtTbl[SCAN_COMP_Y]  = m_psTbl->anDqtTblSel[DQT_DEST_Y];
+		m_anScanDqtTbl[SCAN_COMP_CB] = m_psTbl->anDqtTblSel[DQT_DEST_CB];
+		m_anScanDqtTbl[SCAN_COMP_CR] = m_psTbl->anDqtTblSel[DQT_DEST_CR];
+		if (m_nNumSosComps == NUM_CHAN_YCCK) {
+			m_anScanDqtTbl[SCAN_COMP_K] = m_psTbl->anDqtTblSel[DQT_DEST_K];
+		}
+	}
+
+	// Now check DHT tables
+	bool bDhtReady = true;
+	for (unsigned nClass=DHT_CLASS_DC;nClass<=DHT_CLASS_AC;nClass++) {
+		for (unsigned nCompInd=1;nCompInd<=m_nNumSosComps;nCompInd++) {
+			if (m_psTbl->anDhtTblSel[nClass][nCompInd]<0) bDhtReady = false;
+		}
+	}
+
+	// Ensure that the table has been defined already!
+	unsigned nSel;
+	for (unsigned nCompInd=1;nCompInd<=m_nNumSosComps;nCompInd++) {
+		// Check for DC DHT table
+		nSel = m_psTbl->anDhtTblSel[DHT_CLASS_DC][nCompInd];
+		if (m_psTbl->anDhtLookupSize[DHT_CLASS_DC][nSel] == 0) {
+			bDhtReady = false;
+		}
+		// Check for AC DHT table
+		nSel = m_psTbl->anDhtTblSel[DHT_CLASS_AC][nCompInd];
+		if (m_psTbl->anDhtLookupSize[DHT_CLASS_AC][nSel] == 0) {
+			bDhtReady = false;
+		}
+	}
+
+
+	if (!bDhtReady)
+	{
+		m_pLog->AddLineErr(_T("*** ERROR: Decoding image before DHT Table Selection via JFIF_SOS ***"));
+		// TODO: Is more error handling required here?
+		return;
+	} else {
+		// Define the huffman table indices that are selected for each
+		// image component index and class (AC,DC).
+		//
+		// No need to check if a table is valid here since we have
+		// previously checked to ensure that all required tables
+		// exist.
+		// NOTE: If the table has not been defined, then the index
+		// will be 0xFFFFFFFF. ReadScanVal() will trap this with ASSERT
+		// should it ever be used.
+		// The selections are saved for the MCU decode (DecodeScanMcu)
+		m_anScanDhtTblDc[SCAN_COMP_Y]  = m_psTbl->anDhtTblSel[DHT_CLASS_DC][COMP_IND_YCC_Y];
+		m_anScanDhtTblAc[SCAN_COMP_Y]  = m_psTbl->anDhtTblSel[DHT_CLASS_AC][COMP_IND_YCC_Y];
+		m_anScanDhtTblDc[SCAN_COMP_CB] = m_psTbl->anDhtTblSel[DHT_CLASS_DC][COMP_IND_YCC_CB];
+		m_anScanDhtTblAc[SCAN_COMP_CB] = m_psTbl->anDhtTblSel[DHT_CLASS_AC][COMP_IND_YCC_CB];
+		m_anScanDhtTblDc[SCAN_COMP_CR] = m_psTbl->anDhtTblSel[DHT_CLASS_DC][COMP_IND_YCC_CR];
+		m_anScanDhtTblAc[SCAN_COMP_CR] = m_psTbl->anDhtTblSel[DHT_CLASS_AC][COMP_IND_YCC_CR];
+		if (m_nNumSosComps == NUM_CHAN_YCCK) {
+			m_anScanDhtTblDc[SCAN_COMP_K]  = m_psTbl->anDhtTblSel[DHT_CLASS_DC][COMP_IND_YCC_K];
+			m_anScanDhtTblAc[SCAN_COMP_K]  = m_psTbl->anDhtTblSel[DHT_CLASS_AC][COMP_IND_YCC_K];
+		}
+	}
+
+	// Done checks
+
+
+	// Inform if they are in AC+DC/DC mode
+	if (!bQuiet) {
+		ReportScanMode();
+	}
+
+	// Report any Buffer overlays
+	m_pWBuf->ReportOverlays(m_pLog);
+
+	m_nNumPixels = 0;
+
+	// Clear the histogram and color correction clipping stats
+	if (bDisplay) {
+		memset(&m_sStatClip,0,sizeof(m_sStatClip));
+		memset(&m_sHisto,0,sizeof(m_sHisto));
+
+		// FIXME: Histo should now be done after color convert
+		memset(&m_anCcHisto_r,0,sizeof(m_anCcHisto_r));
+		memset(&m_anCcHisto_g,0,sizeof(m_anCcHisto_g));
+		memset(&m_anCcHisto_b,0,sizeof(m_anCcHisto_b));
+
+		memset(&m_anHistoYFull,0,sizeof(m_anHistoYFull));
+		memset(&m_anHistoYSubset,0,sizeof(m_anHistoYSubset));
+	}
+
+
+
+	// -----------------------------------------------------------------------
+	// Process all scan MCUs
+	// -----------------------------------------------------------------------
+
+	// Decode the restart intervals in parallel if possible, or else
+	// pipeline the decode stages. Otherwise (or if any irregularity is
+	// found) decode the MCUs in sequence.
+	// - Images above the memory limit are decoded in bands, which
+	//   also creates the preview
+	bool	bScanDone = false;
+	bool	bPreviewDone = false;
+	CDocLog	oLogPreview;
+
+	// Load the results of an earlier decode from the scan index
+	// - The index only holds the DC levels, so it replaces the decode
+	//   only if the AC coefficients (and the detailed VLC report) aren't
+	//   needed. Otherwise it is only checked, so that a current index
+	//   isn't rewritten after the decode.
+	bool	bIndexValid = false;
+	bool	bIndexLoaded = false;
+	if (m_pAppConfig->bDecodeScanIndex) {
+		bool	bIndexApply = (!bDecodeScanAc) && (m_nBandMcuRows == 0) && (!m_bDetailVlc);
+		bIndexValid = ScanIndexLoad(nStart,bIndexApply);
+		bIndexLoaded = (bIndexValid) && (bIndexApply);
+		if ((bIndexLoaded) && (!bQuiet)) {
+			strTmp.Format(_T("  Scan decode loaded from index [%s]"),(LPCTSTR)ScanIndexFname());
+			m_pLog->AddLine(strTmp);
+		}
+	}
+
+	if (bIndexLoaded) {
+		if (bDisplay) {
+			ScanIndexRender();
+		}
+		bScanDone = true;
+	} else if (m_nBandMcuRows != 0) {
+		m_bDecodeScanAc = bDecodeScanAc;
+		if (!DecodeScanBands()) {
+			return;
+		}
+		bScanDone = bPreviewDone = true;
+	} else if ((nDecMcuRowStart == 0) && (nDecMcuRowEnd >= m_nMcuYMax) && (nDecMcuRowEndFinal == m_nMcuYMax)) {
+		m_bDecodeScanAc = bDecodeScanAc;
+		bScanDone = DecodeScanParallel(nStart,bDisplay);
+		if ((!bScanDone) && (bDisplay)) {
+			bool	bAbort;
+			bScanDone = bPreviewDone = DecodeScanPipeline(&oLogPreview,bAbort);
+			if (bAbort) {
+				return;
+			}
+		}
+	}
+
+	for (unsigned nMcuY=nDecMcuRowStart;(nMcuY<nDecMcuRowEndFinal)&&(!bScanDone);nMcuY++) {
+
+		// Set the statusbar text to Processing...
+		strTmp.Format(_T("Decoding Scan Data... Row %04u of %04u (%3.0f%%)"),nMcuY,m_nMcuYMax,nMcuY*100.0/m_nMcuYMax);
+		SetStatusText(strTmp);
+
+		// TODO: Trap escape keypress here (or run as thread)
+
+		// To support a fast decode mode, allow for a subset of the
+		// image to have DC+AC decoding, while the remainder is only DC decoding
+		if ((nMcuY<nDecMcuRowStart) || (nMcuY>nDecMcuRowEnd)) {
+			m_bDecodeScanAc = false;
+		} else {
+			m_bDecodeScanAc = bDecodeScanAc;
+		}
+
+		if (!DecodeScanMcuRange(nMcuY*m_nMcuXMax,(nMcuY+1)*m_nMcuXMax,bDisplay)) {
+			return;
+		}
+
+	} // nMcuY
+
+	// Save the decode for the next analysis of the file
+	if ((m_pAppConfig->bDecodeScanIndex) && (!bIndexValid)) {
+		ScanIndexStore(nStart);
+	}
+
+	if (!bQuiet) {
+		m_pLog->AddLine(_T(""));
+	}
+
+	// ---------------------------------------------------------
+
+	// Now we can create the final preview. Since we have just finished
+	// decoding a new image, we need to ensure that we invalidate
+	// the temporary preview (multi-channel option). Done earlier
+	// with PREVIEW_NONE. The pipelined decode has already created it.
+	if (bPreviewDone) {
+		m_pLog->AddLog(&oLogPreview);
+	} else if (bDisplay) {
+		CalcChannelPreview();
+	}
+
+	// DIB is ready for display now
+	// - The image statistics are complete, so the pixel planes
+	//   no longer need the samples before clipping
+	if (bDisplay) {
+		m_bDibTempReady = true;
+		m_bPreviewIsJpeg = true;
+		PlaneCompact();
+	}
+
+	ReportScanStats(bDisplay,bQuiet);
+}
+
+// Decode the scan in bands of MCU rows (images above the memory limit)
+// - The pixel maps only hold m_nBandMcuRows MCU rows. Each band is
+//   decoded in sequence and color converted for the image statistics
+//   (histogram, clipping stats, brightest pixel and average luminance
+//   at the decode resolution). The band is then averaged down into the
+//   preview pixel maps and the band buffers are reused for the next.
+// - At the end the preview pixel maps replace the band, so that the
+//   decoder is left as after a scaled decode. The channel preview and
+//   the exports work on the preview.
+// - The restart intervals are not decoded in parallel
+// - The YCC clipping reports give the file position at the end of the
+//   band rather than at the end of the scan
+//
+// PRE:
+// - DecodeScanImgInit() with m_nBandMcuRows != 0
+// - Scan buffer and DC state reset to the start of scan
+// - m_bDecodeScanAc
+// POST:
+// - m_asPixPlane[] (preview)
+// - m_nPixMapW, m_nPixMapH, m_nScaleShift (preview)
+// - m_pDibTemp
+// - Preview state (see PreviewStateCopy)
+// RETURN:
+// - False if the decode was aborted
+//
+bool CimgDecode::DecodeScanBands()
+{
+	CString		strTmp;
+	unsigned	nPixMapW = m_nPixMapW;
+	unsigned	nBandPixH = m_nPixMapH;
+	unsigned	nMcuPixH = m_nMcuHeight >> m_nScaleShift;
+	unsigned	nRedW = nPixMapW >> m_nBandShift;
+	unsigned	nRedH = (m_nMcuYMax * nMcuPixH) >> m_nBandShift;
+	unsigned char*	pDibBits = (unsigned char*)(m_pDibTemp.GetDIBBitArray());
+
+	// Allocate the preview pixel maps, the RGB rows of the band and
+	// the column sums for the preview
+	short*		apReduced[NUM_CHAN_YCCK] = {NULL,NULL,NULL,NULL};
+	unsigned char*	pBandRgb = NULL;
+	int*		pnAcc = NULL;
+	bool		bAllocOk = (pDibBits != NULL);
+	for (unsigned nChan=0;(bAllocOk)&&(nChan<m_nNumSosComps);nChan++) {
+		apReduced[nChan] = new short[nRedW * nRedH];
+		bAllocOk = (apReduced[nChan] != NULL);
+	}
+	if (bAllocOk) {
+		pBandRgb = new unsigned char[nPixMapW * nBandPixH * sizeof(RGBQUAD)];
+		pnAcc = new int[nRedW * m_nNumSosComps];
+		bAllocOk = (pBandRgb) && (pnAcc);
+	}
+
+	bool		bDecodeOk = bAllocOk;
+	if (!bAllocOk) {
+		strTmp = _T("ERROR: Not enough memory for Image Decoder Band Preview");
+		m_pLog->AddLineErr(strTmp);
+		if (m_pAppConfig->bInteractive)
+			AfxMessageBox(strTmp);
+	} else {
+		memset(pnAcc,0,nRedW * m_nNumSosComps * sizeof(int));
+	}
+
+	unsigned	nSumY = 0;
+	if (bDecodeOk) {
+		CalcChannelPreviewStart();
+	}
+	for (unsigned nMcuY=0;(nMcuY<m_nMcuYMax)&&(bDecodeOk);nMcuY+=m_nBandMcuRows) {
+		unsigned	nMcuYEnd = min(nMcuY+m_nBandMcuRows,m_nMcuYMax);
+		unsigned	nRows = (nMcuYEnd-nMcuY) * nMcuPixH;
+		m_nBandPixY = nMcuY * nMcuPixH;
+
+		// The band buffers are reused, so start with a clear band
+		ClrFullRes();
+
+		for (unsigned nMcuRow=nMcuY;(nMcuRow<nMcuYEnd)&&(bDecodeOk);nMcuRow++) {
+			// Set the statusbar text to Processing...
+			strTmp.Format(_T("Decoding Scan Data... Row %04u of %04u (%3.0f%%)"),nMcuRow,m_nMcuYMax,nMcuRow*100.0/m_nMcuYMax);
+			SetStatusText(strTmp);
+
+			bDecodeOk = DecodeScanMcuRange(nMcuRow*m_nMcuXMax,(nMcuRow+1)*m_nMcuXMax,true);
+		}
+
+		if (bDecodeOk) {
+			CalcChannelPreviewRows(0,nRows,pBandRgb,nSumY);
+			DecodeScanBandReduce(nRows,apReduced,pnAcc);
+		}
+	}
+	m_nBandPixY = 0;
+
+	if (pBandRgb) {
+		delete [] pBandRgb;
+	}
+	if (pnAcc) {
+		delete [] pnAcc;
+	}
+	if (!bDecodeOk) {
+		for (unsigned nChan=0;nChan<NUM_CHAN_YCCK;nChan++) {
+			if (apReduced[nChan]) {
+				delete [] apReduced[nChan];
+			}
+		}
+		return false;
+	}
+
+	// Complete the statistics over the whole image
+	m_nPixMapH = m_nMcuYMax * nMcuPixH;
+	CalcChannelPreviewEnd(nSumY);
+
+	// Replace the band with the preview pixel maps
+	// - The preview planes are at full resolution
+	PlaneFree();
+	for (unsigned nChan=0;nChan<m_nNumSosComps;nChan++) {
+		PixPlane*	psPlane = &m_asPixPlane[nChan];
+		psPlane->pnPix = apReduced[nChan];
+		psPlane->nW = nRedW;
+		psPlane->nH = nRedH;
+		psPlane->nSampH = 1;
+		psPlane->nSampV = 1;
+		psPlane->nSampHMax = 1;
+		psPlane->nSampVMax = 1;
+	}
+	m_nPixMapW = nRedW;
+	m_nPixMapH = nRedH;
+	m_nScaleShift += m_nBandShift;
+
+	// Color convert the preview pixel maps into the DIB
+	// - A separate decoder does the conversion so that the image
+	//   statistics from the bands are kept
+	CDocLog		oLogPreview;
+	CimgDecode*	pPreview = new CimgDecode(&oLogPreview,m_pWBuf,this);
+	pPreview->PreviewStateCopy(this);
+	pPreview->m_bHistEn = false;
+	pPreview->m_bStatClipEn = false;
+	pPreview->m_bDetailVlc = false;
+	pPreview->CalcChannelPreviewFull(NULL,pDibBits);
+	pPreview->ScanWorkerDetach();
+	delete pPreview;
+
+	SetStatusText(_T(""));
+	return true;
+}
+
+// Average the rows of a band down into the preview pixel maps
+// - Each preview pixel is the mean of a square of (1<<m_nBandShift)
+//   pixel map rows and columns. The column sums are kept in pnAcc[]
+//   as a square may span two bands.
+// - The rows and columns beyond the last whole square are dropped
+//
+// INPUT:
+// - nBandPixH				= Number of rows decoded in the band
+// - apReduced				= Preview pixel map of each channel
+// - pnAcc					= Column sums of each channel
+// PRE:
+// - m_nBandPixY
+// - m_asPixPlane[] (band)
+// OUTPUT:
+// - apReduced				= Preview pixel rows completed by the band
+// - pnAcc					= Column sums of the incomplete preview row
+//
+void CimgDecode::DecodeScanBandReduce(unsigned nBandPixH,short** apReduced,int* pnAcc)
+{
+	unsigned	nShift = m_nBandShift;
+	unsigned	nStep = 1 << nShift;
+	unsigned	nRedW = m_nPixMapW >> nShift;
+	unsigned	nRedH = ((m_nBlkYMax*BLK_SZ_Y) >> m_nScaleShift) >> nShift;
+	int			nRound = 1 << (2*nShift - 1);
+
+	short*		pnRow = new short[m_nPixMapW];
+	if (!pnRow) {
+		return;
+	}
+
+	for (unsigned nRow=0;nRow<nBandPixH;nRow++) {
+		unsigned	nPixY = m_nBandPixY + nRow;
+		unsigned	nRedY = nPixY >> nShift;
+		if (nRedY >= nRedH) {
+			break;
+		}
+		bool		bRedRowEnd = (((nPixY+1) & (nStep-1)) == 0);
+
+		for (unsigned nChan=0;nChan<m_nNumSosComps;nChan++) {
+			const short*	pSrc = PlaneRowGet(nChan,nRow,pnRow);
+			int*		pnChanAcc = &pnAcc[nChan*nRedW];
+			for (unsigned nRedX=0;nRedX<nRedW;nRedX++) {
+				int		nSum = 0;
+				for (unsigned nInd=0;nInd<nStep;nInd++) {
+					nSum += *pSrc++;
+				}
+				pnChanAcc[nRedX] += nSum;
+			}
+
+			// Store the mean once the last row of the square is in
+			if (bRedRowEnd) {
+				short*	pDst = &apReduced[nChan][nRedY*nRedW];
+				for (unsigned nRedX=0;nRedX<nRedW;nRedX++) {
+					pDst[nRedX] = (short)((pnChanAcc[nRedX] + nRound) >> (2*nShift));
+					pnChanAcc[nRedX] = 0;
+				}
+			}
+		}
+	}
+
+	delete [] pnRow;
+}
+
+// Save the entropy decoder state at the start of an MCU
+// - Called by DecodeScanMcuRange() before the MCU is decoded
+// - The RSTn marker ending the previous interval is only processed
+//   when the DC coefficient of the MCU is read, so in that case the
+//   state after the marker is saved instead
+// - No checkpoint is saved once the scan data has been overread
+//
+// INPUT:
+// - nMcuXY					= MCU index (multiple of m_nScanCkptMcus)
+// PRE:
+// - Scan buffer and DC state positioned at the start of nMcuXY
+// POST:
+// - m_psScanCkpt[]
+//
+void CimgDecode::ScanCkptSave(unsigned nMcuXY)
+{
+	ScanCkpt*	psCkpt = &m_psScanCkpt[nMcuXY / m_nScanCkptMcus];
+	unsigned	nByteInd,nAlign;
+
+	if (m_nScanBuffOverBits != 0) {
+		psCkpt->bValid = false;
+		return;
+	}
+
+	if ((m_bRestartRead) && (m_nScanBuffBits < 8)) {
+		// Only the padding bits before the marker remain
+		psCkpt->nFilePos = m_nScanBuffPtr + 2;
+		psCkpt->nFileBit = 0;
+		psCkpt->nDcLum = 0;
+		psCkpt->nDcChrCb = 0;
+		psCkpt->nDcChrCr = 0;
+		psCkpt->nDcK = 0;
+		psCkpt->nRestartMcusLeft = m_nRestartInterval;
+		psCkpt->nRestartExpectInd = m_nRestartExpectInd;
+	} else {
+		GetScanBufInd(nByteInd,nAlign);
+		if (nByteInd == m_nScanBuffLoadInd) {
+			psCkpt->nFilePos = m_nScanBuffPtr;
+		} else {
+			psCkpt->nFilePos = m_anScanBuffPos[nByteInd & SCANBUF_POS_MASK];
+		}
+		psCkpt->nFileBit = nAlign;
+		psCkpt->nDcLum = m_nDcLum;
+		psCkpt->nDcChrCb = m_nDcChrCb;
+		psCkpt->nDcChrCr = m_nDcChrCr;
+		psCkpt->nDcK = m_nDcK;
+		psCkpt->nRestartMcusLeft = m_nRestartMcusLeft;
+		// A marker already in the reservoir is read again on restore
+		psCkpt->nRestartExpectInd = (m_bRestartRead) ? m_nRestartLastInd : m_nRestartExpectInd;
+	}
+	psCkpt->bValid = true;
+}
+
+// Find the latest checkpoint at or before an MCU
+//
+// INPUT:
+// - nMcuXY					= MCU index to decode next
+// PRE:
+// - m_psScanCkpt[]
+// RETURN:
+// - Checkpoint index, or -1 if there is none
+//
+int CimgDecode::ScanCkptFind(unsigned nMcuXY)
+{
+	if ((!m_psScanCkpt) || (m_nScanCkptNum == 0)) {
+		return -1;
+	}
+	int		nCkpt = (int)min(nMcuXY / m_nScanCkptMcus,m_nScanCkptNum-1);
+	while ((nCkpt >= 0) && (!m_psScanCkpt[nCkpt].bValid)) {
+		nCkpt--;
+	}
+	return nCkpt;
+}
+
+// Position the scan buffer and DC state at a checkpoint
+//
+// INPUT:
+// - psCkpt					= Checkpoint (of the main decoder)
+// POST:
+// - Scan buffer and DC state positioned at the start of the MCU
+//
+void CimgDecode::ScanCkptRestore(const ScanCkpt* psCkpt)
+{
+	DecodeRestartScanBuf(psCkpt->nFilePos,true);
+	m_nRestartMcusLeft = psCkpt->nRestartMcusLeft;
+	m_nRestartExpectInd = psCkpt->nRestartExpectInd;
+	m_nRestartLastInd = (psCkpt->nRestartExpectInd + 7) % 8;
+	m_nDcLum = psCkpt->nDcLum;
+	m_nDcChrCb = psCkpt->nDcChrCb;
+	m_nDcChrCr = psCkpt->nDcChrCr;
+	m_nDcK = psCkpt->nDcK;
+
+	m_pWBuf->BufLoadWindow(psCkpt->nFilePos);
+	BuffTopup();
+	ScanBuffConsume(min(psCkpt->nFileBit,m_nScanBuffBits));
+}
+
+// Release the entropy decoder checkpoints
+//
+// POST:
+// - m_psScanCkpt
+//
+void CimgDecode::ScanCkptFree()
+{
+	if (m_psScanCkpt) {
+		delete [] m_psScanCkpt;
+		m_psScanCkpt = NULL;
+	}
+	m_nScanCkptNum = 0;
+}
+
+// Decode a region of the image at full resolution
+// - Only the MCUs that intersect the region are decoded. Each MCU row
+//   of the region is entered from the nearest entropy checkpoint (or
+//   from the end of the previous row if that is closer). The MCUs
+//   between the checkpoint and the region are only entropy decoded.
+// - A separate decoder does the decode, so the preview, the pixel
+//   planes, the MCU file map and the scan reports are unchanged. Its
+//   pixel planes cover the MCU rows of the region (as in band decode).
+// - The color conversion follows the current preview mode and YCC
+//   adjust. The AC coefficients are decoded per the configuration,
+//   regardless of the scale of the preview.
+// - Requires the checkpoints of a sequential (Huffman) scan decode
+//
+// INPUT:
+// - rectPix				= Region in image pixels
+// OUTPUT:
+// - pRgb					= RGB pixels of the region (32-bit per pixel, [B,G,R,0]),
+//                            rectPix.Width() x rectPix.Height(), top row first
+// RETURN:
+// - False if the region can't be decoded
+//
+bool CimgDecode::DecodeScanRegion(CRect rectPix,unsigned char* pRgb)
+{
+	if ((!m_psScanCkpt) || (m_nScanCkptNum == 0) || (!pRgb)) {
+		return false;
+	}
+	rectPix.NormalizeRect();
+	if ((rectPix.left < 0) || (rectPix.top < 0) ||
+		((unsigned)rectPix.right > m_nImgSizeX) || ((unsigned)rectPix.bottom > m_nImgSizeY) ||
+		(rectPix.IsRectEmpty())) {
+		return false;
+	}
+
+	unsigned	nMcuX1 = rectPix.left / m_nMcuWidth;
+	unsigned	nMcuX2 = (rectPix.right + m_nMcuWidth-1) / m_nMcuWidth;
+	unsigned	nMcuY1 = rectPix.top / m_nMcuHeight;
+	unsigned	nMcuY2 = (rectPix.bottom + m_nMcuHeight-1) / m_nMcuHeight;
+
+	CDocLog		oLogRegion;
+	CimgDecode*	pRegion = new CimgDecode(&oLogRegion,m_pWBuf,this);
+	if (!pRegion) {
+		return false;
+	}
+	pRegion->PreviewStateCopy(this);
+	pRegion->m_bHistEn = false;
+	pRegion->m_bStatClipEn = false;
+	pRegion->m_bDetailVlc = false;
+	pRegion->m_bScanErrorsDisable = true;
+
+	// Private pixel planes for the MCU rows of the region
+	// - Neither the file map nor the checkpoints are updated
+	pRegion->m_pMcuFileMap = NULL;
+	pRegion->m_psScanCkpt = NULL;
+	pRegion->m_nScanCkptNum = 0;
+	memset(pRegion->m_asPixPlane,0,sizeof(pRegion->m_asPixPlane));
+	pRegion->m_nScaleShift = SCAN_SCALE_1;
+	pRegion->m_nPixMapW = m_nBlkXMax*BLK_SZ_X;
+	pRegion->m_nPixMapH = (nMcuY2-nMcuY1) * m_nMcuHeight;
+	pRegion->m_nBandPixY = nMcuY1 * m_nMcuHeight;
+
+	bool		bOk = true;
+	for (unsigned nChan=0;(bOk)&&(nChan<m_nNumSosComps);nChan++) {
+		bOk = pRegion->PlaneAlloc(nChan,m_anSofSampFactH[nChan+1],m_anSofSampFactV[nChan+1],m_nSosSampFactHMax,m_nSosSampFactVMax);
+	}
+	unsigned char*	pRows = NULL;
+	if (bOk) {
+		pRows = new unsigned char[pRegion->m_nPixMapW * pRegion->m_nPixMapH * sizeof(RGBQUAD)];
+		bOk = (pRows != NULL);
+	}
+	if (bOk) {
+		pRegion->ClrFullRes();
+	}
+
+	// Decode the MCUs of the region, a row at a time
+	bool		bDecodeScanAc = m_pAppConfig->bDecodeScanImgAc;
+	bool		bPositioned = false;
+	unsigned	nMcuCur = 0;
+	for (unsigned nMcuY=nMcuY1;(bOk)&&(nMcuY<nMcuY2);nMcuY++) {
+		unsigned	nMcuBegin = nMcuY*m_nMcuXMax + nMcuX1;
+		unsigned	nMcuEnd = nMcuY*m_nMcuXMax + nMcuX2;
+
+		// Continue from the end of the previous row unless a checkpoint is closer
+		int			nCkpt = ScanCkptFind(nMcuBegin);
+		if (nCkpt < 0) {
+			bOk = bPositioned;
+		} else if ((!bPositioned) || (nCkpt*m_nScanCkptMcus > nMcuCur)) {
+			pRegion->ScanCkptRestore(&m_psScanCkpt[nCkpt]);
+			nMcuCur = nCkpt*m_nScanCkptMcus;
+			bPositioned = true;
+		}
+
+		// Entropy decode up to the region (no IDCT)
+		if (bOk) {
+			pRegion->m_bDecodeScanAc = false;
+			bOk = pRegion->DecodeScanMcuRange(nMcuCur,nMcuBegin,false);
+		}
+		if (bOk) {
+			pRegion->m_bDecodeScanAc = bDecodeScanAc;
+			bOk = pRegion->DecodeScanMcuRange(nMcuBegin,nMcuEnd,true);
+			nMcuCur = nMcuEnd;
+		}
+	}
+
+	// Color convert the MCU rows and copy out the region
+	// - DIB rows are stored up-side down
+	if (bOk) {
+		unsigned	nSumY = 0;
+		unsigned	nRowBytes = pRegion->m_nPixMapW * sizeof(RGBQUAD);
+		unsigned	nRegionRowBytes = rectPix.Width() * sizeof(RGBQUAD);
+		pRegion->CalcChannelPreviewStart();
+		pRegion->CalcChannelPreviewRows(0,pRegion->m_nPixMapH,pRows,nSumY);
+		for (int nPixY=rectPix.top;nPixY<rectPix.bottom;nPixY++) {
+			unsigned	nRow = (pRegion->m_nPixMapH-1) - (nPixY - pRegion->m_nBandPixY);
+			memcpy(&pRgb[(nPixY-rectPix.top)*nRegionRowBytes],
+				&pRows[nRow*nRowBytes + rectPix.left*sizeof(RGBQUAD)],nRegionRowBytes);
+		}
+	}
+
+	if (pRows) {
+		delete [] pRows;
+	}
+	pRegion->PlaneFree();
+	pRegion->ScanWorkerDetach();
+	delete pRegion;
+	return bOk;
+}
+
+// Determine the file name of the scan index (beside the image)
+//
+// RETURN:
+// - File name, or empty if there is no current file
+//
+CString CimgDecode::ScanIndexFname()
+{
+	if (m_pAppConfig->strCurFname.IsEmpty()) {
+		return _T("");
+	}
+	return m_pAppConfig->strCurFname + SCAN_INDEX_EXT;
+}
+
+// Calculate the hash that validates a scan index
+// - Covers the scan data up to the end of the decode and the DQT / DHT
+//   tables used by the scan, as a change to either changes the result
+//
+// INPUT:
+// - nStart					= File position at start of scan
+// - nEndPos				= Scan buffer position at the end of the decode
+// PRE:
+// - nStart <= nEndPos < end of file
+// OUTPUT:
+// - pnHash					= MD5 digest (16 bytes)
+//
+void CimgDecode::ScanIndexHash(unsigned nStart,unsigned nEndPos,unsigned char* pnHash)
+{
+	MD5_CTX		sMd5;
+	BYTE		anBuf[4096];
+
+	ASSERT((nStart <= nEndPos) && (nEndPos < m_pWBuf->GetPosEof()));
+
+	// Count down the bytes left so that the loop can't wrap at the
+	// end of the 32-bit file position range
+	unsigned	nPos = nStart;
+	unsigned	nLeft = nEndPos - nStart + 1;
+	MD5Init(&sMd5,0);
+	while (nLeft > 0) {
+		unsigned	nLen = min(nLeft,(unsigned)sizeof(anBuf));
+		m_pWBuf->BufCopy(nPos,nLen,anBuf);
+		MD5Update(&sMd5,anBuf,nLen);
+		nPos += nLen;
+		nLeft -= nLen;
+	}
+	for (unsigned nComp=1;nComp<=m_nNumSosComps;nComp++) {
+		MD5Update(&sMd5,(unsigned char*)m_psTbl->anDqtCoeff[m_anScanDqtTbl[nComp]],sizeof(m_psTbl->anDqtCoeff[0]));
+	}
+	for (unsigned nClass=DHT_CLASS_DC;nClass<=DHT_CLASS_AC;nClass++) {
+		for (unsigned nDestId=0;nDestId<MAX_DHT_DEST_ID;nDestId++) {
+			MD5Update(&sMd5,(unsigned char*)m_psTbl->anDhtLookupfast[nClass][nDestId],sizeof(m_psTbl->anDhtLookupfast[0][0]));
+			MD5Update(&sMd5,(unsigned char*)m_psTbl->anDhtLookupSub[nClass][nDestId],
+				m_psTbl->anDhtLookupSubNum[nClass][nDestId]*sizeof(m_psTbl->anDhtLookupSub[0][0][0]));
+		}
+	}
+	MD5Update(&sMd5,(unsigned char*)m_anScanDhtTblDc,sizeof(m_anScanDhtTblDc));
+	MD5Update(&sMd5,(unsigned char*)m_anScanDhtTblAc,sizeof(m_anScanDhtTblAc));
+	MD5Final(&sMd5);
+	memcpy(pnHash,sMd5.digest,sizeof(sMd5.digest));
+}
+
+// Append a value to a scan index buffer
+// - Signed values are zigzag mapped, then stored 7 bits per byte
+//   (least significant first) with bit 7 set on all but the last
+//
+// INPUT:
+// - pBuf					= Output buffer (SCAN_INDEX_VAL_LEN bytes free)
+// - nOffset				= Offset in buffer
+// - nVal					= Value
+// RETURN:
+// - Offset after the value
+//
+unsigned CimgDecode::ScanIndexPutVal(BYTE* pBuf,unsigned nOffset,LONGLONG nVal)
+{
+	ULONGLONG	nZz = ((ULONGLONG)nVal << 1) ^ ((nVal < 0) ? ~(ULONGLONG)0 : 0);
+	while (nZz >= 0x80) {
+		pBuf[nOffset++] = (BYTE)(nZz | 0x80);
+		nZz >>= 7;
+	}
+	pBuf[nOffset++] = (BYTE)nZz;
+	return nOffset;
+}
+
+// Fetch a value from a scan index buffer (see ScanIndexPutVal)
+//
+// INPUT:
+// - pBuf					= Input buffer
+// - nLen					= End of the input
+// - nOffset				= Offset in buffer
+// OUTPUT:
+// - nOffset				= Offset after the value
+// - nVal					= Value
+// RETURN:
+// - False if the value is truncated or too long
+//
+bool CimgDecode::ScanIndexGetVal(const BYTE* pBuf,unsigned nLen,unsigned &nOffset,LONGLONG &nVal)
+{
+	ULONGLONG	nZz = 0;
+	for (unsigned nShift=0;nShift<64;nShift+=7) {
+		if (nOffset >= nLen) {
+			return false;
+		}
+		BYTE	nByte = pBuf[nOffset++];
+		nZz |= (ULONGLONG)(nByte & 0x7F) << nShift;
+		if ((nByte & 0x80) == 0) {
+			nVal = (LONGLONG)((nZz >> 1) ^ (0 - (nZz & 1)));
+			return true;
+		}
+	}
+	return false;
+}
+
+// Append a 32-bit value (little-endian) to a scan index buffer
+//
+// INPUT:
+// - pBuf					= Output buffer (4 bytes free)
+// - nOffset				= Offset in buffer
+// - nVal					= Value
+// RETURN:
+// - Offset after the value
+//
+unsigned CimgDecode::ScanIndexPutU32(BYTE* pBuf,unsigned nOffset,unsigned nVal)
+{
+	pBuf[nOffset++] = (BYTE)(nVal);
+	pBuf[nOffset++] = (BYTE)(nVal >> 8);
+	pBuf[nOffset++] = (BYTE)(nVal >> 16);
+	pBuf[nOffset++] = (BYTE)(nVal >> 24);
+	return nOffset;
+}
+
+// Fetch a 32-bit value (little-endian) from a scan index buffer
+// - The caller has checked the length of the buffer
+//
+// INPUT:
+// - pBuf					= Input buffer
+// - nOffset				= Offset in buffer
+// OUTPUT:
+// - nOffset				= Offset after the value
+// RETURN:
+// - Value
+//
+unsigned CimgDecode::ScanIndexGetU32(const BYTE* pBuf,unsigned &nOffset)
+{
+	unsigned	nVal;
+	nVal  = (unsigned)pBuf[nOffset];
+	nVal |= (unsigned)pBuf[nOffset+1] << 8;
+	nVal |= (unsigned)pBuf[nOffset+2] << 16;
+	nVal |= (unsigned)pBuf[nOffset+3] << 24;
+	nOffset += 4;
+	return nVal;
+}
+
+// Store the scan index header in its file layout
+//
+// INPUT:
+// - pBuf					= Output buffer (SCAN_INDEX_HDR_LEN bytes)
+// - sHdr					= Header
+// RETURN:
+// - Stored length (SCAN_INDEX_HDR_LEN)
+//
+unsigned CimgDecode::ScanIndexPutHdr(BYTE* pBuf,const ScanIndexHdr &sHdr)
+{
+	unsigned	nOffset = 0;
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nMagic);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nVer);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nScanStart);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nScanEndPos);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nScanEndBit);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nImgSizeX);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nImgSizeY);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nNumSosComps);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nMcuXMax);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nMcuYMax);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nRestartInterval);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nRestartRead);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nCkptMcus);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nCkptNum);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nMcuMapLen);
+	nOffset = ScanIndexPutU32(pBuf,nOffset,sHdr.nDcMapLen);
+	memcpy(&pBuf[nOffset],sHdr.anHash,sizeof(sHdr.anHash));
+	nOffset += sizeof(sHdr.anHash);
+	ASSERT(nOffset == SCAN_INDEX_HDR_LEN);
+	return nOffset;
+}
+
+// Fetch the scan index header from its file layout
+//
+// INPUT:
+// - pBuf					= Input buffer (SCAN_INDEX_HDR_LEN bytes)
+// OUTPUT:
+// - sHdr					= Header
+//
+void CimgDecode::ScanIndexGetHdr(const BYTE* pBuf,ScanIndexHdr &sHdr)
+{
+	unsigned	nOffset = 0;
+	sHdr.nMagic = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nVer = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nScanStart = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nScanEndPos = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nScanEndBit = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nImgSizeX = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nImgSizeY = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nNumSosComps = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nMcuXMax = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nMcuYMax = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nRestartInterval = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nRestartRead = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nCkptMcus = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nCkptNum = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nMcuMapLen = ScanIndexGetU32(pBuf,nOffset);
+	sHdr.nDcMapLen = ScanIndexGetU32(pBuf,nOffset);
+	memcpy(sHdr.anHash,&pBuf[nOffset],sizeof(sHdr.anHash));
+}
+
+// Save the results of a sequential scan decode to the scan index
+// - Only a decode without any scan errors is saved
+// - A missing or read-only directory isn't an error (nothing is saved)
+//
+// INPUT:
+// - nStart					= File position at start of scan
+// PRE:
+// - DecodeScanImg() MCU decode complete
+// - m_pMcuFileMap, m_pBlkDcVal*[], m_psScanCkpt[], m_anDhtHisto[][][]
+//
+void CimgDecode::ScanIndexStore(unsigned nStart)
+{
+	CString			strFname = ScanIndexFname();
+	ScanIndexHdr	sHdr;
+	unsigned		nMcuNum = m_nMcuXMax*m_nMcuYMax;
+	unsigned		nBlkNum = m_nBlkXMax*m_nBlkYMax;
+	short int*		apBlkDcVal[NUM_CHAN_YCCK] = {m_pBlkDcValY,m_pBlkDcValCb,m_pBlkDcValCr,m_pBlkDcValK};
+	unsigned		nHistoNum = sizeof(m_anDhtHisto)/sizeof(m_anDhtHisto[0][0][0]);
+	unsigned		nCkptNum = (m_psScanCkpt) ? m_nScanCkptNum : 0;
+
+	if ((strFname.IsEmpty()) || (m_nWarnBadScanNum != 0) || (m_bScanBad) || (m_nScanBuffOverBits != 0)) {
 		return;
-#endif
 	}
 
-	// Check DQT tables
-	// We need to ensure that the DQT Table selection has already
-	// been done (via a call from JfifDec to SetDqtTables() ).
-	unsigned	nDqtTblY  =0;
-	unsigned	nDqtTblCr =0;
-	unsigned	nDqtTblCb =0;
-#ifdef DEBUG_YCCK
-	unsigned	nDqtTblK =0;
-#endif
-	bool		bDqtReady = true;
-	for (unsigned ind=1;ind<=m_nNumSosComps;ind++) {
-		if (m_anDqtTblSel[ind]<0) bDqtReady = false;
+	// The end of the decode must be within the file (see ScanIndexHash)
+	unsigned	nScanBufInd,nScanBufAlign;
+	unsigned	nScanEndPos;
+	GetScanBufInd(nScanBufInd,nScanBufAlign);
+	nScanEndPos = GetScanBufFilePos(nScanBufInd);
+	if ((nScanEndPos < nStart) || (nScanEndPos >= m_pWBuf->GetPosEof())) {
+		return;
+	}
+
+	BYTE*	pMcuMap = new BYTE[nMcuNum*SCAN_INDEX_VAL_LEN];
+	BYTE*	pDcMap = new BYTE[nBlkNum*m_nNumSosComps*3];
+	BYTE*	pTbl = new BYTE[SCAN_INDEX_HDR_LEN + nHistoNum*4 + nCkptNum*SCAN_INDEX_CKPT_LEN];
+	if ((!pMcuMap) || (!pDcMap) || (!pTbl)) {
+		if (pMcuMap) {
+			delete [] pMcuMap;
+		}
+		if (pDcMap) {
+			delete [] pDcMap;
+		}
+		if (pTbl) {
+			delete [] pTbl;
+		}
+		return;
+	}
+
+	// MCU bit offsets, relative to the previous MCU
+	unsigned	nMcuMapLen = 0;
+	ULONGLONG	nBitPosLast = (ULONGLONG)nStart*8;
+	for (unsigned nMcuXY=0;nMcuXY<nMcuNum;nMcuXY++) {
+		ULONGLONG	nBitPos = m_pMcuFileMap->Get(nMcuXY);
+		nMcuMapLen = ScanIndexPutVal(pMcuMap,nMcuMapLen,(LONGLONG)(nBitPos - nBitPosLast));
+		nBitPosLast = nBitPos;
+	}
+
+	// DC block maps, relative to the previous block in the row
+	unsigned	nDcMapLen = 0;
+	for (unsigned nChan=0;nChan<m_nNumSosComps;nChan++) {
+		for (unsigned nBlkY=0;nBlkY<m_nBlkYMax;nBlkY++) {
+			int		nDcLast = 0;
+			for (unsigned nBlkX=0;nBlkX<m_nBlkXMax;nBlkX++) {
+				int		nDc = apBlkDcVal[nChan][nBlkY*m_nBlkXMax + nBlkX];
+				nDcMapLen = ScanIndexPutVal(pDcMap,nDcMapLen,nDc - nDcLast);
+				nDcLast = nDc;
+			}
+		}
+	}
+
+	memset(&sHdr,0,sizeof(sHdr));
+	sHdr.nMagic = SCAN_INDEX_MAGIC;
+	sHdr.nVer = SCAN_INDEX_VER;
+	sHdr.nScanStart = nStart;
+	sHdr.nScanEndPos = nScanEndPos;
+	sHdr.nScanEndBit = nScanBufAlign;
+	sHdr.nImgSizeX = m_nImgSizeX;
+	sHdr.nImgSizeY = m_nImgSizeY;
+	sHdr.nNumSosComps = m_nNumSosComps;
+	sHdr.nMcuXMax = m_nMcuXMax;
+	sHdr.nMcuYMax = m_nMcuYMax;
+	sHdr.nRestartInterval = (m_bRestartEn) ? m_nRestartInterval : 0;
+	sHdr.nRestartRead = m_nRestartRead;
+	sHdr.nCkptMcus = (nCkptNum) ? m_nScanCkptMcus : 0;
+	sHdr.nCkptNum = nCkptNum;
+	sHdr.nMcuMapLen = nMcuMapLen;
+	sHdr.nDcMapLen = nDcMapLen;
+	ScanIndexHash(nStart,sHdr.nScanEndPos,sHdr.anHash);
+
+	// Header and Huffman code histograms
+	unsigned	nTblLen = ScanIndexPutHdr(pTbl,sHdr);
+	unsigned	nHdrHistoLen;
+	const unsigned*	pnHisto = &m_anDhtHisto[0][0][0];
+	for (unsigned nInd=0;nInd<nHistoNum;nInd++) {
+		nTblLen = ScanIndexPutU32(pTbl,nTblLen,pnHisto[nInd]);
+	}
+	nHdrHistoLen = nTblLen;
+
+	// Entropy decoder checkpoints
+	for (unsigned nCkpt=0;nCkpt<nCkptNum;nCkpt++) {
+		const ScanCkpt*	psCkpt = &m_psScanCkpt[nCkpt];
+		nTblLen = ScanIndexPutU32(pTbl,nTblLen,(psCkpt->bValid) ? 1 : 0);
+		nTblLen = ScanIndexPutU32(pTbl,nTblLen,psCkpt->nFilePos);
+		nTblLen = ScanIndexPutU32(pTbl,nTblLen,psCkpt->nFileBit);
+		nTblLen = ScanIndexPutU32(pTbl,nTblLen,(unsigned)psCkpt->nDcLum);
+		nTblLen = ScanIndexPutU32(pTbl,nTblLen,(unsigned)psCkpt->nDcChrCb);
+		nTblLen = ScanIndexPutU32(pTbl,nTblLen,(unsigned)psCkpt->nDcChrCr);
+		nTblLen = ScanIndexPutU32(pTbl,nTblLen,(unsigned)psCkpt->nDcK);
+		nTblLen = ScanIndexPutU32(pTbl,nTblLen,psCkpt->nRestartMcusLeft);
+		nTblLen = ScanIndexPutU32(pTbl,nTblLen,psCkpt->nRestartExpectInd);
+	}
+
+	CFile*	pFile = NULL;
+	try
+	{
+		pFile = new CFile(strFname, CFile::modeCreate| CFile::modeWrite | CFile::typeBinary | CFile::shareDenyNone);
+		pFile->Write(pTbl,nHdrHistoLen);
+		pFile->Write(pMcuMap,nMcuMapLen);
+		pFile->Write(pDcMap,nDcMapLen);
+		pFile->Write(&pTbl[nHdrHistoLen],nTblLen - nHdrHistoLen);
+		pFile->Close();
+	}
+	catch (CFileException* e)
+	{
+		TCHAR	msg[MAX_BUF_EX_ERR_MSG];
+		CString	strTmp;
+		e->GetErrorMessage(msg,MAX_BUF_EX_ERR_MSG);
+		e->Delete();
+		strTmp.Format(_T("  NOTE: Couldn't write scan index [%s]: [%s]"),(LPCTSTR)strFname,(LPCTSTR)msg);
+		m_pLog->AddLine(strTmp);
+	}
+	if (pFile) {
+		delete pFile;
+	}
+
+	delete [] pMcuMap;
+	delete [] pDcMap;
+	delete [] pTbl;
+}
+
+// Check the scan index and optionally load it in place of the decode
+// - The index is only valid for the same scan data, tables, geometry
+//   and checkpoint interval. The header and the hash of the scan data
+//   are always compared, so that a stale index is never reported as
+//   valid (and is replaced after the decode).
+// - Loading restores the MCU file map, the DC block maps, the entropy
+//   decoder checkpoints, the Huffman code histograms and the scan
+//   buffer position at the end of the scan (for the reports). The
+//   pixel planes can then be generated from the DC levels only
+//   (ScanIndexRender).
+//
+// INPUT:
+// - nStart					= File position at start of scan
+// - bApply					= Load the index (else only check it)
+// PRE:
+// - DecodeScanImg() tables and maps set up
+// POST:
+// - m_pMcuFileMap, m_pBlkDcVal*[], m_psScanCkpt[], m_anDhtHisto[][][]
+// - m_nRestartRead, m_nNumPixels
+// - Scan buffer at the end of the scan
+// RETURN:
+// - True if the index is valid and was loaded (if bApply)
+//
+bool CimgDecode::ScanIndexLoad(unsigned nStart,bool bApply)
+{
+	CString			strFname = ScanIndexFname();
+	ScanIndexHdr	sHdr;
+	BYTE			anHdr[SCAN_INDEX_HDR_LEN];
+	unsigned		nMcuNum = m_nMcuXMax*m_nMcuYMax;
+	unsigned		nBlkNum = m_nBlkXMax*m_nBlkYMax;
+	unsigned		nCkptNum = (m_psScanCkpt) ? m_nScanCkptNum : 0;
+	unsigned		nHistoNum = sizeof(m_anDhtHisto)/sizeof(m_anDhtHisto[0][0][0]);
+	short int*		apBlkDcVal[NUM_CHAN_YCCK] = {m_pBlkDcValY,m_pBlkDcValCb,m_pBlkDcValCr,m_pBlkDcValK};
+	BYTE*			pData = NULL;
+	unsigned		nDataLen = 0;
+	bool			bOk = false;
+
+	if (strFname.IsEmpty()) {
+		return false;
+	}
+
+	// A missing index is the normal case, so no error is reported
+	CFile*	pFile = NULL;
+	try
+	{
+		pFile = new CFile(strFname, CFile::modeRead | CFile::typeBinary | CFile::shareDenyNone);
+		ULONGLONG	nFileLen = pFile->GetLength();
+
+		bOk = (pFile->Read(anHdr,SCAN_INDEX_HDR_LEN) == SCAN_INDEX_HDR_LEN);
+		if (bOk) {
+			ScanIndexGetHdr(anHdr,sHdr);
+		}
+		bOk = bOk && (sHdr.nMagic == SCAN_INDEX_MAGIC) && (sHdr.nVer == SCAN_INDEX_VER);
+		// The end position bounds the hash, so it must be within the file
+		bOk = bOk && (sHdr.nScanStart == nStart) &&
+			(sHdr.nScanEndPos >= nStart) && (sHdr.nScanEndPos < m_pWBuf->GetPosEof()) &&
+			(sHdr.nScanEndBit < 8) &&
+			(sHdr.nImgSizeX == m_nImgSizeX) && (sHdr.nImgSizeY == m_nImgSizeY) &&
+			(sHdr.nNumSosComps == m_nNumSosComps) &&
+			(sHdr.nMcuXMax == m_nMcuXMax) && (sHdr.nMcuYMax == m_nMcuYMax) &&
+			(sHdr.nRestartInterval == ((m_bRestartEn) ? m_nRestartInterval : 0)) &&
+			(sHdr.nCkptNum == nCkptNum) && (sHdr.nCkptMcus == ((nCkptNum) ? m_nScanCkptMcus : 0)) &&
+			(sHdr.nMcuMapLen <= nMcuNum*SCAN_INDEX_VAL_LEN) && (sHdr.nDcMapLen <= nBlkNum*m_nNumSosComps*3);
+		if (bOk) {
+			nDataLen = nHistoNum*4 + sHdr.nMcuMapLen + sHdr.nDcMapLen + sHdr.nCkptNum*SCAN_INDEX_CKPT_LEN;
+			bOk = (nFileLen == SCAN_INDEX_HDR_LEN + nDataLen);
+		}
+		if (bOk) {
+			unsigned char	anHash[sizeof(sHdr.anHash)];
+			ScanIndexHash(nStart,sHdr.nScanEndPos,anHash);
+			bOk = (memcmp(anHash,sHdr.anHash,sizeof(anHash)) == 0);
+		}
+		if ((bOk) && (bApply)) {
+			pData = new BYTE[nDataLen];
+			bOk = (pData) && (pFile->Read(pData,nDataLen) == nDataLen);
+		}
+		pFile->Close();
+	}
+	catch (CFileException* e)
+	{
+		e->Delete();
+		bOk = false;
+	}
+	if (pFile) {
+		delete pFile;
+	}
+
+	if ((!bOk) || (!bApply)) {
+		if (pData) {
+			delete [] pData;
+		}
+		return bOk;
+	}
+
+	// Huffman code histograms
+	unsigned	nOffset = 0;
+	unsigned*	pnHisto = &m_anDhtHisto[0][0][0];
+	for (unsigned nInd=0;nInd<nHistoNum;nInd++) {
+		pnHisto[nInd] = ScanIndexGetU32(pData,nOffset);
+	}
+
+	// MCU bit offsets
+	unsigned	nEnd = nOffset + sHdr.nMcuMapLen;
+	ULONGLONG	nBitPos = (ULONGLONG)nStart*8;
+	LONGLONG	nVal;
+	m_pMcuFileMap->Clear();
+	for (unsigned nMcuXY=0;(bOk)&&(nMcuXY<nMcuNum);nMcuXY++) {
+		bOk = ScanIndexGetVal(pData,nEnd,nOffset,nVal);
+		nBitPos += nVal;
+		m_pMcuFileMap->Set(nMcuXY,nBitPos);
+	}
+	bOk = (bOk) && (nOffset == nEnd);
+
+	// DC block maps
+	nEnd = nOffset + sHdr.nDcMapLen;
+	for (unsigned nChan=0;(bOk)&&(nChan<m_nNumSosComps);nChan++) {
+		for (unsigned nBlkY=0;(bOk)&&(nBlkY<m_nBlkYMax);nBlkY++) {
+			int		nDc = 0;
+			for (unsigned nBlkX=0;(bOk)&&(nBlkX<m_nBlkXMax);nBlkX++) {
+				bOk = ScanIndexGetVal(pData,nEnd,nOffset,nVal);
+				nDc += (int)nVal;
+				apBlkDcVal[nChan][nBlkY*m_nBlkXMax + nBlkX] = (short int)nDc;
+			}
+		}
+	}
+	bOk = (bOk) && (nOffset == nEnd);
+
+	// Entropy decoder checkpoints
+	for (unsigned nCkpt=0;(bOk)&&(nCkpt<nCkptNum);nCkpt++) {
+		ScanCkpt*	psCkpt = &m_psScanCkpt[nCkpt];
+		psCkpt->bValid = (ScanIndexGetU32(pData,nOffset) != 0);
+		psCkpt->nFilePos = ScanIndexGetU32(pData,nOffset);
+		psCkpt->nFileBit = ScanIndexGetU32(pData,nOffset);
+		psCkpt->nDcLum = (signed short)ScanIndexGetU32(pData,nOffset);
+		psCkpt->nDcChrCb = (signed short)ScanIndexGetU32(pData,nOffset);
+		psCkpt->nDcChrCr = (signed short)ScanIndexGetU32(pData,nOffset);
+		psCkpt->nDcK = (signed short)ScanIndexGetU32(pData,nOffset);
+		psCkpt->nRestartMcusLeft = ScanIndexGetU32(pData,nOffset);
+		psCkpt->nRestartExpectInd = ScanIndexGetU32(pData,nOffset);
+		// A checkpoint is only restored within the scan
+		if ((psCkpt->bValid) && ((psCkpt->nFilePos < nStart) || (psCkpt->nFilePos > sHdr.nScanEndPos) || (psCkpt->nFileBit >= 8))) {
+			bOk = false;
+		}
+	}
+	delete [] pData;
+	if (!bOk) {
+		// The decode overwrites the maps, but not checkpoints it skips
+		if (nCkptNum != 0) {
+			memset(m_psScanCkpt,0,(nCkptNum*sizeof(ScanCkpt)));
+		}
+		return false;
+	}
+
+	// Leave the scan buffer where the decode would have ended
+	DecodeRestartScanBuf(sHdr.nScanEndPos,true);
+	m_pWBuf->BufLoadWindow(sHdr.nScanEndPos);
+	BuffTopup();
+	ScanBuffConsume(min(sHdr.nScanEndBit,m_nScanBuffBits));
+	m_nRestartRead = sHdr.nRestartRead;
+	m_nNumPixels = nMcuNum * m_anSampPerMcuH[SCAN_COMP_Y] * m_anSampPerMcuV[SCAN_COMP_Y] * BLK_SZ_X*BLK_SZ_Y;
+	return true;
+}
+
+// Generate the pixel planes from the DC block maps (scan index)
+// - Each block is set to its DC level, as in the DC-only decode
+//
+// PRE:
+// - ScanIndexLoad()
+// POST:
+// - m_asPixPlane[]
+//
+void CimgDecode::ScanIndexRender()
+{
+	short int*	apBlkDcVal[NUM_CHAN_YCCK] = {m_pBlkDcValY,m_pBlkDcValCb,m_pBlkDcValCr,m_pBlkDcValK};
+	unsigned	nBlkX,nBlkY;
+
+	memset(m_afIdctBlock,0,sizeof(m_afIdctBlock));
+	memset(m_anIdctBlock,0,sizeof(m_anIdctBlock));
+
+	for (unsigned nMcuY=0;nMcuY<m_nMcuYMax;nMcuY++) {
+		for (unsigned nMcuX=0;nMcuX<m_nMcuXMax;nMcuX++) {
+			for (unsigned nComp=SCAN_COMP_Y;nComp<=m_nNumSosComps;nComp++) {
+				for (unsigned nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+					for (unsigned nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+						// Same block map layout as DecodeScanMcu()
+						if (nComp == SCAN_COMP_Y) {
+							nBlkX = nMcuX*m_anSampPerMcuH[nComp] + nCssIndH;
+							nBlkY = nMcuY*m_anSampPerMcuV[nComp] + nCssIndV;
+						} else {
+							nBlkX = nMcuX*m_anExpandBitsMcuH[nComp] + nCssIndH;
+							nBlkY = nMcuY*m_anExpandBitsMcuV[nComp] + nCssIndV;
+						}
+						if ((nBlkX < m_nBlkXMax) && (nBlkY < m_nBlkYMax)) {
+							SetFullRes(nMcuX,nMcuY,nComp,nCssIndH,nCssIndV,
+								apBlkDcVal[nComp-1][nBlkY*m_nBlkXMax + nBlkX]);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+// Report the scan decode mode (AC+DC or DC only), scale and bands
+// PRE:
+// - m_bDecodeScanAc
+// - m_nScaleShift
+// - m_nBandMcuRows, m_nBandShift
+//
+void CimgDecode::ReportScanMode()
+{
+	CString		strTmp;
+
+	if (m_bDecodeScanAc) {
+		m_pLog->AddLine(_T("  Scan Decode Mode: Full IDCT (AC + DC)"));
+	} else if (m_nScaleShift == SCAN_SCALE_8) {
+		m_pLog->AddLine(_T("  Scan Decode Mode: No IDCT (DC only)"));
+	} else {
+		m_pLog->AddLine(_T("  Scan Decode Mode: No IDCT (DC only)"));
+		m_pLog->AddLineWarn(_T("    NOTE: Low-resolution DC component shown. Can decode full-res with [Options->Scan Segment->Full IDCT]"));
+	}
+	// In band decode the pixel maps only hold a band of rows
+	unsigned	nPixMapH = (m_nBlkYMax*BLK_SZ_Y) >> m_nScaleShift;
+	if (m_nScaleShift != SCAN_SCALE_1) {
+		strTmp.Format(_T("  Scan Decode Scale: 1/%u (%u x %u pixels)"),1<<m_nScaleShift,m_nPixMapW,nPixMapH);
+		m_pLog->AddLine(strTmp);
+	}
+	if (m_nBandMcuRows != 0) {
+		strTmp.Format(_T("  Scan Decode Bands: %u MCU rows per band (limit %u MB), preview 1/%u (%u x %u pixels)"),
+			m_nBandMcuRows,m_pAppConfig->nDecodeScanMemMax,1<<(m_nScaleShift+m_nBandShift),
+			m_nPixMapW >> m_nBandShift,nPixMapH >> m_nBandShift);
+		m_pLog->AddLine(strTmp);
+	}
+	m_pLog->AddLine(_T(""));
+}
+
+// Report the scan decode statistics and the image analysis
+// - Compression ratio, Huffman code histograms, IDCT and color stats
+// - Histogram, average luminance and brightest pixel of the preview
+//
+// INPUT:
+// - bDisplay				= Was a preview image generated?
+// - bQuiet					= Disable output of certain messages?
+// PRE:
+// - m_nScanBuffPtr_first	= File position at start of the (first) scan
+//
+void CimgDecode::ReportScanStats(bool bDisplay,bool bQuiet)
+{
+	CString		strTmp;
+	bool		bDumpHistoY		= m_pAppConfig->bDumpHistoY;
+
+	if (!bQuiet) {
+
+		// Report Compression stats
+		// TODO: Should we use m_nNumSofComps?
+		strTmp.Format(_T("  Compression stats:"));
+		m_pLog->AddLine(strTmp);
+		unsigned nScanBufInd,nScanBufAlign;
+		GetScanBufInd(nScanBufInd,nScanBufAlign);
+		unsigned nScanBufPosEnd = GetScanBufFilePos(nScanBufInd);
+		unsigned nPixelBits = (m_bLossless) ? m_nLlNumComps*m_nPrecision : m_nNumSosComps*8;
+		float nCompressionRatio = (float)(m_nDimX*m_nDimY*nPixelBits) / (float)((nScanBufPosEnd-m_nScanBuffPtr_first)*8);
+		strTmp.Format(_T("    Compression Ratio: %5.2f:1"),nCompressionRatio);
+		m_pLog->AddLine(strTmp);
+		float nBitsPerPixel = (float)((nScanBufPosEnd-m_nScanBuffPtr_first)*8) / (float)(m_nDimX*m_nDimY);
+		strTmp.Format(_T("    Bits per pixel:    %5.2f:1"),nBitsPerPixel);
+		m_pLog->AddLine(strTmp);
+		m_pLog->AddLine(_T(""));
+
+
+		// Report Huffman stats
+		strTmp.Format(_T("  Huffman code histogram stats:"));
+		m_pLog->AddLine(strTmp);
+
+		unsigned nDhtHistoTotal;
+		for (unsigned nClass=DHT_CLASS_DC;nClass<=DHT_CLASS_AC;nClass++) {
+			for (unsigned nDhtDestId=0;nDhtDestId<=m_psTbl->anDhtLookupSetMax[nClass];nDhtDestId++) {
+				nDhtHistoTotal = 0;
+				for (unsigned nBitLen=1;nBitLen<=MAX_DHT_CODELEN;nBitLen++) {
+					nDhtHistoTotal += m_anDhtHisto[nClass][nDhtDestId][nBitLen];
+				}
+
+				strTmp.Format(_T("    Huffman Table: (Dest ID: %u, Class: %s)"),nDhtDestId,(nClass?_T("AC"):_T("DC")));
+				m_pLog->AddLine(strTmp);
+				for (unsigned nBitLen=1;nBitLen<=MAX_DHT_CODELEN;nBitLen++) {
+					strTmp.Format(_T("      # codes of length %02u bits: %8u (%3.0f%%)"),
+						nBitLen,m_anDhtHisto[nClass][nDhtDestId][nBitLen],(m_anDhtHisto[nClass][nDhtDestId][nBitLen]*100.0)/nDhtHistoTotal);
+					m_pLog->AddLine(strTmp);
+				}
+				m_pLog->AddLine(_T(""));
+			}
+		}
+
+		// Report IDCT stats
+		if (m_bDecodeScanAc) {
+			ReportIdctStats();
+		}
+
+		// Report YCC stats
+		// - The clipping stats are only collected for YCC conversions
+		if (m_nNumSosComps == NUM_CHAN_YCCK) {
+			m_pLog->AddLine(_T("  NOTE: YCC clipping stats not available for 4-component (CMYK/YCCK) images"));
+			m_pLog->AddLine(_T(""));
+		} else {
+			ReportColorStats();
+		}
+
+	}	// !bQuiet
+
+	// ------------------------------------
+
+	// Display the image histogram if enabled
+	if (bDisplay && m_bHistEn && (m_nNumSosComps != NUM_CHAN_YCCK)) {
+		DrawHistogram(bQuiet,bDumpHistoY);
+	}
+
+	if (bDisplay && m_bAvgYValid) {
+		m_pLog->AddLine(_T("  Average Pixel Luminance (Y):"));
+		strTmp.Format(_T("    Y=[%3u] (range: 0..255)"),
+			m_nAvgY);
+		m_pLog->AddLine(strTmp);
+		m_pLog->AddLine(_T(""));
+	}
+
+	if (bDisplay && m_bBrightValid) {
+		m_pLog->AddLine(_T("  Brightest Pixel Search:"));
+		if (m_nNumSosComps == NUM_CHAN_YCCK) {
+			strTmp.Format(_T("    %s=[%5d,%5d,%5d,%5d] RGB=[%3u,%3u,%3u] @ MCU[%3u,%3u]"),
+				(m_bColorYcck)?_T("YCCK"):_T("CMYK"),
+				m_nBrightY,m_nBrightCb,m_nBrightCr,m_nBrightK,m_nBrightR,m_nBrightG,m_nBrightB,
+				m_ptBrightMcu.x,m_ptBrightMcu.y);
+		} else {
+			strTmp.Format(_T("    YCC=[%5d,%5d,%5d] RGB=[%3u,%3u,%3u] @ MCU[%3u,%3u]"),
+				m_nBrightY,m_nBrightCb,m_nBrightCr,m_nBrightR,m_nBrightG,m_nBrightB,
+				m_ptBrightMcu.x,m_ptBrightMcu.y);
+		}
+		m_pLog->AddLine(strTmp);
+		m_pLog->AddLine(_T(""));
+	}
+
+
+	// --------------------------------------
+
+	if (!bQuiet) {
+		m_pLog->AddLine(_T("  Finished Decoding SCAN Data"));
+		strTmp.Format(_T("    Number of RESTART markers decoded: %u"),m_nRestartRead);
+		m_pLog->AddLine(strTmp);
+		strTmp.Format(_T("    Next position in scan buffer: Offset %s"),(LPCTSTR)GetScanBufPos());
+		m_pLog->AddLine(strTmp);
+
+		m_pLog->AddLine(_T(""));
+	}
+
+	// --------------------------------------
+	// Write out the full Y histogram if requested!
+
+	CString strFull;
+
+	if (bDisplay && m_bHistEn && bDumpHistoY) {
+		ReportHistogramY();
+	}
+}
+
+// Is a progressive decode waiting for its last scan?
+// - The coefficient buffer is allocated by the first scan and
+//   released once the image has been reconstructed
+//
+// RETURN:
+// - True if DecodeScanProgEnd() should still be called
+//
+bool CimgDecode::IsScanProgPending()
+{
+	return (m_apProgCoef[SCAN_COMP_Y] != NULL);
+}
+
+// Release the progressive coefficient buffers
+// POST:
+// - m_apProgCoef[]
+//
+void CimgDecode::DecodeScanProgFree()
+{
+	for (unsigned nComp=0;nComp<=NUM_CHAN_YCCK;nComp++) {
+		if (m_apProgCoef[nComp]) {
+			delete [] m_apProgCoef[nComp];
+			m_apProgCoef[nComp] = NULL;
+		}
+	}
+}
+
+// Report an error found in a progressive scan
+// - Only the first m_nScanErrMax errors are reported
+//
+// INPUT:
+// - strErr					= Error message
+// POST:
+// - m_bScanBad
+// - m_nWarnBadScanNum
+//
+void CimgDecode::ReportScanProgErr(LPCTSTR strErr)
+{
+	CString		strTmp;
+
+	m_bScanBad = true;
+	if (m_nWarnBadScanNum < m_nScanErrMax) {
+		m_pLog->AddLineErr(strErr);
+
+		m_nWarnBadScanNum++;
+		if (m_nWarnBadScanNum >= m_nScanErrMax) {
+			strTmp.Format(_T("    Only reported first %u instances of this message..."),m_nScanErrMax);
+			m_pLog->AddLineErr(strTmp);
+		}
+	}
+}
+
+// Read a huffman symbol from the scan buffer
+// - Unlike ReadScanVal(), the extra bits are not read, as their meaning
+//   depends on the type of progressive scan (eg. EOB runs)
+//
+// INPUT:
+// - nClass					= DHT Table class (0..1)
+// - nTbl					= DHT Destination ID (0..3)
+// OUTPUT:
+// - rSym					= Huffman symbol (RS)
+// POST:
+// - m_anDhtHisto[][][]
+// RETURN:
+// - False if no valid code was found (the error has been reported)
+//
+bool CimgDecode::ReadScanSym(unsigned nClass,unsigned nTbl,unsigned &rSym)
+{
+	CString		strTmp;
+
+	ASSERT(nClass < MAX_DHT_CLASS);
+	ASSERT(nTbl < MAX_DHT_DEST_ID);
+
+	rSym = 0;
+
+	if (m_nScanBuffBits < 32) {
+		BuffTopup();
+	}
+
+	// Has the scan buffer been depleted?
+	// - If this is due to a restart marker, the decode resumes after
+	//   the marker at the end of the restart interval
+	if (m_nScanBuffBits == 0) {
+		strTmp.Format(_T("*** ERROR: Overread scan segment (before nCode)! @ Offset: %s"),(LPCTSTR)GetScanBufPos());
+		ReportScanProgErr(strTmp);
+		if (!m_bRestartRead) {
+			m_bScanEnd = true;
+		}
+		return false;
+	}
+
+	// Look up the variable-length huffman code (see ReadScanVal)
+	unsigned nEntry;
+	unsigned nBitLen;
+	nEntry = m_psTbl->anDhtLookupfast[nClass][nTbl][(unsigned)(m_nScanBuff>>(SCANBUF_BITS-DHT_FAST_SIZE))];
+	if ((nEntry != DHT_CODE_UNUSED) && (nEntry & DHT_LOOKUP_SUB)) {
+		unsigned nSubInd = nEntry >> DHT_LOOKUP_VAL_SHIFT;
+		unsigned nSubVal = m_psTbl->anDhtLookupSub[nClass][nTbl][nSubInd][(unsigned)(m_nScanBuff>>(SCANBUF_BITS-MAX_DHT_CODELEN)) & DHT_SUB_MASK];
+		nEntry = (nSubVal == DHT_SUB_UNUSED) ? DHT_CODE_UNUSED : nSubVal;
+	}
+	if (nEntry != DHT_CODE_UNUSED) {
+		nBitLen = (nEntry >> DHT_LOOKUP_LEN_SHIFT) & DHT_LOOKUP_LEN_MASK;
+		if (nBitLen <= m_nScanBuffBits) {
+			rSym = nEntry & 0xFF;
+			m_anDhtHisto[nClass][nTbl][nBitLen]++;
+			ScanBuffConsume(nBitLen);
+			return true;
+		}
+	}
+
+	// Move forward by one bit to try to re-align
+	strTmp.Format(_T("*** ERROR: Bad huffman code @ %s"),(LPCTSTR)GetScanBufPos());
+	ReportScanProgErr(strTmp);
+	m_anDhtHisto[nClass][nTbl][1]++;
+	ScanBuffConsume(1);
+	return false;
+}
+
+// Read raw bits from the scan buffer
+// - Used for the extra bits that follow a huffman symbol
+//
+// INPUT:
+// - nNumBits				= Number of bits to read (0..16)
+// RETURN:
+// - Bits read (MSB first). Any bits beyond the end of the scan
+//   segment are read as zero
+//
+unsigned CimgDecode::ReadScanBits(unsigned nNumBits)
+{
+	CString		strTmp;
+	unsigned	nVal;
+
+	ASSERT(nNumBits <= MAX_DHT_CODELEN);
+	if (nNumBits == 0) {
+		return 0;
+	}
+
+	if (m_nScanBuffBits < nNumBits) {
+		BuffTopup();
 	}
-	if (!bDqtReady)
-	{
-		m_pLog->AddLineErr(_T("*** ERROR: Decoding image before DQT Table Selection via JFIF_SOF ***"));
-		// TODO: Is more error handling required?
-		return;
-	} else {
-		// FIXME: Not sure that we can always depend on the indices to appear
-		// in this order. May need another layer of indirection to get at the
-		// frame image component index.
-		nDqtTblY  = m_anDqtTblSel[DQT_DEST_Y];
-		nDqtTblCb = m_anDqtTblSel[DQT_DEST_CB];
-		nDqtTblCr = m_anDqtTblSel[DQT_DEST_CR];
-#ifdef DEBUG_YCCK
-		if (m_nNumSosComps==4) {
-			nDqtTblK = m_anDqtTblSel[DQT_DEST_K];
+	nVal = (unsigned)(m_nScanBuff>>(SCANBUF_BITS-nNumBits));
+
+	// Did we overread the scan buffer?
+	if (nNumBits > m_nScanBuffBits) {
+		ScanBuffConsume(m_nScanBuffBits);
+		strTmp.Format(_T("*** ERROR: Overread scan segment (after nCode)! @ Offset: %s"),(LPCTSTR)GetScanBufPos());
+		ReportScanProgErr(strTmp);
+		if (!m_bRestartRead) {
+			m_bScanEnd = true;
 		}
-#endif
+		return nVal;
 	}
 
-	// Now check DHT tables
-	bool bDhtReady = true;
-	unsigned nDhtTblDcY,nDhtTblDcCb,nDhtTblDcCr;
-	unsigned nDhtTblAcY,nDhtTblAcCb,nDhtTblAcCr;
-#ifdef DEBUG_YCCK
-	unsigned nDhtTblDcK,nDhtTblAcK;
-#endif
-	for (unsigned nClass=DHT_CLASS_DC;nClass<=DHT_CLASS_AC;nClass++) {
-		for (unsigned nCompInd=1;nCompInd<=m_nNumSosComps;nCompInd++) {
-			if (m_anDhtTblSel[nClass][nCompInd]<0) bDhtReady = false;
+	ScanBuffConsume(nNumBits);
+	return nVal;
+}
+
+// Handle the end of a restart interval in a progressive scan
+// - Unlike the sequential decode (which restarts when a huffman
+//   lookup runs into the RSTn marker) the restart is explicit as an
+//   EOB run can end an interval without reading any more bits
+//
+// INPUT:
+// - anDcPred				= DC predictors per scan component
+// OUTPUT:
+// - anDcPred				= Reset if the marker was found
+// POST:
+// - m_nProgEobRun
+// - m_nRestartMcusLeft
+// - Arithmetic decoder state (see DecodeScanArithInit)
+// RETURN:
+// - True if the RSTn marker was found in the expected place
+//
+bool CimgDecode::DecodeScanProgRestart(int* anDcPred)
+{
+	CString		strTmp;
+	bool		bRet = true;
+
+	// The arithmetic decoder doesn't necessarily read all of the bytes
+	// that the encoder flushed at the end of the interval
+	if (m_bScanArith) {
+		while (!ReadScanArithEnd()) {
+			ScanBuffConsume(8);
 		}
 	}
 
-	// Ensure that the table has been defined already!
-	unsigned nSel;
-	for (unsigned nCompInd=1;nCompInd<=m_nNumSosComps;nCompInd++) {
-		// Check for DC DHT table
-		nSel = m_anDhtTblSel[DHT_CLASS_DC][nCompInd];
-		if (m_anDhtLookupSize[DHT_CLASS_DC][nSel] == 0) {
-			bDhtReady = false;
+	// Make sure that the reservoir has been filled up to the RST marker
+	BuffTopup();
+	if ((!m_bRestartRead) || (m_nScanBuffBits >= 8)) {
+		if (!m_bScanErrorsDisable) {
+			strTmp.Format(_T("  Expect Restart interval elapsed @ %s"),(LPCTSTR)GetScanBufPos());
+			m_pLog->AddLine(strTmp);
+			strTmp.Format(_T("    ERROR: Restart marker not detected"));
+			m_pLog->AddLineErr(strTmp);
 		}
-		// Check for AC DHT table
-		nSel = m_anDhtTblSel[DHT_CLASS_AC][nCompInd];
-		if (m_anDhtLookupSize[DHT_CLASS_AC][nSel] == 0) {
-			bDhtReady = false;
+		bRet = false;
+	}
+
+	// Resume after the marker
+	if (m_bRestartRead) {
+		m_nScanBuffPtr += 2;
+		DecodeRestartScanBuf(m_nScanBuffPtr,true);
+		m_bRestartRead = false;
+		BuffTopup();
+
+		for (unsigned nScanComp=1;nScanComp<=MAX_SOS_COMP_NS;nScanComp++) {
+			anDcPred[nScanComp] = 0;
+		}
+		m_nProgEobRun = 0;
+		if (m_bScanArith) {
+			DecodeScanArithInit();
 		}
 	}
 
+	return bRet;
+}
 
-	if (!bDhtReady)
-	{
-		m_pLog->AddLineErr(_T("*** ERROR: Decoding image before DHT Table Selection via JFIF_SOS ***"));
-		// TODO: Is more error handling required here?
-		return;
+// Decode one block of a progressive scan into the coefficient buffer
+// - DC first scans decode the DC difference (scaled by Al) and DC
+//   refinement scans add one bit (ITU-T.81 G.1.2.1)
+// - AC scans are handled by DecodeScanProgAcFirst() and
+//   DecodeScanProgAcRefine()
+// - Sequential scans (Ss=0, Se=63) are handled by DecodeScanProgSeq()
+// - Arithmetic coded scans are handled by DecodeScanArithBlk()
+//
+// INPUT:
+// - pnCoef					= Block coefficients (zigzag order)
+// - nScanComp				= Scan component index (1..Ns)
+// - rnDcPred				= DC predictor for the scan component
+// OUTPUT:
+// - pnCoef					= Refined block coefficients
+// - rnDcPred				= Updated DC predictor
+// PRE:
+// - m_nSosSpectralStart, m_nSosSpectralEnd
+// - m_nSosSuccApproxHigh, m_nSosSuccApproxLow
+// - m_anScanDhtTblDc[], m_anScanDhtTblAc[]
+// RETURN:
+// - False if the block could not be decoded
+//
+bool CimgDecode::DecodeScanProgBlk(short int* pnCoef,unsigned nScanComp,int &rnDcPred)
+{
+	if (m_bScanArith) {
+		return DecodeScanArithBlk(pnCoef,nScanComp,rnDcPred);
+	}
+	if (m_bProgSequential) {
+		return DecodeScanProgSeq(pnCoef,nScanComp,rnDcPred);
+	}
+
+	if (m_nSosSpectralStart != 0) {
+		if (m_nSosSuccApproxHigh == 0) {
+			return DecodeScanProgAcFirst(pnCoef,m_anScanDhtTblAc[nScanComp]);
+		} else {
+			return DecodeScanProgAcRefine(pnCoef,m_anScanDhtTblAc[nScanComp]);
+		}
+	}
+
+	if (m_nSosSuccApproxHigh == 0) {
+		// DC first scan
+		unsigned	nSym;
+		unsigned	nBits;
+		if (!ReadScanSym(DHT_CLASS_DC,m_anScanDhtTblDc[nScanComp],nSym)) {
+			return false;
+		}
+		nBits = nSym & 0x0F;
+		if (nBits > 0) {
+			rnDcPred += HuffmanDc2Signed(ReadScanBits(nBits),nBits);
+		}
+		pnCoef[DCT_COEFF_DC] = (short int)(rnDcPred * (1<<m_nSosSuccApproxLow));
 	} else {
-		// Define the huffman table indices that are selected for each
-		// image component index and class (AC,DC).
-		//
-		// No need to check if a table is valid here since we have
-		// previously checked to ensure that all required tables
-		// exist.
-		// NOTE: If the table has not been defined, then the index
-		// will be 0xFFFFFFFF. ReadScanVal() will trap this with ASSERT
-		// should it ever be used.
-		nDhtTblDcY  = m_anDhtTblSel[DHT_CLASS_DC][COMP_IND_YCC_Y];
-		nDhtTblAcY  = m_anDhtTblSel[DHT_CLASS_AC][COMP_IND_YCC_Y];
-		nDhtTblDcCb = m_anDhtTblSel[DHT_CLASS_DC][COMP_IND_YCC_CB];
-		nDhtTblAcCb = m_anDhtTblSel[DHT_CLASS_AC][COMP_IND_YCC_CB];
-		nDhtTblDcCr = m_anDhtTblSel[DHT_CLASS_DC][COMP_IND_YCC_CR];
-		nDhtTblAcCr = m_anDhtTblSel[DHT_CLASS_AC][COMP_IND_YCC_CR];
-#ifdef DEBUG_YCCK
-		nDhtTblDcK	= m_anDhtTblSel[DHT_CLASS_DC][COMP_IND_YCC_K];
-		nDhtTblAcK	= m_anDhtTblSel[DHT_CLASS_AC][COMP_IND_YCC_K];
-#endif
+		// DC refinement scan
+		if (ReadScanBits(1)) {
+			pnCoef[DCT_COEFF_DC] |= (short int)(1<<m_nSosSuccApproxLow);
+		}
 	}
+	return true;
+}
 
-	// Done checks
+// Decode all of the coefficients of a block in a sequential scan
+// - Used when the components of a sequential (baseline / extended)
+//   frame are spread over several scans. This is the same huffman
+//   decode as DecodeScanComp() but the coefficients are kept until the
+//   frame is complete. Any AC symbol with no coefficient bits other
+//   than ZRL ends the block (ITU-T.81 F.2.2.2)
+//
+// INPUT:
+// - pnCoef					= Block coefficients (zigzag order)
+// - nScanComp				= Scan component index (1..Ns)
+// - rnDcPred				= DC predictor for the scan component
+// OUTPUT:
+// - pnCoef					= Block coefficients
+// - rnDcPred				= Updated DC predictor
+// RETURN:
+// - False if the block could not be decoded
+//
+bool CimgDecode::DecodeScanProgSeq(short int* pnCoef,unsigned nScanComp,int &rnDcPred)
+{
+	CString		strTmp;
+	unsigned	nSym;
+	unsigned	nRun;
+	unsigned	nBits;
 
+	if (!ReadScanSym(DHT_CLASS_DC,m_anScanDhtTblDc[nScanComp],nSym)) {
+		return false;
+	}
+	nBits = nSym & 0x0F;
+	if (nBits > 0) {
+		rnDcPred += HuffmanDc2Signed(ReadScanBits(nBits),nBits);
+	}
+	pnCoef[DCT_COEFF_DC] = (short int)rnDcPred;
 
-	// Inform if they are in AC+DC/DC mode
-	if (!bQuiet) {
-		if (m_bDecodeScanAc) {
-			m_pLog->AddLine(_T("  Scan Decode Mode: Full IDCT (AC + DC)"));
+	for (unsigned nInd=1;nInd<DCT_SZ_ALL;nInd++) {
+		if (!ReadScanSym(DHT_CLASS_AC,m_anScanDhtTblAc[nScanComp],nSym)) {
+			return false;
+		}
+		nRun = nSym >> 4;
+		nBits = nSym & 0x0F;
+		if (nBits != 0) {
+			nInd += nRun;
+			if (nInd >= DCT_SZ_ALL) {
+				strTmp.Format(_T("*** ERROR: @ %s, nNumCoeffs>%u"),(LPCTSTR)GetScanBufPos(),DCT_SZ_ALL);
+				ReportScanProgErr(strTmp);
+				return false;
+			}
+			pnCoef[nInd] = (short int)HuffmanDc2Signed(ReadScanBits(nBits),nBits);
+		} else if (nRun == 15) {
+			// ZRL: 16 zero coefficients
+			nInd += 15;
 		} else {
-			m_pLog->AddLine(_T("  Scan Decode Mode: No IDCT (DC only)"));
-			m_pLog->AddLineWarn(_T("    NOTE: Low-resolution DC component shown. Can decode full-res with [Options->Scan Segment->Full IDCT]"));
+			// EOB
+			break;
 		}
-		m_pLog->AddLine(_T(""));
 	}
+	return true;
+}
 
-	// Report any Buffer overlays
-	m_pWBuf->ReportOverlays(m_pLog);
+// Decode the AC coefficients of a block in the first scan of a band
+// - An EOBn symbol ends this block and a run of following blocks
+//   (ITU-T.81 G.1.2.2)
+//
+// INPUT:
+// - pnCoef					= Block coefficients (zigzag order)
+// - nTbl					= AC DHT table
+// OUTPUT:
+// - pnCoef					= Coefficients Ss..Se (scaled by Al)
+// POST:
+// - m_nProgEobRun
+// RETURN:
+// - False if the block could not be decoded
+//
+bool CimgDecode::DecodeScanProgAcFirst(short int* pnCoef,unsigned nTbl)
+{
+	CString		strTmp;
+	unsigned	nSym;
+	unsigned	nRun;
+	unsigned	nBits;
 
-	m_nNumPixels = 0;
+	// Blocks within an EOB run have no coefficients in this band
+	if (m_nProgEobRun > 0) {
+		m_nProgEobRun--;
+		return true;
+	}
 
-	// Clear the histogram and color correction clipping stats
-	if (bDisplay) {
-		memset(&m_sStatClip,0,sizeof(m_sStatClip));
-		memset(&m_sHisto,0,sizeof(m_sHisto));
+	for (unsigned nInd=m_nSosSpectralStart;nInd<=m_nSosSpectralEnd;nInd++) {
+		if (!ReadScanSym(DHT_CLASS_AC,nTbl,nSym)) {
+			return false;
+		}
+		nRun = nSym >> 4;
+		nBits = nSym & 0x0F;
+		if (nBits != 0) {
+			nInd += nRun;
+			if (nInd > m_nSosSpectralEnd) {
+				strTmp.Format(_T("*** ERROR: @ %s, nNumCoeffs>%u"),(LPCTSTR)GetScanBufPos(),m_nSosSpectralEnd+1);
+				ReportScanProgErr(strTmp);
+				return false;
+			}
+			pnCoef[nInd] = (short int)(HuffmanDc2Signed(ReadScanBits(nBits),nBits) * (1<<m_nSosSuccApproxLow));
+		} else if (nRun == 15) {
+			// ZRL: 16 zero coefficients
+			nInd += 15;
+		} else {
+			// EOBn: this block and the next (2^n - 1 + extra bits) blocks
+			m_nProgEobRun = 1 << nRun;
+			if (nRun > 0) {
+				m_nProgEobRun += ReadScanBits(nRun);
+			}
+			m_nProgEobRun--;
+			break;
+		}
+	}
+	return true;
+}
 
-		// FIXME: Histo should now be done after color convert
-		memset(&m_anCcHisto_r,0,sizeof(m_anCcHisto_r));
-		memset(&m_anCcHisto_g,0,sizeof(m_anCcHisto_g));
-		memset(&m_anCcHisto_b,0,sizeof(m_anCcHisto_b));
+// Decode the AC refinement bits of a block (successive approximation)
+// - Each new coefficient is +/-1 (scaled by Al). Every coefficient that
+//   is already non-zero and that is passed over receives a correction
+//   bit (ITU-T.81 G.1.2.3)
+//
+// INPUT:
+// - pnCoef					= Block coefficients (zigzag order)
+// - nTbl					= AC DHT table
+// OUTPUT:
+// - pnCoef					= Refined coefficients Ss..Se
+// POST:
+// - m_nProgEobRun
+// RETURN:
+// - False if the block could not be decoded
+//
+bool CimgDecode::DecodeScanProgAcRefine(short int* pnCoef,unsigned nTbl)
+{
+	CString		strTmp;
+	short int	nBitP1 = (short int)(1<<m_nSosSuccApproxLow);	// +1 in the bit position
+	short int	nBitM1 = -nBitP1;								// -1 in the bit position
+	int			nInd = (int)m_nSosSpectralStart;
+	int			nEnd = (int)m_nSosSpectralEnd;
+	unsigned	nSym;
+	int			nRun;
+	short int	nVal;
+
+	if (m_nProgEobRun == 0) {
+		for (;nInd<=nEnd;nInd++) {
+			if (!ReadScanSym(DHT_CLASS_AC,nTbl,nSym)) {
+				return false;
+			}
+			nRun = (int)(nSym >> 4);
+			nVal = 0;
+			if ((nSym & 0x0F) != 0) {
+				if ((nSym & 0x0F) != 1) {
+					strTmp.Format(_T("*** ERROR: Bad refinement coefficient size [%u] @ %s"),nSym & 0x0F,(LPCTSTR)GetScanBufPos());
+					ReportScanProgErr(strTmp);
+				}
+				nVal = (ReadScanBits(1)) ? nBitP1 : nBitM1;
+			} else if (nRun != 15) {
+				// EOBn: the rest of this block is handled as part of the run
+				m_nProgEobRun = 1 << nRun;
+				if (nRun > 0) {
+					m_nProgEobRun += ReadScanBits(nRun);
+				}
+				break;
+			}
+			// (else ZRL: skip 16 zero coefficients)
+
+			// Pass over the coefficients that are already non-zero (adding
+			// their correction bits) and nRun zero coefficients
+			while (nInd <= nEnd) {
+				short int* pnCur = &pnCoef[nInd];
+				if (*pnCur != 0) {
+					if (ReadScanBits(1)) {
+						if ((*pnCur & nBitP1) == 0) {
+							*pnCur += (*pnCur >= 0) ? nBitP1 : nBitM1;
+						}
+					}
+				} else {
+					if (--nRun < 0) {
+						break;
+					}
+				}
+				nInd++;
+			}
+			if ((nVal != 0) && (nInd <= nEnd)) {
+				pnCoef[nInd] = nVal;
+			}
+		}
+	}
+
+	if (m_nProgEobRun > 0) {
+		// The remaining non-zero coefficients of a block in the
+		// EOB run still receive their correction bits
+		for (;nInd<=nEnd;nInd++) {
+			short int* pnCur = &pnCoef[nInd];
+			if (*pnCur != 0) {
+				if (ReadScanBits(1)) {
+					if ((*pnCur & nBitP1) == 0) {
+						*pnCur += (*pnCur >= 0) ? nBitP1 : nBitM1;
+					}
+				}
+			}
+		}
+		m_nProgEobRun--;
+	}
+	return true;
+}
+
+// Probability estimation state machine (ITU-T.81 Table D.2)
+// - Each entry packs Qe (bits 31..16), Next_Index_MPS (bits 15..8),
+//   Switch_MPS (bit 7) and Next_Index_LPS (bits 6..0)
+// - The extra last entry is a fixed estimate (Qe=0x5A1D) that never
+//   changes state. It is used for the sign and refinement bits that
+//   are coded without adaptation
+//
+#define ARITH_QE(nQe,nLps,nMps,nSwitch)	((DWORD)(((nQe)<<16) | ((nMps)<<8) | ((nSwitch)<<7) | (nLps)))
+const DWORD CimgDecode::m_anArithQe[ARITH_QE_NUM+1] = {
+	ARITH_QE(0x5a1d,   1,   1, 1), ARITH_QE(0x2586,  14,   2, 0), ARITH_QE(0x1114,  16,   3, 0), ARITH_QE(0x080b,  18,   4, 0),
+	ARITH_QE(0x03d8,  20,   5, 0), ARITH_QE(0x01da,  23,   6, 0), ARITH_QE(0x00e5,  25,   7, 0), ARITH_QE(0x006f,  28,   8, 0),
+	ARITH_QE(0x0036,  30,   9, 0), ARITH_QE(0x001a,  33,  10, 0), ARITH_QE(0x000d,  35,  11, 0), ARITH_QE(0x0006,   9,  12, 0),
+	ARITH_QE(0x0003,  10,  13, 0), ARITH_QE(0x0001,  12,  13, 0), ARITH_QE(0x5a7f,  15,  15, 1), ARITH_QE(0x3f25,  36,  16, 0),
+	ARITH_QE(0x2cf2,  38,  17, 0), ARITH_QE(0x207c,  39,  18, 0), ARITH_QE(0x17b9,  40,  19, 0), ARITH_QE(0x1182,  42,  20, 0),
+	ARITH_QE(0x0cef,  43,  21, 0), ARITH_QE(0x09a1,  45,  22, 0), ARITH_QE(0x072f,  46,  23, 0), ARITH_QE(0x055c,  48,  24, 0),
+	ARITH_QE(0x0406,  49,  25, 0), ARITH_QE(0x0303,  51,  26, 0), ARITH_QE(0x0240,  52,  27, 0), ARITH_QE(0x01b1,  54,  28, 0),
+	ARITH_QE(0x0144,  56,  29, 0), ARITH_QE(0x00f5,  57,  30, 0), ARITH_QE(0x00b7,  59,  31, 0), ARITH_QE(0x008a,  60,  32, 0),
+	ARITH_QE(0x0068,  62,  33, 0), ARITH_QE(0x004e,  63,  34, 0), ARITH_QE(0x003b,  32,  35, 0), ARITH_QE(0x002c,  33,   9, 0),
+	ARITH_QE(0x5ae1,  37,  37, 1), ARITH_QE(0x484c,  64,  38, 0), ARITH_QE(0x3a0d,  65,  39, 0), ARITH_QE(0x2ef1,  67,  40, 0),
+	ARITH_QE(0x261f,  68,  41, 0), ARITH_QE(0x1f33,  69,  42, 0), ARITH_QE(0x19a8,  70,  43, 0), ARITH_QE(0x1518,  72,  44, 0),
+	ARITH_QE(0x1177,  73,  45, 0), ARITH_QE(0x0e74,  74,  46, 0), ARITH_QE(0x0bfb,  75,  47, 0), ARITH_QE(0x09f8,  77,  48, 0),
+	ARITH_QE(0x0861,  78,  49, 0), ARITH_QE(0x0706,  79,  50, 0), ARITH_QE(0x05cd,  48,  51, 0), ARITH_QE(0x04de,  50,  52, 0),
+	ARITH_QE(0x040f,  50,  53, 0), ARITH_QE(0x0363,  51,  54, 0), ARITH_QE(0x02d4,  52,  55, 0), ARITH_QE(0x025c,  53,  56, 0),
+	ARITH_QE(0x01f8,  54,  57, 0), ARITH_QE(0x01a4,  55,  58, 0), ARITH_QE(0x0160,  56,  59, 0), ARITH_QE(0x0125,  57,  60, 0),
+	ARITH_QE(0x00f6,  58,  61, 0), ARITH_QE(0x00cb,  59,  62, 0), ARITH_QE(0x00ab,  61,  63, 0), ARITH_QE(0x008f,  61,  32, 0),
+	ARITH_QE(0x5b12,  65,  65, 1), ARITH_QE(0x4d04,  80,  66, 0), ARITH_QE(0x412c,  81,  67, 0), ARITH_QE(0x37d8,  82,  68, 0),
+	ARITH_QE(0x2fe8,  83,  69, 0), ARITH_QE(0x293c,  84,  70, 0), ARITH_QE(0x2379,  86,  71, 0), ARITH_QE(0x1edf,  87,  72, 0),
+	ARITH_QE(0x1aa9,  87,  73, 0), ARITH_QE(0x174e,  72,  74, 0), ARITH_QE(0x1424,  72,  75, 0), ARITH_QE(0x119c,  74,  76, 0),
+	ARITH_QE(0x0f6b,  74,  77, 0), ARITH_QE(0x0d51,  75,  78, 0), ARITH_QE(0x0bb6,  77,  79, 0), ARITH_QE(0x0a40,  77,  48, 0),
+	ARITH_QE(0x5832,  80,  81, 1), ARITH_QE(0x4d1c,  88,  82, 0), ARITH_QE(0x438e,  89,  83, 0), ARITH_QE(0x3bdd,  90,  84, 0),
+	ARITH_QE(0x34ee,  91,  85, 0), ARITH_QE(0x2eae,  92,  86, 0), ARITH_QE(0x299a,  93,  87, 0), ARITH_QE(0x2516,  86,  71, 0),
+	ARITH_QE(0x5570,  88,  89, 1), ARITH_QE(0x4ca9,  95,  90, 0), ARITH_QE(0x44d9,  96,  91, 0), ARITH_QE(0x3e22,  97,  92, 0),
+	ARITH_QE(0x3824,  99,  93, 0), ARITH_QE(0x32b4,  99,  94, 0), ARITH_QE(0x2e17,  93,  86, 0), ARITH_QE(0x56a8,  95,  96, 1),
+	ARITH_QE(0x4f46, 101,  97, 0), ARITH_QE(0x47e5, 102,  98, 0), ARITH_QE(0x41cf, 103,  99, 0), ARITH_QE(0x3c3d, 104, 100, 0),
+	ARITH_QE(0x375e,  99,  93, 0), ARITH_QE(0x5231, 105, 102, 0), ARITH_QE(0x4c0f, 106, 103, 0), ARITH_QE(0x4639, 107, 104, 0),
+	ARITH_QE(0x415e, 103,  99, 0), ARITH_QE(0x5627, 105, 106, 1), ARITH_QE(0x50e7, 108, 107, 0), ARITH_QE(0x4b85, 109, 103, 0),
+	ARITH_QE(0x5597, 110, 109, 0), ARITH_QE(0x504f, 111, 107, 0), ARITH_QE(0x5a10, 110, 111, 1), ARITH_QE(0x5522, 112, 109, 0),
+	ARITH_QE(0x59eb, 112, 111, 1),
+	ARITH_QE(0x5a1d, ARITH_QE_FIXED, ARITH_QE_FIXED, 0)
+};
+
+// Has the arithmetic decoder reached the end of the entropy coded segment?
+// - BuffAddByte() only halts at RSTn markers. Any other marker is
+//   loaded into the reservoir (flagged as SCANBUF_BADMARK) so it is
+//   detected once the decoder reaches the flagged byte
+//
+// PRE:
+// - m_nScanBuffBits is a multiple of 8 (arithmetic scans are byte aligned)
+// RETURN:
+// - True if there are no more bytes in the segment
+//
+bool CimgDecode::ReadScanArithEnd()
+{
+	if (m_nScanBuffBits < 8) {
+		BuffTopup();
+		if (m_nScanBuffBits < 8) {
+			return true;
+		}
+	}
+	if (m_nScanBuffErrNum > 0) {
+		ScanBuffLatchErr(m_nScanBuffLoadInd - m_nScanBuffBits/8);
+	}
+	return (m_nScanBuffLatchErr == SCANBUF_BADMARK);
+}
+
+// Read the next byte of an arithmetic coded scan
+// - The byte stuffing has already been removed by BuffAddByte()
+// - Once the scan segment (or restart interval) has been read, the
+//   decoder is fed with zero bytes (ITU-T.81 D.2.6). The encoder may
+//   have dropped trailing zero bytes, so this isn't an error
+//
+// RETURN:
+// - Next byte of the entropy coded segment, or 0
+//
+unsigned CimgDecode::ReadScanArithByte()
+{
+	unsigned	nVal;
+
+	if (ReadScanArithEnd()) {
+		return 0;
+	}
+	nVal = (unsigned)(m_nScanBuff>>(SCANBUF_BITS-8));
+	ScanBuffConsume(8);
+	return nVal;
+}
+
+// Decode one binary decision with the QM-coder
+// - Implements the DECODE procedure with the conditional exchange,
+//   probability estimation and renormalization (ITU-T.81 D.2)
+//
+// INPUT:
+// - rSt					= Statistics bin for the decision context
+// OUTPUT:
+// - rSt					= Updated statistics bin
+// PRE:
+// - DecodeScanArithInit()
+// POST:
+// - m_nArithC, m_nArithA, m_nArithCt
+// RETURN:
+// - Decoded decision (0 or 1)
+//
+inline unsigned CimgDecode::ReadScanArith(BYTE &rSt)
+{
+	unsigned	nSv;
+	unsigned	nQe;
+	unsigned	nNextLps;
+	unsigned	nNextMps;
+	unsigned	nTemp;
+
+	// Renormalize and read in the next bytes as needed (D.2.6)
+	// - Starting from CT=-16, the first two bytes are read into C
+	//   before A is initialized
+	while (m_nArithA < 0x8000) {
+		if (--m_nArithCt < 0) {
+			m_nArithC = (m_nArithC << 8) | ReadScanArithByte();
+			m_nArithCt += 8;
+			if (m_nArithCt < 0) {
+				if (++m_nArithCt == 0) {
+					m_nArithA = 0x8000;
+				}
+			}
+		}
+		m_nArithA <<= 1;
+	}
+
+	nSv = rSt;
+	nQe = m_anArithQe[nSv & 0x7F];
+	nNextLps = nQe & 0xFF;			// Next_Index_LPS + Switch_MPS
+	nNextMps = (nQe >> 8) & 0xFF;	// Next_Index_MPS
+	nQe >>= 16;
+
+	// Decode the decision with conditional exchange (D.2.4, D.2.5)
+	// - C is aligned with A by the CT bits that haven't been used yet
+	nTemp = m_nArithA - nQe;
+	m_nArithA = nTemp;
+	nTemp <<= m_nArithCt;
+	if (m_nArithC >= nTemp) {
+		m_nArithC -= nTemp;
+		if (m_nArithA < nQe) {
+			m_nArithA = nQe;
+			rSt = (BYTE)((nSv & 0x80) ^ nNextMps);
+		} else {
+			m_nArithA = nQe;
+			rSt = (BYTE)((nSv & 0x80) ^ nNextLps);
+			nSv ^= 0x80;
+		}
+	} else if (m_nArithA < 0x8000) {
+		if (m_nArithA < nQe) {
+			rSt = (BYTE)((nSv & 0x80) ^ nNextLps);
+			nSv ^= 0x80;
+		} else {
+			rSt = (BYTE)((nSv & 0x80) ^ nNextMps);
+		}
+	}
+
+	return nSv >> 7;
+}
+
+// Report an invalid arithmetic code
+// - The rest of the restart interval (or scan) is skipped as the
+//   decoder can't resynchronize before the next restart marker
+//
+// POST:
+// - m_bArithErr
+//
+void CimgDecode::ReportScanArithErr()
+{
+	CString		strTmp;
+
+	strTmp.Format(_T("*** ERROR: Bad arithmetic code @ %s"),(LPCTSTR)GetScanBufPos());
+	ReportScanProgErr(strTmp);
+	m_bArithErr = true;
+}
+
+// Reset the arithmetic decoder at the start of a scan or restart interval
+// - All of the statistics bins start with state 0 and MPS=0 (F.1.4.4)
+//
+// POST:
+// - m_anArithDcStats[][], m_anArithAcStats[][]
+// - m_anArithDcContext[]
+// - m_nArithC, m_nArithA, m_nArithCt
+// - m_bArithErr
+//
+void CimgDecode::DecodeScanArithInit()
+{
+	memset(m_anArithDcStats,0,sizeof(m_anArithDcStats));
+	memset(m_anArithAcStats,0,sizeof(m_anArithAcStats));
+	m_nArithFixedBin = ARITH_QE_FIXED;
+	for (unsigned nScanComp=0;nScanComp<=MAX_SOS_COMP_NS;nScanComp++) {
+		m_anArithDcContext[nScanComp] = 0;
+	}
+
+	// Force the first decision to read in two bytes
+	m_nArithC = 0;
+	m_nArithA = 0;
+	m_nArithCt = -16;
+	m_bArithErr = false;
+}
+
+// Decode one block of an arithmetic coded scan into the coefficient buffer
+// - The same scan types as DecodeScanProgBlk(). Note that arithmetic
+//   coding doesn't use EOB runs
+//
+// INPUT:
+// - pnCoef					= Block coefficients (zigzag order)
+// - nScanComp				= Scan component index (1..Ns)
+// - rnDcPred				= DC predictor for the scan component
+// OUTPUT:
+// - pnCoef					= Refined block coefficients
+// - rnDcPred				= Updated DC predictor
+// RETURN:
+// - False if the block could not be decoded
+//
+bool CimgDecode::DecodeScanArithBlk(short int* pnCoef,unsigned nScanComp,int &rnDcPred)
+{
+	// After an error, nothing more is decoded until the next restart
+	if (m_bArithErr) {
+		return false;
+	}
+
+	if (m_bProgSequential) {
+		if (!DecodeScanArithDc(nScanComp,rnDcPred)) {
+			return false;
+		}
+		pnCoef[DCT_COEFF_DC] = (short int)rnDcPred;
+		return DecodeScanArithAc(pnCoef,m_anScanDhtTblAc[nScanComp]);
+	}
+
+	if (m_nSosSpectralStart != 0) {
+		if (m_nSosSuccApproxHigh == 0) {
+			return DecodeScanArithAc(pnCoef,m_anScanDhtTblAc[nScanComp]);
+		} else {
+			return DecodeScanArithAcRefine(pnCoef,m_anScanDhtTblAc[nScanComp]);
+		}
+	}
 
-		memset(&m_anHistoYFull,0,sizeof(m_anHistoYFull));
-		memset(&m_anHistoYSubset,0,sizeof(m_anHistoYSubset));
+	if (m_nSosSuccApproxHigh == 0) {
+		// DC first scan
+		if (!DecodeScanArithDc(nScanComp,rnDcPred)) {
+			return false;
+		}
+		pnCoef[DCT_COEFF_DC] = (short int)(rnDcPred * (1<<m_nSosSuccApproxLow));
+	} else {
+		// DC refinement scan (G.1.3.1)
+		if (ReadScanArith(m_nArithFixedBin)) {
+			pnCoef[DCT_COEFF_DC] |= (short int)(1<<m_nSosSuccApproxLow);
+		}
 	}
+	return true;
+}
 
+// Decode the DC difference of a block and update the predictor
+// - The statistics bin depends on the conditioning category of the
+//   previous difference of the component (F.1.4.4.1 & F.2.4.1)
+//
+// INPUT:
+// - nScanComp				= Scan component index (1..Ns)
+// - rnDcPred				= DC predictor for the scan component
+// OUTPUT:
+// - rnDcPred				= Updated DC predictor
+// POST:
+// - m_anArithDcContext[]
+// RETURN:
+// - False if the magnitude was invalid
+//
+bool CimgDecode::DecodeScanArithDc(unsigned nScanComp,int &rnDcPred)
+{
+	unsigned	nTbl = m_anScanDhtTblDc[nScanComp];
+	BYTE*		pSt = &m_anArithDcStats[nTbl][m_anArithDcContext[nScanComp]];
+	unsigned	nSign;
+	unsigned	nMag;
+	unsigned	nVal;
 
+	// Zero difference (S0)
+	if (ReadScanArith(pSt[0]) == 0) {
+		m_anArithDcContext[nScanComp] = 0;
+		return true;
+	}
+
+	// Sign (SS) then magnitude category (SP / SN, X1..X15)
+	nSign = ReadScanArith(pSt[1]);
+	pSt += 2 + nSign;
+	nMag = ReadScanArith(*pSt);
+	if (nMag != 0) {
+		pSt = &m_anArithDcStats[nTbl][20];
+		while (ReadScanArith(*pSt)) {
+			nMag <<= 1;
+			if (nMag == 0x8000) {
+				ReportScanArithErr();
+				return false;
+			}
+			pSt++;
+		}
+	}
 
-	// -----------------------------------------------------------------------
-	// Process all scan MCUs
-	// -----------------------------------------------------------------------
+	// Conditioning category for the next difference (F.1.4.4.1.2)
+	if (nMag < ((1u << m_anArithDcL[nTbl]) >> 1)) {
+		m_anArithDcContext[nScanComp] = 0;
+	} else if (nMag > ((1u << m_anArithDcU[nTbl]) >> 1)) {
+		m_anArithDcContext[nScanComp] = 12 + (nSign * 4);
+	} else {
+		m_anArithDcContext[nScanComp] = 4 + (nSign * 4);
+	}
 
-	for (unsigned nMcuY=nDecMcuRowStart;nMcuY<nDecMcuRowEndFinal;nMcuY++) {
+	// Magnitude bits (M2..M15 sit 14 bins after X2..X15)
+	nVal = nMag;
+	pSt += 14;
+	while (nMag >>= 1) {
+		if (ReadScanArith(*pSt)) {
+			nVal |= nMag;
+		}
+	}
+	nVal++;
+	rnDcPred += (nSign) ? -(int)nVal : (int)nVal;
+	return true;
+}
 
-		// Set the statusbar text to Processing...
-		strTmp.Format(_T("Decoding Scan Data... Row %04u of %04u (%3.0f%%)"),nMcuY,m_nMcuYMax,nMcuY*100.0/m_nMcuYMax);
-		SetStatusText(strTmp);
+// Decode the AC coefficients Ss..Se of a block
+// - Used by sequential scans (1..63) and by the first scan of a
+//   progressive band, where the coefficients are scaled by Al
+//   (F.1.4.4.2, F.2.4.2 & G.1.3.2)
+//
+// INPUT:
+// - pnCoef					= Block coefficients (zigzag order)
+// - nTbl					= AC conditioning table
+// OUTPUT:
+// - pnCoef					= Decoded coefficients
+// RETURN:
+// - False if the block could not be decoded
+//
+bool CimgDecode::DecodeScanArithAc(short int* pnCoef,unsigned nTbl)
+{
+	unsigned	nStart = (m_bProgSequential) ? 1 : m_nSosSpectralStart;
+	unsigned	nEnd = (m_bProgSequential) ? DCT_SZ_ALL-1 : m_nSosSpectralEnd;
+	unsigned	nAl = (m_bProgSequential) ? 0 : m_nSosSuccApproxLow;
+	BYTE*		pStats = m_anArithAcStats[nTbl];
+	BYTE*		pSt;
+	unsigned	nInd = nStart-1;		// Index of the last decoded coefficient
+	unsigned	nSign;
+	unsigned	nMag;
+	unsigned	nVal;
 
-		// TODO: Trap escape keypress here (or run as thread)
+	while (nInd < nEnd) {
+		// End of block (SE) is coded before each run of zeros
+		pSt = pStats + 3*nInd;
+		if (ReadScanArith(pSt[0])) {
+			break;
+		}
 
-		bool	bDscRet;	// Return value for DecodeScanComp()
-		bool	bScanStop = false;
-		for (unsigned nMcuX=0;(nMcuX<m_nMcuXMax)&&(!bScanStop);nMcuX++) {
+		// Zero run (S0)
+		for (;;) {
+			nInd++;
+			if (ReadScanArith(pSt[1])) {
+				break;
+			}
+			pSt += 3;
+			if (nInd >= nEnd) {
+				ReportScanArithErr();
+				return false;
+			}
+		}
 
-			// Check to see if we should expect a restart marker!
-			// FIXME: Should actually check to ensure that we do in
-			// fact get a restart marker, and that it was the right
-			// one!
-			if ((m_bRestartEn) && (m_nRestartMcusLeft == 0)) {
-				/*
-				if (m_bVerbose) {
-					strTmp.Format(_T("  Expect Restart interval elapsed @ %s"),GetScanBufPos());
-					m_pLog->AddLine(strTmp);
-				}
-				*/
-				if (m_bRestartRead) {
-					/*
-					// FIXME: Check for restart counter value match
-					if (m_bVerbose) {
-						strTmp.Format(_T("  Restart marker matched"));
-						m_pLog->AddLine(strTmp);
-					}
-					*/
-				} else {
-					strTmp.Format(_T("  Expect Restart interval elapsed @ %s"),(LPCTSTR)GetScanBufPos());
-					m_pLog->AddLine(strTmp);
-						strTmp.Format(_T("    ERROR: Restart marker not detected"));
-						m_pLog->AddLineErr(strTmp);
-				}
-				/*
-				if (ExpectRestart()) {
-					if (m_bVerbose) {
-						strTmp.Format(_T("  Restart marker detected"));
-						m_pLog->AddLine(strTmp);
+		// Sign (fixed estimate) then magnitude category (SP, X2..X15)
+		nSign = ReadScanArith(m_nArithFixedBin);
+		pSt += 2;
+		nMag = ReadScanArith(*pSt);
+		if (nMag != 0) {
+			if (ReadScanArith(*pSt)) {
+				nMag <<= 1;
+				pSt = pStats + ((nInd <= m_anArithAcK[nTbl]) ? 189 : 217);
+				while (ReadScanArith(*pSt)) {
+					nMag <<= 1;
+					if (nMag == 0x8000) {
+						ReportScanArithErr();
+						return false;
 					}
-				} else {
-					strTmp.Format(_T("  ERROR: Restart marker expected but not found @ %s"),GetScanBufPos());
-					m_pLog->AddLineErr(strTmp);
+					pSt++;
 				}
-				*/
-
-
 			}
+		}
 
-			// To support a fast decode mode, allow for a subset of the
-			// image to have DC+AC decoding, while the remainder is only DC decoding
-			if ((nMcuY<nDecMcuRowStart) || (nMcuY>nDecMcuRowEnd)) {
-				m_bDecodeScanAc = false;
-			} else {
-				m_bDecodeScanAc = bDecodeScanAc;
+		// Magnitude bits
+		nVal = nMag;
+		pSt += 14;
+		while (nMag >>= 1) {
+			if (ReadScanArith(*pSt)) {
+				nVal |= nMag;
 			}
+		}
+		nVal++;
+		pnCoef[nInd] = (short int)(((nSign) ? -(int)nVal : (int)nVal) * (1<<nAl));
+	}
+	return true;
+}
 
+// Decode the AC refinement bits of a block (successive approximation)
+// - Unlike the huffman refinement, each coefficient is coded in turn
+//   and the end of block is only coded after the last coefficient
+//   that was non-zero in an earlier scan (G.1.3.3)
+//
+// INPUT:
+// - pnCoef					= Block coefficients (zigzag order)
+// - nTbl					= AC conditioning table
+// OUTPUT:
+// - pnCoef					= Refined coefficients Ss..Se
+// RETURN:
+// - False if the block could not be decoded
+//
+bool CimgDecode::DecodeScanArithAcRefine(short int* pnCoef,unsigned nTbl)
+{
+	short int	nBitP1 = (short int)(1<<m_nSosSuccApproxLow);	// +1 in the bit position
+	short int	nBitM1 = -nBitP1;								// -1 in the bit position
+	BYTE*		pStats = m_anArithAcStats[nTbl];
+	BYTE*		pSt;
+	unsigned	nInd;
+	unsigned	nIndEob;			// Index of the previous end of block (EOBx)
+	short int*	pnCur;
+
+	for (nIndEob=m_nSosSpectralEnd;nIndEob>0;nIndEob--) {
+		if (pnCoef[nIndEob] != 0) {
+			break;
+		}
+	}
 
-			// Precalculate MCU matrix index
-			unsigned nMcuXY = nMcuY*m_nMcuXMax+nMcuX;
-
-			// Mark the start of the MCU in the file map
-			m_pMcuFileMap[nMcuXY] = PackFileOffset(m_anScanBuffPtr_pos[0],m_nScanBuffPtr_align);
-
-			// Is this an MCU that we want full printing of decode process?
-			bool		bVlcDump = false;
-			unsigned	nRangeBase;
-			unsigned	nRangeCur;
-			if (m_bDetailVlc) {
-				nRangeBase = (m_nDetailVlcY * m_nMcuXMax) + m_nDetailVlcX;
-				nRangeCur  = nMcuXY;
-				if ( (nRangeCur >= nRangeBase) && (nRangeCur < nRangeBase+m_nDetailVlcLen) ) {
-                    bVlcDump = true;
+	nInd = m_nSosSpectralStart-1;
+	while (nInd < m_nSosSpectralEnd) {
+		pSt = pStats + 3*nInd;
+		if (nInd >= nIndEob) {
+			if (ReadScanArith(pSt[0])) {
+				break;
+			}
+		}
+		for (;;) {
+			pnCur = &pnCoef[++nInd];
+			if (*pnCur != 0) {
+				// Correction bit for a coefficient that is already non-zero
+				if (ReadScanArith(pSt[2])) {
+					*pnCur += (*pnCur < 0) ? nBitM1 : nBitP1;
 				}
+				break;
 			}
-
-			// Luminance
-			// If there is chroma subsampling, then this block will have
-			//    (css_x * css_y) luminance blocks to process
-			// We store them all in an array m_anDcLumCss[]
-
-			// Give separator line between MCUs
-			if (bVlcDump) {
-				m_pLog->AddLine(_T(""));
+			if (ReadScanArith(pSt[1])) {
+				// Newly non-zero coefficient
+				*pnCur = (ReadScanArith(m_nArithFixedBin)) ? nBitM1 : nBitP1;
+				break;
 			}
+			pSt += 3;
+			if (nInd >= m_nSosSpectralEnd) {
+				ReportScanArithErr();
+				return false;
+			}
+		}
+	}
+	return true;
+}
 
-			// CSS array indices
-			unsigned	nCssIndH;
-			unsigned	nCssIndV;
-			unsigned	nComp;
-
-			// No need to reset the IDCT output matrix for this MCU
-			// since we are going to be generating it here. This help
-			// maintain performance.
-
-			// --------------------------------------------------------------
-			nComp = SCAN_COMP_Y;
-
-			// Step through the sampling factors per image component
-			// TODO: Could rewrite this to use single loop across each image component
-			for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
-				for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
-
-					if (!bVlcDump) {
-						bDscRet = DecodeScanComp(nDhtTblDcY,nDhtTblAcY,nDqtTblY,nMcuX,nMcuY);// Lum DC+AC
-					} else {
-						bDscRet = DecodeScanCompPrint(nDhtTblDcY,nDhtTblAcY,nDqtTblY,nMcuX,nMcuY);// Lum DC+AC
-					}
-					if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,nComp);
-					if (!bDscRet && bDieOnFirstErr) return;
-
-					// The DCT Block matrix has already been dezigzagged
-					// and multiplied against quantization table entry
-					m_nDcLum += m_anDctBlock[DCT_COEFF_DC];
-
-					if (bVlcDump) {
-//						PrintDcCumVal(nMcuX,nMcuY,m_nDcLum);
-					}
-
-					// Now take a snapshot of the current cumulative DC value
-					m_anDcLumCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcLum;
+// Decode one scan of a progressive image into the coefficient buffer
+// - The first scan sets up the frame (MCU geometry, pixel maps) and
+//   allocates the coefficient buffer of each frame component
+// - Each scan refines the coefficients within its spectral selection
+//   (Ss..Se) and successive approximation (Ah,Al)
+// - A sequential frame whose components are split over several scans
+//   is decoded the same way, with a full band (Ss=0, Se=63, Ah=Al=0)
+//   in each scan
+// - The IDCT and color conversion only run once, after the last scan
+//   (see DecodeScanProgEnd)
+//
+// INPUT:
+// - nStart					= File position at start of scan
+// - bDisplay				= Generate a preview image?
+// PRE:
+// - SetImageDetails(), SetSosCompInd() and SetSosProgress() for this scan
+// - SetDhtTables() for each scan component
+// POST:
+// - m_apProgCoef[]
+// - m_nProgScanNum
+// - m_pMcuFileMap		= Position of each MCU in the first scan that
+//							  carries the first frame component
+//
+void CimgDecode::DecodeScanProg(unsigned nStart,bool bDisplay)
+{
+	CString		strTmp;
+	unsigned	nNumScanComps = m_nNumSosComps;
 
-					// At this point we have one of the luminance comps
-					// fully decoded (with IDCT if enabled). The result is
-					// currently in the array: m_afIdctBlock[]
-					// The next step would be to move these elements into
-					// the 3-channel MCU image map
+	// The frame geometry and pixel maps cover all of the frame components
+	m_nNumSosComps = m_nNumSofComps;
 
-					// Store the pixels associated with this channel into
-					// the full-res pixel map. IDCT has already been computed
-					// on the 8x8 (or larger) MCU block region.
+	if (!IsScanProgPending()) {
+		if ( (m_nNumSofComps != NUM_CHAN_GRAYSCALE) && (m_nNumSofComps != NUM_CHAN_YCC) && (m_nNumSofComps != NUM_CHAN_YCCK) ) {
+			strTmp.Format(_T("  NOTE: Number of Image Components not supported [%u]"),m_nNumSofComps);
+			m_pLog->AddLineWarn(strTmp);
+			return;
+		}
 
-#if 1
-					if (bDisplay)
-						SetFullRes(nMcuX,nMcuY,nComp,nCssIndH,nCssIndV,m_nDcLum);
-#else
-					// FIXME
-					// Temporarily experiment with trying to handle multiple scans
-					// by converting sampling factor of luminance scan back to 1x1
-					unsigned nNewMcuX,nNewMcuY,nNewCssX,nNewCssY;
-					if (nCssIndV == 0) {
-						if (nMcuX < m_nMcuXMax/2) {
-							nNewMcuX = nMcuX;
-							nNewMcuY = nMcuY;
-							nNewCssY = 0;
-						} else {
-							nNewMcuX = nMcuX - (m_nMcuXMax/2);
-							nNewMcuY = nMcuY;
-							nNewCssY = 1;
-						}
-						nNewCssX = nCssIndH;
-						SetFullRes(nNewMcuX,nNewMcuY,SCAN_COMP_Y,nNewCssX,nNewCssY,m_nDcLum);
-					} else {
-						nNewMcuX = (nMcuX / 2) + 1;
-						nNewMcuY = (nMcuY / 2);
-						nNewCssX = nCssIndH;
-						nNewCssY = nMcuY % 2;
-					}
-#endif
+		if (!DecodeScanImgInit(bDisplay,SCAN_SCALE_1,false)) {
+			return;
+		}
 
-					// ---------------
+		// Allocate the coefficient buffers (padded to whole MCUs)
+		for (unsigned nComp=1;nComp<=m_nNumSofComps;nComp++) {
+			m_anProgBlkW[nComp] = m_nMcuXMax * m_anSampPerMcuH[nComp];
+			m_anProgBlkH[nComp] = m_nMcuYMax * m_anSampPerMcuV[nComp];
+			unsigned nCoefNum = m_anProgBlkW[nComp] * m_anProgBlkH[nComp] * DCT_SZ_ALL;
+			m_apProgCoef[nComp] = new short int[nCoefNum];
+			if (!m_apProgCoef[nComp]) {
+				strTmp = _T("ERROR: Not enough memory for Image Decoder Coefficient Buffer");
+				m_pLog->AddLineErr(strTmp);
+				if (m_pAppConfig->bInteractive)
+					AfxMessageBox(strTmp);
+				DecodeScanProgFree();
+				return;
+			}
+			memset(m_apProgCoef[nComp], 0, (nCoefNum*sizeof(short int)) );
+		}
 
-					// TODO: Counting pixels makes assumption that luminance is
-					// not subsampled, so we increment by 64.
-					m_nNumPixels += BLK_SZ_X*BLK_SZ_Y;
+		m_nProgScanNum = 0;
+		m_nProgPosFirst = nStart;
+		m_nProgMcuMapScan = 0;
+		m_bProgSequential = (m_nSosSpectralStart == 0) && (m_nSosSpectralEnd == DCT_SZ_ALL-1) &&
+			(m_nSosSuccApproxHigh == 0) && (m_nSosSuccApproxLow == 0);
+	}
+	m_nProgScanNum++;
+
+	// Check the scan parameters
+	// - DC scans can be interleaved, AC scans are a band of a single component
+	// - A refinement scan adds the bit below the previous scan
+	// - Sequential scans always carry the full band
+	unsigned	nSs = m_nSosSpectralStart;
+	unsigned	nSe = m_nSosSpectralEnd;
+	unsigned	nAh = m_nSosSuccApproxHigh;
+	unsigned	nAl = m_nSosSuccApproxLow;
+	bool		bScanOk = true;
+	if (m_bProgSequential) {
+		if ((nSs != 0) || (nSe != DCT_SZ_ALL-1) || (nAh != 0) || (nAl != 0)) {
+			bScanOk = false;
+		}
+	} else {
+		if ((nSs > nSe) || (nSe >= DCT_SZ_ALL) || ((nSs == 0) && (nSe != 0)) || ((nSs != 0) && (nNumScanComps != 1))) {
+			bScanOk = false;
+		}
+		if ((nAl > MAX_SOS_SUCC_APPROX) || ((nAh != 0) && (nAh != nAl+1))) {
+			bScanOk = false;
+		}
+	}
+	if ((nNumScanComps == 0) || (nNumScanComps > m_nNumSofComps)) {
+		bScanOk = false;
+	}
+	for (unsigned nScanComp=1;(bScanOk)&&(nScanComp<=nNumScanComps);nScanComp++) {
+		if ((m_anSosCompInd[nScanComp] < 1) || (m_anSosCompInd[nScanComp] > m_nNumSofComps)) {
+			bScanOk = false;
+		}
+	}
+	if (!bScanOk) {
+		strTmp.Format(_T("*** ERROR: %s scan not supported [Ns=%u Ss=%u Se=%u Ah=%u Al=%u], skipping"),
+			(m_bProgSequential)?_T("Sequential"):_T("Progressive"),nNumScanComps,nSs,nSe,nAh,nAl);
+		m_pLog->AddLineErr(strTmp);
+		return;
+	}
 
-				}
+	// Check the DHT tables needed by this scan
+	// - DC refinement scans don't use a DHT table
+	// - Arithmetic coded scans select conditioning tables (DAC) instead,
+	//   which always have a default
+	bool		bDhtReady = true;
+	int			nSel;
+	for (unsigned nScanComp=1;nScanComp<=nNumScanComps;nScanComp++) {
+		if (m_bScanArith) {
+			m_anScanDhtTblDc[nScanComp] = m_psTbl->anDhtTblSel[DHT_CLASS_DC][nScanComp];
+			m_anScanDhtTblAc[nScanComp] = m_psTbl->anDhtTblSel[DHT_CLASS_AC][nScanComp];
+			continue;
+		}
+		if ((nSs == 0) && (nAh == 0)) {
+			nSel = m_psTbl->anDhtTblSel[DHT_CLASS_DC][nScanComp];
+			if ((nSel < 0) || (m_psTbl->anDhtLookupSize[DHT_CLASS_DC][nSel] == 0)) {
+				bDhtReady = false;
+			} else {
+				m_anScanDhtTblDc[nScanComp] = nSel;
 			}
+		}
+		if ((nSs != 0) || (m_bProgSequential)) {
+			nSel = m_psTbl->anDhtTblSel[DHT_CLASS_AC][nScanComp];
+			if ((nSel < 0) || (m_psTbl->anDhtLookupSize[DHT_CLASS_AC][nSel] == 0)) {
+				bDhtReady = false;
+			} else {
+				m_anScanDhtTblAc[nScanComp] = nSel;
+			}
+		}
+	}
+	if (!bDhtReady) {
+		m_pLog->AddLineErr(_T("*** ERROR: Decoding image before DHT Table Selection via JFIF_SOS ***"));
+		return;
+	}
 
-			// In a grayscale image, we don't do this part!
-			//if (m_nNumSofComps == NUM_CHAN_YCC) {
-			if (m_nNumSosComps == NUM_CHAN_YCC) {
+	strTmp.Format(_T("Decoding Scan Data... Scan %u"),m_nProgScanNum);
+	SetStatusText(strTmp);
 
-				// --------------------------------------------------------------
-				nComp = SCAN_COMP_CB;
+	// Reset the scan buffer
+	DecodeRestartScanBuf(nStart,false);
+	m_pWBuf->BufLoadWindow(nStart);
+	m_nRestartExpectInd = 0;
+	m_nRestartLastInd = 0;
+	m_nProgEobRun = 0;
+	BuffTopup();
+	if (m_bScanArith) {
+		DecodeScanArithInit();
+	}
 
-				// Chrominance Cb
-				for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
-					for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+	int			anDcPred[1+MAX_SOS_COMP_NS];
+	for (unsigned nScanComp=0;nScanComp<=MAX_SOS_COMP_NS;nScanComp++) {
+		anDcPred[nScanComp] = 0;
+	}
 
-						if (!bVlcDump) {
-							bDscRet = DecodeScanComp(nDhtTblDcCb,nDhtTblAcCb,nDqtTblCb,nMcuX,nMcuY);// Chr Cb DC+AC
-						} else {
-							bDscRet = DecodeScanCompPrint(nDhtTblDcCb,nDhtTblAcCb,nDqtTblCb,nMcuX,nMcuY);// Chr Cb DC+AC
-						}
-						if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,nComp);
-						if (!bDscRet && bDieOnFirstErr) return;
+	unsigned	nComp;
+	short int*	pnCoef;
 
-						m_nDcChrCb += m_anDctBlock[DCT_COEFF_DC];
+	// The MCU file map is recorded by the first scan that carries the
+	// first frame component, as it starts each MCU in a sequential decode
+	bool		bMcuMap = false;
+	if (m_nProgMcuMapScan == 0) {
+		for (unsigned nScanComp=1;nScanComp<=nNumScanComps;nScanComp++) {
+			if (m_anSosCompInd[nScanComp] == SCAN_COMP_Y) {
+				bMcuMap = true;
+				m_nProgMcuMapScan = m_nProgScanNum;
+			}
+		}
+	}
 
+	if (nNumScanComps > 1) {
 
-						if (bVlcDump) {
-							//PrintDcCumVal(nMcuX,nMcuY,m_nDcChrCb);
-						}
+		// Interleaved scan: the blocks of each scan component per MCU
+		for (unsigned nMcuXY=0;nMcuXY<m_nMcuXMax*m_nMcuYMax;nMcuXY++) {
+			unsigned	nMcuX = nMcuXY % m_nMcuXMax;
+			unsigned	nMcuY = nMcuXY / m_nMcuXMax;
 
-						// Now take a snapshot of the current cumulative DC value
-						m_anDcChrCbCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcChrCb;
+			if ((m_bRestartEn) && (m_nRestartMcusLeft == 0)) {
+				DecodeScanProgRestart(anDcPred);
+			}
 
-						// Store fullres value
-						if (bDisplay)
-							SetFullRes(nMcuX,nMcuY,nComp,nCssIndH,nCssIndV,m_nDcChrCb);
+			if (bMcuMap) {
+				unsigned nMcuBufInd,nMcuBufAlign;
+				GetScanBufInd(nMcuBufInd,nMcuBufAlign);
+				m_pMcuFileMap->Set(nMcuXY,(ULONGLONG)GetScanBufFilePos(nMcuBufInd)*8 + nMcuBufAlign);
+			}
 
+			for (unsigned nScanComp=1;nScanComp<=nNumScanComps;nScanComp++) {
+				nComp = m_anSosCompInd[nScanComp];
+				for (unsigned nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+					for (unsigned nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+						pnCoef = m_apProgCoef[nComp] + ( (nMcuY*m_anSampPerMcuV[nComp]+nCssIndV)*m_anProgBlkW[nComp] +
+							(nMcuX*m_anSampPerMcuH[nComp]+nCssIndH) ) * DCT_SZ_ALL;
+						DecodeScanProgBlk(pnCoef,nScanComp,anDcPred[nScanComp]);
 					}
 				}
+			}
 
-				// --------------------------------------------------------------
-				nComp = SCAN_COMP_CR;
-
-				// Chrominance Cr
-				for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
-					for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
-						if (!bVlcDump) {
-							bDscRet = DecodeScanComp(nDhtTblDcCr,nDhtTblAcCr,nDqtTblCr,nMcuX,nMcuY);// Chr Cr DC+AC
-						} else {
-							bDscRet = DecodeScanCompPrint(nDhtTblDcCr,nDhtTblAcCr,nDqtTblCr,nMcuX,nMcuY);// Chr Cr DC+AC
-						}
-						if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,nComp);
-						if (!bDscRet && bDieOnFirstErr) return;
-
-						m_nDcChrCr += m_anDctBlock[DCT_COEFF_DC];
+			if (m_bRestartEn) {
+				m_nRestartMcusLeft--;
+			}
 
+			// Give up on the rest of the scan if we ran out of data
+			if (m_bScanEnd && m_bScanBad) {
+				break;
+			}
+		}
 
+	} else {
 
-						if (bVlcDump) {
-							//PrintDcCumVal(nMcuX,nMcuY,m_nDcChrCr);
-						}
+		// Non-interleaved scan: the component's blocks in raster order,
+		// which only cover the component's own dimensions (ITU-T.81 A.2.2)
+		// Each MCU is mapped to its top-left block of the first component
+		nComp = m_anSosCompInd[1];
+		unsigned	nCompW = (m_nDimX*m_anSofSampFactH[nComp] + m_nSosSampFactHMax-1) / m_nSosSampFactHMax;
+		unsigned	nCompH = (m_nDimY*m_anSofSampFactV[nComp] + m_nSosSampFactVMax-1) / m_nSosSampFactVMax;
+		unsigned	nBlkW = min((nCompW + BLK_SZ_X-1) / BLK_SZ_X,m_anProgBlkW[nComp]);
+		unsigned	nBlkH = min((nCompH + BLK_SZ_Y-1) / BLK_SZ_Y,m_anProgBlkH[nComp]);
+		unsigned	nSampH = m_anSampPerMcuH[nComp];
+		unsigned	nSampV = m_anSampPerMcuV[nComp];
+		for (unsigned nBlkXY=0;nBlkXY<nBlkW*nBlkH;nBlkXY++) {
+			unsigned	nBlkX = nBlkXY % nBlkW;
+			unsigned	nBlkY = nBlkXY / nBlkW;
 
-						// Now take a snapshot of the current cumulative DC value
-						m_anDcChrCrCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcChrCr;
+			if ((m_bRestartEn) && (m_nRestartMcusLeft == 0)) {
+				DecodeScanProgRestart(anDcPred);
+			}
 
-						// Store fullres value
-						if (bDisplay)
-							SetFullRes(nMcuX,nMcuY,nComp,nCssIndH,nCssIndV,m_nDcChrCr);
+			if ((bMcuMap) && (nBlkX % nSampH == 0) && (nBlkY % nSampV == 0)) {
+				unsigned nMcuBufInd,nMcuBufAlign;
+				GetScanBufInd(nMcuBufInd,nMcuBufAlign);
+				m_pMcuFileMap->Set((nBlkY/nSampV)*m_nMcuXMax+(nBlkX/nSampH),(ULONGLONG)GetScanBufFilePos(nMcuBufInd)*8 + nMcuBufAlign);
+			}
 
-					}
-				}
+			pnCoef = m_apProgCoef[nComp] + (nBlkY*m_anProgBlkW[nComp] + nBlkX) * DCT_SZ_ALL;
+			DecodeScanProgBlk(pnCoef,1,anDcPred[1]);
 
+			if (m_bRestartEn) {
+				m_nRestartMcusLeft--;
+			}
 
+			if (m_bScanEnd && m_bScanBad) {
+				break;
 			}
-#ifdef DEBUG_YCCK
-			else if (m_nNumSosComps == NUM_CHAN_YCCK) {
+		}
 
-				// --------------------------------------------------------------
-				nComp = SCAN_COMP_CB;
+	}
+}
 
-				// Chrominance Cb
-				for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
-					for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+// Reconstruct a progressive (or multi-scan sequential) image from its
+// coefficient buffer
+// - Called after the last scan. Each block goes through the same IDCT
+//   and pixel map transfer as in the sequential decode, followed by
+//   the preview and the statistics
+//
+// INPUT:
+// - bDisplay				= Generate a preview image?
+// - bQuiet					= Disable output of certain messages during decode?
+// PRE:
+// - m_apProgCoef[]
+// POST:
+// - m_pBlkDcValY[], m_pBlkDcValCb[], m_pBlkDcValCr[], m_pBlkDcValK[]
+// - m_asPixPlane[]
+// - m_apProgCoef[]			= Released
+//
+void CimgDecode::DecodeScanProgEnd(bool bDisplay,bool bQuiet)
+{
+	CString		strTmp;
 
-						if (!bVlcDump) {
-							bDscRet = DecodeScanComp(nDhtTblDcCb,nDhtTblAcCb,nDqtTblCb,nMcuX,nMcuY);// Chr Cb DC+AC
-						} else {
-							bDscRet = DecodeScanCompPrint(nDhtTblDcCb,nDhtTblAcCb,nDqtTblCb,nMcuX,nMcuY);// Chr Cb DC+AC
-						}
-						if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,nComp);
-						if (!bDscRet && bDieOnFirstErr) return;
+	if (!IsScanProgPending()) {
+		return;
+	}
+	m_nNumSosComps = m_nNumSofComps;
 
-						m_nDcChrCb += m_anDctBlock[DCT_COEFF_DC];
+	if (!bQuiet) {
+		m_pLog->AddLineHdr(_T("*** Decoding SCAN Data ***"));
+		strTmp.Format(_T("  OFFSET: 0x%08X"),m_nProgPosFirst);
+		m_pLog->AddLine(strTmp);
+		strTmp.Format(_T("  %s scans: %u"),(m_bProgSequential)?_T("Sequential"):_T("Progressive"),m_nProgScanNum);
+		m_pLog->AddLine(strTmp);
+		ReportScanMode();
+	}
 
+	// Report any Buffer overlays
+	m_pWBuf->ReportOverlays(m_pLog);
 
-						if (bVlcDump) {
-							//PrintDcCumVal(nMcuX,nMcuY,m_nDcChrCb);
-						}
+	// Check DQT tables
+	for (unsigned nComp=1;nComp<=m_nNumSofComps;nComp++) {
+		if (m_psTbl->anDqtTblSel[nComp]<0) {
+			m_pLog->AddLineErr(_T("*** ERROR: Decoding image before DQT Table Selection via JFIF_SOF ***"));
+			DecodeScanProgFree();
+			return;
+		}
+		m_anScanDqtTbl[nComp] = m_psTbl->anDqtTblSel[nComp];
+	}
 
-						// Now take a snapshot of the current cumulative DC value
-						m_anDcChrCbCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcChrCb;
+	m_nNumPixels = 0;
 
-						// Store fullres value
-						if (bDisplay)
-							SetFullRes(nMcuX,nMcuY,nComp,0,0,m_nDcChrCb);
+	// Clear the histogram and color correction clipping stats
+	if (bDisplay) {
+		memset(&m_sStatClip,0,sizeof(m_sStatClip));
+		memset(&m_sHisto,0,sizeof(m_sHisto));
 
-					}
-				}
+		memset(&m_anCcHisto_r,0,sizeof(m_anCcHisto_r));
+		memset(&m_anCcHisto_g,0,sizeof(m_anCcHisto_g));
+		memset(&m_anCcHisto_b,0,sizeof(m_anCcHisto_b));
 
-				// --------------------------------------------------------------
-				nComp = SCAN_COMP_CR;
+		memset(&m_anHistoYFull,0,sizeof(m_anHistoYFull));
+		memset(&m_anHistoYSubset,0,sizeof(m_anHistoYSubset));
+	}
 
-				// Chrominance Cr
-				for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
-					for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
-						if (!bVlcDump) {
-							bDscRet = DecodeScanComp(nDhtTblDcCr,nDhtTblAcCr,nDqtTblCr,nMcuX,nMcuY);// Chr Cr DC+AC
-						} else {
-							bDscRet = DecodeScanCompPrint(nDhtTblDcCr,nDhtTblAcCr,nDqtTblCr,nMcuX,nMcuY);// Chr Cr DC+AC
-						}
-						if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,nComp);
-						if (!bDscRet && bDieOnFirstErr) return;
+	// In DC only mode the IDCT output remains clear
+	if (!m_bDecodeScanAc) {
+		DecodeIdctClear();
+	}
 
-						m_nDcChrCr += m_anDctBlock[DCT_COEFF_DC];
+	short int*	apBlkDcVal[1+NUM_CHAN_YCCK] = { NULL, m_pBlkDcValY, m_pBlkDcValCb, m_pBlkDcValCr, m_pBlkDcValK };
+	short int*	pnCoef;
+	short int	nDcVal;
+	short int	nCoefVal;
+	unsigned	nTbl;
+	unsigned	nBlkXY;
 
+	for (unsigned nMcuY=0;nMcuY<m_nMcuYMax;nMcuY++) {
 
+		strTmp.Format(_T("Decoding Scan Data... Row %04u of %04u (%3.0f%%)"),nMcuY,m_nMcuYMax,nMcuY*100.0/m_nMcuYMax);
+		SetStatusText(strTmp);
 
-						if (bVlcDump) {
-							//PrintDcCumVal(nMcuX,nMcuY,m_nDcChrCr);
+		for (unsigned nMcuX=0;nMcuX<m_nMcuXMax;nMcuX++) {
+			for (unsigned nComp=1;nComp<=m_nNumSofComps;nComp++) {
+				nTbl = m_anScanDqtTbl[nComp];
+				for (unsigned nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
+					for (unsigned nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+						pnCoef = m_apProgCoef[nComp] + ( (nMcuY*m_anSampPerMcuV[nComp]+nCssIndV)*m_anProgBlkW[nComp] +
+							(nMcuX*m_anSampPerMcuH[nComp]+nCssIndH) ) * DCT_SZ_ALL;
+
+						// The DC level is dequantized here (see DecodeIdctSet)
+						nDcVal = (short int)(pnCoef[DCT_COEFF_DC] * m_psTbl->anDqtCoeffZz[nTbl][DCT_COEFF_DC]);
+
+						if (bDisplay) {
+							if (m_bDecodeScanAc) {
+								m_anDctBlock[DCT_COEFF_DC] = nDcVal;
+								m_nDctCoefMax = DCT_COEFF_DC;
+								for (unsigned nInd=1;nInd<DCT_SZ_ALL;nInd++) {
+									nCoefVal = pnCoef[nInd];
+									m_anDctBlock[glb_anZigZag[nInd]] = nCoefVal;
+									if (nCoefVal != 0) {
+										m_nDctCoefMax = nInd;
+									}
+								}
+								DecodeIdctCalc(nTbl);
+							}
+							SetFullRes(nMcuX,nMcuY,nComp,nCssIndH,nCssIndV,nDcVal);
 						}
 
-						// Now take a snapshot of the current cumulative DC value
-						m_anDcChrCrCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcChrCr;
-
-						// Store fullres value
-						if (bDisplay)
-							SetFullRes(nMcuX,nMcuY,nComp,0,0,m_nDcChrCr);
-
+						// Save the DC value in the block map (as in DecodeScanMcu)
+						if (nComp == SCAN_COMP_Y) {
+							nBlkXY = (nMcuY*m_anSampPerMcuV[nComp] + nCssIndV)*m_nBlkXMax + (nMcuX*m_anSampPerMcuH[nComp] + nCssIndH);
+							m_nNumPixels += BLK_SZ_X*BLK_SZ_Y;
+						} else {
+							nBlkXY = (nMcuY*m_anExpandBitsMcuV[nComp] + nCssIndV)*m_nBlkXMax + (nMcuX*m_anExpandBitsMcuH[nComp] + nCssIndH);
+						}
+						if (nBlkXY < m_nBlkXMax*m_nBlkYMax) {
+							apBlkDcVal[nComp][nBlkXY] = nDcVal;
+						}
 					}
 				}
+			}
+		}
+	}
+	if (!bQuiet) {
+		m_pLog->AddLine(_T(""));
+	}
+
+	// The coefficients are no longer needed
+	DecodeScanProgFree();
+
+	if (bDisplay) {
+		CalcChannelPreview();
 
-				// --------------------------------------------------------------
-				// IGNORED
-				nComp = SCAN_COMP_K;
+		// DIB is ready for display now
+		m_bDibTempReady = true;
+		m_bPreviewIsJpeg = true;
+		PlaneCompact();
+	}
 
-				// Black K
-				for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
-					for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
+	// Report the statistics across all of the scans
+	m_nScanBuffPtr_first = m_nProgPosFirst;
+	ReportScanStats(bDisplay,bQuiet);
+}
 
-						if (!bVlcDump) {
-							bDscRet = DecodeScanComp(nDhtTblDcK,nDhtTblAcK,nDqtTblK,nMcuX,nMcuY);// K DC+AC
-						} else {
-							bDscRet = DecodeScanCompPrint(nDhtTblDcK,nDhtTblAcK,nDqtTblK,nMcuX,nMcuY);// K DC+AC
-						}
-						if (m_nScanCurErr) CheckScanErrors(nMcuX,nMcuY,nCssIndH,nCssIndV,nComp);
-						if (!bDscRet && bDieOnFirstErr) return;
+// Release the lossless row buffers
+// - The image samples (m_pLlPixMap) are kept until the next decode
+//
+// POST:
+// - m_apLlRow[]
+//
+void CimgDecode::DecodeLosslessFree()
+{
+	for (unsigned nScanComp=0;nScanComp<=MAX_SOS_COMP_NS;nScanComp++) {
+		if (m_apLlRow[nScanComp]) {
+			delete [] m_apLlRow[nScanComp];
+			m_apLlRow[nScanComp] = NULL;
+		}
+	}
+}
 
-/*
-						m_nDcChrK += m_anDctBlock[DCT_COEFF_DC];
+// Read a lossless difference from the scan buffer
+// - The DC tables code the difference category (SSSS) which is followed
+//   by SSSS additional bits as for a DC difference (ITU-T.81 H.1.2.2)
+// - Category 16 is the difference 32768 and has no additional bits
+//
+// INPUT:
+// - nTbl					= DHT Destination ID (0..3)
+// OUTPUT:
+// - rDiff					= Difference (0 if it couldn't be decoded)
+// POST:
+// - m_anDhtHisto[][][]
+// RETURN:
+// - False if no valid difference was found (already reported)
+//
+bool CimgDecode::ReadScanLosslessDiff(unsigned nTbl,int &rDiff)
+{
+	CString		strTmp;
+	unsigned	nEntry;
+	unsigned	nBitLen;
+	unsigned	nSsss;
 
+	if (m_nScanBuffBits < 32) {
+		BuffTopup();
+	}
 
-						if (bVlcDump) {
-							//PrintDcCumVal(nMcuX,nMcuY,m_nDcChrCb);
-						}
+	// Most codes and their additional bits are resolved by a single
+	// probe of the first level lookup (see SetDhtSize)
+	nEntry = m_psTbl->anDhtLookupfast[DHT_CLASS_DC][nTbl][(unsigned)(m_nScanBuff>>(SCANBUF_BITS-DHT_FAST_SIZE))];
+	if ((nEntry != DHT_CODE_UNUSED) && (nEntry & DHT_LOOKUP_VAL)) {
+		nSsss = nEntry & 0xFF;
+		nBitLen = (nEntry >> DHT_LOOKUP_LEN_SHIFT) & DHT_LOOKUP_LEN_MASK;
+		if ((nSsss < LL_DIFF_SSSS_MAX) && (nBitLen+nSsss <= m_nScanBuffBits)) {
+			rDiff = ((signed)nEntry) >> DHT_LOOKUP_VAL_SHIFT;
+			m_anDhtHisto[DHT_CLASS_DC][nTbl][nBitLen]++;
+			ScanBuffConsume(nBitLen+nSsss);
+			return true;
+		}
+	}
 
-						// Now take a snapshot of the current cumulative DC value
-						m_anDcChrKCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH] = m_nDcChrK;
+	rDiff = 0;
+	if (!ReadScanSym(DHT_CLASS_DC,nTbl,nSsss)) {
+		return false;
+	}
+	if (nSsss == LL_DIFF_SSSS_MAX) {
+		rDiff = 32768;
+	} else if (nSsss > LL_DIFF_SSSS_MAX) {
+		strTmp.Format(_T("*** ERROR: Bad lossless difference category [%u] @ Offset: %s"),nSsss,(LPCTSTR)GetScanBufPos());
+		ReportScanProgErr(strTmp);
+		return false;
+	} else if (nSsss > 0) {
+		rDiff = HuffmanDc2Signed(ReadScanBits(nSsss),nSsss);
+	}
+	return true;
+}
 
-						// Store fullres value
-						if (bDisplay)
-							SetFullRes(nMcuX,nMcuY,nComp,0,0,m_nDcChrK);
-*/
+// Prepare to decode a lossless scan from its start
+// - Allocates the row buffers: the row above the MCU row (for the
+//   prediction) followed by the Vi rows of the MCU row
+//
+// PRE:
+// - m_nLlPosStart, m_nLlNumComps, m_nLlMcuXMax
+// - m_anSosCompInd[], m_anSofSampFactH[], m_anSofSampFactV[]
+// POST:
+// - m_apLlRow[], m_anLlRowW[]
+// - m_nLlMcuY
+// - m_bLlScanEnd
+// RETURN:
+// - False if the row buffers couldn't be allocated (already reported)
+//
+bool CimgDecode::DecodeLosslessInit()
+{
+	CString		strTmp;
+	unsigned	nComp;
+
+	DecodeLosslessFree();
+	for (unsigned nScanComp=1;nScanComp<=m_nLlNumComps;nScanComp++) {
+		nComp = m_anSosCompInd[nScanComp];
+		m_anLlRowW[nScanComp] = m_nLlMcuXMax * m_anSofSampFactH[nComp];
+		m_apLlRow[nScanComp] = new unsigned short[m_anLlRowW[nScanComp] * (1+m_anSofSampFactV[nComp])];
+		if (!m_apLlRow[nScanComp]) {
+			strTmp = _T("ERROR: Not enough memory for Image Decoder Lossless Row Buffer");
+			m_pLog->AddLineErr(strTmp);
+			if (m_pAppConfig->bInteractive)
+				AfxMessageBox(strTmp);
+			DecodeLosslessFree();
+			return false;
+		}
+	}
 
-					}
-				}
+	// Reset the scan buffer
+	DecodeRestartScanBuf(m_nLlPosStart,false);
+	m_pWBuf->BufLoadWindow(m_nLlPosStart);
+	m_nRestartExpectInd = 0;
+	m_nRestartLastInd = 0;
+	BuffTopup();
 
+	m_nLlMcuY = 0;
+	m_bLlScanEnd = false;
+	return true;
+}
 
-			}
-#endif
+// Decode the next MCU row of a lossless scan into the row buffers
+// - Each sample Px is predicted from its reconstructed neighbours
+//   (ITU-T.81 H.1.2.1) and the difference is added modulo 2^16:
+//     Rc Rb
+//     Ra Px
+// - The first line of the scan and of each restart interval is
+//   predicted from the left (Ra), starting from 2^(P-Pt-1). The first
+//   sample of the other lines is predicted from above (Rb)
+// - Once the scan data runs out the remaining differences are 0
+//
+// INPUT:
+// - bMcuMap				= Record the MCU file map?
+// PRE:
+// - DecodeLosslessInit()
+// POST:
+// - m_apLlRow[]
+// - m_nLlMcuY
+// - m_pMcuFileMap
+//
+void CimgDecode::DecodeLosslessMcuRow(bool bMcuMap)
+{
+	CString		strTmp;
+	unsigned	nMcuY = m_nLlMcuY;
+	bool		bLineFirst = (nMcuY == 0);
+	int			anDcPred[1+MAX_SOS_COMP_NS];
+
+	// Restart intervals are a whole number of MCU rows
+	// (see DecodeScanLossless)
+	if ((m_nLlRestartRows > 0) && (nMcuY > 0) && (nMcuY % m_nLlRestartRows == 0)) {
+		if (!m_bLlScanEnd) {
+			DecodeScanProgRestart(anDcPred);
+		}
+		bLineFirst = true;
+	}
 
-			// --------------------------------------------------------------------
+	// The last line of the previous MCU row becomes the line above
+	unsigned	nComp;
+	unsigned	nRowW;
+	for (unsigned nScanComp=1;nScanComp<=m_nLlNumComps;nScanComp++) {
+		nComp = m_anSosCompInd[nScanComp];
+		nRowW = m_anLlRowW[nScanComp];
+		if (nMcuY > 0) {
+			memcpy(m_apLlRow[nScanComp],m_apLlRow[nScanComp] + m_anSofSampFactV[nComp]*nRowW,nRowW*sizeof(unsigned short));
+		}
+	}
 
-			unsigned	nBlkXY;
+	int			nPredFirst = 1 << (m_nPrecision - m_nLlPointTrans - 1);
+	int			nPred;
+	int			nDiff;
+	int			nRa,nRb,nRc;
+	unsigned	nSampH,nSampV;
+	unsigned	nTbl;
+	unsigned	nX;
+	unsigned	nBufInd,nBufAlign;
+	unsigned short*	pLine;
+	unsigned short*	pLineAbove;
+
+	for (unsigned nMcuX=0;nMcuX<m_nLlMcuXMax;nMcuX++) {
+
+		// Each MCU of the file map covers 8x8 lossless MCUs
+		if ((bMcuMap) && (nMcuX % BLK_SZ_X == 0) && (nMcuY % BLK_SZ_Y == 0)) {
+			unsigned nMcuBufInd,nMcuBufAlign;
+			GetScanBufInd(nMcuBufInd,nMcuBufAlign);
+			m_pMcuFileMap->Set((nMcuY/BLK_SZ_Y)*m_nMcuXMax + (nMcuX/BLK_SZ_X),(ULONGLONG)GetScanBufFilePos(nMcuBufInd)*8 + nMcuBufAlign);
+		}
 
-			// Now save the DC YCC values (expanded per 8x8 block)
-			// without ranging or translation into RGB.
-			//
-			// We enter this code once per MCU so we need to expand
-			// out to cover all blocks in this MCU.
-
-
-			// --------------------------------------------------------------
-			nComp = SCAN_COMP_Y;
-
-			// Calculate top-left corner of MCU in block map
-			// and then linear offset into block map
-			unsigned   nBlkCornerMcuX,nBlkCornerMcuY,nBlkCornerMcuLinear;
-			nBlkCornerMcuX = nMcuX * m_anExpandBitsMcuH[nComp];
-			nBlkCornerMcuY = nMcuY * m_anExpandBitsMcuV[nComp];
-			nBlkCornerMcuLinear = (nBlkCornerMcuY * m_nBlkXMax) + nBlkCornerMcuX;
-
-			// Now step through each block in the MCU per subsampling
-			for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
-				for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
-					// Calculate upper-left Blk index
-					// FIXME: According to code analysis the following write assignment
-					// to m_pBlkDcValY[] can apparently exceed the buffer bounds (C6386).
-					// I have not yet determined what scenario can lead to
-					// this. So for now, add in specific clause to trap and avoid.
-					nBlkXY = nBlkCornerMcuLinear + (nCssIndV * m_nBlkXMax) + nCssIndH;
-					// FIXME: Temporarily catch any range issue
-					if (nBlkXY >= m_nBlkXMax*m_nBlkYMax) {
-#ifdef DEBUG_LOG
-					CString	strDebug;
-					strTmp.Format(_T("DecodeScanImg() with nBlkXY out of range. nBlkXY=[%u] m_nBlkXMax=[%u] m_nBlkYMax=[%u]"),nBlkXY,m_nBlkXMax,m_nBlkYMax);
-					strDebug.Format(_T("## File=[%-100s] Block=[%-10s] Error=[%s]\n"),(LPCTSTR)m_pAppConfig->strCurFname,
-						_T("ImgDecode"),(LPCTSTR)strTmp);
-					OutputDebugString(strDebug);
-#else
-					ASSERT(false);
-#endif
+		for (unsigned nScanComp=1;nScanComp<=m_nLlNumComps;nScanComp++) {
+			nComp = m_anSosCompInd[nScanComp];
+			nSampH = m_anSofSampFactH[nComp];
+			nSampV = m_anSofSampFactV[nComp];
+			nRowW = m_anLlRowW[nScanComp];
+			nTbl = m_anScanDhtTblDc[nScanComp];
+			for (unsigned nCssIndV=0;nCssIndV<nSampV;nCssIndV++) {
+				pLine = m_apLlRow[nScanComp] + (1+nCssIndV)*nRowW;
+				pLineAbove = pLine - nRowW;
+				for (unsigned nCssIndH=0;nCssIndH<nSampH;nCssIndH++) {
+					nX = nMcuX*nSampH + nCssIndH;
+
+					if ((bLineFirst) && (nCssIndV == 0)) {
+						nPred = (nX == 0) ? nPredFirst : pLine[nX-1];
+					} else if (nX == 0) {
+						nPred = pLineAbove[0];
 					} else {
-						m_pBlkDcValY [nBlkXY] = m_anDcLumCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH];
+						nRa = pLine[nX-1];
+						nRb = pLineAbove[nX];
+						nRc = pLineAbove[nX-1];
+						switch (m_nLlPredictor) {
+							case 1:		nPred = nRa; break;
+							case 2:		nPred = nRb; break;
+							case 3:		nPred = nRc; break;
+							case 4:		nPred = nRa + nRb - nRc; break;
+							case 5:		nPred = nRa + ((nRb - nRc) >> 1); break;
+							case 6:		nPred = nRb + ((nRa - nRc) >> 1); break;
+							default:	nPred = (nRa + nRb) >> 1; break;
+						}
 					}
-				}
-			}
-			// Only process the chrominance if it is YCC
-			if (m_nNumSosComps == NUM_CHAN_YCC) {
-
-				// --------------------------------------------------------------
-				nComp = SCAN_COMP_CB;
 
-				for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
-					for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
-						// Calculate upper-left Blk index
-						nBlkXY = (nMcuY*m_anExpandBitsMcuV[nComp] + nCssIndV)*m_nBlkXMax + (nMcuX*m_anExpandBitsMcuH[nComp] + nCssIndH);
-						// FIXME: Temporarily catch any range issue
-						if (nBlkXY >= m_nBlkXMax*m_nBlkYMax) {
-#ifdef DEBUG_LOG
-							CString	strDebug;
-							strTmp.Format(_T("DecodeScanImg() with nBlkXY out of range. nBlkXY=[%u] m_nBlkXMax=[%u] m_nBlkYMax=[%u]"),nBlkXY,m_nBlkXMax,m_nBlkYMax);
-							strDebug.Format(_T("## File=[%-100s] Block=[%-10s] Error=[%s]\n"),(LPCTSTR)m_pAppConfig->strCurFname,
-								_T("ImgDecode"),(LPCTSTR)strTmp);
-							OutputDebugString(strDebug);
-#else
-							ASSERT(false);
-#endif
-						} else {
-							m_pBlkDcValCb [nBlkXY] = m_anDcChrCbCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH];
+					// A marker other than RSTn ends the scan data (see BuffAddByte)
+					if ((!m_bLlScanEnd) && (m_nScanBuffErrNum > 0)) {
+						GetScanBufInd(nBufInd,nBufAlign);
+						ScanBuffLatchErr(nBufInd);
+						if (m_nScanBuffLatchErr == SCANBUF_BADMARK) {
+							strTmp.Format(_T("*** ERROR: Bad marker @ %s"),(LPCTSTR)GetScanBufPos());
+							ReportScanProgErr(strTmp);
+							m_bLlScanEnd = true;
 						}
 					}
-				}
-
-				// --------------------------------------------------------------
-				nComp = SCAN_COMP_CR;
 
-				for (nCssIndV=0;nCssIndV<m_anSampPerMcuV[nComp];nCssIndV++) {
-					for (nCssIndH=0;nCssIndH<m_anSampPerMcuH[nComp];nCssIndH++) {
-						// Calculate upper-left Blk index
-						nBlkXY = (nMcuY*m_anExpandBitsMcuV[nComp] + nCssIndV)*m_nBlkXMax + (nMcuX*m_anExpandBitsMcuH[nComp] + nCssIndH);
-						// FIXME: Temporarily catch any range issue
-						if (nBlkXY >= m_nBlkXMax*m_nBlkYMax) {
-#ifdef DEBUG_LOG
-							CString	strDebug;
-							strTmp.Format(_T("DecodeScanImg() with nBlkXY out of range. nBlkXY=[%u] m_nBlkXMax=[%u] m_nBlkYMax=[%u]"),nBlkXY,m_nBlkXMax,m_nBlkYMax);
-							strDebug.Format(_T("## File=[%-100s] Block=[%-10s] Error=[%s]\n"),(LPCTSTR)m_pAppConfig->strCurFname,
-								_T("ImgDecode"),(LPCTSTR)strTmp);
-							OutputDebugString(strDebug);
-#else
-							ASSERT(false);
-#endif
-						} else {
-							m_pBlkDcValCr [nBlkXY] = m_anDcChrCrCss[nCssIndV*MAX_SAMP_FACT_H+nCssIndH];
+					nDiff = 0;
+					if (!m_bLlScanEnd) {
+						ReadScanLosslessDiff(nTbl,nDiff);
+						if (m_bScanEnd && m_bScanBad) {
+							m_bLlScanEnd = true;
 						}
 					}
+					pLine[nX] = (unsigned short)((nPred + nDiff) & 0xFFFF);
 				}
 			}
+		}
+	}
 
+	m_nLlMcuY++;
+}
 
+// Copy the image rows of the last decoded MCU row out of the row buffers
+// - Subsampled components are replicated to the full image size
+// - The point transform is undone (ITU-T.81 H.2.1)
+//
+// OUTPUT:
+// - pRows					= Rows of m_nDimX x m_nLlNumComps samples
+//							  (frame component order), LL_ROWS_MAX max
+// PRE:
+// - DecodeLosslessMcuRow()
+// RETURN:
+// - Number of image rows output
+//
+unsigned CimgDecode::DecodeLosslessRowOut(unsigned short* pRows)
+{
+	unsigned	nRowStart = (m_nLlMcuY-1) * m_nSosSampFactVMax;
+	unsigned	nNumRows;
+	unsigned	nComp;
+	unsigned	nSampH,nSampV;
+	unsigned	nPixStride = m_nLlNumComps;
+	const unsigned short*	pSrc;
+	unsigned short*			pDst;
+
+	if (nRowStart >= m_nDimY) {
+		return 0;
+	}
+	nNumRows = min(m_nSosSampFactVMax,m_nDimY-nRowStart);
+
+	for (unsigned nScanComp=1;nScanComp<=m_nLlNumComps;nScanComp++) {
+		nComp = m_anSosCompInd[nScanComp];
+		nSampH = m_anSofSampFactH[nComp];
+		nSampV = m_anSofSampFactV[nComp];
+		for (unsigned nRow=0;nRow<nNumRows;nRow++) {
+			pSrc = m_apLlRow[nScanComp] + (1 + nRow*nSampV/m_nSosSampFactVMax)*m_anLlRowW[nScanComp];
+			pDst = pRows + nRow*m_nDimX*nPixStride + (nComp-1);
+			if (nSampH == m_nSosSampFactHMax) {
+				for (unsigned nX=0;nX<m_nDimX;nX++) {
+					pDst[nX*nPixStride] = (unsigned short)(pSrc[nX] << m_nLlPointTrans);
+				}
+			} else {
+				for (unsigned nX=0;nX<m_nDimX;nX++) {
+					pDst[nX*nPixStride] = (unsigned short)(pSrc[nX*nSampH/m_nSosSampFactHMax] << m_nLlPointTrans);
+				}
+			}
+		}
+	}
+	return nNumRows;
+}
 
+// Transfer image rows of a lossless image to the preview
+// - The samples are converted to the pixel map units (see SetFullRes).
+//   Three component images are treated as RGB and converted to YCC,
+//   all others are previewed from their first component
+// - In scaled decode the rows and columns are point sampled
+// - The block DC map holds the top-left sample of each 8x8 block
+//
+// INPUT:
+// - pRows					= Rows from DecodeLosslessRowOut()
+// - nRowStart				= Image row of the first row
+// - nNumRows				= Number of rows
+// POST:
+// - m_asPixPlane[]
+// - m_pBlkDcValY[], m_pBlkDcValCb[], m_pBlkDcValCr[]
+// - m_nNumPixels
+//
+void CimgDecode::DecodeLosslessPreview(const unsigned short* pRows,unsigned nRowStart,unsigned nNumRows)
+{
+	unsigned	nStepMask = (1 << m_nScaleShift) - 1;
+	unsigned	nPixStride = m_nLlNumComps;
+	unsigned	nValMax = (1 << m_nPrecision) - 1;
+	bool		bRgb = (m_nNumSosComps == NUM_CHAN_YCC);
+	unsigned	nRow;
+	unsigned	nPixX,nPixY;
+	unsigned	nBlkInd;
+	int			nR,nG,nB;
+	int			nY,nCb,nCr;
+	const unsigned short*	pSrc;
 
-			// Now that we finished an MCU, decrement the restart interval counter
-			if (m_bRestartEn) {
-				m_nRestartMcusLeft--;
+	for (unsigned nRowInd=0;nRowInd<nNumRows;nRowInd++) {
+		nRow = nRowStart + nRowInd;
+		if ((nRow & nStepMask) != 0) {
+			continue;
+		}
+		pSrc = pRows + nRowInd*m_nDimX*nPixStride;
+		for (unsigned nX=0;nX<m_nDimX;nX+=(nStepMask+1)) {
+			nR = ((int)min((unsigned)pSrc[nX*nPixStride],nValMax) << 11 >> m_nPrecision) - 1024;
+			if (bRgb) {
+				nG = ((int)min((unsigned)pSrc[nX*nPixStride+1],nValMax) << 11 >> m_nPrecision) - 1024;
+				nB = ((int)min((unsigned)pSrc[nX*nPixStride+2],nValMax) << 11 >> m_nPrecision) - 1024;
+				nY  = ( 19595*nR + 38470*nG +  7471*nB + 32768) >> 16;
+				nCb = (-11059*nR - 21709*nG + 32768*nB + 32768) >> 16;
+				nCr = ( 32768*nR - 27439*nG -  5329*nB + 32768) >> 16;
+			} else {
+				nY = nR;
+				nCb = 0;
+				nCr = 0;
 			}
 
-			// Check to see if we need to abort for some reason.
-			// Note that only check m_bScanEnd if we have a failure.
-			// m_bScanEnd is asserted during normal out-of-data when scan
-			// segment ends with marker. We don't want to abort early
-			// or else we'll not decode the last MCU or two!
-			if (m_bScanEnd && m_bScanBad) {
-				bScanStop = true;
+			nPixX = nX >> m_nScaleShift;
+			nPixY = nRow >> m_nScaleShift;
+			m_asPixPlane[CHAN_Y].pnPix[PlanePixInd(CHAN_Y,nPixX,nPixY)] = (short)nY;
+			if (bRgb) {
+				m_asPixPlane[CHAN_CB].pnPix[PlanePixInd(CHAN_CB,nPixX,nPixY)] = (short)nCb;
+				m_asPixPlane[CHAN_CR].pnPix[PlanePixInd(CHAN_CR,nPixX,nPixY)] = (short)nCr;
 			}
 
-		} // nMcuX
-
-
-	} // nMcuY
-	if (!bQuiet) {
-		m_pLog->AddLine(_T(""));
+			if ((nRow % BLK_SZ_Y == 0) && (nX % BLK_SZ_X == 0)) {
+				nBlkInd = (nRow/BLK_SZ_Y)*m_nBlkXMax + (nX/BLK_SZ_X);
+				m_pBlkDcValY[nBlkInd] = (short)nY;
+				if (bRgb) {
+					m_pBlkDcValCb[nBlkInd] = (short)nCb;
+					m_pBlkDcValCr[nBlkInd] = (short)nCr;
+				}
+			}
+		}
+		m_nNumPixels += m_nDimX;
 	}
+}
 
-	// ---------------------------------------------------------
-
-	// Now we can create the final preview. Since we have just finished
-	// decoding a new image, we need to ensure that we invalidate
-	// the temporary preview (multi-channel option). Done earlier
-	// with PREVIEW_NONE
-	if (bDisplay) {
-		CalcChannelPreview();
+// Decode a lossless scan (SOF3)
+// - The scan must cover all of the frame components
+// - The image is decoded one MCU row at a time. The 16-bit samples
+//   are kept (m_pLlPixMap) if they fit in nDecodeLosslessMapMax,
+//   otherwise LosslessRowsRead() decodes the scan again on request
+// - The preview is scaled down so that it stays within
+//   LL_PREVIEW_PIX_MAX pixels
+//
+// INPUT:
+// - nStart					= File position at start of scan
+// - bDisplay				= Generate a preview image?
+// - bQuiet					= Disable output of certain messages during decode?
+// PRE:
+// - SetImageDetails(), SetSofSampFactors(), SetPrecision()
+// - SetSosCompInd(), SetDhtTables(), SetSosProgress()
+// POST:
+// - m_bLossless
+// - m_pLlPixMap
+//
+void CimgDecode::DecodeScanLossless(unsigned nStart,bool bDisplay,bool bQuiet)
+{
+	CString		strTmp;
+	unsigned	nNumComps = m_nNumSosComps;
+	unsigned	nPredictor = m_nSosSpectralStart;
+	unsigned	nPointTrans = m_nSosSuccApproxLow;
+	unsigned	nComp;
+	int			nSel;
+
+	// Check the frame and scan parameters
+	bool		bScanOk = true;
+	if ((nNumComps == 0) || (nNumComps > MAX_SOS_COMP_NS) || (nNumComps != m_nNumSofComps)) {
+		strTmp.Format(_T("  NOTE: Lossless scan must contain all frame components [Ns=%u Nf=%u]"),nNumComps,m_nNumSofComps);
+		m_pLog->AddLineWarn(strTmp);
+		return;
+	}
+	if ((m_nPrecision < 2) || (m_nPrecision > 16)) {
+		bScanOk = false;
+	}
+	if ((nPredictor == 0) || (nPredictor > LL_PRED_MAX) || (nPointTrans >= m_nPrecision)) {
+		bScanOk = false;
+	}
+	for (unsigned nScanComp=1;(bScanOk)&&(nScanComp<=nNumComps);nScanComp++) {
+		nComp = m_anSosCompInd[nScanComp];
+		if ((nComp < 1) || (nComp > m_nNumSofComps)) {
+			bScanOk = false;
+		} else if ((nNumComps != NUM_CHAN_YCC) && (nNumComps != NUM_CHAN_GRAYSCALE) &&
+			((m_anSofSampFactH[nComp] != 1) || (m_anSofSampFactV[nComp] != 1))) {
+			bScanOk = false;
+		}
+	}
+	if (!bScanOk) {
+		strTmp.Format(_T("*** ERROR: Lossless scan not supported [P=%u Ns=%u Ss=%u Al=%u], skipping"),
+			m_nPrecision,nNumComps,nPredictor,nPointTrans);
+		m_pLog->AddLineErr(strTmp);
+		return;
 	}
 
-	// DIB is ready for display now
-	if (bDisplay) {
-		m_bDibTempReady = true;
-		m_bPreviewIsJpeg = true;
+	// The preview is made from the first component (or RGB)
+	// - Pick the smallest scale that keeps the preview bounded
+	unsigned	nScaleShiftMin = SCAN_SCALE_1;
+	while ((nScaleShiftMin < SCAN_SCALE_8) &&
+		((ULONGLONG)(m_nDimX >> nScaleShiftMin) * (m_nDimY >> nScaleShiftMin) > LL_PREVIEW_PIX_MAX)) {
+		nScaleShiftMin++;
+	}
+	m_nNumSosComps = (nNumComps == NUM_CHAN_YCC) ? NUM_CHAN_YCC : NUM_CHAN_GRAYSCALE;
+	if (!DecodeScanImgInit(bDisplay,nScaleShiftMin,false)) {
+		return;
 	}
+	// The preview pixel map is generated at 8-bit precision, the
+	// full precision samples are in m_pLlPixMap[]
+	m_nPixMapPrecShift = 0;
+	m_bDecodeScanAc = false;
 
+	// Check the DHT tables
+	for (unsigned nScanComp=1;nScanComp<=nNumComps;nScanComp++) {
+		nSel = m_psTbl->anDhtTblSel[DHT_CLASS_DC][nScanComp];
+		if ((nSel < 0) || (m_psTbl->anDhtLookupSize[DHT_CLASS_DC][nSel] == 0)) {
+			m_pLog->AddLineErr(_T("*** ERROR: Decoding image before DHT Table Selection via JFIF_SOS ***"));
+			return;
+		}
+		m_anScanDhtTblDc[nScanComp] = nSel;
+	}
+
+	m_nLlNumComps = nNumComps;
+	m_nLlPredictor = nPredictor;
+	m_nLlPointTrans = nPointTrans;
+	m_nLlPosStart = nStart;
+	m_nLlMcuXMax = (m_nDimX + m_nSosSampFactHMax-1) / m_nSosSampFactHMax;
+	m_nLlMcuYMax = (m_nDimY + m_nSosSampFactVMax-1) / m_nSosSampFactVMax;
+
+	// Restart intervals must cover whole MCU rows as the prediction
+	// is reset at the start of each interval (ITU-T.81 H.1.2.1)
+	m_nLlRestartRows = 0;
+	if (m_bRestartEn) {
+		if ((m_nRestartInterval == 0) || (m_nRestartInterval % m_nLlMcuXMax != 0)) {
+			strTmp.Format(_T("*** ERROR: Lossless restart interval [%u] not a multiple of the MCU row [%u], skipping"),
+				m_nRestartInterval,m_nLlMcuXMax);
+			m_pLog->AddLineErr(strTmp);
+			return;
+		}
+		m_nLlRestartRows = m_nRestartInterval / m_nLlMcuXMax;
+	}
 
-	// ------------------------------------
-	// Report statistics
+	// Keep the image samples if they fit, otherwise decode into a
+	// buffer for a single MCU row
+	ULONGLONG	nPixMapBytes = (ULONGLONG)m_nDimX * m_nDimY * nNumComps * sizeof(unsigned short);
+	unsigned short*	pRowsTmp = NULL;
+	if (nPixMapBytes <= ((ULONGLONG)m_pAppConfig->nDecodeLosslessMapMax << 20)) {
+		m_pLlPixMap = new unsigned short[(size_t)m_nDimX * m_nDimY * nNumComps];
+	}
+	if (!m_pLlPixMap) {
+		pRowsTmp = new unsigned short[LL_ROWS_MAX * m_nDimX * nNumComps];
+		if (!pRowsTmp) {
+			strTmp = _T("ERROR: Not enough memory for Image Decoder Lossless Row Buffer");
+			m_pLog->AddLineErr(strTmp);
+			if (m_pAppConfig->bInteractive)
+				AfxMessageBox(strTmp);
+			return;
+		}
+	}
 
 	if (!bQuiet) {
-
-		// Report Compression stats
-		// TODO: Should we use m_nNumSofComps?
-		strTmp.Format(_T("  Compression stats:"));
-		m_pLog->AddLine(strTmp);
-		float nCompressionRatio = (float)(m_nDimX*m_nDimY*m_nNumSosComps*8) / (float)((m_anScanBuffPtr_pos[0]-m_nScanBuffPtr_first)*8);
-		strTmp.Format(_T("    Compression Ratio: %5.2f:1"),nCompressionRatio);
+		m_pLog->AddLineHdr(_T("*** Decoding SCAN Data ***"));
+		strTmp.Format(_T("  OFFSET: 0x%08X"),nStart);
 		m_pLog->AddLine(strTmp);
-		float nBitsPerPixel = (float)((m_anScanBuffPtr_pos[0]-m_nScanBuffPtr_first)*8) / (float)(m_nDimX*m_nDimY);
-		strTmp.Format(_T("    Bits per pixel:    %5.2f:1"),nBitsPerPixel);
+		strTmp.Format(_T("  Scan Decode Mode: Lossless (Predictor %u, Point transform %u)"),nPredictor,nPointTrans);
 		m_pLog->AddLine(strTmp);
+		if (m_nScaleShift != SCAN_SCALE_1) {
+			strTmp.Format(_T("  Scan Decode Scale: 1/%u (%u x %u pixels)"),1<<m_nScaleShift,m_nPixMapW,m_nPixMapH);
+			m_pLog->AddLine(strTmp);
+		}
+		if (!m_pLlPixMap) {
+			strTmp.Format(_T("  NOTE: %u-bit image not kept in memory (limit %u MB), exports decode the scan again"),
+				m_nPrecision,m_pAppConfig->nDecodeLosslessMapMax);
+			m_pLog->AddLine(strTmp);
+		}
 		m_pLog->AddLine(_T(""));
+	}
 
+	// Report any Buffer overlays
+	m_pWBuf->ReportOverlays(m_pLog);
 
-		// Report Huffman stats
-		strTmp.Format(_T("  Huffman code histogram stats:"));
-		m_pLog->AddLine(strTmp);
-
-		unsigned nDhtHistoTotal;
-		for (unsigned nClass=DHT_CLASS_DC;nClass<=DHT_CLASS_AC;nClass++) {
-			for (unsigned nDhtDestId=0;nDhtDestId<=m_anDhtLookupSetMax[nClass];nDhtDestId++) {
-				nDhtHistoTotal = 0;
-				for (unsigned nBitLen=1;nBitLen<=MAX_DHT_CODELEN;nBitLen++) {
-					nDhtHistoTotal += m_anDhtHisto[nClass][nDhtDestId][nBitLen];
-				}
-
-				strTmp.Format(_T("    Huffman Table: (Dest ID: %u, Class: %s)"),nDhtDestId,(nClass?_T("AC"):_T("DC")));
-				m_pLog->AddLine(strTmp);
-				for (unsigned nBitLen=1;nBitLen<=MAX_DHT_CODELEN;nBitLen++) {
-					strTmp.Format(_T("      # codes of length %02u bits: %8u (%3.0f%%)"),
-						nBitLen,m_anDhtHisto[nClass][nDhtDestId][nBitLen],(m_anDhtHisto[nClass][nDhtDestId][nBitLen]*100.0)/nDhtHistoTotal);
-					m_pLog->AddLine(strTmp);
-				}
-				m_pLog->AddLine(_T(""));
-			}
+	if (!DecodeLosslessInit()) {
+		if (pRowsTmp) {
+			delete [] pRowsTmp;
 		}
+		return;
+	}
+	m_bLossless = true;
+	m_nNumPixels = 0;
 
-		// Report YCC stats
-		ReportColorStats();
-
-	}	// !bQuiet
-
-	// ------------------------------------
+	unsigned short*	pRows;
+	unsigned	nRowStart;
+	unsigned	nNumRows;
+	for (unsigned nMcuY=0;nMcuY<m_nLlMcuYMax;nMcuY++) {
+		if (nMcuY % (BLK_SZ_Y*m_nSosSampFactVMax) == 0) {
+			strTmp.Format(_T("Decoding Scan Data... Row %04u of %04u (%3.0f%%)"),nMcuY,m_nLlMcuYMax,nMcuY*100.0/m_nLlMcuYMax);
+			SetStatusText(strTmp);
+		}
 
-	// Display the image histogram if enabled
-	if (bDisplay && m_bHistEn) {
-		DrawHistogram(bQuiet,bDumpHistoY);
+		nRowStart = nMcuY * m_nSosSampFactVMax;
+		pRows = (m_pLlPixMap) ? m_pLlPixMap + (size_t)nRowStart*m_nDimX*nNumComps : pRowsTmp;
+		DecodeLosslessMcuRow(true);
+		nNumRows = DecodeLosslessRowOut(pRows);
+		if (bDisplay) {
+			DecodeLosslessPreview(pRows,nRowStart,nNumRows);
+		}
 	}
-
-	if (bDisplay && m_bAvgYValid) {
-		m_pLog->AddLine(_T("  Average Pixel Luminance (Y):"));
-		strTmp.Format(_T("    Y=[%3u] (range: 0..255)"),
-			m_nAvgY);
-		m_pLog->AddLine(strTmp);
-		m_pLog->AddLine(_T(""));
+	if (pRowsTmp) {
+		delete [] pRowsTmp;
 	}
+	DecodeLosslessFree();
 
-	if (bDisplay && m_bBrightValid) {
-		m_pLog->AddLine(_T("  Brightest Pixel Search:"));
-		strTmp.Format(_T("    YCC=[%5d,%5d,%5d] RGB=[%3u,%3u,%3u] @ MCU[%3u,%3u]"),
-			m_nBrightY,m_nBrightCb,m_nBrightCr,m_nBrightR,m_nBrightG,m_nBrightB,
-			m_ptBrightMcu.x,m_ptBrightMcu.y);
-		m_pLog->AddLine(strTmp);
-		m_pLog->AddLine(_T(""));
-	}
+	if (bDisplay) {
+		CalcChannelPreview();
 
+		// DIB is ready for display now
+		m_bDibTempReady = true;
+		m_bPreviewIsJpeg = true;
+		PlaneCompact();
+	}
 
-	// --------------------------------------
+	m_nScanBuffPtr_first = nStart;
+	ReportScanStats(bDisplay,bQuiet);
+}
 
-	if (!bQuiet) {
-		m_pLog->AddLine(_T("  Finished Decoding SCAN Data"));
-		strTmp.Format(_T("    Number of RESTART markers decoded: %u"),m_nRestartRead);
-		m_pLog->AddLine(strTmp);
-		strTmp.Format(_T("    Next position in scan buffer: Offset %s"),(LPCTSTR)GetScanBufPos());
-		m_pLog->AddLine(strTmp);
+// Get the format of the lossless image samples
+//
+// OUTPUT:
+// - nSizeX, nSizeY			= Image dimensions
+// - nNumComps				= Number of components per pixel
+// - nPrecision				= Sample precision (bits)
+// RETURN:
+// - True if the image was decoded by DecodeScanLossless()
+//
+bool CimgDecode::GetLosslessInfo(unsigned &nSizeX,unsigned &nSizeY,unsigned &nNumComps,unsigned &nPrecision)
+{
+	nSizeX = m_nDimX;
+	nSizeY = m_nDimY;
+	nNumComps = m_nLlNumComps;
+	nPrecision = m_nPrecision;
+	return m_bLossless;
+}
 
-		m_pLog->AddLine(_T(""));
+// Start reading the rows of the lossless image from the top
+// - If the samples weren't kept the scan is decoded again one MCU row
+//   at a time (the errors have already been reported by the decode)
+//
+// PRE:
+// - DecodeScanLossless()
+// RETURN:
+// - True if the rows can be read by LosslessRowsRead()
+//
+bool CimgDecode::LosslessRowsBegin()
+{
+	if (!m_bLossless) {
+		return false;
+	}
+	m_nLlRowsRead = 0;
+	if (m_pLlPixMap) {
+		return true;
 	}
 
-	// --------------------------------------
-	// Write out the full Y histogram if requested!
+	m_bLlErrDisabled = m_bScanErrorsDisable;
+	ScanErrorsDisable();
+	return DecodeLosslessInit();
+}
 
-	CString strFull;
+// Read the next rows of the lossless image
+//
+// OUTPUT:
+// - pRows					= Rows of m_nDimX x nNumComps samples
+//							  (see GetLosslessInfo). The buffer must hold
+//							  LL_ROWS_MAX rows
+// PRE:
+// - LosslessRowsBegin()
+// RETURN:
+// - Number of rows read (0 at the end of the image)
+//
+unsigned CimgDecode::LosslessRowsRead(unsigned short* pRows)
+{
+	unsigned	nNumRows = 0;
 
-	if (bDisplay && m_bHistEn && bDumpHistoY) {
-		ReportHistogramY();
+	if (!m_bLossless) {
+		return 0;
 	}
+	if (m_pLlPixMap) {
+		if (m_nLlRowsRead < m_nDimY) {
+			nNumRows = min((unsigned)LL_ROWS_MAX,m_nDimY-m_nLlRowsRead);
+			memcpy(pRows,m_pLlPixMap + (size_t)m_nLlRowsRead*m_nDimX*m_nLlNumComps,
+				nNumRows*m_nDimX*m_nLlNumComps*sizeof(unsigned short));
+		}
+	} else if ((m_apLlRow[1]) && (m_nLlMcuY < m_nLlMcuYMax)) {
+		DecodeLosslessMcuRow(false);
+		nNumRows = DecodeLosslessRowOut(pRows);
+	}
+	m_nLlRowsRead += nNumRows;
+	return nNumRows;
+}
 
-
+// Finish reading the rows of the lossless image
+//
+// POST:
+// - m_apLlRow[]
+//
+void CimgDecode::LosslessRowsEnd()
+{
+	if ((m_bLossless) && (!m_pLlPixMap)) {
+		DecodeLosslessFree();
+		if (!m_bLlErrDisabled) {
+			ScanErrorsEnable();
+		}
+	}
 }
 
 //
@@ -4025,12 +9333,11 @@ void CimgDecode::DrawHistogram(bool bQuiet,bool bDumpHistoY)
 // - m_nScanBuff
 // - m_nScanBuffPtr_first
 // - m_nScanBuffPtr_start
-// - m_nScanBuffPtr_align
-// - m_anScanBuffPtr_pos[]
-// - m_anScanBuffPtr_err[]
+// - m_nScanBuffLoadInd
+// - m_anScanBuffPos[]
+// - m_nScanBuffErrNum
 // - m_nScanBuffLatchErr
-// - m_nScanBuffPtr_num
-// - m_nScanBuff_vacant
+// - m_nScanBuffBits
 // - m_nScanCurErr
 // - m_bRestartRead
 // - m_nRestartMcusLeft
@@ -4040,7 +9347,7 @@ void CimgDecode::DecodeRestartScanBuf(unsigned nFilePos,bool bRestart)
 	// Reset the state
 	m_bScanEnd = false;
 	m_bScanBad = false;
-	m_nScanBuff = 0x00000000;
+	m_nScanBuff = 0;
 	m_nScanBuffPtr = nFilePos;
 	if (!bRestart) {
 		// Only reset the scan buffer pointer at the start of the file,
@@ -4049,19 +9356,17 @@ void CimgDecode::DecodeRestartScanBuf(unsigned nFilePos,bool bRestart)
 		m_nScanBuffPtr_first = nFilePos;
 	}
 	m_nScanBuffPtr_start = nFilePos;
-	m_nScanBuffPtr_align = 0;			// Start with byte alignment (0)
-	m_anScanBuffPtr_pos[0] = 0;
-	m_anScanBuffPtr_pos[1] = 0;
-	m_anScanBuffPtr_pos[2] = 0;
-	m_anScanBuffPtr_pos[3] = 0;
-	m_anScanBuffPtr_err[0] = SCANBUF_OK;
-	m_anScanBuffPtr_err[1] = SCANBUF_OK;
-	m_anScanBuffPtr_err[2] = SCANBUF_OK;
-	m_anScanBuffPtr_err[3] = SCANBUF_OK;
+	if (!bRestart) {
+		// The load index is left running across RSTn markers so that
+		// positions saved just before the marker can still be resolved
+		m_nScanBuffLoadInd = 0;
+		memset(m_anScanBuffPos,0,sizeof(m_anScanBuffPos));
+	}
+	m_nScanBuffErrNum = 0;
 	m_nScanBuffLatchErr = SCANBUF_OK;
 
-	m_nScanBuffPtr_num = 0;		// Empty m_nScanBuff
-	m_nScanBuff_vacant = 32;
+	m_nScanBuffBits = 0;		// Empty m_nScanBuff
+	m_nScanBuffOverBits = 0;
 
 	m_nScanCurErr = false;
 
@@ -4091,9 +9396,10 @@ void CimgDecode::ConvertYCCtoRGBFastFloat(PixelCc &sPix)
 
 	// Perform ranging to adjust from Huffman sums to reasonable range
 	// -1024..+1024 -> -128..127
-	sPix.nPreclipY  = sPix.nPrerangeY >> 3;
-	sPix.nPreclipCb = sPix.nPrerangeCb >> 3;
-	sPix.nPreclipCr = sPix.nPrerangeCr >> 3;
+	// - 12-bit images are reduced to 8-bit here (m_nPixMapPrecShift)
+	sPix.nPreclipY  = sPix.nPrerangeY >> (3+m_nPixMapPrecShift);
+	sPix.nPreclipCb = sPix.nPrerangeCb >> (3+m_nPixMapPrecShift);
+	sPix.nPreclipCr = sPix.nPrerangeCr >> (3+m_nPixMapPrecShift);
 
 	// Limit on YCC input
 	// The y/cb/nPreclipCr values should already be 0..255 unless we have a
@@ -4153,9 +9459,9 @@ void CimgDecode::ConvertYCCtoRGBFastFixed(PixelCc &sPix)
 
 	// Perform ranging to adjust from Huffman sums to reasonable range
 	// -1024..+1024 -> -128..+127
-	nPreclipY  = sPix.nPrerangeY >> 3;
-	nPreclipCb = sPix.nPrerangeCb >> 3;
-	nPreclipCr = sPix.nPrerangeCr >> 3;
+	nPreclipY  = sPix.nPrerangeY >> (3+m_nPixMapPrecShift);
+	nPreclipCb = sPix.nPrerangeCb >> (3+m_nPixMapPrecShift);
+	nPreclipCr = sPix.nPrerangeCr >> (3+m_nPixMapPrecShift);
 
 
 	// Limit on YCC input
@@ -4252,7 +9558,7 @@ void CimgDecode::ConvertYCCtoRGB(unsigned nMcuX,unsigned nMcuY,PixelCc &sPix)
 		// Now generate the Y histogram, if requested
 		// Add the Y value to the full histogram (for image similarity calcs)
 		//if (bDumpHistoY) {
-			int histo_index = sPix.nPrerangeY;
+			int histo_index = sPix.nPrerangeY >> m_nPixMapPrecShift;
 			if (histo_index < -1024) histo_index = -1024;
 			if (histo_index > 1023) histo_index = 1023;
 			histo_index += 1024;
@@ -4263,9 +9569,10 @@ void CimgDecode::ConvertYCCtoRGB(unsigned nMcuX,unsigned nMcuY,PixelCc &sPix)
 	// Perform ranging to adjust from Huffman sums to reasonable range
 	// -1024..+1024 -> 0..255
 	// Add 1024 then / 8
-	sPix.nPreclipY  = (sPix.nPrerangeY+1024)/8;
-	sPix.nPreclipCb = (sPix.nPrerangeCb+1024)/8;
-	sPix.nPreclipCr = (sPix.nPrerangeCr+1024)/8;
+	// - 12-bit images: add 16384 then / 128
+	sPix.nPreclipY  = (sPix.nPrerangeY+(1024<<m_nPixMapPrecShift))/(8<<m_nPixMapPrecShift);
+	sPix.nPreclipCb = (sPix.nPrerangeCb+(1024<<m_nPixMapPrecShift))/(8<<m_nPixMapPrecShift);
+	sPix.nPreclipCr = (sPix.nPrerangeCr+(1024<<m_nPixMapPrecShift))/(8<<m_nPixMapPrecShift);
 
 
 	// Limit on YCC input
@@ -4372,7 +9679,7 @@ void CimgDecode::CapYccRange(unsigned nMcuX,unsigned nMcuY,PixelCc &sPix)
 			if (YCC_CLIP_REPORT_ERR && (m_nWarnYccClipNum < YCC_CLIP_REPORT_MAX)) {
 				CString strTmp;
 				strTmp.Format(_T("*** NOTE: YCC Clipped. MCU=(%4u,%4u) YCC=(%5d,%5d,%5d) Y Overflow @ Offset %s"),
-					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetScanBufPos());
+					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetPreviewScanPos());
 				m_pLog->AddLineWarn(strTmp);
 				m_nWarnYccClipNum++;
 				m_sStatClip.nClipYOver++;
@@ -4388,7 +9695,7 @@ void CimgDecode::CapYccRange(unsigned nMcuX,unsigned nMcuY,PixelCc &sPix)
 			if (YCC_CLIP_REPORT_ERR && (m_nWarnYccClipNum < YCC_CLIP_REPORT_MAX)) {
 				CString strTmp;
 				strTmp.Format(_T("*** NOTE: YCC Clipped. MCU=(%4u,%4u) YCC=(%5d,%5d,%5d) Y Underflow @ Offset %s"),
-					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetScanBufPos());
+					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetPreviewScanPos());
 				m_pLog->AddLineWarn(strTmp);
 				m_nWarnYccClipNum++;
 				m_sStatClip.nClipYUnder++;
@@ -4404,7 +9711,7 @@ void CimgDecode::CapYccRange(unsigned nMcuX,unsigned nMcuY,PixelCc &sPix)
 			if (YCC_CLIP_REPORT_ERR && (m_nWarnYccClipNum < YCC_CLIP_REPORT_MAX)) {
 				CString strTmp;
 				strTmp.Format(_T("*** NOTE: YCC Clipped. MCU=(%4u,%4u) YCC=(%5d,%5d,%5d) Cb Overflow @ Offset %s"),
-					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetScanBufPos());
+					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetPreviewScanPos());
 				m_pLog->AddLineWarn(strTmp);
 				m_nWarnYccClipNum++;
 				m_sStatClip.nClipCbOver++;
@@ -4420,7 +9727,7 @@ void CimgDecode::CapYccRange(unsigned nMcuX,unsigned nMcuY,PixelCc &sPix)
 			if (YCC_CLIP_REPORT_ERR && (m_nWarnYccClipNum < YCC_CLIP_REPORT_MAX)) {
 				CString strTmp;
 				strTmp.Format(_T("*** NOTE: YCC Clipped. MCU=(%4u,%4u) YCC=(%5d,%5d,%5d) Cb Underflow @ Offset %s"),
-					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetScanBufPos());
+					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetPreviewScanPos());
 				m_pLog->AddLineWarn(strTmp);
 				m_nWarnYccClipNum++;
 				m_sStatClip.nClipCbUnder++;
@@ -4436,7 +9743,7 @@ void CimgDecode::CapYccRange(unsigned nMcuX,unsigned nMcuY,PixelCc &sPix)
 			if (YCC_CLIP_REPORT_ERR && (m_nWarnYccClipNum < YCC_CLIP_REPORT_MAX)) {
 				CString strTmp;
 				strTmp.Format(_T("*** NOTE: YCC Clipped. MCU=(%4u,%4u) YCC=(%5d,%5d,%5d) Cr Overflow @ Offset %s"),
-					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetScanBufPos());
+					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetPreviewScanPos());
 				m_pLog->AddLineWarn(strTmp);
 				m_nWarnYccClipNum++;
 				m_sStatClip.nClipCrOver++;
@@ -4452,7 +9759,7 @@ void CimgDecode::CapYccRange(unsigned nMcuX,unsigned nMcuY,PixelCc &sPix)
 			if (YCC_CLIP_REPORT_ERR && (m_nWarnYccClipNum < YCC_CLIP_REPORT_MAX)) {
 				CString strTmp;
 				strTmp.Format(_T("*** NOTE: YCC Clipped. MCU=(%4u,%4u) YCC=(%5d,%5d,%5d) Cr Underflow @ Offset %s"),
-					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetScanBufPos());
+					nMcuX,nMcuY,nCurY,nCurCb,nCurCr,(LPCTSTR)GetPreviewScanPos());
 				m_pLog->AddLineWarn(strTmp);
 				m_nWarnYccClipNum++;
 				m_sStatClip.nClipCrUnder++;
@@ -4610,30 +9917,14 @@ void CimgDecode::CapRgbRange(unsigned nMcuX,unsigned nMcuY,PixelCc &sPix)
 // - pRectView				= UNUSED. Intended to limit updates to visible region
 //                            (Range of real image that is visibile / cropped)
 // PRE:
-// - m_pPixValY[]
-// - m_pPixValCb[]
-// - m_pPixValCr[]
+// - m_asPixPlane[]
 // OUTPUT:
 // - pTmp					= RGB pixel map (32-bit per pixel, [0x00,R,G,B])
 //
 void CimgDecode::CalcChannelPreviewFull(CRect* pRectView,unsigned char* pTmp)
 {
 	pRectView;	// Unreferenced param
-	PixelCc		sPixSrc,sPixDst;
-	CString		strTmp;
-
-	unsigned	nRowBytes;
-	nRowBytes = m_nImgSizeX * sizeof(RGBQUAD);
-
-
-	// Color conversion process
-
-	unsigned	nPixMapW = m_nBlkXMax*BLK_SZ_X;
-	unsigned	nPixmapInd;
-
-	unsigned		nRngX1,nRngX2,nRngY1,nRngY2;
-	unsigned		nSumY;
-	unsigned long	nNumPixels = 0;
+	unsigned	nSumY = 0;
 
 	// TODO: Update ranges to take into account the visible view region
 	// The approach might include:
@@ -4652,12 +9943,23 @@ void CimgDecode::CalcChannelPreviewFull(CRect* pRectView,unsigned char* pTmp)
 	// way to handle the brightest pixel search & average luminance logic
 	// since those appear in the nRngX/Y loops.
 
-	nRngX1 = 0;
-	nRngX2 = m_nImgSizeX;
-	nRngY1 = 0;
-	nRngY2 = m_nImgSizeY;
-
+	CalcChannelPreviewStart();
+	CalcChannelPreviewRows(0,m_nPixMapH,pTmp,nSumY);
+	CalcChannelPreviewEnd(nSumY);
+}
 
+// Prepare for the color conversion (CalcChannelPreviewRows)
+// - Reset the brightest pixel and average luminance
+//
+// POST:
+// - m_nBrightY, m_nBrightCb, m_nBrightCr
+// - m_bBrightValid
+// - m_nAvgY
+// - m_bAvgYValid
+//
+void CimgDecode::CalcChannelPreviewStart()
+{
+	CString		strTmp;
 
 	// Brightest pixel values were already reset during Reset() call, but for
 	// safety, do it again here.
@@ -4665,11 +9967,83 @@ void CimgDecode::CalcChannelPreviewFull(CRect* pRectView,unsigned char* pTmp)
 	m_nBrightY  = -32768;
 	m_nBrightCb = -32768;
 	m_nBrightCr = -32768;
+	m_nBrightK  = -32768;
+	m_nBrightLum = -1;
 
 	// Average luminance calculation
 	m_bAvgYValid = false;
 	m_nAvgY = 0;
-	nSumY = 0;
+
+	SetStatusText(_T("Color conversion..."));
+
+	if (m_bDetailVlc) {
+		m_pLog->AddLine(_T("  Detailed IDCT Dump (RGB):"));
+		strTmp.Format(_T("    MCU [%3u,%3u]:"),m_nDetailVlcX,m_nDetailVlcY);
+		m_pLog->AddLine(strTmp);
+	}
+}
+
+// Color convert a range of rows of the YCC pixmap into the RGB pixel map
+// - The rows must be converted in order (top to bottom) so that the
+//   brightest pixel and the statistics are the same as for one pass
+// - The detailed IDCT dump (m_bDetailVlc) requires a single pass
+// - Converts each pixel in turn only for the detailed IDCT dump and the
+//   verbose RGB clipping report. Otherwise the rows are converted by the
+//   YccToRgb kernel (CalcChannelPreviewRowsYcc), and the color statistics
+//   are gathered by a separate pass (CalcChannelStats).
+//
+// INPUT:
+// - nPixY1					= First row of the pixel map
+// - nPixY2					= Row after the last one to convert
+// - nSumY					= Luminance sum of the previous rows
+// PRE:
+// - CalcChannelPreviewStart()
+// - m_asPixPlane[]
+// - m_nBandPixY			= Pixel map row at the top of the band (band decode)
+// OUTPUT:
+// - pTmp					= RGB pixel map (32-bit per pixel, [0x00,R,G,B])
+// - nSumY					= Luminance sum including these rows
+//
+void CimgDecode::CalcChannelPreviewRows(unsigned nPixY1,unsigned nPixY2,unsigned char* pTmp,unsigned &nSumY)
+{
+	if (m_nNumSosComps == NUM_CHAN_YCCK) {
+		CalcChannelPreviewRowsCmyk(nPixY1,nPixY2,pTmp,nSumY);
+		return;
+	}
+	if ((!m_bDetailVlc) && (!m_bVerbose)) {
+		if (m_bHistEn || m_bStatClipEn) {
+			CalcChannelStats(nPixY1,nPixY2);
+		}
+		CalcChannelPreviewRowsYcc(nPixY1,nPixY2,pTmp,nSumY);
+		return;
+	}
+
+	PixelCc		sPixSrc,sPixDst;
+	CString		strTmp;
+
+	unsigned	nRowBytes;
+	nRowBytes = m_nPixMapW * sizeof(RGBQUAD);
+
+
+	// Color conversion process
+
+	unsigned		nRngX1,nRngX2,nRngY1,nRngY2;
+
+	// Rows of the pixel planes at the pixel map resolution
+	short*		pnRowBuf = new short[m_nPixMapW * NUM_CHAN_YCC];
+	if (!pnRowBuf) {
+		return;
+	}
+	const short*	pnRowY = NULL;
+	const short*	pnRowCb = NULL;
+	const short*	pnRowCr = NULL;
+
+	// In scaled decode the pixel map (and DIB) is smaller than the
+	// image, so the pixel coordinates are scaled up for the MCU index
+	nRngX1 = 0;
+	nRngX2 = m_nPixMapW;
+	nRngY1 = nPixY1;
+	nRngY2 = nPixY2;
 
 	// For IDCT RGB Printout:
 	bool		bRowStart = false;
@@ -4678,118 +10052,662 @@ void CimgDecode::CalcChannelPreviewFull(CRect* pRectView,unsigned char* pTmp)
 
 	unsigned	nMcuShiftInd = m_nPreviewShiftMcuY * (m_nImgSizeX/m_nMcuWidth) + m_nPreviewShiftMcuX;
 
-	SetStatusText(_T("Color conversion..."));
+	// Step through the image
+	for (unsigned nPixY=nRngY1;nPixY<nRngY2;nPixY++) {
+
+		// In band decode the rows are relative to the top of the band
+		unsigned nMcuY = ((nPixY+m_nBandPixY)<<m_nScaleShift)/m_nMcuHeight;
+		// DIBs appear to be stored up-side down, so correct Y
+		unsigned nCoordYInv = (m_nPixMapH-1) - nPixY;
+
+		pnRowY = PlaneRowGet(CHAN_Y,nPixY,&pnRowBuf[0]);
+		if (m_nNumSosComps == NUM_CHAN_YCC) {
+			pnRowCb = PlaneRowGet(CHAN_CB,nPixY,&pnRowBuf[m_nPixMapW]);
+			pnRowCr = PlaneRowGet(CHAN_CR,nPixY,&pnRowBuf[m_nPixMapW*2]);
+		}
+
+		for (unsigned nPixX=nRngX1;nPixX<nRngX2;nPixX++) {
+
+			unsigned	nPixByte = nPixX*4+0+nCoordYInv*nRowBytes;
+
+			unsigned	nMcuX = (nPixX<<m_nScaleShift)/m_nMcuWidth;
+			unsigned	nMcuInd = nMcuY * (m_nImgSizeX/m_nMcuWidth) + nMcuX;
+			int			nTmpY,nTmpCb,nTmpCr;
+			nTmpY = pnRowY[nPixX];
+
+			if (m_nNumSosComps == NUM_CHAN_YCC) {
+				nTmpCb = pnRowCb[nPixX];
+				nTmpCr = pnRowCr[nPixX];
+			} else {
+				nTmpCb = 0;
+				nTmpCr = 0;
+			}
+
+			// Load the YCC value
+			sPixSrc.nPrerangeY  = nTmpY;
+			sPixSrc.nPrerangeCb = nTmpCb;
+			sPixSrc.nPrerangeCr = nTmpCr;
+
+			// Update brightest pixel search here
+			int nBrightness = nTmpY;
+			if (nBrightness > m_nBrightY) {
+				m_nBrightY  = nTmpY;
+				m_nBrightCb = nTmpCb;
+				m_nBrightCr = nTmpCr;
+				m_ptBrightMcu.x = nMcuX;
+				m_ptBrightMcu.y = nMcuY;
+			}
+
+			// FIXME
+			// Could speed this up by adding boolean check to see if we are
+			// truly needing to do any shifting!
+			if (nMcuInd >= nMcuShiftInd) {
+				sPixSrc.nPrerangeY  += m_nPreviewShiftY;
+				sPixSrc.nPrerangeCb += m_nPreviewShiftCb;
+				sPixSrc.nPrerangeCr += m_nPreviewShiftCr;
+			}
+
+			// Invoke the appropriate color conversion routine
+			if (m_bHistEn || m_bStatClipEn) {
+				ConvertYCCtoRGB(nMcuX,nMcuY,sPixSrc);
+			} else {
+				ConvertYCCtoRGBFastFloat(sPixSrc);
+				//ConvertYCCtoRGBFastFixed(sPixSrc);
+			}
+
+			// Accumulate the luminance value for this pixel
+			// after we have converted it to the range 0..255
+			nSumY += sPixSrc.nFinalY;
+
+
+			// If we want a detailed decode of RGB, print it out
+			// now if we are on the correct MCU.
+			// NOTE: The level shift (adjust) will affect this report!
+			if (m_bDetailVlc) {
+				if (nMcuY == m_nDetailVlcY) {
+
+					if (nMcuX == m_nDetailVlcX) {
+					//if ((nMcuX >= m_nDetailVlcX) && (nMcuX < m_nDetailVlcX+m_nDetailVlcLen)) {
+						if (!bRowStart) {
+							bRowStart = true;
+							strLine.Format(_T("      [ "));
+						}
+						strTmp.Format(_T("x%02X%02X%02X "),sPixSrc.nFinalR,sPixSrc.nFinalG,sPixSrc.nFinalB);
+						strLine.Append(strTmp);
+					} else {
+						if (bRowStart) {
+							// We had started a row, but we are now out of range, so we
+							// need to close up!
+							strTmp.Format(_T(" ]"));
+							strLine.Append(strTmp);
+							m_pLog->AddLine(strLine);
+							bRowStart = false;
+						}
+					}
+				}
+
+			}
+
+			// Perform any channel filtering if enabled
+			ChannelExtract(m_nPreviewMode,sPixSrc,sPixDst);
+
+			// Assign the RGB pixel map
+			pTmp[nPixByte+3] = 0;
+			pTmp[nPixByte+2] = sPixDst.nFinalR;
+			pTmp[nPixByte+1] = sPixDst.nFinalG;
+			pTmp[nPixByte+0] = sPixDst.nFinalB;
+
+		} // x
+	} // y
+
+	delete [] pnRowBuf;
+}
+
+// Color convert a range of rows of the YCC / grayscale pixmap into the RGB pixel map
+// - Each row is converted by the YccToRgb kernel (see ImgDecodeSimd),
+//   which also applies the preview YCC shift and channel selection.
+//   A row that starts the preview shift part way is converted in two parts.
+// - Horizontally 2:1 subsampled chroma planes are read as they are
+//   (the kernel repeats each sample), otherwise the planes are
+//   upsampled to the pixel map width first (PlaneRowGet)
+// - Same result as the per-pixel conversion (ConvertYCCtoRGBFastFloat),
+//   except that the fixed point conversion can differ by one level
+//
+// INPUT:
+// - nPixY1					= First row of the pixel map
+// - nPixY2					= Row after the last one to convert
+// - nSumY					= Luminance sum of the previous rows
+// PRE:
+// - CalcChannelPreviewStart()
+// - m_asPixPlane[]
+// - m_nBandPixY			= Pixel map row at the top of the band (band decode)
+// OUTPUT:
+// - pTmp					= RGB pixel map (32-bit per pixel, [0x00,R,G,B])
+// - nSumY					= Luminance sum including these rows
+//
+void CimgDecode::CalcChannelPreviewRowsYcc(unsigned nPixY1,unsigned nPixY2,unsigned char* pTmp,unsigned &nSumY)
+{
+	unsigned	nRowBytes = m_nPixMapW * sizeof(RGBQUAD);
+	bool		bColor = (m_nNumSosComps == NUM_CHAN_YCC);
+
+	// Rows of the pixel planes at the pixel map resolution
+	// - Grayscale images use a row of zeros for Cb and Cr
+	short*		pnRowBuf = new short[m_nPixMapW * NUM_CHAN_YCC];
+	if (!pnRowBuf) {
+		return;
+	}
+	memset(pnRowBuf,0,m_nPixMapW * NUM_CHAN_YCC * sizeof(short));
+	const short*	pnRowY;
+	const short*	pnRowCb = &pnRowBuf[m_nPixMapW];
+	const short*	pnRowCr = &pnRowBuf[m_nPixMapW*2];
+
+	const PixPlane*	psPlaneCb = &m_asPixPlane[CHAN_CB];
+	const PixPlane*	psPlaneCr = &m_asPixPlane[CHAN_CR];
+	bool		bChromaHalf = (bColor) && (psPlaneCb->pnPix) && (psPlaneCr->pnPix) &&
+		(psPlaneCb->nSampH*2 == psPlaneCb->nSampHMax) && (psPlaneCr->nSampH*2 == psPlaneCr->nSampHMax);
+
+	// Channel selection (see ChannelExtract)
+	unsigned	anSel[3];
+	switch (m_nPreviewMode) {
+	case PREVIEW_YCC:	anSel[0] = YCC_OUT_CB;	anSel[1] = YCC_OUT_Y;	anSel[2] = YCC_OUT_CR;	break;
+	case PREVIEW_R:		anSel[0] = anSel[1] = anSel[2] = YCC_OUT_R;		break;
+	case PREVIEW_G:		anSel[0] = anSel[1] = anSel[2] = YCC_OUT_G;		break;
+	case PREVIEW_B:		anSel[0] = anSel[1] = anSel[2] = YCC_OUT_B;		break;
+	case PREVIEW_Y:		anSel[0] = anSel[1] = anSel[2] = YCC_OUT_Y;		break;
+	case PREVIEW_CB:	anSel[0] = anSel[1] = anSel[2] = YCC_OUT_CB;	break;
+	case PREVIEW_CR:	anSel[0] = anSel[1] = anSel[2] = YCC_OUT_CR;	break;
+	default:			anSel[0] = YCC_OUT_B;	anSel[1] = YCC_OUT_G;	anSel[2] = YCC_OUT_R;	break;
+	}
+
+	// Preview YCC shift, which applies from MCU (m_nPreviewShiftMcuX,m_nPreviewShiftMcuY)
+	// onwards in raster order
+	short		anOfsNone[NUM_CHAN_YCC] = { 0,0,0 };
+	short		anOfsShift[NUM_CHAN_YCC];
+	anOfsShift[0] = (short)max(min(m_nPreviewShiftY,32767),-32768);
+	anOfsShift[1] = (short)max(min(m_nPreviewShiftCb,32767),-32768);
+	anOfsShift[2] = (short)max(min(m_nPreviewShiftCr,32767),-32768);
+	unsigned	nShiftPixX = ((m_nPreviewShiftMcuX * m_nMcuWidth) + (1<<m_nScaleShift)-1) >> m_nScaleShift;
+	nShiftPixX = min(nShiftPixX,m_nPixMapW);
+
+	unsigned	nShift = 3 + m_nPixMapPrecShift;
+
+	for (unsigned nPixY=nPixY1;nPixY<nPixY2;nPixY++) {
+
+		// In band decode the rows are relative to the top of the band
+		unsigned nMcuY = ((nPixY+m_nBandPixY)<<m_nScaleShift)/m_nMcuHeight;
+		// DIBs appear to be stored up-side down, so correct Y
+		unsigned char*	pRow = &pTmp[((m_nPixMapH-1) - nPixY) * nRowBytes];
+
+		// Pixel map column at which the preview shift starts
+		unsigned	nSplitX;
+		if (nMcuY < m_nPreviewShiftMcuY) {
+			nSplitX = m_nPixMapW;
+		} else if (nMcuY > m_nPreviewShiftMcuY) {
+			nSplitX = 0;
+		} else {
+			nSplitX = nShiftPixX;
+		}
+
+		// A split within a chroma sample pair needs the upsampled rows
+		bool		bRowHalf = (bChromaHalf) && ((nSplitX % 2 == 0) || (nSplitX == m_nPixMapW));
+		pnRowY = PlaneRowGet(CHAN_Y,nPixY,&pnRowBuf[0]);
+		if (bRowHalf) {
+			pnRowCb = &psPlaneCb->pnPix[(nPixY * psPlaneCb->nSampV / psPlaneCb->nSampVMax) * psPlaneCb->nW];
+			pnRowCr = &psPlaneCr->pnPix[(nPixY * psPlaneCr->nSampV / psPlaneCr->nSampVMax) * psPlaneCr->nW];
+		} else if (bColor) {
+			pnRowCb = PlaneRowGet(CHAN_CB,nPixY,&pnRowBuf[m_nPixMapW]);
+			pnRowCr = PlaneRowGet(CHAN_CR,nPixY,&pnRowBuf[m_nPixMapW*2]);
+		}
+		unsigned	nSplitC = (bRowHalf) ? nSplitX/2 : nSplitX;
+
+		if (nSplitX > 0) {
+			nSumY += m_pKernels->pfnYccToRgb(pnRowY,pnRowCb,pnRowCr,bRowHalf,
+				anOfsNone,nShift,anSel,nSplitX,pRow);
+		}
+		if (nSplitX < m_nPixMapW) {
+			nSumY += m_pKernels->pfnYccToRgb(&pnRowY[nSplitX],&pnRowCb[nSplitC],&pnRowCr[nSplitC],bRowHalf,
+				anOfsShift,nShift,anSel,m_nPixMapW-nSplitX,&pRow[nSplitX*4]);
+		}
+
+#ifdef SIMD_SELFCHECK
+		// The kernel must match the scalar reference
+		unsigned char*	pRef = new unsigned char[nRowBytes];
+		if (pRef) {
+			const ImgDecodeKernels*	pKernelsRef = ImgDecodeSimdGet(SIMD_LEVEL_SCALAR);
+			pKernelsRef->pfnYccToRgb(pnRowY,pnRowCb,pnRowCr,bRowHalf,anOfsNone,nShift,anSel,nSplitX,pRef);
+			pKernelsRef->pfnYccToRgb(&pnRowY[nSplitX],&pnRowCb[nSplitC],&pnRowCr[nSplitC],bRowHalf,
+				anOfsShift,nShift,anSel,m_nPixMapW-nSplitX,&pRef[nSplitX*4]);
+			for (unsigned nInd=0;nInd<nRowBytes;nInd++) {
+				if (pRef[nInd] != pRow[nInd]) {
+					ReportSimdCheck(_T("YccToRgb"),nInd/4);
+					break;
+				}
+			}
+			delete [] pRef;
+		}
+#endif
+
+		// Update brightest pixel search here
+		for (unsigned nPixX=0;nPixX<m_nPixMapW;nPixX++) {
+			if (pnRowY[nPixX] > m_nBrightY) {
+				unsigned	nPixXC = (bRowHalf) ? nPixX/2 : nPixX;
+				m_nBrightY  = pnRowY[nPixX];
+				m_nBrightCb = pnRowCb[nPixXC];
+				m_nBrightCr = pnRowCr[nPixXC];
+				m_ptBrightMcu.x = (nPixX<<m_nScaleShift)/m_nMcuWidth;
+				m_ptBrightMcu.y = nMcuY;
+			}
+		}
+	} // y
+
+	delete [] pnRowBuf;
+}
+
+// Color convert a range of rows of the CMYK / YCCK pixmap into the RGB pixel map
+// - Each row is converted by the CmykToRgb kernel (see ImgDecodeSimd)
+// - The brightest pixel search uses the luminance of the RGB value
+// - The YCC preview shift, the color statistics and the detailed IDCT
+//   dump are not supported for 4-component images
+// - In the single channel preview modes the Y, Cb and Cr channels
+//   show the first three components
+//
+// INPUT:
+// - nPixY1					= First row of the pixel map
+// - nPixY2					= Row after the last one to convert
+// - nSumY					= Luminance sum of the previous rows
+// PRE:
+// - CalcChannelPreviewStart()
+// - m_asPixPlane[]
+// - m_bColorYcck
+// - m_nBandPixY			= Pixel map row at the top of the band (band decode)
+// OUTPUT:
+// - pTmp					= RGB pixel map (32-bit per pixel, [0x00,R,G,B])
+// - nSumY					= Luminance sum including these rows
+//
+void CimgDecode::CalcChannelPreviewRowsCmyk(unsigned nPixY1,unsigned nPixY2,unsigned char* pTmp,unsigned &nSumY)
+{
+	PixelCc		sPixSrc,sPixDst;
+	unsigned	nRowBytes = m_nPixMapW * sizeof(RGBQUAD);
+	unsigned	nLum;
+	int			nVal1,nVal2,nVal3;
+
+	// Rows of the pixel planes at the pixel map resolution
+	short*		pnRowBuf = new short[m_nPixMapW * NUM_CHAN_YCCK];
+	if (!pnRowBuf) {
+		return;
+	}
+	const short*	apnRow[NUM_CHAN_YCCK];
+
+	for (unsigned nPixY=nPixY1;nPixY<nPixY2;nPixY++) {
+
+		// DIBs appear to be stored up-side down, so correct Y
+		unsigned char*	pRow = &pTmp[((m_nPixMapH-1) - nPixY) * nRowBytes];
+		for (unsigned nChan=0;nChan<NUM_CHAN_YCCK;nChan++) {
+			apnRow[nChan] = PlaneRowGet(nChan,nPixY,&pnRowBuf[nChan*m_nPixMapW]);
+		}
+
+		m_pKernels->pfnCmykToRgb(apnRow[CHAN_Y],apnRow[CHAN_CB],
+			apnRow[CHAN_CR],apnRow[CHAN_K],m_bColorYcck,3+m_nPixMapPrecShift,m_nPixMapW,pRow);
+
+		for (unsigned nPixX=0;nPixX<m_nPixMapW;nPixX++) {
+			unsigned char*	pPix = &pRow[nPixX*4];
+
+			// Luminance of the RGB value (range 0..255)
+			nLum = (19595*pPix[2] + 38470*pPix[1] + 7471*pPix[0] + 32768) >> 16;
+			nSumY += nLum;
+
+			// Update brightest pixel search here
+			if ((int)nLum > m_nBrightLum) {
+				m_nBrightLum = nLum;
+				m_nBrightY  = apnRow[CHAN_Y][nPixX];
+				m_nBrightCb = apnRow[CHAN_CB][nPixX];
+				m_nBrightCr = apnRow[CHAN_CR][nPixX];
+				m_nBrightK  = apnRow[CHAN_K][nPixX];
+				m_nBrightR = pPix[2];
+				m_nBrightG = pPix[1];
+				m_nBrightB = pPix[0];
+				m_ptBrightMcu.x = (nPixX<<m_nScaleShift)/m_nMcuWidth;
+				m_ptBrightMcu.y = ((nPixY+m_nBandPixY)<<m_nScaleShift)/m_nMcuHeight;
+			}
+
+			// Perform any channel filtering if enabled
+			if (m_nPreviewMode != PREVIEW_RGB) {
+				sPixSrc.nFinalR  = pPix[2];
+				sPixSrc.nFinalG  = pPix[1];
+				sPixSrc.nFinalB  = pPix[0];
+				nVal1 = apnRow[CHAN_Y][nPixX] >> (3+m_nPixMapPrecShift);
+				nVal2 = apnRow[CHAN_CB][nPixX] >> (3+m_nPixMapPrecShift);
+				nVal3 = apnRow[CHAN_CR][nPixX] >> (3+m_nPixMapPrecShift);
+				sPixSrc.nFinalY  = static_cast<BYTE>(((nVal1<-128)?-128:(nVal1>127)?127:nVal1) + 128);
+				sPixSrc.nFinalCb = static_cast<BYTE>(((nVal2<-128)?-128:(nVal2>127)?127:nVal2) + 128);
+				sPixSrc.nFinalCr = static_cast<BYTE>(((nVal3<-128)?-128:(nVal3>127)?127:nVal3) + 128);
+				ChannelExtract(m_nPreviewMode,sPixSrc,sPixDst);
+				pPix[2] = sPixDst.nFinalR;
+				pPix[1] = sPixDst.nFinalG;
+				pPix[0] = sPixDst.nFinalB;
+			}
+		} // x
+	} // y
+
+	delete [] pnRowBuf;
+}
+
+// Gather the color statistics for a range of rows of the YCC pixmap
+// - Same results as the per-pixel conversion (ConvertYCCtoRGB) of
+//   these rows, including the order of the YCC clipping reports
+// - The rows are split into stripes that are processed in parallel
+//   (CalcChannelStatsStripe) and then merged in order
+//
+// INPUT:
+// - nPixY1					= First row of the pixel map
+// - nPixY2					= Row after the last one
+// PRE:
+// - m_asPixPlane[]
+// - m_nBandPixY			= Pixel map row at the top of the band (band decode)
+// POST:
+// - m_sHisto
+// - m_sStatClip
+// - m_anHistoYFull[]
+// - m_anCcHisto_r[], m_anCcHisto_g[], m_anCcHisto_b[]
+//
+void CimgDecode::CalcChannelStats(unsigned nPixY1,unsigned nPixY2)
+{
+	unsigned	nRows = nPixY2 - nPixY1;
+	unsigned	nThreads = m_pAppConfig->nDecodeScanThreads;
+	if (nThreads == 0) {
+		nThreads = std::thread::hardware_concurrency();
+	}
+	nThreads = min(nThreads,(unsigned)SCAN_PAR_THREADS_MAX);
+	nThreads = min(nThreads,nRows / STAT_STRIPE_ROWS_MIN);
+	nThreads = max(nThreads,1u);
+
+	StatStripe*	asStripe = new StatStripe[nThreads];
+	if (!asStripe) {
+		return;
+	}
 
-	if (m_bDetailVlc) {
-		m_pLog->AddLine(_T("  Detailed IDCT Dump (RGB):"));
-		strTmp.Format(_T("    MCU [%3u,%3u]:"),m_nDetailVlcX,m_nDetailVlcY);
-		m_pLog->AddLine(strTmp);
+	// The last stripe is processed by this thread
+	std::thread	aThread[SCAN_PAR_THREADS_MAX];
+	unsigned	anStripeY[SCAN_PAR_THREADS_MAX+1];
+	for (unsigned nStripe=0;nStripe<=nThreads;nStripe++) {
+		anStripeY[nStripe] = nPixY1 + (unsigned)((ULONGLONG)nRows * nStripe / nThreads);
+	}
+	for (unsigned nStripe=0;nStripe+1<nThreads;nStripe++) {
+		aThread[nStripe] = std::thread(&CimgDecode::CalcChannelStatsStripe,this,
+			anStripeY[nStripe],anStripeY[nStripe+1],&asStripe[nStripe]);
+	}
+	CalcChannelStatsStripe(anStripeY[nThreads-1],anStripeY[nThreads],&asStripe[nThreads-1]);
+	for (unsigned nStripe=0;nStripe+1<nThreads;nStripe++) {
+		aThread[nStripe].join();
+	}
+
+#ifdef SIMD_SELFCHECK
+	// The kernel must match the scalar reference
+	StatStripe*	psRef = new StatStripe;
+	if (psRef) {
+		const ImgDecodeKernels*	pKernels = m_pKernels;
+		m_pKernels = ImgDecodeSimdGet(SIMD_LEVEL_SCALAR);
+		for (unsigned nStripe=0;nStripe<nThreads;nStripe++) {
+			CalcChannelStatsStripe(anStripeY[nStripe],anStripeY[nStripe+1],psRef);
+			if (memcmp(&psRef->sStats,&asStripe[nStripe].sStats,sizeof(YccStats)) != 0) {
+				m_pKernels = pKernels;
+				ReportSimdCheck(_T("YccStats"),anStripeY[nStripe]);
+				m_pKernels = ImgDecodeSimdGet(SIMD_LEVEL_SCALAR);
+			}
+		}
+		m_pKernels = pKernels;
+		delete psRef;
 	}
+#endif
 
-	// Determine pixel count
-	nNumPixels = (nRngY2-nRngY1+1) * (nRngX2-nRngX1+1);
+	for (unsigned nStripe=0;nStripe<nThreads;nStripe++) {
+		CalcChannelStatsMerge(&asStripe[nStripe]);
+	}
+	delete [] asStripe;
+}
 
-	// Step through the image
-	for (unsigned nPixY=nRngY1;nPixY<nRngY2;nPixY++) {
+// Gather the color statistics of a stripe of rows (worker thread)
+// - The statistics of each row are accumulated by the YccStats kernel
+// - A row with YCC clipping is checked pixel by pixel to record the
+//   pixels that CapYccRange would report
+//
+// INPUT:
+// - nPixY1					= First row of the pixel map
+// - nPixY2					= Row after the last one
+// PRE:
+// - m_asPixPlane[]
+// OUTPUT:
+// - psStripe				= Statistics of the stripe
+//
+void CimgDecode::CalcChannelStatsStripe(unsigned nPixY1,unsigned nPixY2,StatStripe* psStripe)
+{
+	YccStats*	psStats = &psStripe->sStats;
+	bool		bColor = (m_nNumSosComps == NUM_CHAN_YCC);
 
-		unsigned nMcuY = nPixY/m_nMcuHeight;
-		// DIBs appear to be stored up-side down, so correct Y
-		unsigned nCoordYInv = (m_nImgSizeY-1) - nPixY;
+	memset(psStripe,0,sizeof(StatStripe));
+	for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+		psStats->anMin[nStat] = INT_MAX;
+		psStats->anMax[nStat] = INT_MIN;
+	}
 
-		for (unsigned nPixX=nRngX1;nPixX<nRngX2;nPixX++) {
+	// Rows of the pixel planes at the pixel map resolution
+	// - Grayscale images use a row of zeros for Cb and Cr
+	short*		pnRowBuf = new short[m_nPixMapW * NUM_CHAN_YCC];
+	if (!pnRowBuf) {
+		return;
+	}
+	memset(pnRowBuf,0,m_nPixMapW * NUM_CHAN_YCC * sizeof(short));
+	const short*	pnRowY;
+	const short*	pnRowCb = &pnRowBuf[m_nPixMapW];
+	const short*	pnRowCr = &pnRowBuf[m_nPixMapW*2];
+
+	// Preview YCC shift, which applies to MCUs with an index (as
+	// computed by CalcChannelPreviewRows) from nMcuShiftInd onwards
+	int			anOfsNone[NUM_CHAN_YCC] = { 0,0,0 };
+	int			anOfsShift[NUM_CHAN_YCC] = { m_nPreviewShiftY,m_nPreviewShiftCb,m_nPreviewShiftCr };
+	unsigned	nMcuRowLen = m_nImgSizeX/m_nMcuWidth;
+	unsigned	nMcuShiftInd = m_nPreviewShiftMcuY * nMcuRowLen + m_nPreviewShiftMcuX;
+	unsigned	nMcuXEnd = (((m_nPixMapW-1)<<m_nScaleShift)/m_nMcuWidth) + 1;
+
+	unsigned	nRangeOfs = 1024<<m_nPixMapPrecShift;
+	int			nRangeDiv = 8<<m_nPixMapPrecShift;
+
+	for (unsigned nPixY=nPixY1;nPixY<nPixY2;nPixY++) {
+
+		// In band decode the rows are relative to the top of the band
+		unsigned nMcuY = ((nPixY+m_nBandPixY)<<m_nScaleShift)/m_nMcuHeight;
+
+		// Pixel map column at which the preview shift starts
+		unsigned	nSplitX = 0;
+		if (nMcuShiftInd > nMcuY * nMcuRowLen) {
+			unsigned	nSplitMcuX = nMcuShiftInd - nMcuY * nMcuRowLen;
+			if (nSplitMcuX >= nMcuXEnd) {
+				nSplitX = m_nPixMapW;
+			} else {
+				nSplitX = ((nSplitMcuX * m_nMcuWidth) + (1<<m_nScaleShift)-1) >> m_nScaleShift;
+				nSplitX = min(nSplitX,m_nPixMapW);
+			}
+		}
 
-			nPixmapInd = nPixY*nPixMapW + nPixX;
-			unsigned	nPixByte = nPixX*4+0+nCoordYInv*nRowBytes;
+		pnRowY = PlaneRowGet(CHAN_Y,nPixY,&pnRowBuf[0]);
+		if (bColor) {
+			pnRowCb = PlaneRowGet(CHAN_CB,nPixY,&pnRowBuf[m_nPixMapW]);
+			pnRowCr = PlaneRowGet(CHAN_CR,nPixY,&pnRowBuf[m_nPixMapW*2]);
+		}
 
-			unsigned	nMcuX = nPixX/m_nMcuWidth;
-			unsigned	nMcuInd = nMcuY * (m_nImgSizeX/m_nMcuWidth) + nMcuX;
-			int			nTmpY,nTmpCb,nTmpCr;
-			nTmpY = m_pPixValY[nPixmapInd];
+		unsigned	nClipYcc = 0;
+		for (unsigned nChan=CHAN_Y;nChan<NUM_CHAN_YCC;nChan++) {
+			nClipYcc += psStats->anUnder[YCC_STAT_Y+nChan] + psStats->anOver[YCC_STAT_Y+nChan];
+		}
 
-			if (m_nNumSosComps == NUM_CHAN_YCC) {
-				nTmpCb = m_pPixValCb[nPixmapInd];
-				nTmpCr = m_pPixValCr[nPixmapInd];
-			} else {
-				nTmpCb = 0;
-				nTmpCr = 0;
-			}
+		if (nSplitX > 0) {
+			m_pKernels->pfnYccStats(pnRowY,pnRowCb,pnRowCr,anOfsNone,m_nPixMapPrecShift,nSplitX,psStats);
+		}
+		if (nSplitX < m_nPixMapW) {
+			m_pKernels->pfnYccStats(&pnRowY[nSplitX],&pnRowCb[nSplitX],&pnRowCr[nSplitX],
+				anOfsShift,m_nPixMapPrecShift,m_nPixMapW-nSplitX,psStats);
+		}
 
-			// Load the YCC value
-			sPixSrc.nPrerangeY  = nTmpY;
-			sPixSrc.nPrerangeCb = nTmpCb;
-			sPixSrc.nPrerangeCr = nTmpCr;
+		for (unsigned nChan=CHAN_Y;nChan<NUM_CHAN_YCC;nChan++) {
+			nClipYcc -= psStats->anUnder[YCC_STAT_Y+nChan] + psStats->anOver[YCC_STAT_Y+nChan];
+		}
+		if ((nClipYcc == 0) || (psStripe->nClipYccNum >= YCC_CLIP_REPORT_MAX)) {
+			continue;
+		}
 
-			// Update brightest pixel search here
-			int nBrightness = nTmpY;
-			if (nBrightness > m_nBrightY) {
-				m_nBrightY  = nTmpY;
-				m_nBrightCb = nTmpCb;
-				m_nBrightCr = nTmpCr;
-				m_ptBrightMcu.x = nMcuX;
-				m_ptBrightMcu.y = nMcuY;
+		// Record the pixels with YCC clipping
+		for (unsigned nPixX=0;nPixX<m_nPixMapW;nPixX++) {
+			const int*	pnOfs = (nPixX < nSplitX) ? anOfsNone : anOfsShift;
+			int			nPreclipY  = ((int)pnRowY[nPixX] + pnOfs[0] + (int)nRangeOfs) / nRangeDiv;
+			int			nPreclipCb = ((int)pnRowCb[nPixX] + pnOfs[1] + (int)nRangeOfs) / nRangeDiv;
+			int			nPreclipCr = ((int)pnRowCr[nPixX] + pnOfs[2] + (int)nRangeOfs) / nRangeDiv;
+			if ((nPreclipY  < CC_CLIP_YCC_MIN) || (nPreclipY  > CC_CLIP_YCC_MAX) ||
+				(nPreclipCb < CC_CLIP_YCC_MIN) || (nPreclipCb > CC_CLIP_YCC_MAX) ||
+				(nPreclipCr < CC_CLIP_YCC_MIN) || (nPreclipCr > CC_CLIP_YCC_MAX)) {
+				PixelCcClipYcc*	psClip = &psStripe->asClipYcc[psStripe->nClipYccNum];
+				psClip->nMcuX = (nPixX<<m_nScaleShift)/m_nMcuWidth;
+				psClip->nMcuY = nMcuY;
+				psClip->nPreclipY  = nPreclipY;
+				psClip->nPreclipCb = nPreclipCb;
+				psClip->nPreclipCr = nPreclipCr;
+				psStripe->nClipYccNum++;
+				if (psStripe->nClipYccNum >= YCC_CLIP_REPORT_MAX) {
+					break;
+				}
 			}
+		}
+	} // y
 
-			// FIXME
-			// Could speed this up by adding boolean check to see if we are
-			// truly needing to do any shifting!
-			if (nMcuInd >= nMcuShiftInd) {
-				sPixSrc.nPrerangeY  += m_nPreviewShiftY;
-				sPixSrc.nPrerangeCb += m_nPreviewShiftCb;
-				sPixSrc.nPrerangeCr += m_nPreviewShiftCr;
-			}
+	delete [] pnRowBuf;
+}
 
-			// Invoke the appropriate color conversion routine
-			if (m_bHistEn || m_bStatClipEn) {
-				ConvertYCCtoRGB(nMcuX,nMcuY,sPixSrc);
-			} else {
-				ConvertYCCtoRGBFastFloat(sPixSrc);
-				//ConvertYCCtoRGBFastFixed(sPixSrc);
-			}
+// Add the color statistics of a stripe to the image statistics
+// - The stripes must be merged in order for the YCC clipping reports
+//
+// INPUT:
+// - psStripe				= Statistics of the stripe (CalcChannelStatsStripe)
+// POST:
+// - m_sHisto
+// - m_sStatClip
+// - m_anHistoYFull[]
+// - m_anCcHisto_r[], m_anCcHisto_g[], m_anCcHisto_b[]
+//
+void CimgDecode::CalcChannelStatsMerge(const StatStripe* psStripe)
+{
+	const YccStats*	psStats = &psStripe->sStats;
+
+	// The sums wrap around as in ConvertYCCtoRGB
+	int*		apnHisto[YCC_STAT_NUM][3] = {
+		{ &m_sHisto.nPreclipYMin,  &m_sHisto.nPreclipYMax,  &m_sHisto.nPreclipYSum },
+		{ &m_sHisto.nPreclipCbMin, &m_sHisto.nPreclipCbMax, &m_sHisto.nPreclipCbSum },
+		{ &m_sHisto.nPreclipCrMin, &m_sHisto.nPreclipCrMax, &m_sHisto.nPreclipCrSum },
+		{ &m_sHisto.nClipYMin,     &m_sHisto.nClipYMax,     &m_sHisto.nClipYSum },
+		{ &m_sHisto.nClipCbMin,    &m_sHisto.nClipCbMax,    &m_sHisto.nClipCbSum },
+		{ &m_sHisto.nClipCrMin,    &m_sHisto.nClipCrMax,    &m_sHisto.nClipCrSum },
+		{ &m_sHisto.nPreclipRMin,  &m_sHisto.nPreclipRMax,  &m_sHisto.nPreclipRSum },
+		{ &m_sHisto.nPreclipGMin,  &m_sHisto.nPreclipGMax,  &m_sHisto.nPreclipGSum },
+		{ &m_sHisto.nPreclipBMin,  &m_sHisto.nPreclipBMax,  &m_sHisto.nPreclipBSum },
+		{ &m_sHisto.nClipRMin,     &m_sHisto.nClipRMax,     &m_sHisto.nClipRSum },
+		{ &m_sHisto.nClipGMin,     &m_sHisto.nClipGMax,     &m_sHisto.nClipGSum },
+		{ &m_sHisto.nClipBMin,     &m_sHisto.nClipBMax,     &m_sHisto.nClipBSum },
+	};
 
-			// Accumulate the luminance value for this pixel
-			// after we have converted it to the range 0..255
-			nSumY += sPixSrc.nFinalY;
+	if (m_bHistEn) {
+		for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+			*apnHisto[nStat][0] = min(*apnHisto[nStat][0],psStats->anMin[nStat]);
+			*apnHisto[nStat][1] = max(*apnHisto[nStat][1],psStats->anMax[nStat]);
+			*apnHisto[nStat][2] = (int)((unsigned)*apnHisto[nStat][2] + psStats->anSum[nStat]);
+		}
+		m_sHisto.nCount += psStats->nCount;
 
+		for (unsigned nBin=0;nBin<FULL_HISTO_BINS;nBin++) {
+			m_anHistoYFull[nBin] += psStats->anHistoY[nBin];
+		}
+		for (unsigned nBin=0;nBin<HISTO_BINS;nBin++) {
+			m_anCcHisto_r[nBin] += psStats->anHistoR[nBin];
+			m_anCcHisto_g[nBin] += psStats->anHistoG[nBin];
+			m_anCcHisto_b[nBin] += psStats->anHistoB[nBin];
+		}
+	}
 
-			// If we want a detailed decode of RGB, print it out
-			// now if we are on the correct MCU.
-			// NOTE: The level shift (adjust) will affect this report!
-			if (m_bDetailVlc) {
-				if (nMcuY == m_nDetailVlcY) {
+	// The YCC clipping is only counted while it is reported
+	for (unsigned nClip=0;nClip<psStripe->nClipYccNum;nClip++) {
+		if (m_nWarnYccClipNum >= YCC_CLIP_REPORT_MAX) {
+			break;
+		}
+		ReportYccClip(&psStripe->asClipYcc[nClip]);
+	}
 
-					if (nMcuX == m_nDetailVlcX) {
-					//if ((nMcuX >= m_nDetailVlcX) && (nMcuX < m_nDetailVlcX+m_nDetailVlcLen)) {
-						if (!bRowStart) {
-							bRowStart = true;
-							strLine.Format(_T("      [ "));
-						}
-						strTmp.Format(_T("x%02X%02X%02X "),sPixSrc.nFinalR,sPixSrc.nFinalG,sPixSrc.nFinalB);
-						strLine.Append(strTmp);
-					} else {
-						if (bRowStart) {
-							// We had started a row, but we are now out of range, so we
-							// need to close up!
-							strTmp.Format(_T(" ]"));
-							strLine.Append(strTmp);
-							m_pLog->AddLine(strLine);
-							bRowStart = false;
-						}
-					}
-				}
+	m_sStatClip.nClipRUnder += psStats->anUnder[YCC_STAT_R];
+	m_sStatClip.nClipROver  += psStats->anOver[YCC_STAT_R];
+	m_sStatClip.nClipGUnder += psStats->anUnder[YCC_STAT_G];
+	m_sStatClip.nClipGOver  += psStats->anOver[YCC_STAT_G];
+	m_sStatClip.nClipBUnder += psStats->anUnder[YCC_STAT_B];
+	m_sStatClip.nClipBOver  += psStats->anOver[YCC_STAT_B];
+}
 
+// Report the YCC clipping of a pixel
+// - Same reports and clip counts as CapYccRange
+//
+// INPUT:
+// - psClip					= Pixel with YCC clipping
+// POST:
+// - m_sStatClip
+// - m_nWarnYccClipNum
+//
+void CimgDecode::ReportYccClip(const PixelCcClipYcc* psClip)
+{
+	CString		strTmp;
+	int			anCur[NUM_CHAN_YCC] = { psClip->nPreclipY,psClip->nPreclipCb,psClip->nPreclipCr };
+	LPCTSTR		astrChan[NUM_CHAN_YCC] = { _T("Y"),_T("Cb"),_T("Cr") };
+	unsigned*	apnOver[NUM_CHAN_YCC] = { &m_sStatClip.nClipYOver,&m_sStatClip.nClipCbOver,&m_sStatClip.nClipCrOver };
+	unsigned*	apnUnder[NUM_CHAN_YCC] = { &m_sStatClip.nClipYUnder,&m_sStatClip.nClipCbUnder,&m_sStatClip.nClipCrUnder };
+
+	for (unsigned nChan=CHAN_Y;nChan<NUM_CHAN_YCC;nChan++) {
+		for (unsigned nDir=0;nDir<2;nDir++) {
+			bool	bOver = (nDir == 0);
+			if ((bOver) ? (anCur[nChan] <= CC_CLIP_YCC_MAX) : (anCur[nChan] >= CC_CLIP_YCC_MIN)) {
+				continue;
 			}
+			if (YCC_CLIP_REPORT_ERR && (m_nWarnYccClipNum < YCC_CLIP_REPORT_MAX)) {
+				strTmp.Format(_T("*** NOTE: YCC Clipped. MCU=(%4u,%4u) YCC=(%5d,%5d,%5d) %s %s @ Offset %s"),
+					psClip->nMcuX,psClip->nMcuY,anCur[0],anCur[1],anCur[2],astrChan[nChan],
+					(bOver) ? _T("Overflow") : _T("Underflow"),(LPCTSTR)GetPreviewScanPos());
+				m_pLog->AddLineWarn(strTmp);
+				m_nWarnYccClipNum++;
+				if (bOver) {
+					(*apnOver[nChan])++;
+				} else {
+					(*apnUnder[nChan])++;
+				}
+				if (m_nWarnYccClipNum == YCC_CLIP_REPORT_MAX) {
+					strTmp.Format(_T("    Only reported first %u instances of this message..."),YCC_CLIP_REPORT_MAX);
+					m_pLog->AddLineWarn(strTmp);
+				}
+			}
+			anCur[nChan] = (bOver) ? CC_CLIP_YCC_MAX : CC_CLIP_YCC_MIN;
+		}
+	}
+}
 
-			// Perform any channel filtering if enabled
-			ChannelExtract(m_nPreviewMode,sPixSrc,sPixDst);
-
-			// Assign the RGB pixel map
-			pTmp[nPixByte+3] = 0;
-			pTmp[nPixByte+2] = sPixDst.nFinalR;
-			pTmp[nPixByte+1] = sPixDst.nFinalG;
-			pTmp[nPixByte+0] = sPixDst.nFinalB;
+// Complete the color conversion (CalcChannelPreviewRows)
+// - Compute the RGB value of the brightest pixel and the average luminance
+//
+// INPUT:
+// - nSumY					= Luminance sum of all rows
+// POST:
+// - m_nBrightR, m_nBrightG, m_nBrightB
+// - m_bBrightValid
+// - m_nAvgY
+// - m_bAvgYValid
+//
+void CimgDecode::CalcChannelPreviewEnd(unsigned nSumY)
+{
+	PixelCc			sPixSrc;
+	unsigned long	nNumPixels = 0;
 
-		} // x
-	} // y
+	// Determine pixel count
+	nNumPixels = (m_nPixMapH+1) * (m_nPixMapW+1);
 
 	SetStatusText(_T(""));
 	// ---------------------------------------------------------
@@ -4801,14 +10719,17 @@ void CimgDecode::CalcChannelPreviewFull(CRect* pRectView,unsigned char* pTmp)
 
 	// Assume that brightest pixel search was successful
 	// Now compute the RGB value for this pixel!
+	// - 4-component images record the RGB value during the search
 	m_bBrightValid = true;
-	sPixSrc.nPrerangeY = m_nBrightY;
-	sPixSrc.nPrerangeCb = m_nBrightCb;
-	sPixSrc.nPrerangeCr = m_nBrightCr;
-	ConvertYCCtoRGBFastFloat(sPixSrc);
-	m_nBrightR = sPixSrc.nFinalR;
-	m_nBrightG = sPixSrc.nFinalG;
-	m_nBrightB = sPixSrc.nFinalB;
+	if (m_nNumSosComps != NUM_CHAN_YCCK) {
+		sPixSrc.nPrerangeY = m_nBrightY;
+		sPixSrc.nPrerangeCb = m_nBrightCb;
+		sPixSrc.nPrerangeCr = m_nBrightCr;
+		ConvertYCCtoRGBFastFloat(sPixSrc);
+		m_nBrightR = sPixSrc.nFinalR;
+		m_nBrightG = sPixSrc.nFinalG;
+		m_nBrightB = sPixSrc.nFinalB;
+	}
 
 	// Now perform average luminance calculation
 	// NOTE: This will result in a value in the range 0..255
@@ -4903,21 +10824,40 @@ void CimgDecode::SetDetailVlc(bool bDetail,unsigned nX,unsigned nY,unsigned nLen
 	m_nDetailVlcLen = nLen;
 }
 
-// Fetch the pointers for the pixel map
+// Fetch one row of the pixel map as YCC
+// - The pixel planes are upsampled to the pixel map width
+// - Grayscale images have Cb and Cr set to zero
 //
+// INPUT:
+// - nPixY				= Row of the pixel map
 // OUTPUT:
-// - pMayY				= Pointer to pixel map for Y component
-// - pMapCb				= Pointer to pixel map for Cb component
-// - pMapCr				= Pointer to pixel map for Cr component
+// - pnYcc				= m_nPixMapW YCC triplets in pixel map units
+// RETURN:
+// - False if there is no pixel map or the row is out of range
 //
-void CimgDecode::GetPixMapPtrs(short* &pMapY,short* &pMapCb,short* &pMapCr)
+bool CimgDecode::GetPixMapRowYcc(unsigned nPixY,short* pnYcc)
 {
-	ASSERT(m_pPixValY);
-	ASSERT(m_pPixValCb);
-	ASSERT(m_pPixValCr);
-	pMapY = m_pPixValY;
-	pMapCb = m_pPixValCb;
-	pMapCr = m_pPixValCr;
+	if ((!PlaneValid(CHAN_Y)) || (nPixY >= m_nPixMapH)) {
+		return false;
+	}
+	bool		bColor = (m_nNumSosComps >= NUM_CHAN_YCC);
+
+	short*		pnRowBuf = new short[m_nPixMapW * NUM_CHAN_YCC];
+	if (!pnRowBuf) {
+		return false;
+	}
+	const short*	pnRowY = PlaneRowGet(CHAN_Y,nPixY,&pnRowBuf[0]);
+	const short*	pnRowCb = (bColor) ? PlaneRowGet(CHAN_CB,nPixY,&pnRowBuf[m_nPixMapW]) : NULL;
+	const short*	pnRowCr = (bColor) ? PlaneRowGet(CHAN_CR,nPixY,&pnRowBuf[m_nPixMapW*2]) : NULL;
+
+	for (unsigned nPixX=0;nPixX<m_nPixMapW;nPixX++) {
+		pnYcc[nPixX*3+0] = pnRowY[nPixX];
+		pnYcc[nPixX*3+1] = (bColor) ? pnRowCb[nPixX] : 0;
+		pnYcc[nPixX*3+2] = (bColor) ? pnRowCr[nPixX] : 0;
+	}
+
+	delete [] pnRowBuf;
+	return true;
 }
 
 // Get image pixel dimensions rounded up to nearest MCU
@@ -4932,6 +10872,98 @@ void CimgDecode::GetImageSize(unsigned &nX,unsigned &nY)
 	nY = m_nImgSizeY;
 }
 
+// Get pixel map (and bitmap) dimensions
+// - Same as GetImageSize() unless a scaled decode was performed
+//
+// OUTPUT:
+// - nX					= X dimension of pixel map
+// - nY					= Y dimension of pixel map
+//
+void CimgDecode::GetPixMapSize(unsigned &nX,unsigned &nY)
+{
+	nX = m_nPixMapW;
+	nY = m_nPixMapH;
+}
+
+// Get the sample precision held by the pixel maps
+// - Pixel map values are (sample - 2^(precision-1)) * 8
+// - 12-bit DCT images keep their full precision, all other
+//   images (including the lossless preview) are at 8-bit
+//
+// RETURN:
+// - Precision in bits (8 or 12)
+//
+unsigned CimgDecode::GetPixMapPrecision()
+{
+	return 8 + m_nPixMapPrecShift;
+}
+
+// Convert one row of the pixel maps to RGB at the pixel map precision
+// - Used to export 12-bit images without the 8-bit preview reduction
+// - Same conversion as ConvertYCCtoRGBFastFloat() but without the
+//   preview level shift and channel selection
+//
+// INPUT:
+// - nPixY				= Row of the pixel map
+// OUTPUT:
+// - pnRgb				= m_nPixMapW RGB triplets, scaled to 16-bit
+// RETURN:
+// - False if the pixel maps are not YCC or grayscale
+//
+bool CimgDecode::GetPixMapRowRgb16(unsigned nPixY,unsigned short* pnRgb)
+{
+	if ((!PlaneValid(CHAN_Y)) || (nPixY >= m_nPixMapH)) {
+		return false;
+	}
+	if ((m_nNumSosComps != NUM_CHAN_GRAYSCALE) && (m_nNumSosComps != NUM_CHAN_YCC)) {
+		return false;
+	}
+
+	short*		pnRowBuf = new short[m_nPixMapW * NUM_CHAN_YCC];
+	if (!pnRowBuf) {
+		return false;
+	}
+	const short*	pnRowY = PlaneRowGet(CHAN_Y,nPixY,&pnRowBuf[0]);
+	const short*	pnRowCb = NULL;
+	const short*	pnRowCr = NULL;
+	if (m_nNumSosComps == NUM_CHAN_YCC) {
+		pnRowCb = PlaneRowGet(CHAN_CB,nPixY,&pnRowBuf[m_nPixMapW]);
+		pnRowCr = PlaneRowGet(CHAN_CR,nPixY,&pnRowBuf[m_nPixMapW*2]);
+	}
+
+	unsigned	nPrecision = 8 + m_nPixMapPrecShift;
+	float		fValMax = (float)((1 << nPrecision) - 1);
+	float		fDiv = (float)8;
+	float		fOffset = (float)(1 << (nPrecision-1));
+	float		fValY,fValCb,fValCr;
+	float		afRgb[3];
+
+	for (unsigned nPixX=0;nPixX<m_nPixMapW;nPixX++) {
+		fValY = pnRowY[nPixX] / fDiv;
+		if (m_nNumSosComps == NUM_CHAN_YCC) {
+			fValCb = pnRowCb[nPixX] / fDiv;
+			fValCr = pnRowCr[nPixX] / fDiv;
+		} else {
+			fValCb = 0;
+			fValCr = 0;
+		}
+		// r = cr * 1.402 + y;
+		// b = cb * 1.772 + y;
+		// g = (y - 0.114 * b - 0.299 * r) / 0.587;
+		afRgb[0] = fValCr*1.402f + fValY;
+		afRgb[2] = fValCb*1.772f + fValY;
+		afRgb[1] = (fValY - 0.114f*afRgb[2] - 0.299f*afRgb[0]) / 0.587f;
+		for (unsigned nChan=0;nChan<3;nChan++) {
+			afRgb[nChan] += fOffset;
+			afRgb[nChan] = (afRgb[nChan]<0)?0:(afRgb[nChan]>fValMax)?fValMax:afRgb[nChan];
+			pnRgb[nPixX*3+nChan] = (unsigned short)((unsigned)(afRgb[nChan] + 0.5f) << (16-nPrecision));
+		}
+	}
+
+	delete [] pnRowBuf;
+	return true;
+}
+
 // Get the bitmap pointer
 //
 // OUTPUT:
@@ -4954,9 +10986,7 @@ void CimgDecode::GetBitmapPtr(unsigned char* &pBitmap)
 // Calculate RGB pixel map from selected channels of YCC pixel map
 //
 // PRE:
-// - m_pPixValY
-// - m_pPixValCb
-// - m_pPixValCr
+// - m_asPixPlane[]
 // POST:
 // - m_pDibTemp
 // NOTE:
@@ -4989,6 +11019,42 @@ void CimgDecode::CalcChannelPreview()
 }
 
 
+// Color convert a range of MCU rows of the YCC pixmap into the preview
+// - Used when only part of the preview changes (see SetPreviewYccOffset).
+//   The brightest pixel does not depend on the level shift, while the
+//   average luminance and the color statistics are left as they were
+//   for the decode.
+//
+// INPUT:
+// - nMcuY1					= First MCU row
+// - nMcuY2					= MCU row after the last one
+// PRE:
+// - m_asPixPlane[]
+// POST:
+// - m_pDibTemp
+//
+void CimgDecode::CalcChannelPreviewMcuRows(unsigned nMcuY1,unsigned nMcuY2)
+{
+	unsigned char*	pDibImgTmpBits = (unsigned char*)(m_pDibTemp.GetDIBBitArray());
+	unsigned		nSumY = 0;
+
+	if (!pDibImgTmpBits) {
+		return;
+	}
+
+	// First pixel map row of each MCU row, as the MCU row of a pixel is
+	// (nPixY<<m_nScaleShift)/m_nMcuHeight
+	unsigned	nPixY1 = ((nMcuY1*m_nMcuHeight) + (1<<m_nScaleShift)-1) >> m_nScaleShift;
+	unsigned	nPixY2 = ((nMcuY2*m_nMcuHeight) + (1<<m_nScaleShift)-1) >> m_nScaleShift;
+	if (nMcuY2 >= m_nMcuYMax) {
+		nPixY2 = m_nPixMapH;
+	}
+	nPixY1 = min(nPixY1,m_nPixMapH);
+	nPixY2 = min(nPixY2,m_nPixMapH);
+	CalcChannelPreviewRowsYcc(nPixY1,nPixY2,pDibImgTmpBits,nSumY);
+}
+
+
 // Determine the file position from a pixel coordinate
 //
 // INPUT:
@@ -5001,11 +11067,9 @@ void CimgDecode::CalcChannelPreview()
 void CimgDecode::LookupFilePosPix(unsigned nPixX,unsigned nPixY, unsigned &nByte, unsigned &nBit)
 {
 	unsigned nMcuX,nMcuY;
-	unsigned nPacked;
 	nMcuX = nPixX / m_nMcuWidth;
 	nMcuY = nPixY / m_nMcuHeight;
-	nPacked = m_pMcuFileMap[nMcuX + nMcuY*m_nMcuXMax];
-	UnpackFileOffset(nPacked,nByte,nBit);
+	LookupFilePosMcu(nMcuX,nMcuY,nByte,nBit);
 }
 
 // Determine the file position from a MCU coordinate
@@ -5019,9 +11083,86 @@ void CimgDecode::LookupFilePosPix(unsigned nPixX,unsigned nPixY, unsigned &nByte
 //
 void CimgDecode::LookupFilePosMcu(unsigned nMcuX,unsigned nMcuY, unsigned &nByte, unsigned &nBit)
 {
-	unsigned nPacked;
-	nPacked = m_pMcuFileMap[nMcuX + nMcuY*m_nMcuXMax];
-	UnpackFileOffset(nPacked,nByte,nBit);
+	ULONGLONG nBitPos = 0;
+	if (m_pMcuFileMap) {
+		nBitPos = m_pMcuFileMap->Get(nMcuX + nMcuY*m_nMcuXMax);
+	}
+	nByte = (unsigned)(nBitPos / 8);
+	nBit = (unsigned)(nBitPos % 8);
+}
+
+// Determine the MCU and block from a file position
+// - Reverse of LookupFilePosMcu(). The MCU is located with the MCU
+//   file map. The block within the MCU is then located by entropy
+//   decoding the MCU (from the nearest checkpoint) in a separate
+//   decoder, so this requires the checkpoints of a sequential scan
+//   decode. Otherwise the first block of the MCU is reported.
+// - A position in the padding or RSTn marker before an MCU belongs to
+//   the first block of that MCU
+//
+// INPUT:
+// - nByte					= File offset (byte)
+// - nBit					= File offset (bit)
+// OUTPUT:
+// - ptMcu					= MCU coordinate
+// - nComp					= Scan component of the block (SCAN_COMP_*)
+// - ptBlk					= Block within the MCU of that component
+//                            (horizontal / vertical sampling index)
+// RETURN:
+// - False if the position is not within the mapped scan data
+//
+bool CimgDecode::LookupMcuFilePos(unsigned nByte,unsigned nBit,CPoint &ptMcu,unsigned &nComp,CPoint &ptBlk)
+{
+	ULONGLONG	nBitPos = (ULONGLONG)nByte*8 + nBit;
+	unsigned	nMcuXY;
+	if ((!m_pMcuFileMap) || (m_nMcuXMax == 0) || (!m_pMcuFileMap->Find(nBitPos,nMcuXY))) {
+		return false;
+	}
+	ptMcu = CPoint(nMcuXY % m_nMcuXMax,nMcuXY / m_nMcuXMax);
+	nComp = SCAN_COMP_Y;
+	ptBlk = CPoint(0,0);
+
+	int			nCkpt = ScanCkptFind(nMcuXY);
+	if ((nCkpt < 0) || (m_nNumSosComps == 0) || (m_nNumSosComps > NUM_CHAN_YCCK)) {
+		return true;
+	}
+
+	// Entropy decode (no IDCT) up to the MCU
+	CDocLog		oLogLookup;
+	CimgDecode*	pLookup = new CimgDecode(&oLogLookup,m_pWBuf,this);
+	if (!pLookup) {
+		return true;
+	}
+	pLookup->m_bDetailVlc = false;
+	pLookup->m_bScanErrorsDisable = true;
+	pLookup->m_psScanCkpt = NULL;
+	pLookup->m_nScanCkptNum = 0;
+	pLookup->m_bDecodeScanAc = false;
+	pLookup->ScanCkptRestore(&m_psScanCkpt[nCkpt]);
+	bool		bOk = pLookup->DecodeScanMcuRange(nCkpt*m_nScanCkptMcus,nMcuXY,false);
+	if ((pLookup->m_bRestartEn) && (pLookup->m_nRestartMcusLeft == 0)) {
+		pLookup->BuffTopup();
+	}
+
+	// Decode the blocks of the MCU in order until one ends beyond the position
+	// - The block DC map is not touched, so the DC accumulators are not kept
+	bool		bFound = false;
+	unsigned	nBufInd,nBufAlign;
+	for (unsigned nScanComp=SCAN_COMP_Y;(bOk)&&(!bFound)&&(nScanComp<=m_nNumSosComps);nScanComp++) {
+		for (unsigned nCssIndV=0;(bOk)&&(!bFound)&&(nCssIndV<m_anSampPerMcuV[nScanComp]);nCssIndV++) {
+			for (unsigned nCssIndH=0;(bOk)&&(!bFound)&&(nCssIndH<m_anSampPerMcuH[nScanComp]);nCssIndH++) {
+				nComp = nScanComp;
+				ptBlk = CPoint(nCssIndH,nCssIndV);
+				bOk = pLookup->DecodeScanComp(m_anScanDhtTblDc[nScanComp],m_anScanDhtTblAc[nScanComp],m_anScanDqtTbl[nScanComp],ptMcu.x,ptMcu.y);
+				pLookup->GetScanBufInd(nBufInd,nBufAlign);
+				bFound = (nBitPos < (ULONGLONG)pLookup->GetScanBufFilePos(nBufInd)*8 + nBufAlign);
+			}
+		}
+	}
+
+	pLookup->ScanWorkerDetach();
+	delete pLookup;
+	return true;
 }
 
 // Determine the YCC DC value of a specified block
@@ -5037,7 +11178,7 @@ void CimgDecode::LookupFilePosMcu(unsigned nMcuX,unsigned nMcuY, unsigned &nByte
 void CimgDecode::LookupBlkYCC(unsigned nBlkX,unsigned nBlkY,int &nY,int &nCb,int &nCr)
 {
 	nY  = m_pBlkDcValY [nBlkX + nBlkY*m_nBlkXMax];
-	if (m_nNumSosComps == NUM_CHAN_YCC) {
+	if (m_nNumSosComps != NUM_CHAN_GRAYSCALE) {
 		nCb = m_pBlkDcValCb[nBlkX + nBlkY*m_nBlkXMax];
 		nCr = m_pBlkDcValCr[nBlkX + nBlkY*m_nBlkXMax];
 	} else {
@@ -5092,41 +11233,6 @@ unsigned CimgDecode::McuXyToLinear(CPoint ptMcu)
 	return nLinear;
 }
 
-// Create a file offset notation that represents bytes and bits
-// - Essentially a fixed-point notation
-//
-// INPUT:
-// - nByte				= File byte position
-// - nBit				= File bit position
-// RETURN:
-// - Fixed-point file offset (29b for bytes, 3b for bits)
-//
-unsigned CimgDecode::PackFileOffset(unsigned nByte,unsigned nBit)
-{
-	unsigned nTmp;
-	// Note that we only really need 3 bits, but I'll keep 4
-	// so that the file offset is human readable. We will only
-	// handle files up to 2^28 bytes (256MB), so this is probably
-	// fine!
-	nTmp = (nByte << 4) + nBit;
-	return nTmp;
-}
-
-// Convert from file offset notation to bytes and bits
-//
-// INPUT:
-// - nPacked			= Fixed-point file offset (29b for bytes, 3b for bits)
-// OUTPUT:
-// - nByte				= File byte position
-// - nBit				= File bit position
-//
-void CimgDecode::UnpackFileOffset(unsigned nPacked, unsigned &nByte, unsigned &nBit)
-{
-	nBit  = nPacked & 0x7;
-	nByte = nPacked >> 4;
-}
-
-
 // Fetch the number of block markers assigned
 //
 // RETURN:
@@ -5440,10 +11546,16 @@ void CimgDecode::ViewOnDraw(CDC* pDC,CRect rectClient,CPoint ptScrolledPos,
 				default:			strTitle += _T("???"); break;
 			}
 			if (m_bDecodeScanAc) {
-				strTitle += _T(", DC+AC)");
+				strTitle += _T(", DC+AC");
 			} else {
-				strTitle += _T(", DC)");
+				strTitle += _T(", DC");
+			}
+			if (m_nScaleShift != SCAN_SCALE_1) {
+				CString strScale;
+				strScale.Format(_T(", 1/%u"),1<<m_nScaleShift);
+				strTitle += strScale;
 			}
+			strTitle += _T(")");
 		}
 
 
@@ -5502,7 +11614,9 @@ void CimgDecode::ViewOnDraw(CDC* pDC,CRect rectClient,CPoint ptScrolledPos,
 		// Image member usage:
 		// m_pDibTemp:
 
-		m_pDibTemp.CopyDIB(pDC,m_rectImgReal.left,m_rectImgReal.top,m_nZoom);
+		// A scaled decode bitmap is stretched back up to the image size
+		// so that the overlays (in image coordinates) still line up
+		m_pDibTemp.CopyDIB(pDC,m_rectImgReal.left,m_rectImgReal.top,m_nZoom*(1<<m_nScaleShift));
 
 		// Now create overlays
 
@@ -37,6 +37,7 @@
 
 #include "DocLog.h"
 #include "WindowBuf.h"
+#include "McuFileMap.h"
 #include "afxwin.h"
 #include "Dib.h"
 
@@ -44,6 +45,8 @@
 
 #include "General.h"
 
+#include "ImgDecodeSimd.h"
+
 
 // Color conversion clipping (YCC) reporting
 #define YCC_CLIP_REPORT_ERR true	// Are YCC clips an error?
@@ -57,7 +60,7 @@
 #define	COMP_IND_CMYK_C			1
 #define	COMP_IND_CMYK_M	 		2
 #define	COMP_IND_CMYK_Y			3
-#define	COMP_IND_CMYK_K			3
+#define	COMP_IND_CMYK_K			4
 
 // Definitions for DHT array indices m_anDhtTblSel[][]
 #define	MAX_DHT_CLASS		2
@@ -95,9 +98,50 @@
 #define MAX_SCAN_DECODED_DIM	512	// X & Y dimension for top-left image display
 #define DHT_FAST_SIZE			9	// Number of bits for DHT direct lookup
 
+// Two-level DHT lookup
+// - The first level (ScanDecodeTbl::anDhtLookupfast) is indexed by the next DHT_FAST_SIZE
+//   bits of the scan buffer. Each entry is one of:
+//   - DHT_CODE_UNUSED           : No code with this prefix
+//   - Code entry                : [7:0] code, [12:8] code length
+//                                 If DHT_LOOKUP_VAL is set, the entry also
+//                                 covers the extra bits and [31:16] holds
+//                                 the sign-extended coefficient value
+//   - Subtable entry (DHT_LOOKUP_SUB) : [31:16] index of second level table
+// - The second level (ScanDecodeTbl::anDhtLookupSub) is indexed by the following
+//   DHT_SUB_SIZE bits and resolves codes longer than DHT_FAST_SIZE.
+//   Each entry is [7:0] code, [12:8] code length or DHT_SUB_UNUSED
+#define DHT_SUB_SIZE			(MAX_DHT_CODELEN-DHT_FAST_SIZE)	// Number of bits for DHT second level lookup
+#define DHT_SUB_MASK			((1<<DHT_SUB_SIZE)-1)
+#define DHT_SUB_MAX				(MAX_DHT_CODES/2+1)	// Max second level tables per DHT (prefixes shared by long codes)
+#define DHT_SUB_UNUSED			0xFFFF		// Mark second level entry as unused
+#define DHT_LOOKUP_LEN_SHIFT	8			// Code length field
+#define DHT_LOOKUP_LEN_MASK		0x1F
+#define DHT_LOOKUP_VAL			0x2000		// Entry includes extra bits & coefficient value
+#define DHT_LOOKUP_SUB			0x4000		// Entry refers to second level table
+#define DHT_LOOKUP_VAL_SHIFT	16			// Coefficient value or second level table index
+
+// Arithmetic decoding (QM-coder) per ITU-T.81 Annex D & F.2.4
+#define ARITH_DC_STAT_BINS		64			// Statistics bins per DC conditioning table
+#define ARITH_AC_STAT_BINS		256			// Statistics bins per AC conditioning table
+#define ARITH_QE_NUM			113			// Number of probability estimation states (Table D.2)
+#define ARITH_QE_FIXED			ARITH_QE_NUM	// Extra non-adapting state (Qe=0x5A1D) for sign bits
+#define ARITH_DC_L_DEF			0			// Default DC conditioning lower bound (L)
+#define ARITH_DC_U_DEF			1			// Default DC conditioning upper bound (U)
+#define ARITH_AC_K_DEF			5			// Default AC conditioning (Kx)
+
+// Lossless decode (SOF3) per ITU-T.81 Annex H
+#define LL_PRED_MAX				7			// Highest predictor selection value (Ss)
+#define LL_DIFF_SSSS_MAX		16			// Difference category 16 (value 32768) has no extra bits
+#define LL_ROWS_MAX				MAX_SAMP_FACT_V	// Max image rows produced per MCU row (LosslessRowsRead)
+#define LL_PREVIEW_PIX_MAX		(16*1024*1024)	// Preview is scaled down until it fits (pixels)
+
+// Band decode (DecodeScanBands) of images above the scan decode memory limit
+#define SCAN_BAND_SHIFT_MAX		6			// Largest reduction of the preview (1/64)
+
 // FIXME: MAX_SOF_COMP_NF per spec might actually be 255
 #define MAX_SOF_COMP_NF			256		// Maximum number of Image Components in Frame (Nf) [from SOF] (Nf range 1..255)
 #define MAX_SOS_COMP_NS			4		// Maximum number of Image Components in Scan (Ns) [from SOS] (Ns range 1..4)
+#define MAX_SOS_SUCC_APPROX		13		// Maximum successive approximation bit position (Ah,Al) [from SOS]
 
 // TODO: Merge with COMP_IND_YCC_*?
 #define SCAN_COMP_Y				1
@@ -116,6 +160,7 @@
 #define CHAN_Y				0
 #define	CHAN_CB				1
 #define	CHAN_CR				2
+#define	CHAN_K				3
 
 // Maximum number of blocks that can be marked
 // - This feature is generally used to mark ranges for the detailed scan decode feature
@@ -170,7 +215,71 @@ enum teRsvRet {
 	RSV_RST_TERM		// No huffman code found, but restart marker seen
 };
 
-// Scan decode errors (in m_anScanBuffPtr_err[] buffer array)
+// IDCT kernel selected for a block (from the last non-zero coefficient)
+enum teIdctPath {
+	IDCT_PATH_DC,		// DC only (no IDCT needed)
+	IDCT_PATH_2X2,		// Coefficients within top-left 2x2
+	IDCT_PATH_4X4,		// Coefficients within top-left 4x4
+	IDCT_PATH_FULL,		// Full 8x8 IDCT
+	IDCT_PATH_SCALED,	// Reduced size IDCT (scaled decode)
+	IDCT_PATH_NUM
+};
+
+// MCU decode selected for the sampling layout of the scan
+enum teMcuLayout {
+	MCU_LAYOUT_GENERIC,	// Any layout (DecodeScanMcu)
+	MCU_LAYOUT_GRAY,	// Single component
+	MCU_LAYOUT_444,		// YCC with Y 1x1
+	MCU_LAYOUT_422,		// YCC with Y 2x1
+	MCU_LAYOUT_420		// YCC with Y 2x2
+};
+
+// Scan bit reservoir
+// - File position ring holds the file offset of each byte loaded into
+//   the 64-bit reservoir. It only needs to cover the bytes in the
+//   reservoir plus a few that were consumed since a position was saved.
+#define SCANBUF_BITS		64
+#define SCANBUF_POS_RING	32		// Must be power of 2
+#define SCANBUF_POS_MASK	(SCANBUF_POS_RING-1)
+#define SCANBUF_ERR_MAX		16		// Max pending (unconsumed) error bytes
+
+// Parallel scan decode across restart intervals (DecodeScanParallel)
+#define SCAN_PAR_THREADS_MAX	64		// Max decode threads
+#define SCAN_PAR_COPY_CHUNK		65536	// Scan pre-pass chunk size (within one buffer window)
+
+// Pipelined scan decode (DecodeScanPipeline)
+#define SCAN_PIPE_BATCHES		8		// Ring buffer size (MCU rows in flight)
+
+// Previews of other channel modes kept for switching back (PreviewCacheSwap)
+#define PREVIEW_CACHE_MAX		8		// Max cached previews
+
+// Color statistics pass over stripes of rows (CalcChannelStats)
+#define STAT_STRIPE_ROWS_MIN	64		// Min pixel map rows per thread
+
+// One block in the pipelined scan decode
+// - Holds the entropy-decoded coefficients until the IDCT stage
+typedef struct {
+	short int*		pPixVal;				// Pixel plane of the component
+	unsigned		nOffsetBlkCorner;		// Pixel plane offset of the top-left corner
+	unsigned		nPlaneW;				// Pixel plane width
+	int				nIdctTbl;				// DQT table for the IDCT (-1 if none)
+	unsigned		nDctCoefMax;			// Last non-zero coefficient (zigzag index)
+	short int		nDcOffset;				// Level shift
+	short int		anDctBlock[DCT_SZ_ALL];	// Coefficients (only with nIdctTbl>=0)
+} ScanPipeBlk;
+
+// One MCU row of blocks (ring buffer entry)
+typedef struct {
+	ScanPipeBlk*	psBlk;
+	unsigned		nBlkNum;
+	unsigned		nBlkMax;
+	unsigned		nMcuY;
+	bool			bBusy;					// Queued or in the IDCT stage
+} ScanPipeBatch;
+
+struct ScanPipe;							// Pipeline control (ImgDecode.cpp)
+
+// Scan decode errors (latched in m_nScanBuffLatchErr)
 enum teScanBufStatus {
 	SCANBUF_OK,
 	SCANBUF_BADMARK,
@@ -178,6 +287,107 @@ enum teScanBufStatus {
 };
 
 
+// Pixel plane of one image component
+// - The samples are held at the sampling of the component, so a
+//   subsampled component only takes (nSampH*nSampV)/(nSampHMax*nSampVMax)
+//   of the pixel map size. The planes are upsampled to the pixel map
+//   size when they are read (PlaneRowGet).
+// - The samples are in pixel map units (see SetFullRes) until the
+//   plane is compacted (PlaneCompact) into clipped 8-bit samples
+typedef struct {
+	short int*		pnPix;			// Samples in pixel map units (NULL once compacted)
+	unsigned char*	pnPix8;			// Clipped 8-bit samples (compacted plane only)
+	unsigned		nW;				// Plane width (samples)
+	unsigned		nH;				// Plane height (samples)
+	unsigned		nSampH;			// Sampling factors relative to the pixel map
+	unsigned		nSampV;			// (plane = pixel map * nSampH / nSampHMax)
+	unsigned		nSampHMax;
+	unsigned		nSampVMax;
+} PixPlane;
+
+
+// Entropy decoder state at the start of an MCU
+// - Saved every nDecodeScanCkptMcus MCUs by the sequential scan decode
+//   so that a region can be decoded from the nearest checkpoint
+//   rather than from the start of the scan (DecodeScanRegion)
+// - If the MCU starts at a restart marker, the state after the marker
+//   is saved (DC predictors reset, file position after the RSTn)
+typedef struct {
+	bool			bValid;				// Checkpoint was reached by the decode
+	unsigned		nFilePos;			// File position of the byte holding the next bit
+	unsigned		nFileBit;			// Bit alignment within that byte (0..7)
+	signed short	nDcLum;				// DC predictors
+	signed short	nDcChrCb;
+	signed short	nDcChrCr;
+	signed short	nDcK;
+	unsigned		nRestartMcusLeft;	// MCUs until the next RSTn
+	unsigned		nRestartExpectInd;	// Next RSTn expected (0..7)
+} ScanCkpt;
+
+
+// DQT, DHT and IDCT tables of the scan decode
+// - Set up from the DQT / DHT markers (SetDqtTables, SetDhtTables) and
+//   by PrecalcIdct(), and only read during the scan decode. The worker
+//   decoders of the parallel, pipelined and band decodes point at the
+//   tables of the main decoder instead of holding a copy.
+// Note: Component destination index is 1-based; first entry [0] is unused
+typedef struct {
+	unsigned short	anDqtCoeff[MAX_DQT_DEST_ID][MAX_DQT_COEFF];		// Normal ordering
+	unsigned short	anDqtCoeffZz[MAX_DQT_DEST_ID][MAX_DQT_COEFF];	// Original zigzag ordering
+	float			afDqtIdctMult[MAX_DQT_DEST_ID][MAX_DQT_COEFF];	// Dequantization & AAN IDCT prescale (normal ordering)
+	int				anDqtIdctMult[MAX_DQT_DEST_ID][MAX_DQT_COEFF];	// Fixed point version of afDqtIdctMult
+	int				anDqtTblSel[MAX_DQT_COMP];						// DQT table selector for image component in frame
+
+	int				anDhtTblSel[MAX_DHT_CLASS][1+MAX_SOS_COMP_NS];						// DHT table selected for image component index (1..4)
+	unsigned		anHuffMaskLookup[32];
+	unsigned		anDhtLookupSetMax[MAX_DHT_CLASS];									// Highest DHT table index (ie. 0..3) per class
+	unsigned		anDhtLookupSize[MAX_DHT_CLASS][MAX_DHT_DEST_ID];						// Number of entries in each lookup table
+	unsigned		anDhtLookupfast[MAX_DHT_CLASS][MAX_DHT_DEST_ID][1<<DHT_FAST_SIZE];	// First level lookup (see DHT_LOOKUP_*)
+	unsigned short	anDhtLookupSub[MAX_DHT_CLASS][MAX_DHT_DEST_ID][DHT_SUB_MAX][1<<DHT_SUB_SIZE];	// Second level lookup for long codes
+	unsigned		anDhtLookupSubNum[MAX_DHT_CLASS][MAX_DHT_DEST_ID];						// Number of second level tables allocated
+
+	float			afIdctLookup[DCT_SZ_ALL][DCT_SZ_ALL];				// IDCT lookup table (reference only)
+	float			afIdctScaleCos[SCAN_SCALE_END][DCT_SZ_X][DCT_SZ_X];	// Reduced IDCT basis per scale [x][u]
+} ScanDecodeTbl;
+
+
+// Scan index file (see ScanIndexStore)
+// - Holds the results of the entropy decode of a sequential scan so
+//   that a later analysis of the same file can skip it
+// - Followed by the Huffman code histograms, the MCU bit offsets and
+//   the DC block maps (both as variable length coded deltas) and the
+//   entropy decoder checkpoints
+// - The hash covers the scan data and the DQT / DHT tables
+// - The header, histograms and checkpoints are stored field by field
+//   as 32-bit little-endian values, independent of the struct layout
+#define SCAN_INDEX_MAGIC	0x5844494A		// "JIDX"
+#define SCAN_INDEX_VER		2
+#define SCAN_INDEX_EXT		_T(".jsi")
+#define SCAN_INDEX_HDR_LEN	(16*4 + 16)		// Stored size of ScanIndexHdr
+#define SCAN_INDEX_CKPT_LEN	(9*4)			// Stored size of ScanCkpt
+#define SCAN_INDEX_VAL_LEN	10				// Maximum stored size of a coded value
+
+typedef struct {
+	unsigned		nMagic;				// SCAN_INDEX_MAGIC
+	unsigned		nVer;				// SCAN_INDEX_VER
+	unsigned		nScanStart;			// File position of the scan data
+	unsigned		nScanEndPos;		// Scan buffer position at the end of the decode
+	unsigned		nScanEndBit;
+	unsigned		nImgSizeX;			// Image geometry (must match)
+	unsigned		nImgSizeY;
+	unsigned		nNumSosComps;
+	unsigned		nMcuXMax;
+	unsigned		nMcuYMax;
+	unsigned		nRestartInterval;
+	unsigned		nRestartRead;		// Number of RSTn markers decoded
+	unsigned		nCkptMcus;			// MCUs between checkpoints (0 if none)
+	unsigned		nCkptNum;
+	unsigned		nMcuMapLen;			// Length of the coded MCU bit offsets
+	unsigned		nDcMapLen;			// Length of the coded DC block maps
+	unsigned char	anHash[16];			// MD5 of the scan data and tables
+} ScanIndexHdr;
+
+
 // Per-pixel color conversion structure
 // - Records each stage of the process and associated clipping/ranging
 typedef struct {
@@ -279,12 +489,43 @@ typedef struct {
 	unsigned	nCount;
 } PixelCcHisto;
 
+// Cached preview of one channel mode (PreviewCacheSwap)
+// - Keyed by the preview mode and the preview level shift
+typedef struct {
+	CDIB*		pDib;
+	unsigned	nMode;					// Preview mode (PREVIEW_*)
+	unsigned	nShiftMcuX;				// Level shift (see SetPreviewYccOffset)
+	unsigned	nShiftMcuY;
+	int			nShiftY;
+	int			nShiftCb;
+	int			nShiftCr;
+	unsigned	nLastUse;				// Least recently used is replaced first
+} PreviewCacheEnt;
+
+// Pixel with YCC clipping, as reported by CapYccRange
+typedef struct {
+	unsigned	nMcuX;
+	unsigned	nMcuY;
+	int			nPreclipY;
+	int			nPreclipCb;
+	int			nPreclipCr;
+} PixelCcClipYcc;
+
+// Color statistics of a stripe of rows (CalcChannelStatsStripe)
+// - Only the first YCC_CLIP_REPORT_MAX pixels with YCC clipping are
+//   kept, as no more can be reported
+typedef struct {
+	YccStats		sStats;
+	unsigned		nClipYccNum;
+	PixelCcClipYcc	asClipYcc[YCC_CLIP_REPORT_MAX];
+} StatStripe;
+
 
 
 class CimgDecode
 {
 public:
-	CimgDecode(CDocLog* pLog, CwindowBuf* pWBuf);
+	CimgDecode(CDocLog* pLog, CwindowBuf* pWBuf, const CimgDecode* pMain = NULL);
 	~CimgDecode();
 
 	void		Reset();		// Called during start of SOS decode
@@ -292,6 +533,16 @@ public:
 
 	void		SetStatusBar(CStatusBar* pStatBar);
 	void		DecodeScanImg(unsigned bStart,bool bDisplay,bool bQuiet);
+	void		DecodeScanProg(unsigned nStart,bool bDisplay);
+	void		DecodeScanProgEnd(bool bDisplay,bool bQuiet);
+	bool		IsScanProgPending();
+	void		DecodeScanLossless(unsigned nStart,bool bDisplay,bool bQuiet);
+
+	// Lossless image samples (16-bit, all components interleaved)
+	bool		GetLosslessInfo(unsigned &nSizeX,unsigned &nSizeY,unsigned &nNumComps,unsigned &nPrecision);
+	bool		LosslessRowsBegin();
+	unsigned	LosslessRowsRead(unsigned short* pRows);
+	void		LosslessRowsEnd();
 
 	void		DrawHistogram(bool bQuiet,bool bDumpHistoY);
 	void		ReportHistogramY();
@@ -309,10 +560,15 @@ public:
 	bool		SetDqtTables(unsigned nCompInd, unsigned nTbl);
 	unsigned	GetDqtEntry(unsigned nTblDestId, unsigned nCoeffInd);
 	bool		SetDhtTables(unsigned nCompInd, unsigned nTblDc, unsigned nTblAc);
+	bool		SetSosCompInd(unsigned nScanCompInd, unsigned nCompInd);
+	void		SetArithCoding(bool bArith);
+	bool		SetDacEntry(unsigned nClass, unsigned nTbl, unsigned nVal);
+	void		SetSosProgress(unsigned nSpectralStart, unsigned nSpectralEnd, unsigned nSuccApproxHigh, unsigned nSuccApproxLow);
 	bool		SetDhtEntry(unsigned nDestId, unsigned nClass, unsigned nInd, unsigned nLen,
 							unsigned nBits, unsigned nMask, unsigned nCode);
 	bool		SetDhtSize(unsigned nDestId,unsigned nClass,unsigned nSize);
 	void		SetPrecision(unsigned nPrecision);
+	void		SetColorYcck(bool bYcck);
 
 
 	// Modes -- accessed from Doc
@@ -331,6 +587,7 @@ public:
 	// Utilities
 	void		LookupFilePosPix(unsigned nPixX,unsigned nPixY, unsigned &nByte, unsigned &nBit);
 	void		LookupFilePosMcu(unsigned nMcuX,unsigned nMcuY, unsigned &nByte, unsigned &nBit);
+	bool		LookupMcuFilePos(unsigned nByte,unsigned nBit,CPoint &ptMcu,unsigned &nComp,CPoint &ptBlk);
 	void		LookupBlkYCC(unsigned nBlkX,unsigned nBlkY,int &nY,int &nCb,int &nCr);
 
 	void		SetMarkerBlk(unsigned nBlkX,unsigned nBlkY);
@@ -341,6 +598,11 @@ public:
 	CPoint		PixelToBlk(CPoint ptPix);
 	unsigned	McuXyToLinear(CPoint ptMcu);
 	void		GetImageSize(unsigned &nX,unsigned &nY);
+	void		GetPixMapSize(unsigned &nX,unsigned &nY);
+	unsigned	GetPixMapPrecision();
+	bool		GetPixMapRowRgb16(unsigned nPixY,unsigned short* pnRgb);
+	bool		GetPixMapRowYcc(unsigned nPixY,short* pnYcc);
+	bool		DecodeScanRegion(CRect rectPix,unsigned char* pRgb);
 
 	// View helper routines
 	void		ViewOnDraw(CDC* pDC,CRect rectClient,CPoint ptScrolledPos,CFont* pFont, CSize &szNewScrollSize);
@@ -348,7 +610,6 @@ public:
 	void		ViewMcuMarkedOverlay(CDC* pDC);
 	void		ViewMarkerOverlay(CDC* pDC,unsigned nBlkX,unsigned nBlkY);	// UNUSED?
 
-	void		GetPixMapPtrs(short* &pMapY,short* &pMapCb,short* &pMapCr);
 	void		GetDetailVlc(bool &bDetail,unsigned &nX,unsigned &nY,unsigned &nLen);
 	void		SetDetailVlc(bool bDetail,unsigned nX,unsigned nY,unsigned nLen);
 
@@ -357,11 +618,20 @@ public:
 
 private:
 
+	bool		DecodeScanImgInit(bool bDisplay,unsigned nScaleShiftMin,bool bBandEn);
+	void		ReportScanMode();
+	void		ReportScanStats(bool bDisplay,bool bQuiet);
+
 	void		ResetDqtTables();
 	void		ResetDhtLookup();
+	void		ResetDhtLookupTbl(unsigned nClass,unsigned nDestId);
 
 	CString		GetScanBufPos();
 	CString		GetScanBufPos(unsigned pos, unsigned align);
+	CString		GetScanBufPosAt(unsigned nByteInd, unsigned nAlign);
+	void		GetScanBufInd(unsigned &nByteInd,unsigned &nAlign);
+	unsigned	GetScanBufFilePos(unsigned nByteInd);
+	void		ScanBuffLatchErr(unsigned nByteInd);
 
 	void		ConvertYCCtoRGB(unsigned nMcuX,unsigned nMcuY,PixelCc &sPix);
 	void		ConvertYCCtoRGBFastFloat(PixelCc &sPix);
@@ -374,6 +644,7 @@ private:
 	void		GenLookupHuffMask();
 	unsigned	ExtractBits(unsigned nWord,unsigned nBits);
 	teRsvRet	ReadScanVal(unsigned nClass,unsigned nTbl,unsigned &rZrl,signed &rVal);
+	bool		ReadScanSkipAc(unsigned nTbl,unsigned &rNumCoeffs);
 	bool		DecodeScanComp(unsigned nTblDhtDc,unsigned nTblDhtAc,unsigned nTblDqt,unsigned nMcuX,unsigned nMcuY);
 	bool		DecodeScanCompPrint(unsigned nTblDhtDc,unsigned nTblDhtAc,unsigned nTblDqt,unsigned nMcuX,unsigned nMcuY);
 	signed		HuffmanDc2Signed(unsigned nVal,unsigned nBits);
@@ -396,21 +667,125 @@ private:
 
 	// IDCT calcs
 	void		PrecalcIdct();
+	void		PrecalcIdctDqt(unsigned nTbl,unsigned nCoeffInd);
 	void		DecodeIdctClear();
 	void		DecodeIdctSet(unsigned nTbl,unsigned num_coeffs,unsigned zrl,short int val);
-	void		DecodeIdctCalcFloat(unsigned nCoefMax);
-	void		DecodeIdctCalcFixedpt();
-	void		ClrFullRes(unsigned nWidth,unsigned nHeight);
+	void		DecodeIdctCalc(unsigned nDqtTbl);
+	void		DecodeIdctCalcFloat(unsigned nDqtTbl);
+	void		DecodeIdctCalcFixedpt(unsigned nDqtTbl);
+	void		DecodeIdctCalcScaled(unsigned nDqtTbl);
+	void		DecodeIdctCalcRef(unsigned nDqtTbl,float* pfBlock);
+	void		DecodeIdctCheck(unsigned nDqtTbl);
+	void		ReportSimdCheck(LPCTSTR strKernel,unsigned nInd);
+	void		ReportIdctStats();
+	void		ClrFullRes();
+	void		LevelShiftBlock(short int nDcOffset,short int* pnPix);
 	void		SetFullRes(unsigned nMcuX,unsigned nMcuY,unsigned nComp,unsigned nCssXInd,unsigned nCssYInd,short int nDcOffset);
+	void		SetFullResBlk(short int* pPixVal,unsigned nOffsetBlkCorner,unsigned nPlaneW,short int nDcOffset);
+
+	// Pixel planes (component samples at their sampled resolution)
+	bool		PlaneAlloc(unsigned nChan,unsigned nSampH,unsigned nSampV,unsigned nSampHMax,unsigned nSampVMax);
+	void		PlaneFree();
+	unsigned	PlaneBlkOffset(unsigned nChan,unsigned nBlkX,unsigned nBlkY);
+	unsigned	PlanePixInd(unsigned nChan,unsigned nPixX,unsigned nPixY);
+	bool		PlaneValid(unsigned nChan);
+	template <typename T>
+	void		PlaneRowUpsample(const T* pSrc,const PixPlane* psPlane,short* pnRow);
+	const short*	PlaneRowGet(unsigned nChan,unsigned nPixY,short* pnRow);
+	void		PlaneCompact();
+
+	// MCU decode
+	bool		DecodeScanMcu(unsigned nMcuX,unsigned nMcuY,bool bDisplay,bool bVlcDump);
+	template <unsigned nSampH,unsigned nSampV,bool bColor>
+	bool		DecodeScanMcuFixed(unsigned nMcuX,unsigned nMcuY,bool bDisplay);
+	bool		DecodeScanMcuRange(unsigned nMcuBegin,unsigned nMcuEnd,bool bDisplay);
+
+	// Parallel decode of restart intervals
+	bool		DecodeScanParallel(unsigned nStart,bool bDisplay);
+	unsigned	DecodeScanFindRst(unsigned nStart,unsigned nRstMax,unsigned* anRstPos);
+	void		DecodeScanInterval(unsigned nFilePos,unsigned nInterval,unsigned nMcuBegin,unsigned nMcuEnd,bool bDisplay,bool bLast);
+	void		ScanWorkerAttach(const CimgDecode* pMain);
+	void		ScanWorkerDetach();
+
+	// Entropy decoder checkpoints (region decode)
+	void		ScanCkptSave(unsigned nMcuXY);
+	int			ScanCkptFind(unsigned nMcuXY);
+	void		ScanCkptRestore(const ScanCkpt* psCkpt);
+	void		ScanCkptFree();
+
+	// Scan index file
+	CString		ScanIndexFname();
+	void		ScanIndexHash(unsigned nStart,unsigned nEndPos,unsigned char* pnHash);
+	bool		ScanIndexLoad(unsigned nStart,bool bApply);
+	void		ScanIndexStore(unsigned nStart);
+	void		ScanIndexRender();
+	unsigned	ScanIndexPutVal(BYTE* pBuf,unsigned nOffset,LONGLONG nVal);
+	bool		ScanIndexGetVal(const BYTE* pBuf,unsigned nLen,unsigned &nOffset,LONGLONG &nVal);
+	unsigned	ScanIndexPutU32(BYTE* pBuf,unsigned nOffset,unsigned nVal);
+	unsigned	ScanIndexGetU32(const BYTE* pBuf,unsigned &nOffset);
+	unsigned	ScanIndexPutHdr(BYTE* pBuf,const ScanIndexHdr &sHdr);
+	void		ScanIndexGetHdr(const BYTE* pBuf,ScanIndexHdr &sHdr);
+
+	// Pipelined decode (entropy, IDCT and color conversion stages)
+	bool		DecodeScanPipeline(CDocLog* pLogPreview,bool &bAbort);
+	void		PipeAddBlock(short int* pPixVal,unsigned nOffsetBlkCorner,unsigned nPlaneW,short int nDcOffset);
+	void		PipeIdctWorker(ScanPipe* psPipe);
+	void		PipeColorWorker(ScanPipe* psPipe,unsigned char* pDibBits);
+	void		PreviewStateCopy(const CimgDecode* pSrc);
+	CString		GetPreviewScanPos();
+
+	// Band decode (pixel maps for a window of MCU rows)
+	bool		DecodeScanBands();
+	void		DecodeScanBandReduce(unsigned nBandPixH,short** apReduced,int* pnAcc);
+
+	// Progressive and multi-scan sequential decode (coefficient buffer)
+	bool		ReadScanSym(unsigned nClass,unsigned nTbl,unsigned &rSym);
+	unsigned	ReadScanBits(unsigned nNumBits);
+	void		ReportScanProgErr(LPCTSTR strErr);
+	bool		DecodeScanProgRestart(int* anDcPred);
+	bool		DecodeScanProgBlk(short int* pnCoef,unsigned nScanComp,int &rnDcPred);
+	bool		DecodeScanProgAcFirst(short int* pnCoef,unsigned nTbl);
+	bool		DecodeScanProgAcRefine(short int* pnCoef,unsigned nTbl);
+	bool		DecodeScanProgSeq(short int* pnCoef,unsigned nScanComp,int &rnDcPred);
+	void		DecodeScanProgFree();
+
+	// Arithmetic decode (QM-coder) into the coefficient buffer
+	bool		ReadScanArithEnd();
+	unsigned	ReadScanArithByte();
+	unsigned	ReadScanArith(BYTE &rSt);
+	void		ReportScanArithErr();
+	void		DecodeScanArithInit();
+	bool		DecodeScanArithBlk(short int* pnCoef,unsigned nScanComp,int &rnDcPred);
+	bool		DecodeScanArithDc(unsigned nScanComp,int &rnDcPred);
+	bool		DecodeScanArithAc(short int* pnCoef,unsigned nTbl);
+	bool		DecodeScanArithAcRefine(short int* pnCoef,unsigned nTbl);
+
+	// Lossless decode (row by row)
+	bool		ReadScanLosslessDiff(unsigned nTbl,int &rDiff);
+	bool		DecodeLosslessInit();
+	void		DecodeLosslessMcuRow(bool bMcuMap);
+	unsigned	DecodeLosslessRowOut(unsigned short* pRows);
+	void		DecodeLosslessPreview(const unsigned short* pRows,unsigned nRowStart,unsigned nNumRows);
+	void		DecodeLosslessFree();
 
-public: // For ImgMod
-	unsigned	PackFileOffset(unsigned nByte,unsigned nBit);
-	void		UnpackFileOffset(unsigned nPacked, unsigned &nByte, unsigned &nBit);
-private:
 
 	void		ChannelExtract(unsigned nMode,PixelCc &sSrc,PixelCc &sDst);
 	void		CalcChannelPreviewFull(CRect* pRectView,unsigned char* pTmp);
+	void		CalcChannelPreviewStart();
+	void		CalcChannelPreviewRows(unsigned nPixY1,unsigned nPixY2,unsigned char* pTmp,unsigned &nSumY);
+	void		CalcChannelPreviewRowsYcc(unsigned nPixY1,unsigned nPixY2,unsigned char* pTmp,unsigned &nSumY);
+	void		CalcChannelPreviewRowsCmyk(unsigned nPixY1,unsigned nPixY2,unsigned char* pTmp,unsigned &nSumY);
+	void		CalcChannelStats(unsigned nPixY1,unsigned nPixY2);
+	void		CalcChannelStatsStripe(unsigned nPixY1,unsigned nPixY2,StatStripe* psStripe);
+	void		CalcChannelStatsMerge(const StatStripe* psStripe);
+	void		ReportYccClip(const PixelCcClipYcc* psClip);
+	void		CalcChannelPreviewEnd(unsigned nSumY);
 	void		CalcChannelPreview();
+	bool		CalcPreviewShiftDirty(unsigned nMcuX,unsigned nMcuY,int nY,int nCb,int nCr,
+					unsigned &nMcuY1,unsigned &nMcuY2);
+	void		CalcChannelPreviewMcuRows(unsigned nMcuY1,unsigned nMcuY2);
+	bool		PreviewCacheSwap(unsigned nMode);
+	void		PreviewCacheClear();
 
 public: // For Export
 	void		GetBitmapPtr(unsigned char* &pBitmap);
@@ -424,7 +799,7 @@ public: // For Export
 	void		SetStatusFilePosText(CString strText);
 	CString		GetStatusFilePosText();
 
-	void		ReportDctMatrix();
+	void		ReportDctMatrix(unsigned nDqtTbl);
 	void		ReportDctYccMatrix();
 	void		ReportVlc(unsigned nVlcPos, unsigned nVlcAlign,
 						   unsigned nZrl, int nVal,
@@ -441,7 +816,7 @@ public: // For Export
 private:
 	CSnoopConfig*		m_pAppConfig;	// Pointer to application config
 
-	unsigned *			m_pMcuFileMap;
+	CMcuFileMap*		m_pMcuFileMap;		// File position of each MCU
 	unsigned			m_nMcuWidth;	// Width (pix) of MCU (e.g. 8,16)
 	unsigned			m_nMcuHeight;	// Height (pix) of MCU (e.g. 8,16)
 	unsigned			m_nMcuXMax;		// Number of MCUs across
@@ -451,14 +826,18 @@ private:
 
 	// Fill these with the cumulative values so that we can do
 	// a YCC to RGB conversion (for level shift previews, etc.)
-	short *				m_pPixValY;		// Pixel value
-	short *				m_pPixValCb;	// Pixel value
-	short *				m_pPixValCr;	// Pixel value
+	// - Indexed by channel (CHAN_Y, CHAN_CB, CHAN_CR, CHAN_K)
+	PixPlane			m_asPixPlane[NUM_CHAN_YCCK];	// Pixel planes
+	unsigned			m_nPixMapW;		// Width of pixel maps (after scaling, before subsampling)
+	unsigned			m_nPixMapH;		// Height of pixel maps (after scaling, before subsampling)
+	unsigned			m_nScaleShift;	// Scaled decode: pixel maps are 1/(1<<m_nScaleShift) size (teScanScale)
+	unsigned			m_nPixMapPrecShift;	// Sample bits above 8 held by the pixel maps (12-bit DCT: 4)
 
 	// Array of block DC values. Only used for under-cursor reporting.
 	short *				m_pBlkDcValY;	// Block DC value
 	short *				m_pBlkDcValCb;	// Block DC value
 	short *				m_pBlkDcValCr;	// Block DC value
+	short *				m_pBlkDcValK;	// Block DC value (4-component images only)
 
 	// TODO: Later use these to support frequency spectrum
 	// display of image data
@@ -496,9 +875,11 @@ private:
 	signed short		m_nDcLum;
 	signed short		m_nDcChrCb;
 	signed short		m_nDcChrCr;
+	signed short		m_nDcK;
 	signed short		m_anDcLumCss[MAX_SAMP_FACT_V*MAX_SAMP_FACT_H];	// Need 4x2 at least. Support up to 4x4
 	signed short		m_anDcChrCbCss[MAX_SAMP_FACT_V*MAX_SAMP_FACT_H];
 	signed short		m_anDcChrCrCss[MAX_SAMP_FACT_V*MAX_SAMP_FACT_H];
+	signed short		m_anDcKCss[MAX_SAMP_FACT_V*MAX_SAMP_FACT_H];
 
 
 	bool				m_bScanBad;			// Any errors found?
@@ -510,6 +891,10 @@ public: // FIXME (workaround)
 	bool				m_bPreviewIsJpeg;		// Is the preview image from decoded JPEG?
 private:
 
+	PreviewCacheEnt		m_asPreviewCache[PREVIEW_CACHE_MAX];	// Previews of other modes
+	unsigned			m_nPreviewCacheNum;
+	unsigned			m_nPreviewCacheUse;		// Use counter (PreviewCacheEnt::nLastUse)
+
 	bool				m_bDibHistRgbReady;
 	CDIB				m_pDibHistRgb;
 
@@ -535,6 +920,7 @@ private:
 	unsigned			m_nNumSosComps;							// Number of Image Components (DHT?)
 	unsigned			m_nNumSofComps;							// Number of Image Components (DQT?)
 	unsigned			m_nPrecision;							// 8-bit or 12-bit (defined in JFIF_SOF1)
+	bool				m_bColorYcck;							// 4-component image is YCCK rather than CMYK (APP14)
 	unsigned			m_anSofSampFactH[MAX_SOF_COMP_NF];		// Sampling factor per component ID in frame from SOF
 	unsigned			m_anSofSampFactV[MAX_SOF_COMP_NF];	  	// Sampling factor per component ID in frame from SOF
 	unsigned			m_nSosSampFactHMax;						// Maximum sampling factor for scan
@@ -545,6 +931,68 @@ private:
 	unsigned			m_anSampPerMcuV[MAX_SOF_COMP_NF];		// Number of samples of component ID per MCU
 	unsigned			m_anExpandBitsMcuH[MAX_SOF_COMP_NF];	// Number of bits to replicate in SetFullRes() due to sampling factor
 	unsigned			m_anExpandBitsMcuV[MAX_SOF_COMP_NF];	// Number of bits to replicate in SetFullRes() due to sampling factor
+	teMcuLayout			m_eMcuLayout;							// MCU decode selected for the scan sampling layout
+	unsigned			m_anScanDhtTblDc[1+MAX_SOS_COMP_NS];	// DC DHT table selected per scan component (SCAN_COMP_*)
+	unsigned			m_anScanDhtTblAc[1+MAX_SOS_COMP_NS];	// AC DHT table selected per scan component (SCAN_COMP_*)
+	unsigned			m_anScanDqtTbl[1+MAX_SOS_COMP_NS];		// DQT table selected per scan component (SCAN_COMP_*)
+
+	// Progressive and multi-scan sequential decode
+	// - Each frame component keeps all of its quantized coefficients until
+	//   the last scan: 64 x 16-bit per 8x8 block (in zigzag order), blocks
+	//   in raster order over the padded MCU grid
+	unsigned			m_anSosCompInd[1+MAX_SOS_COMP_NS];		// Frame component index (1..Nf) per scan component
+	unsigned			m_nSosSpectralStart;					// Ss
+	unsigned			m_nSosSpectralEnd;						// Se
+	unsigned			m_nSosSuccApproxHigh;					// Ah
+	unsigned			m_nSosSuccApproxLow;					// Al
+	short int*			m_apProgCoef[1+NUM_CHAN_YCCK];			// Coefficient buffer per frame component
+	unsigned			m_anProgBlkW[1+NUM_CHAN_YCCK];			// Coefficient buffer width (blocks)
+	unsigned			m_anProgBlkH[1+NUM_CHAN_YCCK];			// Coefficient buffer height (blocks)
+	unsigned			m_nProgScanNum;							// Number of scans decoded into the buffer
+	unsigned			m_nProgPosFirst;						// File position of the first scan
+	unsigned			m_nProgEobRun;							// Remaining blocks of the current EOB run
+	bool				m_bProgSequential;						// Buffer holds sequential scans (one per component group)
+	unsigned			m_nProgMcuMapScan;						// Scan that provided the MCU file map (0 if none yet)
+
+	// Arithmetic decode
+	// - Each statistics bin holds the MPS in bit 7 and the probability
+	//   estimation state (index into Table D.2) in bits 6..0
+	bool				m_bScanArith;							// Frame is arithmetic coded (SOF9 / SOF10)
+	unsigned			m_anArithDcL[MAX_DHT_DEST_ID];			// DC conditioning lower bound (L) per table [from DAC]
+	unsigned			m_anArithDcU[MAX_DHT_DEST_ID];			// DC conditioning upper bound (U) per table [from DAC]
+	unsigned			m_anArithAcK[MAX_DHT_DEST_ID];			// AC conditioning (Kx) per table [from DAC]
+	BYTE				m_anArithDcStats[MAX_DHT_DEST_ID][ARITH_DC_STAT_BINS];
+	BYTE				m_anArithAcStats[MAX_DHT_DEST_ID][ARITH_AC_STAT_BINS];
+	BYTE				m_nArithFixedBin;						// Non-adapting bin (ARITH_QE_FIXED)
+	unsigned			m_anArithDcContext[1+MAX_SOS_COMP_NS];	// DC conditioning category per scan component
+	unsigned			m_nArithC;								// Code register (C)
+	unsigned			m_nArithA;								// Probability interval (A)
+	int					m_nArithCt;								// Bits left in C before the next byte (CT)
+	bool				m_bArithErr;							// Skip to the next restart interval after an error
+	static const DWORD	m_anArithQe[ARITH_QE_NUM+1];			// Qe and state transitions per estimation state
+
+	// Lossless decode
+	// - The scan is decoded one MCU row at a time. Each component keeps
+	//   the sample row above the MCU row (row 0) followed by its Vi rows
+	//   within the MCU row, before the point transform is undone
+	// - The image samples are kept in m_pLlPixMap if they fit within
+	//   nDecodeLosslessMapMax, otherwise LosslessRowsRead() decodes the
+	//   scan again
+	bool				m_bLossless;							// Image was decoded by DecodeScanLossless()
+	unsigned			m_nLlPredictor;							// Predictor selection value (Ss)
+	unsigned			m_nLlPointTrans;						// Point transform (Al)
+	unsigned			m_nLlPosStart;							// File position of the scan
+	unsigned			m_nLlNumComps;							// Number of components (Ns = Nf)
+	unsigned			m_nLlMcuXMax;							// Number of MCUs across (samples of Hmax)
+	unsigned			m_nLlMcuYMax;							// Number of MCU rows (samples of Vmax)
+	unsigned			m_nLlMcuY;								// Next MCU row to decode
+	unsigned			m_nLlRestartRows;						// MCU rows per restart interval (0 if none)
+	bool				m_bLlScanEnd;							// Scan data exhausted, remaining differences are 0
+	bool				m_bLlErrDisabled;						// Scan error state before LosslessRowsBegin()
+	unsigned			m_anLlRowW[1+MAX_SOS_COMP_NS];			// Row buffer width (samples) per scan component
+	unsigned short*		m_apLlRow[1+MAX_SOS_COMP_NS];			// Row buffer (1+Vi rows) per scan component
+	unsigned short*		m_pLlPixMap;							// Image samples (m_nDimX x m_nDimY x m_nLlNumComps)
+	unsigned			m_nLlRowsRead;							// Next image row returned by LosslessRowsRead()
 
 	bool				m_bRestartEn;		// Did decoder see DRI?
 	unsigned			m_nRestartInterval;	// ... if so, what is the MCU interval
@@ -564,13 +1012,9 @@ private:
 
 
 
-	// DQT Table
-public: 
-	unsigned short		m_anDqtCoeff[MAX_DQT_DEST_ID][MAX_DQT_COEFF];	// Normal ordering
-	unsigned short		m_anDqtCoeffZz[MAX_DQT_DEST_ID][MAX_DQT_COEFF];	// Original zigzag ordering
-	int					m_anDqtTblSel[MAX_DQT_COMP];					// DQT table selector for image component in frame
-
-private:
+	// DQT, DHT and IDCT tables (shared with the worker decoders)
+	ScanDecodeTbl*		m_psTbl;
+	bool				m_bTblOwner;					// Tables allocated by this decoder (else by the main decoder)
 
 
 	bool				m_bDecodeScanAc;				// User request decode of AC components?
@@ -579,6 +1023,8 @@ private:
 	int					m_nBrightY;
 	int					m_nBrightCb;
 	int					m_nBrightCr;
+	int					m_nBrightK;		// 4-component images only
+	int					m_nBrightLum;	// 4-component images: luminance of the RGB value (0..255)
 	unsigned			m_nBrightR;
 	unsigned			m_nBrightG;
 	unsigned			m_nBrightB;
@@ -593,41 +1039,36 @@ private:
 	bool				m_bScanErrorsDisable;			// Disable scan errors reporting
 
 	// Temporary processing of IDCT per block
-	float				m_afIdctLookup[DCT_SZ_ALL][DCT_SZ_ALL];	// IDCT lookup table (floating point)
-	int					m_anIdctLookup[DCT_SZ_ALL][DCT_SZ_ALL];	// IDCT lookup table (fixed point)
-	unsigned			m_nDctCoefMax;							// Largest DCT coeff to process
-	signed short		m_anDctBlock[DCT_SZ_ALL];				// Input block for IDCT process
+	unsigned			m_nDctCoefMax;							// Last non-zero DCT coeff in block (zigzag index)
+	signed short		m_anDctBlock[DCT_SZ_ALL];				// Input block for IDCT process (DC dequantized, AC quantized)
 	float				m_afIdctBlock[DCT_SZ_ALL];				// Output block after IDCT (via floating point)
 	int					m_anIdctBlock[DCT_SZ_ALL];				// Output block after IDCT (via fixed point)
+	unsigned			m_nWarnIdctCheckNum;					// Number of IDCT self-check mismatches reported
+	unsigned			m_anIdctPathNum[IDCT_PATH_NUM];			// Number of blocks that used each IDCT kernel
+	static const LPCTSTR	m_astrIdctPathName[IDCT_PATH_NUM];	// IDCT kernel names
+
+	// Per-block kernels (scalar / SSE2 / AVX2)
+	const ImgDecodeKernels*	m_pKernels;							// Kernels selected from CPUID
+	unsigned			m_nWarnSimdCheckNum;					// Number of SIMD self-check mismatches reported
 
-	// DHT Lookup table for real decode
-	// Note: Component destination index is 1-based; first entry [0] is unused
-	int					m_anDhtTblSel       [MAX_DHT_CLASS][1+MAX_SOS_COMP_NS];					// DHT table selected for image component index (1..4)
-	unsigned			m_anHuffMaskLookup[32];
-	// Huffman lookup table for current scan
-	unsigned			m_anDhtLookupSetMax [MAX_DHT_CLASS];									// Highest DHT table index (ie. 0..3) per class
-	unsigned			m_anDhtLookupSize   [MAX_DHT_CLASS][MAX_DHT_DEST_ID];						// Number of entries in each lookup table
-	unsigned			m_anDhtLookup_bitlen[MAX_DHT_CLASS][MAX_DHT_DEST_ID][MAX_DHT_CODES];		// Number of compare bits in MSB
-	unsigned			m_anDhtLookup_bits  [MAX_DHT_CLASS][MAX_DHT_DEST_ID][MAX_DHT_CODES];		// Compare bits in MSB
-	unsigned			m_anDhtLookup_mask  [MAX_DHT_CLASS][MAX_DHT_DEST_ID][MAX_DHT_CODES];		// Mask of compare bits
-	unsigned			m_anDhtLookup_code  [MAX_DHT_CLASS][MAX_DHT_DEST_ID][MAX_DHT_CODES];		// Resulting code
-	unsigned			m_anDhtLookupfast   [MAX_DHT_CLASS][MAX_DHT_DEST_ID][2<<DHT_FAST_SIZE];	// Fast direct lookup for codes <= 10 bits
+	// Huffman code histograms of the current scan
 	unsigned			m_anDhtHisto        [MAX_DHT_CLASS][MAX_DHT_DEST_ID][MAX_DHT_CODELEN+1];
 	// Note: MAX_DHT_CODELEN is +1 because this array index is 1-based since there are no codes of length 0 bits
 
-	unsigned			m_nScanBuff;			// 32 bits of scan data after removing stuffs
+	ULONGLONG			m_nScanBuff;			// 64-bit reservoir of scan data after removing stuffs (MSB first)
 
-	unsigned			m_nScanBuff_vacant;		// Bits unused in LSB after shifting (add if >= 8)
+	unsigned			m_nScanBuffBits;		// Number of valid bits in reservoir (from MSB)
+	unsigned			m_nScanBuffOverBits;	// Number of bits requested beyond the end of reservoir (overread)
 	unsigned long		m_nScanBuffPtr;			// Next byte position to load
 	unsigned long		m_nScanBuffPtr_start;	// Saved first position of scan data (reset by RSTn markers)
 	unsigned long		m_nScanBuffPtr_first;	// Saved first position of scan data in file (not reset by RSTn markers). For comp ratio.
 
 	bool				m_nScanCurErr;			// Mark as soon as error occurs
-	unsigned			m_anScanBuffPtr_pos[4];	// File posn for each byte in buffer
-	unsigned			m_anScanBuffPtr_err[4];	// Does this byte have an error?
+	unsigned			m_nScanBuffLoadInd;		// Number of bytes loaded into reservoir (index of next byte)
+	unsigned			m_anScanBuffPos[SCANBUF_POS_RING];	// File posn for each loaded byte (ring, by load index)
+	unsigned			m_anScanBuffErrInd[SCANBUF_ERR_MAX];	// Load index of bytes with an error (not yet consumed)
+	unsigned			m_nScanBuffErrNum;		// Number of entries in m_anScanBuffErrInd[]
 	unsigned			m_nScanBuffLatchErr;
-	unsigned			m_nScanBuffPtr_num;		// Number of bytes in buffer
-	unsigned			m_nScanBuffPtr_align;	// Bit alignment in file for 1st byte in buffer
 	bool				m_bScanEnd;				// Reached end of scan segment?
 
 	bool				m_bRestartRead;			// Have we seen a restart marker?
@@ -642,6 +1083,17 @@ private:
 	bool				m_bVerbose;
 	unsigned			m_nWarnYccClipNum;
 	unsigned			m_nWarnBadScanNum;
+	bool				m_bScanIntervalOk;		// Worker range decoded cleanly (DecodeScanInterval)
+	ULONGLONG			m_nScanIntervalEndPos;	// Worker range end position (bits, for the MCU file map)
+	ScanPipeBatch*		m_psPipeBatch;			// Batch filled by the entropy stage (pipelined decode only)
+	int					m_nPipeIdctTbl;			// DQT table of the IDCT due on m_anDctBlock (-1 if none)
+	ScanPipe*			m_psPipe;				// Pipeline of the color stage worker (NULL otherwise)
+	unsigned			m_nBandMcuRows;			// Band decode: MCU rows per band (0 if the whole image is held)
+	unsigned			m_nBandPixY;			// Band decode: pixel map row at the top of the band
+	unsigned			m_nBandShift;			// Band decode: reduction of the preview pixel maps kept after decode
+	ScanCkpt*			m_psScanCkpt;			// Entropy decoder checkpoints (NULL if none)
+	unsigned			m_nScanCkptMcus;		// MCUs between checkpoints
+	unsigned			m_nScanCkptNum;			// Number of checkpoints allocated
 
 	unsigned			m_nScanBitsUsed1;
 	unsigned			m_nScanBitsUsed2;
@@ -0,0 +1,1512 @@
+// JPEGsnoop - JPEG Image Decoder & Analysis Utility
+// Copyright (C) 2017 - Calvin Hass
+// http://www.impulseadventure.com/photo/jpeg-snoop.html
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "stdafx.h"
+
+#include "ImgDecodeSimd.h"
+
+#include <limits.h>
+#include <math.h>
+#include <intrin.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+
+// Range that float IDCT outputs are limited to before conversion
+// - Keeps the float to int conversion defined for corrupt data
+#define SIMD_FLOAT_LIMIT	65536.0f
+
+// AAN IDCT constants
+#define AAN_C_SQRT2		1.414213562f
+#define AAN_C_Z5		1.847759065f
+#define AAN_C_Z12		1.082392200f
+#define AAN_C_Z10		-2.613125930f
+
+// Fixed point AAN IDCT constants
+#define IDCT_INT_FIX(x)		((int)((x)*(1<<IDCT_INT_CONST_BITS)+0.5))
+#define IDCT_INT_MUL(v,c)	((int)(((LONGLONG)(v)*(c)) >> IDCT_INT_CONST_BITS))
+
+// YCC to RGB constants for the YCC and YCCK conversions (fixed point, 14 bits)
+#define CMYK_FIX_SHIFT	14
+#define CMYK_FIX_ROUND	(1<<(CMYK_FIX_SHIFT-1))
+#define CMYK_FIX_CR_R	22970		// 1.402
+#define CMYK_FIX_CB_G	-5638		// -0.344136
+#define CMYK_FIX_CR_G	-11700		// -0.714136
+#define CMYK_FIX_CB_B	29032		// 1.772
+
+// YCC to RGB constants of the color statistics (CimgDecode::ConvertYCCtoRGB)
+#define STAT_CONST_RED		0.299f
+#define STAT_CONST_GREEN	0.587f
+#define STAT_CONST_BLUE		0.114f
+
+
+// ---------------------------------------
+// Scalar kernels (reference)
+// ---------------------------------------
+
+// Saturate to signed 16-bit
+static inline short Sat16(int nVal)
+{
+	if (nVal > 32767) {
+		return 32767;
+	} else if (nVal < -32768) {
+		return -32768;
+	}
+	return (short)nVal;
+}
+
+static void DequantFloatScalar(const short* pnCoef,const float* pfMult,float* pfBlock)
+{
+	for (unsigned nInd=0;nInd<64;nInd++) {
+		pfBlock[nInd] = pnCoef[nInd] * pfMult[nInd];
+	}
+}
+
+// Perform a one-dimensional AAN IDCT on 8 prescaled values in place
+// - Arai, Agui & Nakajima factorization (5 multiplies per 8 points)
+// - The SIMD versions must follow the same order of operations
+//
+// INPUT:
+// - pfVal					= Pointer to first value
+// - nStride				= Distance between values (1=row, 8=column)
+// OUTPUT:
+// - pfVal					= Results (x8 scaled)
+//
+static inline void IdctAanFloat1d(float* pfVal,unsigned nStride)
+{
+	float	fTmp0,fTmp1,fTmp2,fTmp3,fTmp4,fTmp5,fTmp6,fTmp7;
+	float	fTmp10,fTmp11,fTmp12,fTmp13;
+	float	fZ5,fZ10,fZ11,fZ12,fZ13;
+
+	// Even part
+	fTmp0 = pfVal[0*nStride];
+	fTmp1 = pfVal[2*nStride];
+	fTmp2 = pfVal[4*nStride];
+	fTmp3 = pfVal[6*nStride];
+
+	fTmp10 = fTmp0 + fTmp2;
+	fTmp11 = fTmp0 - fTmp2;
+	fTmp13 = fTmp1 + fTmp3;
+	fTmp12 = (fTmp1 - fTmp3) * AAN_C_SQRT2 - fTmp13;
+
+	fTmp0 = fTmp10 + fTmp13;
+	fTmp3 = fTmp10 - fTmp13;
+	fTmp1 = fTmp11 + fTmp12;
+	fTmp2 = fTmp11 - fTmp12;
+
+	// Odd part
+	fTmp4 = pfVal[1*nStride];
+	fTmp5 = pfVal[3*nStride];
+	fTmp6 = pfVal[5*nStride];
+	fTmp7 = pfVal[7*nStride];
+
+	fZ13 = fTmp6 + fTmp5;
+	fZ10 = fTmp6 - fTmp5;
+	fZ11 = fTmp4 + fTmp7;
+	fZ12 = fTmp4 - fTmp7;
+
+	fTmp7 = fZ11 + fZ13;
+	fTmp11 = (fZ11 - fZ13) * AAN_C_SQRT2;
+
+	fZ5 = (fZ10 + fZ12) * AAN_C_Z5;
+	fTmp10 = fZ12 * AAN_C_Z12 - fZ5;
+	fTmp12 = fZ10 * AAN_C_Z10 + fZ5;
+
+	fTmp6 = fTmp12 - fTmp7;
+	fTmp5 = fTmp11 - fTmp6;
+	fTmp4 = fTmp10 + fTmp5;
+
+	pfVal[0*nStride] = fTmp0 + fTmp7;
+	pfVal[7*nStride] = fTmp0 - fTmp7;
+	pfVal[1*nStride] = fTmp1 + fTmp6;
+	pfVal[6*nStride] = fTmp1 - fTmp6;
+	pfVal[2*nStride] = fTmp2 + fTmp5;
+	pfVal[5*nStride] = fTmp2 - fTmp5;
+	pfVal[4*nStride] = fTmp3 + fTmp4;
+	pfVal[3*nStride] = fTmp3 - fTmp4;
+}
+
+static void IdctFloatScalar(float* pfBlock)
+{
+	// Columns
+	// - All columns are transformed (without skipping the columns that
+	//   have no AC terms) so that the signs of zero results match the
+	//   SIMD kernels
+	for (unsigned nX=0;nX<8;nX++) {
+		IdctAanFloat1d(&pfBlock[nX],8);
+	}
+
+	// Rows
+	for (unsigned nY=0;nY<8;nY++) {
+		IdctAanFloat1d(&pfBlock[nY*8],1);
+	}
+}
+
+// Perform a one-dimensional AAN IDCT where only the first 2 or 4
+// inputs can be non-zero
+// - Same as IdctAanFloat1d() with the zero terms removed. Adding or
+//   subtracting the zero terms doesn't change the result so both
+//   produce the same values
+//
+// INPUT:
+// - pfVal					= Pointer to first value
+// - nStride				= Distance between values (1=row, 8=column)
+// OUTPUT:
+// - pfVal					= Results (x8 scaled), all 8 entries
+//
+static inline void IdctAanFloat1d2(float* pfVal,unsigned nStride)
+{
+	float	fTmp0,fTmp4,fTmp5,fTmp6,fTmp7;
+	float	fTmp10,fTmp11,fTmp12;
+	float	fZ5;
+
+	// Even part: only the DC term remains
+	fTmp0 = pfVal[0*nStride];
+
+	// Odd part: Z10 = Z13 = 0, Z11 = Z12 = input 1
+	fTmp4 = pfVal[1*nStride];
+
+	fTmp7 = fTmp4;
+	fTmp11 = fTmp4 * AAN_C_SQRT2;
+
+	fZ5 = fTmp4 * AAN_C_Z5;
+	fTmp10 = fTmp4 * AAN_C_Z12 - fZ5;
+	fTmp12 = fZ5;
+
+	fTmp6 = fTmp12 - fTmp7;
+	fTmp5 = fTmp11 - fTmp6;
+	fTmp4 = fTmp10 + fTmp5;
+
+	pfVal[0*nStride] = fTmp0 + fTmp7;
+	pfVal[7*nStride] = fTmp0 - fTmp7;
+	pfVal[1*nStride] = fTmp0 + fTmp6;
+	pfVal[6*nStride] = fTmp0 - fTmp6;
+	pfVal[2*nStride] = fTmp0 + fTmp5;
+	pfVal[5*nStride] = fTmp0 - fTmp5;
+	pfVal[4*nStride] = fTmp0 + fTmp4;
+	pfVal[3*nStride] = fTmp0 - fTmp4;
+}
+
+static inline void IdctAanFloat1d4(float* pfVal,unsigned nStride)
+{
+	float	fTmp0,fTmp1,fTmp2,fTmp3,fTmp4,fTmp5,fTmp6,fTmp7;
+	float	fTmp10,fTmp11,fTmp12,fTmp13;
+	float	fZ5,fZ10,fZ11,fZ12,fZ13;
+
+	// Even part: inputs 4 and 6 are zero
+	fTmp10 = pfVal[0*nStride];
+	fTmp13 = pfVal[2*nStride];
+	fTmp12 = fTmp13 * AAN_C_SQRT2 - fTmp13;
+
+	fTmp0 = fTmp10 + fTmp13;
+	fTmp3 = fTmp10 - fTmp13;
+	fTmp1 = fTmp10 + fTmp12;
+	fTmp2 = fTmp10 - fTmp12;
+
+	// Odd part: inputs 5 and 7 are zero
+	fZ11 = pfVal[1*nStride];
+	fZ13 = pfVal[3*nStride];
+	fZ10 = -fZ13;
+	fZ12 = fZ11;
+
+	fTmp7 = fZ11 + fZ13;
+	fTmp11 = (fZ11 - fZ13) * AAN_C_SQRT2;
+
+	fZ5 = (fZ10 + fZ12) * AAN_C_Z5;
+	fTmp10 = fZ12 * AAN_C_Z12 - fZ5;
+	fTmp12 = fZ10 * AAN_C_Z10 + fZ5;
+
+	fTmp6 = fTmp12 - fTmp7;
+	fTmp5 = fTmp11 - fTmp6;
+	fTmp4 = fTmp10 + fTmp5;
+
+	pfVal[0*nStride] = fTmp0 + fTmp7;
+	pfVal[7*nStride] = fTmp0 - fTmp7;
+	pfVal[1*nStride] = fTmp1 + fTmp6;
+	pfVal[6*nStride] = fTmp1 - fTmp6;
+	pfVal[2*nStride] = fTmp2 + fTmp5;
+	pfVal[5*nStride] = fTmp2 - fTmp5;
+	pfVal[4*nStride] = fTmp3 + fTmp4;
+	pfVal[3*nStride] = fTmp3 - fTmp4;
+}
+
+// Sparse IDCT kernels
+// - Only the top-left corner is dequantized. The remaining columns have
+//   no input so they stay zero after the column pass, and each row pass
+//   only has the corner columns as input
+// - These are cheaper than the full SIMD IDCT so they are shared by
+//   all SIMD levels
+//
+static void IdctFloat2x2Scalar(const short* pnCoef,const float* pfMult,float* pfBlock)
+{
+	memset(pfBlock,0,64*sizeof(float));
+	pfBlock[0*8+0] = pnCoef[0*8+0] * pfMult[0*8+0];
+	pfBlock[0*8+1] = pnCoef[0*8+1] * pfMult[0*8+1];
+	pfBlock[1*8+0] = pnCoef[1*8+0] * pfMult[1*8+0];
+	pfBlock[1*8+1] = pnCoef[1*8+1] * pfMult[1*8+1];
+
+	IdctAanFloat1d2(&pfBlock[0],8);
+	IdctAanFloat1d2(&pfBlock[1],8);
+	for (unsigned nY=0;nY<8;nY++) {
+		IdctAanFloat1d2(&pfBlock[nY*8],1);
+	}
+}
+
+static void IdctFloat4x4Scalar(const short* pnCoef,const float* pfMult,float* pfBlock)
+{
+	unsigned	nX,nY;
+
+	memset(pfBlock,0,64*sizeof(float));
+	for (nY=0;nY<4;nY++) {
+		for (nX=0;nX<4;nX++) {
+			pfBlock[nY*8+nX] = pnCoef[nY*8+nX] * pfMult[nY*8+nX];
+		}
+	}
+
+	for (nX=0;nX<4;nX++) {
+		IdctAanFloat1d4(&pfBlock[nX],8);
+	}
+	for (nY=0;nY<8;nY++) {
+		IdctAanFloat1d4(&pfBlock[nY*8],1);
+	}
+}
+
+// Perform a one-dimensional AAN IDCT on 8 prescaled values in place
+// - Fixed point version of IdctAanFloat1d()
+//
+// INPUT:
+// - pnVal					= Pointer to first value
+// - nStride				= Distance between values (1=row, 8=column)
+// OUTPUT:
+// - pnVal					= Results (x8 scaled)
+//
+static inline void IdctAanInt1d(int* pnVal,unsigned nStride)
+{
+	int		nTmp0,nTmp1,nTmp2,nTmp3,nTmp4,nTmp5,nTmp6,nTmp7;
+	int		nTmp10,nTmp11,nTmp12,nTmp13;
+	int		nZ5,nZ10,nZ11,nZ12,nZ13;
+
+	// Even part
+	nTmp0 = pnVal[0*nStride];
+	nTmp1 = pnVal[2*nStride];
+	nTmp2 = pnVal[4*nStride];
+	nTmp3 = pnVal[6*nStride];
+
+	nTmp10 = nTmp0 + nTmp2;
+	nTmp11 = nTmp0 - nTmp2;
+	nTmp13 = nTmp1 + nTmp3;
+	nTmp12 = IDCT_INT_MUL(nTmp1 - nTmp3, IDCT_INT_FIX(1.414213562)) - nTmp13;
+
+	nTmp0 = nTmp10 + nTmp13;
+	nTmp3 = nTmp10 - nTmp13;
+	nTmp1 = nTmp11 + nTmp12;
+	nTmp2 = nTmp11 - nTmp12;
+
+	// Odd part
+	nTmp4 = pnVal[1*nStride];
+	nTmp5 = pnVal[3*nStride];
+	nTmp6 = pnVal[5*nStride];
+	nTmp7 = pnVal[7*nStride];
+
+	nZ13 = nTmp6 + nTmp5;
+	nZ10 = nTmp6 - nTmp5;
+	nZ11 = nTmp4 + nTmp7;
+	nZ12 = nTmp4 - nTmp7;
+
+	nTmp7 = nZ11 + nZ13;
+	nTmp11 = IDCT_INT_MUL(nZ11 - nZ13, IDCT_INT_FIX(1.414213562));
+
+	nZ5 = IDCT_INT_MUL(nZ10 + nZ12, IDCT_INT_FIX(1.847759065));
+	nTmp10 = IDCT_INT_MUL(nZ12, IDCT_INT_FIX(1.082392200)) - nZ5;
+	nTmp12 = nZ5 - IDCT_INT_MUL(nZ10, IDCT_INT_FIX(2.613125930));
+
+	nTmp6 = nTmp12 - nTmp7;
+	nTmp5 = nTmp11 - nTmp6;
+	nTmp4 = nTmp10 + nTmp5;
+
+	pnVal[0*nStride] = nTmp0 + nTmp7;
+	pnVal[7*nStride] = nTmp0 - nTmp7;
+	pnVal[1*nStride] = nTmp1 + nTmp6;
+	pnVal[6*nStride] = nTmp1 - nTmp6;
+	pnVal[2*nStride] = nTmp2 + nTmp5;
+	pnVal[5*nStride] = nTmp2 - nTmp5;
+	pnVal[4*nStride] = nTmp3 + nTmp4;
+	pnVal[3*nStride] = nTmp3 - nTmp4;
+}
+
+static void IdctIntScalar(const short* pnCoef,const int* pnMult,int* pnBlock)
+{
+	unsigned	nX,nY,nInd;
+
+	// Dequantize and prescale
+	// - The multipliers carry extra fraction bits as the prescale factors
+	//   are small for high quality (low DQT value) coefficients
+	for (nInd=0;nInd<64;nInd++) {
+		pnBlock[nInd] = (int)(((LONGLONG)pnCoef[nInd] * pnMult[nInd] +
+			(1<<(IDCT_INT_DQT_BITS-1))) >> IDCT_INT_DQT_BITS);
+	}
+
+	// Columns
+	for (nX=0;nX<8;nX++) {
+		// Columns without any AC terms are constant
+		if ((pnCoef[1*8+nX] | pnCoef[2*8+nX] | pnCoef[3*8+nX] | pnCoef[4*8+nX] |
+			pnCoef[5*8+nX] | pnCoef[6*8+nX] | pnCoef[7*8+nX]) == 0) {
+			for (nY=1;nY<8;nY++) {
+				pnBlock[nY*8+nX] = pnBlock[nX];
+			}
+		} else {
+			IdctAanInt1d(&pnBlock[nX],8);
+		}
+	}
+
+	// Rows, then remove the fraction bits (with rounding)
+	for (nY=0;nY<8;nY++) {
+		IdctAanInt1d(&pnBlock[nY*8],1);
+	}
+	for (nInd=0;nInd<64;nInd++) {
+		pnBlock[nInd] = (pnBlock[nInd] + (1<<(IDCT_INT_MULT_BITS-1))) >> IDCT_INT_MULT_BITS;
+	}
+}
+
+static void LevelShiftFloatScalar(const float* pfBlock,short nDcOffset,short* pnPix)
+{
+	float	fVal;
+	for (unsigned nInd=0;nInd<64;nInd++) {
+		fVal = pfBlock[nInd];
+		fVal = (fVal < SIMD_FLOAT_LIMIT) ? fVal : SIMD_FLOAT_LIMIT;
+		fVal = (fVal > -SIMD_FLOAT_LIMIT) ? fVal : -SIMD_FLOAT_LIMIT;
+		pnPix[nInd] = Sat16(Sat16((int)fVal) + nDcOffset);
+	}
+}
+
+static void LevelShiftIntScalar(const int* pnBlock,short nDcOffset,short* pnPix)
+{
+	for (unsigned nInd=0;nInd<64;nInd++) {
+		pnPix[nInd] = Sat16(Sat16(pnBlock[nInd]) + nDcOffset);
+	}
+}
+
+// Saturate to 0..255
+static inline int Sat8(int nVal)
+{
+	return (nVal < 0) ? 0 : (nVal > 255) ? 255 : nVal;
+}
+
+// Product of two 0..255 values divided by 255 (rounded)
+static inline int MulDiv255(int nA,int nB)
+{
+	int nVal = nA * nB + 128;
+	return (nVal + (nVal >> 8)) >> 8;
+}
+
+static void CmykToRgbScalar(const short* pnC,const short* pnM,const short* pnY,const short* pnK,
+							bool bYcck,unsigned nShift,unsigned nNum,unsigned char* pnBgra)
+{
+	int		nC,nM,nY,nK;
+	int		nR,nG,nB;
+	for (unsigned nInd=0;nInd<nNum;nInd++) {
+		nC = Sat8((pnC[nInd] >> nShift) + 128);
+		nM = Sat8((pnM[nInd] >> nShift) + 128);
+		nY = Sat8((pnY[nInd] >> nShift) + 128);
+		nK = Sat8((pnK[nInd] >> nShift) + 128);
+		if (bYcck) {
+			// Y,Cb,Cr to "RGB" gives the CMY ink amounts, which are
+			// inverted to match the stored CMYK (as libjpeg does)
+			nM -= 128;
+			nY -= 128;
+			nR = 255 - Sat8(nC + ((CMYK_FIX_CR_R*nY + CMYK_FIX_ROUND) >> CMYK_FIX_SHIFT));
+			nG = 255 - Sat8(nC + ((CMYK_FIX_CB_G*nM + CMYK_FIX_CR_G*nY + CMYK_FIX_ROUND) >> CMYK_FIX_SHIFT));
+			nB = 255 - Sat8(nC + ((CMYK_FIX_CB_B*nM + CMYK_FIX_ROUND) >> CMYK_FIX_SHIFT));
+		} else {
+			nR = nC;
+			nG = nM;
+			nB = nY;
+		}
+		pnBgra[nInd*4+0] = (unsigned char)MulDiv255(nB,nK);
+		pnBgra[nInd*4+1] = (unsigned char)MulDiv255(nG,nK);
+		pnBgra[nInd*4+2] = (unsigned char)MulDiv255(nR,nK);
+		pnBgra[nInd*4+3] = 0;
+	}
+}
+
+// Saturate to -128..127
+static inline int SatS8(int nVal)
+{
+	return (nVal < -128) ? -128 : (nVal > 127) ? 127 : nVal;
+}
+
+static unsigned YccToRgbScalar(const short* pnY,const short* pnCb,const short* pnCr,bool bChromaHalf,
+							const short* pnOfs,unsigned nShift,const unsigned* pnSel,
+							unsigned nNum,unsigned char* pnBgra)
+{
+	int			anVal[YCC_OUT_NUM];
+	int			nY,nCb,nCr;
+	unsigned	nIndC;
+	unsigned	nSumY = 0;
+	for (unsigned nInd=0;nInd<nNum;nInd++) {
+		nIndC = (bChromaHalf) ? nInd/2 : nInd;
+		nY  = SatS8((pnY[nInd] + pnOfs[0]) >> nShift);
+		nCb = SatS8((pnCb[nIndC] + pnOfs[1]) >> nShift);
+		nCr = SatS8((pnCr[nIndC] + pnOfs[2]) >> nShift);
+		anVal[YCC_OUT_R] = Sat8(nY + 128 + ((CMYK_FIX_CR_R*nCr) >> CMYK_FIX_SHIFT));
+		anVal[YCC_OUT_G] = Sat8(nY + 128 + ((CMYK_FIX_CB_G*nCb + CMYK_FIX_CR_G*nCr) >> CMYK_FIX_SHIFT));
+		anVal[YCC_OUT_B] = Sat8(nY + 128 + ((CMYK_FIX_CB_B*nCb) >> CMYK_FIX_SHIFT));
+		anVal[YCC_OUT_Y]  = nY + 128;
+		anVal[YCC_OUT_CB] = nCb + 128;
+		anVal[YCC_OUT_CR] = nCr + 128;
+		nSumY += nY + 128;
+		pnBgra[nInd*4+0] = (unsigned char)anVal[pnSel[0]];
+		pnBgra[nInd*4+1] = (unsigned char)anVal[pnSel[1]];
+		pnBgra[nInd*4+2] = (unsigned char)anVal[pnSel[2]];
+		pnBgra[nInd*4+3] = 0;
+	}
+	return nSumY;
+}
+
+
+static void YccStatsScalar(const short* pnY,const short* pnCb,const short* pnCr,
+							const int* pnOfs,unsigned nPrecShift,unsigned nNum,YccStats* psStats)
+{
+	const float	fConstRed   = STAT_CONST_RED;
+	const float	fConstGreen = STAT_CONST_GREEN;
+	const float	fConstBlue  = STAT_CONST_BLUE;
+	int			nRangeOfs = 1024<<nPrecShift;
+	int			nRangeDiv = 8<<nPrecShift;
+	int			anVal[YCC_STAT_NUM];
+	float		fValY,fValCb,fValCr;
+	float		fValR,fValG,fValB;
+	int			nHisto;
+	for (unsigned nInd=0;nInd<nNum;nInd++) {
+		anVal[YCC_STAT_PRE_Y]  = pnY[nInd] + pnOfs[0];
+		anVal[YCC_STAT_PRE_CB] = pnCb[nInd] + pnOfs[1];
+		anVal[YCC_STAT_PRE_CR] = pnCr[nInd] + pnOfs[2];
+		anVal[YCC_STAT_Y]  = (anVal[YCC_STAT_PRE_Y] + nRangeOfs) / nRangeDiv;
+		anVal[YCC_STAT_CB] = (anVal[YCC_STAT_PRE_CB] + nRangeOfs) / nRangeDiv;
+		anVal[YCC_STAT_CR] = (anVal[YCC_STAT_PRE_CR] + nRangeOfs) / nRangeDiv;
+
+		// Same operations as the float conversion of ConvertYCCtoRGB
+		fValY  = (float)(Sat8(anVal[YCC_STAT_Y]) - 128);
+		fValCb = (float)(Sat8(anVal[YCC_STAT_CB]) - 128);
+		fValCr = (float)(Sat8(anVal[YCC_STAT_CR]) - 128);
+		fValR = fValCr*(2-2*fConstRed)+fValY;
+		fValB = fValCb*(2-2*fConstBlue)+fValY;
+		fValG = (fValY-fConstBlue*fValB-fConstRed*fValR)/fConstGreen;
+		anVal[YCC_STAT_PRE_R] = (int)(fValR + 128);
+		anVal[YCC_STAT_PRE_G] = (int)(fValG + 128);
+		anVal[YCC_STAT_PRE_B] = (int)(fValB + 128);
+		anVal[YCC_STAT_R] = Sat8(anVal[YCC_STAT_PRE_R]);
+		anVal[YCC_STAT_G] = Sat8(anVal[YCC_STAT_PRE_G]);
+		anVal[YCC_STAT_B] = Sat8(anVal[YCC_STAT_PRE_B]);
+
+		for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+			psStats->anMin[nStat] = (anVal[nStat] < psStats->anMin[nStat]) ? anVal[nStat] : psStats->anMin[nStat];
+			psStats->anMax[nStat] = (anVal[nStat] > psStats->anMax[nStat]) ? anVal[nStat] : psStats->anMax[nStat];
+			psStats->anSum[nStat] += (unsigned)anVal[nStat];
+		}
+		for (unsigned nChan=0;nChan<3;nChan++) {
+			psStats->anUnder[YCC_STAT_Y+nChan] += (anVal[YCC_STAT_Y+nChan] < 0);
+			psStats->anOver[YCC_STAT_Y+nChan]  += (anVal[YCC_STAT_Y+nChan] > 255);
+			psStats->anUnder[YCC_STAT_R+nChan] += (anVal[YCC_STAT_PRE_R+nChan] < 0);
+			psStats->anOver[YCC_STAT_R+nChan]  += (anVal[YCC_STAT_PRE_R+nChan] > 255);
+		}
+		psStats->nCount++;
+
+		nHisto = anVal[YCC_STAT_PRE_Y] >> nPrecShift;
+		nHisto = (nHisto < -1024) ? -1024 : (nHisto > 1023) ? 1023 : nHisto;
+		psStats->anHistoY[nHisto+1024]++;
+		psStats->anHistoR[anVal[YCC_STAT_R]/(256/YCC_STAT_HISTO_BINS)]++;
+		psStats->anHistoG[anVal[YCC_STAT_G]/(256/YCC_STAT_HISTO_BINS)]++;
+		psStats->anHistoB[anVal[YCC_STAT_B]/(256/YCC_STAT_HISTO_BINS)]++;
+	}
+}
+
+
+// ---------------------------------------
+// SSE2 kernels
+// ---------------------------------------
+
+static void DequantFloatSse2(const short* pnCoef,const float* pfMult,float* pfBlock)
+{
+	__m128i	nCoef,nLo,nHi;
+	for (unsigned nInd=0;nInd<64;nInd+=8) {
+		// Sign-extend 8 coefficients to 32-bit
+		nCoef = _mm_loadu_si128((const __m128i*)&pnCoef[nInd]);
+		nLo = _mm_srai_epi32(_mm_unpacklo_epi16(nCoef,nCoef),16);
+		nHi = _mm_srai_epi32(_mm_unpackhi_epi16(nCoef,nCoef),16);
+		_mm_storeu_ps(&pfBlock[nInd+0],_mm_mul_ps(_mm_cvtepi32_ps(nLo),_mm_loadu_ps(&pfMult[nInd+0])));
+		_mm_storeu_ps(&pfBlock[nInd+4],_mm_mul_ps(_mm_cvtepi32_ps(nHi),_mm_loadu_ps(&pfMult[nInd+4])));
+	}
+}
+
+// One-dimensional AAN IDCT on 4 columns at once
+// - See IdctAanFloat1d()
+//
+// INPUT:
+// - pV						= 8 vectors, each holding the same row of 4 columns
+//
+static inline void IdctAanSse2(__m128* pV)
+{
+	__m128	fTmp0,fTmp1,fTmp2,fTmp3,fTmp4,fTmp5,fTmp6,fTmp7;
+	__m128	fTmp10,fTmp11,fTmp12,fTmp13;
+	__m128	fZ5,fZ10,fZ11,fZ12,fZ13;
+
+	// Even part
+	fTmp10 = _mm_add_ps(pV[0],pV[4]);
+	fTmp11 = _mm_sub_ps(pV[0],pV[4]);
+	fTmp13 = _mm_add_ps(pV[2],pV[6]);
+	fTmp12 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(pV[2],pV[6]),_mm_set1_ps(AAN_C_SQRT2)),fTmp13);
+
+	fTmp0 = _mm_add_ps(fTmp10,fTmp13);
+	fTmp3 = _mm_sub_ps(fTmp10,fTmp13);
+	fTmp1 = _mm_add_ps(fTmp11,fTmp12);
+	fTmp2 = _mm_sub_ps(fTmp11,fTmp12);
+
+	// Odd part
+	fZ13 = _mm_add_ps(pV[5],pV[3]);
+	fZ10 = _mm_sub_ps(pV[5],pV[3]);
+	fZ11 = _mm_add_ps(pV[1],pV[7]);
+	fZ12 = _mm_sub_ps(pV[1],pV[7]);
+
+	fTmp7 = _mm_add_ps(fZ11,fZ13);
+	fTmp11 = _mm_mul_ps(_mm_sub_ps(fZ11,fZ13),_mm_set1_ps(AAN_C_SQRT2));
+
+	fZ5 = _mm_mul_ps(_mm_add_ps(fZ10,fZ12),_mm_set1_ps(AAN_C_Z5));
+	fTmp10 = _mm_sub_ps(_mm_mul_ps(fZ12,_mm_set1_ps(AAN_C_Z12)),fZ5);
+	fTmp12 = _mm_add_ps(_mm_mul_ps(fZ10,_mm_set1_ps(AAN_C_Z10)),fZ5);
+
+	fTmp6 = _mm_sub_ps(fTmp12,fTmp7);
+	fTmp5 = _mm_sub_ps(fTmp11,fTmp6);
+	fTmp4 = _mm_add_ps(fTmp10,fTmp5);
+
+	pV[0] = _mm_add_ps(fTmp0,fTmp7);
+	pV[7] = _mm_sub_ps(fTmp0,fTmp7);
+	pV[1] = _mm_add_ps(fTmp1,fTmp6);
+	pV[6] = _mm_sub_ps(fTmp1,fTmp6);
+	pV[2] = _mm_add_ps(fTmp2,fTmp5);
+	pV[5] = _mm_sub_ps(fTmp2,fTmp5);
+	pV[4] = _mm_add_ps(fTmp3,fTmp4);
+	pV[3] = _mm_sub_ps(fTmp3,fTmp4);
+}
+
+// Transpose an 8x8 block held as left (columns 0..3) and right (columns 4..7) halves
+static inline void TransposeSse2(__m128* pL,__m128* pR)
+{
+	__m128	fTmp;
+	_MM_TRANSPOSE4_PS(pL[0],pL[1],pL[2],pL[3]);
+	_MM_TRANSPOSE4_PS(pR[0],pR[1],pR[2],pR[3]);
+	_MM_TRANSPOSE4_PS(pL[4],pL[5],pL[6],pL[7]);
+	_MM_TRANSPOSE4_PS(pR[4],pR[5],pR[6],pR[7]);
+	// Swap the off-diagonal quadrants
+	for (unsigned nInd=0;nInd<4;nInd++) {
+		fTmp = pR[nInd];
+		pR[nInd] = pL[nInd+4];
+		pL[nInd+4] = fTmp;
+	}
+}
+
+static void IdctFloatSse2(float* pfBlock)
+{
+	__m128	afL[8],afR[8];
+	unsigned	nY;
+
+	for (nY=0;nY<8;nY++) {
+		afL[nY] = _mm_loadu_ps(&pfBlock[nY*8+0]);
+		afR[nY] = _mm_loadu_ps(&pfBlock[nY*8+4]);
+	}
+
+	// Columns
+	IdctAanSse2(afL);
+	IdctAanSse2(afR);
+
+	// Rows (as columns of the transposed block)
+	TransposeSse2(afL,afR);
+	IdctAanSse2(afL);
+	IdctAanSse2(afR);
+	TransposeSse2(afL,afR);
+
+	for (nY=0;nY<8;nY++) {
+		_mm_storeu_ps(&pfBlock[nY*8+0],afL[nY]);
+		_mm_storeu_ps(&pfBlock[nY*8+4],afR[nY]);
+	}
+}
+
+static void LevelShiftFloatSse2(const float* pfBlock,short nDcOffset,short* pnPix)
+{
+	__m128	fMax = _mm_set1_ps(SIMD_FLOAT_LIMIT);
+	__m128	fMin = _mm_set1_ps(-SIMD_FLOAT_LIMIT);
+	__m128i	nDc = _mm_set1_epi16(nDcOffset);
+	__m128i	nLo,nHi;
+	for (unsigned nInd=0;nInd<64;nInd+=8) {
+		nLo = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(&pfBlock[nInd+0]),fMax),fMin));
+		nHi = _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(&pfBlock[nInd+4]),fMax),fMin));
+		_mm_storeu_si128((__m128i*)&pnPix[nInd],_mm_adds_epi16(_mm_packs_epi32(nLo,nHi),nDc));
+	}
+}
+
+static void LevelShiftIntSse2(const int* pnBlock,short nDcOffset,short* pnPix)
+{
+	__m128i	nDc = _mm_set1_epi16(nDcOffset);
+	__m128i	nLo,nHi;
+	for (unsigned nInd=0;nInd<64;nInd+=8) {
+		nLo = _mm_loadu_si128((const __m128i*)&pnBlock[nInd+0]);
+		nHi = _mm_loadu_si128((const __m128i*)&pnBlock[nInd+4]);
+		_mm_storeu_si128((__m128i*)&pnPix[nInd],_mm_adds_epi16(_mm_packs_epi32(nLo,nHi),nDc));
+	}
+}
+
+// Range 8 pixel map values to samples 0..255 (see CmykToRgbScalar)
+static inline __m128i CmykSampleSse2(const short* pnVal,__m128i nShift)
+{
+	__m128i	nVal = _mm_sra_epi16(_mm_loadu_si128((const __m128i*)pnVal),nShift);
+	nVal = _mm_add_epi16(nVal,_mm_set1_epi16(128));
+	return _mm_max_epi16(_mm_min_epi16(nVal,_mm_set1_epi16(255)),_mm_setzero_si128());
+}
+
+// Fixed point product of 16-bit pairs, shifted back to 16-bit
+// - Each pair (nA[i],nB[i]) is multiplied by (nMultA,nMultB) and summed
+static inline __m128i CmykMaddSse2(__m128i nA,__m128i nB,short nMultA,short nMultB,int nRound)
+{
+	__m128i	nMult = _mm_set1_epi32((nMultB << 16) | (nMultA & 0xFFFF));
+	__m128i	nLo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(nA,nB),nMult),_mm_set1_epi32(nRound));
+	__m128i	nHi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(nA,nB),nMult),_mm_set1_epi32(nRound));
+	return _mm_packs_epi32(_mm_srai_epi32(nLo,CMYK_FIX_SHIFT),_mm_srai_epi32(nHi,CMYK_FIX_SHIFT));
+}
+
+// Product of 0..255 values divided by 255 (see MulDiv255)
+// - The product fits in an unsigned 16-bit lane
+static inline __m128i CmykMulDiv255Sse2(__m128i nA,__m128i nB)
+{
+	__m128i	nVal = _mm_add_epi16(_mm_mullo_epi16(nA,nB),_mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(nVal,_mm_srli_epi16(nVal,8)),8);
+}
+
+static void CmykToRgbSse2(const short* pnC,const short* pnM,const short* pnY,const short* pnK,
+							bool bYcck,unsigned nShift,unsigned nNum,unsigned char* pnBgra)
+{
+	__m128i	nZero = _mm_setzero_si128();
+	__m128i	nMax = _mm_set1_epi16(255);
+	__m128i	nOfs = _mm_set1_epi16(128);
+	__m128i	nShiftCnt = _mm_cvtsi32_si128(nShift);
+	__m128i	nC,nM,nY,nK;
+	__m128i	nR,nG,nB,nBg;
+	unsigned	nInd;
+	for (nInd=0;nInd+8<=nNum;nInd+=8) {
+		nC = CmykSampleSse2(&pnC[nInd],nShiftCnt);
+		nM = CmykSampleSse2(&pnM[nInd],nShiftCnt);
+		nY = CmykSampleSse2(&pnY[nInd],nShiftCnt);
+		nK = CmykSampleSse2(&pnK[nInd],nShiftCnt);
+		if (bYcck) {
+			nM = _mm_sub_epi16(nM,nOfs);
+			nY = _mm_sub_epi16(nY,nOfs);
+			nR = _mm_add_epi16(nC,CmykMaddSse2(nY,nZero,CMYK_FIX_CR_R,0,CMYK_FIX_ROUND));
+			nG = _mm_add_epi16(nC,CmykMaddSse2(nM,nY,CMYK_FIX_CB_G,CMYK_FIX_CR_G,CMYK_FIX_ROUND));
+			nB = _mm_add_epi16(nC,CmykMaddSse2(nM,nZero,CMYK_FIX_CB_B,0,CMYK_FIX_ROUND));
+			nR = _mm_sub_epi16(nMax,_mm_max_epi16(_mm_min_epi16(nR,nMax),nZero));
+			nG = _mm_sub_epi16(nMax,_mm_max_epi16(_mm_min_epi16(nG,nMax),nZero));
+			nB = _mm_sub_epi16(nMax,_mm_max_epi16(_mm_min_epi16(nB,nMax),nZero));
+		} else {
+			nR = nC;
+			nG = nM;
+			nB = nY;
+		}
+		nR = CmykMulDiv255Sse2(nR,nK);
+		nG = CmykMulDiv255Sse2(nG,nK);
+		nB = CmykMulDiv255Sse2(nB,nK);
+		// Interleave to [B,G,R,0]
+		nBg = _mm_or_si128(nB,_mm_slli_epi16(nG,8));
+		_mm_storeu_si128((__m128i*)&pnBgra[nInd*4+0], _mm_unpacklo_epi16(nBg,nR));
+		_mm_storeu_si128((__m128i*)&pnBgra[nInd*4+16],_mm_unpackhi_epi16(nBg,nR));
+	}
+	CmykToRgbScalar(&pnC[nInd],&pnM[nInd],&pnY[nInd],&pnK[nInd],bYcck,nShift,nNum-nInd,&pnBgra[nInd*4]);
+}
+
+// Offset and range 8 pixel map values to -128..127 (see YccToRgbScalar)
+static inline __m128i YccSampleSse2(__m128i nVal,short nOfs,__m128i nShift)
+{
+	nVal = _mm_sra_epi16(_mm_adds_epi16(nVal,_mm_set1_epi16(nOfs)),nShift);
+	return _mm_max_epi16(_mm_min_epi16(nVal,_mm_set1_epi16(127)),_mm_set1_epi16(-128));
+}
+
+// Load 8 chroma values, repeating each one for two pixels if bHalf
+static inline __m128i YccChromaSse2(const short* pnVal,bool bHalf)
+{
+	if (bHalf) {
+		__m128i	nVal = _mm_loadl_epi64((const __m128i*)pnVal);
+		return _mm_unpacklo_epi16(nVal,nVal);
+	}
+	return _mm_loadu_si128((const __m128i*)pnVal);
+}
+
+static unsigned YccToRgbSse2(const short* pnY,const short* pnCb,const short* pnCr,bool bChromaHalf,
+							const short* pnOfs,unsigned nShift,const unsigned* pnSel,
+							unsigned nNum,unsigned char* pnBgra)
+{
+	__m128i	nZero = _mm_setzero_si128();
+	__m128i	nMax = _mm_set1_epi16(255);
+	__m128i	nOfs = _mm_set1_epi16(128);
+	__m128i	nOne = _mm_set1_epi16(1);
+	__m128i	nShiftCnt = _mm_cvtsi32_si128(nShift);
+	__m128i	nSumAcc = _mm_setzero_si128();
+	__m128i	nY,nCb,nCr,nBg;
+	__m128i	anVal[YCC_OUT_NUM];
+	unsigned	nInd;
+	unsigned	nIndC;
+	for (nInd=0;nInd+8<=nNum;nInd+=8) {
+		nIndC = (bChromaHalf) ? nInd/2 : nInd;
+		nY  = YccSampleSse2(_mm_loadu_si128((const __m128i*)&pnY[nInd]),pnOfs[0],nShiftCnt);
+		nCb = YccSampleSse2(YccChromaSse2(&pnCb[nIndC],bChromaHalf),pnOfs[1],nShiftCnt);
+		nCr = YccSampleSse2(YccChromaSse2(&pnCr[nIndC],bChromaHalf),pnOfs[2],nShiftCnt);
+		anVal[YCC_OUT_Y]  = _mm_add_epi16(nY,nOfs);
+		anVal[YCC_OUT_CB] = _mm_add_epi16(nCb,nOfs);
+		anVal[YCC_OUT_CR] = _mm_add_epi16(nCr,nOfs);
+		anVal[YCC_OUT_R] = _mm_add_epi16(anVal[YCC_OUT_Y],CmykMaddSse2(nCr,nZero,CMYK_FIX_CR_R,0,0));
+		anVal[YCC_OUT_G] = _mm_add_epi16(anVal[YCC_OUT_Y],CmykMaddSse2(nCb,nCr,CMYK_FIX_CB_G,CMYK_FIX_CR_G,0));
+		anVal[YCC_OUT_B] = _mm_add_epi16(anVal[YCC_OUT_Y],CmykMaddSse2(nCb,nZero,CMYK_FIX_CB_B,0,0));
+		anVal[YCC_OUT_R] = _mm_max_epi16(_mm_min_epi16(anVal[YCC_OUT_R],nMax),nZero);
+		anVal[YCC_OUT_G] = _mm_max_epi16(_mm_min_epi16(anVal[YCC_OUT_G],nMax),nZero);
+		anVal[YCC_OUT_B] = _mm_max_epi16(_mm_min_epi16(anVal[YCC_OUT_B],nMax),nZero);
+		nSumAcc = _mm_add_epi32(nSumAcc,_mm_madd_epi16(anVal[YCC_OUT_Y],nOne));
+		// Interleave to [B,G,R,0]
+		nBg = _mm_or_si128(anVal[pnSel[0]],_mm_slli_epi16(anVal[pnSel[1]],8));
+		_mm_storeu_si128((__m128i*)&pnBgra[nInd*4+0], _mm_unpacklo_epi16(nBg,anVal[pnSel[2]]));
+		_mm_storeu_si128((__m128i*)&pnBgra[nInd*4+16],_mm_unpackhi_epi16(nBg,anVal[pnSel[2]]));
+	}
+	nSumAcc = _mm_add_epi32(nSumAcc,_mm_srli_si128(nSumAcc,8));
+	nSumAcc = _mm_add_epi32(nSumAcc,_mm_srli_si128(nSumAcc,4));
+	nIndC = (bChromaHalf) ? nInd/2 : nInd;
+	return (unsigned)_mm_cvtsi128_si32(nSumAcc) +
+		YccToRgbScalar(&pnY[nInd],&pnCb[nIndC],&pnCr[nIndC],bChromaHalf,pnOfs,nShift,pnSel,nNum-nInd,&pnBgra[nInd*4]);
+}
+
+
+// 32-bit min / max (_mm_min_epi32 / _mm_max_epi32 need SSE4.1)
+static inline __m128i MinEpi32Sse2(__m128i nA,__m128i nB)
+{
+	__m128i	nGt = _mm_cmpgt_epi32(nA,nB);
+	return _mm_or_si128(_mm_and_si128(nGt,nB),_mm_andnot_si128(nGt,nA));
+}
+
+static inline __m128i MaxEpi32Sse2(__m128i nA,__m128i nB)
+{
+	__m128i	nGt = _mm_cmpgt_epi32(nA,nB);
+	return _mm_or_si128(_mm_and_si128(nGt,nA),_mm_andnot_si128(nGt,nB));
+}
+
+// Load 4 samples sign-extended to 32-bit
+static inline __m128i LoadEpi16Sse2(const short* pnVal)
+{
+	__m128i	nVal = _mm_loadl_epi64((const __m128i*)pnVal);
+	return _mm_srai_epi32(_mm_unpacklo_epi16(nVal,nVal),16);
+}
+
+// Divide by (nDivM1+1) = 1<<nShift, truncating towards zero as in C
+static inline __m128i DivTruncSse2(__m128i nVal,__m128i nShift,__m128i nDivM1)
+{
+	return _mm_sra_epi32(_mm_add_epi32(nVal,_mm_and_si128(_mm_srai_epi32(nVal,31),nDivM1)),nShift);
+}
+
+// Fold the vector statistics into psStats (see YccStatsSse2 and YccStatsAvx2)
+static void YccStatsFold(const int* pnMin,const int* pnMax,const unsigned* pnSum,
+							const unsigned* pnUnder,const unsigned* pnOver,unsigned nLanes,YccStats* psStats)
+{
+	for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+		for (unsigned nLane=0;nLane<nLanes;nLane++) {
+			unsigned nInd = nStat*nLanes + nLane;
+			psStats->anMin[nStat] = (pnMin[nInd] < psStats->anMin[nStat]) ? pnMin[nInd] : psStats->anMin[nStat];
+			psStats->anMax[nStat] = (pnMax[nInd] > psStats->anMax[nStat]) ? pnMax[nInd] : psStats->anMax[nStat];
+			psStats->anSum[nStat] += pnSum[nInd];
+			psStats->anUnder[nStat] += pnUnder[nInd];
+			psStats->anOver[nStat] += pnOver[nInd];
+		}
+	}
+}
+
+static void YccStatsSse2(const short* pnY,const short* pnCb,const short* pnCr,
+							const int* pnOfs,unsigned nPrecShift,unsigned nNum,YccStats* psStats)
+{
+	const float	fConstRed   = STAT_CONST_RED;
+	const float	fConstGreen = STAT_CONST_GREEN;
+	const float	fConstBlue  = STAT_CONST_BLUE;
+	__m128i	nZero = _mm_setzero_si128();
+	__m128i	nMax = _mm_set1_epi32(255);
+	__m128i	nLevel = _mm_set1_epi32(128);
+	__m128i	nRangeOfs = _mm_set1_epi32(1024<<nPrecShift);
+	__m128i	nRangeDivM1 = _mm_set1_epi32((8<<nPrecShift)-1);
+	__m128i	nRangeShift = _mm_cvtsi32_si128(3+nPrecShift);
+	__m128i	nPrecCnt = _mm_cvtsi32_si128(nPrecShift);
+	__m128i	nHistoMin = _mm_set1_epi32(-1024);
+	__m128i	nHistoMax = _mm_set1_epi32(1023);
+	__m128	fMultR = _mm_set1_ps(2-2*fConstRed);
+	__m128	fMultB = _mm_set1_ps(2-2*fConstBlue);
+	__m128	fRed = _mm_set1_ps(fConstRed);
+	__m128	fGreen = _mm_set1_ps(fConstGreen);
+	__m128	fBlue = _mm_set1_ps(fConstBlue);
+	__m128	fLevel = _mm_set1_ps(128);
+	__m128	fY,fCb,fCr,fR,fG,fB;
+	__m128i	anVal[YCC_STAT_NUM];
+	__m128i	anMin[YCC_STAT_NUM];
+	__m128i	anMax[YCC_STAT_NUM];
+	__m128i	anSum[YCC_STAT_NUM];
+	__m128i	anUnder[YCC_STAT_NUM];
+	__m128i	anOver[YCC_STAT_NUM];
+	int		anHisto[4][4];
+	unsigned	nInd;
+	for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+		anMin[nStat] = _mm_set1_epi32(INT_MAX);
+		anMax[nStat] = _mm_set1_epi32(INT_MIN);
+		anSum[nStat] = nZero;
+		anUnder[nStat] = nZero;
+		anOver[nStat] = nZero;
+	}
+	for (nInd=0;nInd+4<=nNum;nInd+=4) {
+		anVal[YCC_STAT_PRE_Y]  = _mm_add_epi32(LoadEpi16Sse2(&pnY[nInd]),_mm_set1_epi32(pnOfs[0]));
+		anVal[YCC_STAT_PRE_CB] = _mm_add_epi32(LoadEpi16Sse2(&pnCb[nInd]),_mm_set1_epi32(pnOfs[1]));
+		anVal[YCC_STAT_PRE_CR] = _mm_add_epi32(LoadEpi16Sse2(&pnCr[nInd]),_mm_set1_epi32(pnOfs[2]));
+		anVal[YCC_STAT_Y]  = DivTruncSse2(_mm_add_epi32(anVal[YCC_STAT_PRE_Y],nRangeOfs),nRangeShift,nRangeDivM1);
+		anVal[YCC_STAT_CB] = DivTruncSse2(_mm_add_epi32(anVal[YCC_STAT_PRE_CB],nRangeOfs),nRangeShift,nRangeDivM1);
+		anVal[YCC_STAT_CR] = DivTruncSse2(_mm_add_epi32(anVal[YCC_STAT_PRE_CR],nRangeOfs),nRangeShift,nRangeDivM1);
+
+		fY  = _mm_cvtepi32_ps(_mm_sub_epi32(MaxEpi32Sse2(MinEpi32Sse2(anVal[YCC_STAT_Y],nMax),nZero),nLevel));
+		fCb = _mm_cvtepi32_ps(_mm_sub_epi32(MaxEpi32Sse2(MinEpi32Sse2(anVal[YCC_STAT_CB],nMax),nZero),nLevel));
+		fCr = _mm_cvtepi32_ps(_mm_sub_epi32(MaxEpi32Sse2(MinEpi32Sse2(anVal[YCC_STAT_CR],nMax),nZero),nLevel));
+		fR = _mm_add_ps(_mm_mul_ps(fCr,fMultR),fY);
+		fB = _mm_add_ps(_mm_mul_ps(fCb,fMultB),fY);
+		fG = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(fY,_mm_mul_ps(fBlue,fB)),_mm_mul_ps(fRed,fR)),fGreen);
+		anVal[YCC_STAT_PRE_R] = _mm_cvttps_epi32(_mm_add_ps(fR,fLevel));
+		anVal[YCC_STAT_PRE_G] = _mm_cvttps_epi32(_mm_add_ps(fG,fLevel));
+		anVal[YCC_STAT_PRE_B] = _mm_cvttps_epi32(_mm_add_ps(fB,fLevel));
+		anVal[YCC_STAT_R] = MaxEpi32Sse2(MinEpi32Sse2(anVal[YCC_STAT_PRE_R],nMax),nZero);
+		anVal[YCC_STAT_G] = MaxEpi32Sse2(MinEpi32Sse2(anVal[YCC_STAT_PRE_G],nMax),nZero);
+		anVal[YCC_STAT_B] = MaxEpi32Sse2(MinEpi32Sse2(anVal[YCC_STAT_PRE_B],nMax),nZero);
+
+		for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+			anMin[nStat] = MinEpi32Sse2(anMin[nStat],anVal[nStat]);
+			anMax[nStat] = MaxEpi32Sse2(anMax[nStat],anVal[nStat]);
+			anSum[nStat] = _mm_add_epi32(anSum[nStat],anVal[nStat]);
+		}
+		// The compare masks are -1 for each clipped sample
+		for (unsigned nChan=0;nChan<3;nChan++) {
+			anUnder[YCC_STAT_Y+nChan] = _mm_sub_epi32(anUnder[YCC_STAT_Y+nChan],_mm_cmplt_epi32(anVal[YCC_STAT_Y+nChan],nZero));
+			anOver[YCC_STAT_Y+nChan]  = _mm_sub_epi32(anOver[YCC_STAT_Y+nChan],_mm_cmpgt_epi32(anVal[YCC_STAT_Y+nChan],nMax));
+			anUnder[YCC_STAT_R+nChan] = _mm_sub_epi32(anUnder[YCC_STAT_R+nChan],_mm_cmplt_epi32(anVal[YCC_STAT_PRE_R+nChan],nZero));
+			anOver[YCC_STAT_R+nChan]  = _mm_sub_epi32(anOver[YCC_STAT_R+nChan],_mm_cmpgt_epi32(anVal[YCC_STAT_PRE_R+nChan],nMax));
+		}
+
+		// Histogram bins are updated one sample at a time
+		_mm_storeu_si128((__m128i*)anHisto[0],MaxEpi32Sse2(MinEpi32Sse2(
+			_mm_sra_epi32(anVal[YCC_STAT_PRE_Y],nPrecCnt),nHistoMax),nHistoMin));
+		_mm_storeu_si128((__m128i*)anHisto[1],anVal[YCC_STAT_R]);
+		_mm_storeu_si128((__m128i*)anHisto[2],anVal[YCC_STAT_G]);
+		_mm_storeu_si128((__m128i*)anHisto[3],anVal[YCC_STAT_B]);
+		for (unsigned nLane=0;nLane<4;nLane++) {
+			psStats->anHistoY[anHisto[0][nLane]+1024]++;
+			psStats->anHistoR[anHisto[1][nLane]/(256/YCC_STAT_HISTO_BINS)]++;
+			psStats->anHistoG[anHisto[2][nLane]/(256/YCC_STAT_HISTO_BINS)]++;
+			psStats->anHistoB[anHisto[3][nLane]/(256/YCC_STAT_HISTO_BINS)]++;
+		}
+	}
+
+	int			anMinLane[YCC_STAT_NUM*4];
+	int			anMaxLane[YCC_STAT_NUM*4];
+	unsigned	anSumLane[YCC_STAT_NUM*4];
+	unsigned	anUnderLane[YCC_STAT_NUM*4];
+	unsigned	anOverLane[YCC_STAT_NUM*4];
+	for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+		_mm_storeu_si128((__m128i*)&anMinLane[nStat*4],anMin[nStat]);
+		_mm_storeu_si128((__m128i*)&anMaxLane[nStat*4],anMax[nStat]);
+		_mm_storeu_si128((__m128i*)&anSumLane[nStat*4],anSum[nStat]);
+		_mm_storeu_si128((__m128i*)&anUnderLane[nStat*4],anUnder[nStat]);
+		_mm_storeu_si128((__m128i*)&anOverLane[nStat*4],anOver[nStat]);
+	}
+	YccStatsFold(anMinLane,anMaxLane,anSumLane,anUnderLane,anOverLane,4,psStats);
+	psStats->nCount += nInd;
+	YccStatsScalar(&pnY[nInd],&pnCb[nInd],&pnCr[nInd],pnOfs,nPrecShift,nNum-nInd,psStats);
+}
+
+
+// ---------------------------------------
+// AVX2 kernels
+// - Each kernel ends with _mm256_zeroupper() to avoid the
+//   AVX to SSE transition penalty in the (non-VEX) caller
+// ---------------------------------------
+
+static void DequantFloatAvx2(const short* pnCoef,const float* pfMult,float* pfBlock)
+{
+	__m256i	nCoef;
+	for (unsigned nInd=0;nInd<64;nInd+=8) {
+		nCoef = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&pnCoef[nInd]));
+		_mm256_storeu_ps(&pfBlock[nInd],_mm256_mul_ps(_mm256_cvtepi32_ps(nCoef),_mm256_loadu_ps(&pfMult[nInd])));
+	}
+	_mm256_zeroupper();
+}
+
+// One-dimensional AAN IDCT on 8 columns at once
+// - See IdctAanFloat1d()
+//
+// INPUT:
+// - pV						= 8 vectors, each holding one row
+//
+static inline void IdctAanAvx2(__m256* pV)
+{
+	__m256	fTmp0,fTmp1,fTmp2,fTmp3,fTmp4,fTmp5,fTmp6,fTmp7;
+	__m256	fTmp10,fTmp11,fTmp12,fTmp13;
+	__m256	fZ5,fZ10,fZ11,fZ12,fZ13;
+
+	// Even part
+	fTmp10 = _mm256_add_ps(pV[0],pV[4]);
+	fTmp11 = _mm256_sub_ps(pV[0],pV[4]);
+	fTmp13 = _mm256_add_ps(pV[2],pV[6]);
+	fTmp12 = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(pV[2],pV[6]),_mm256_set1_ps(AAN_C_SQRT2)),fTmp13);
+
+	fTmp0 = _mm256_add_ps(fTmp10,fTmp13);
+	fTmp3 = _mm256_sub_ps(fTmp10,fTmp13);
+	fTmp1 = _mm256_add_ps(fTmp11,fTmp12);
+	fTmp2 = _mm256_sub_ps(fTmp11,fTmp12);
+
+	// Odd part
+	fZ13 = _mm256_add_ps(pV[5],pV[3]);
+	fZ10 = _mm256_sub_ps(pV[5],pV[3]);
+	fZ11 = _mm256_add_ps(pV[1],pV[7]);
+	fZ12 = _mm256_sub_ps(pV[1],pV[7]);
+
+	fTmp7 = _mm256_add_ps(fZ11,fZ13);
+	fTmp11 = _mm256_mul_ps(_mm256_sub_ps(fZ11,fZ13),_mm256_set1_ps(AAN_C_SQRT2));
+
+	fZ5 = _mm256_mul_ps(_mm256_add_ps(fZ10,fZ12),_mm256_set1_ps(AAN_C_Z5));
+	fTmp10 = _mm256_sub_ps(_mm256_mul_ps(fZ12,_mm256_set1_ps(AAN_C_Z12)),fZ5);
+	fTmp12 = _mm256_add_ps(_mm256_mul_ps(fZ10,_mm256_set1_ps(AAN_C_Z10)),fZ5);
+
+	fTmp6 = _mm256_sub_ps(fTmp12,fTmp7);
+	fTmp5 = _mm256_sub_ps(fTmp11,fTmp6);
+	fTmp4 = _mm256_add_ps(fTmp10,fTmp5);
+
+	pV[0] = _mm256_add_ps(fTmp0,fTmp7);
+	pV[7] = _mm256_sub_ps(fTmp0,fTmp7);
+	pV[1] = _mm256_add_ps(fTmp1,fTmp6);
+	pV[6] = _mm256_sub_ps(fTmp1,fTmp6);
+	pV[2] = _mm256_add_ps(fTmp2,fTmp5);
+	pV[5] = _mm256_sub_ps(fTmp2,fTmp5);
+	pV[4] = _mm256_add_ps(fTmp3,fTmp4);
+	pV[3] = _mm256_sub_ps(fTmp3,fTmp4);
+}
+
+// Transpose an 8x8 block held as 8 row vectors
+static inline void TransposeAvx2(__m256* pV)
+{
+	__m256	afT[8],afTT[8];
+
+	afT[0] = _mm256_unpacklo_ps(pV[0],pV[1]);
+	afT[1] = _mm256_unpackhi_ps(pV[0],pV[1]);
+	afT[2] = _mm256_unpacklo_ps(pV[2],pV[3]);
+	afT[3] = _mm256_unpackhi_ps(pV[2],pV[3]);
+	afT[4] = _mm256_unpacklo_ps(pV[4],pV[5]);
+	afT[5] = _mm256_unpackhi_ps(pV[4],pV[5]);
+	afT[6] = _mm256_unpacklo_ps(pV[6],pV[7]);
+	afT[7] = _mm256_unpackhi_ps(pV[6],pV[7]);
+
+	afTT[0] = _mm256_shuffle_ps(afT[0],afT[2],0x44);
+	afTT[1] = _mm256_shuffle_ps(afT[0],afT[2],0xEE);
+	afTT[2] = _mm256_shuffle_ps(afT[1],afT[3],0x44);
+	afTT[3] = _mm256_shuffle_ps(afT[1],afT[3],0xEE);
+	afTT[4] = _mm256_shuffle_ps(afT[4],afT[6],0x44);
+	afTT[5] = _mm256_shuffle_ps(afT[4],afT[6],0xEE);
+	afTT[6] = _mm256_shuffle_ps(afT[5],afT[7],0x44);
+	afTT[7] = _mm256_shuffle_ps(afT[5],afT[7],0xEE);
+
+	for (unsigned nInd=0;nInd<4;nInd++) {
+		pV[nInd+0] = _mm256_permute2f128_ps(afTT[nInd],afTT[nInd+4],0x20);
+		pV[nInd+4] = _mm256_permute2f128_ps(afTT[nInd],afTT[nInd+4],0x31);
+	}
+}
+
+static void IdctFloatAvx2(float* pfBlock)
+{
+	__m256		afV[8];
+	unsigned	nY;
+
+	for (nY=0;nY<8;nY++) {
+		afV[nY] = _mm256_loadu_ps(&pfBlock[nY*8]);
+	}
+
+	// Columns
+	IdctAanAvx2(afV);
+
+	// Rows (as columns of the transposed block)
+	TransposeAvx2(afV);
+	IdctAanAvx2(afV);
+	TransposeAvx2(afV);
+
+	for (nY=0;nY<8;nY++) {
+		_mm256_storeu_ps(&pfBlock[nY*8],afV[nY]);
+	}
+	_mm256_zeroupper();
+}
+
+static void LevelShiftFloatAvx2(const float* pfBlock,short nDcOffset,short* pnPix)
+{
+	__m256	fMax = _mm256_set1_ps(SIMD_FLOAT_LIMIT);
+	__m256	fMin = _mm256_set1_ps(-SIMD_FLOAT_LIMIT);
+	__m256i	nDc = _mm256_set1_epi16(nDcOffset);
+	__m256i	nRow0,nRow1,nPack;
+	for (unsigned nInd=0;nInd<64;nInd+=16) {
+		nRow0 = _mm256_cvttps_epi32(_mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(&pfBlock[nInd+0]),fMax),fMin));
+		nRow1 = _mm256_cvttps_epi32(_mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(&pfBlock[nInd+8]),fMax),fMin));
+		// Pack works within 128-bit lanes so restore the order afterwards
+		nPack = _mm256_permute4x64_epi64(_mm256_packs_epi32(nRow0,nRow1),0xD8);
+		_mm256_storeu_si256((__m256i*)&pnPix[nInd],_mm256_adds_epi16(nPack,nDc));
+	}
+	_mm256_zeroupper();
+}
+
+static void LevelShiftIntAvx2(const int* pnBlock,short nDcOffset,short* pnPix)
+{
+	__m256i	nDc = _mm256_set1_epi16(nDcOffset);
+	__m256i	nRow0,nRow1,nPack;
+	for (unsigned nInd=0;nInd<64;nInd+=16) {
+		nRow0 = _mm256_loadu_si256((const __m256i*)&pnBlock[nInd+0]);
+		nRow1 = _mm256_loadu_si256((const __m256i*)&pnBlock[nInd+8]);
+		nPack = _mm256_permute4x64_epi64(_mm256_packs_epi32(nRow0,nRow1),0xD8);
+		_mm256_storeu_si256((__m256i*)&pnPix[nInd],_mm256_adds_epi16(nPack,nDc));
+	}
+	_mm256_zeroupper();
+}
+
+// See CmykSampleSse2(), CmykMaddSse2() and CmykMulDiv255Sse2()
+// - The unpack and pack operations work within 128-bit lanes, so the
+//   order of the 16-bit results is unchanged
+static inline __m256i CmykSampleAvx2(const short* pnVal,__m128i nShift)
+{
+	__m256i	nVal = _mm256_sra_epi16(_mm256_loadu_si256((const __m256i*)pnVal),nShift);
+	nVal = _mm256_add_epi16(nVal,_mm256_set1_epi16(128));
+	return _mm256_max_epi16(_mm256_min_epi16(nVal,_mm256_set1_epi16(255)),_mm256_setzero_si256());
+}
+
+static inline __m256i CmykMaddAvx2(__m256i nA,__m256i nB,short nMultA,short nMultB,int nRound)
+{
+	__m256i	nMult = _mm256_set1_epi32((nMultB << 16) | (nMultA & 0xFFFF));
+	__m256i	nLo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(nA,nB),nMult),_mm256_set1_epi32(nRound));
+	__m256i	nHi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(nA,nB),nMult),_mm256_set1_epi32(nRound));
+	return _mm256_packs_epi32(_mm256_srai_epi32(nLo,CMYK_FIX_SHIFT),_mm256_srai_epi32(nHi,CMYK_FIX_SHIFT));
+}
+
+static inline __m256i CmykMulDiv255Avx2(__m256i nA,__m256i nB)
+{
+	__m256i	nVal = _mm256_add_epi16(_mm256_mullo_epi16(nA,nB),_mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(nVal,_mm256_srli_epi16(nVal,8)),8);
+}
+
+static void CmykToRgbAvx2(const short* pnC,const short* pnM,const short* pnY,const short* pnK,
+							bool bYcck,unsigned nShift,unsigned nNum,unsigned char* pnBgra)
+{
+	__m256i	nZero = _mm256_setzero_si256();
+	__m256i	nMax = _mm256_set1_epi16(255);
+	__m256i	nOfs = _mm256_set1_epi16(128);
+	__m128i	nShiftCnt = _mm_cvtsi32_si128(nShift);
+	__m256i	nC,nM,nY,nK;
+	__m256i	nR,nG,nB,nBg,nLo,nHi;
+	unsigned	nInd;
+	for (nInd=0;nInd+16<=nNum;nInd+=16) {
+		nC = CmykSampleAvx2(&pnC[nInd],nShiftCnt);
+		nM = CmykSampleAvx2(&pnM[nInd],nShiftCnt);
+		nY = CmykSampleAvx2(&pnY[nInd],nShiftCnt);
+		nK = CmykSampleAvx2(&pnK[nInd],nShiftCnt);
+		if (bYcck) {
+			nM = _mm256_sub_epi16(nM,nOfs);
+			nY = _mm256_sub_epi16(nY,nOfs);
+			nR = _mm256_add_epi16(nC,CmykMaddAvx2(nY,nZero,CMYK_FIX_CR_R,0,CMYK_FIX_ROUND));
+			nG = _mm256_add_epi16(nC,CmykMaddAvx2(nM,nY,CMYK_FIX_CB_G,CMYK_FIX_CR_G,CMYK_FIX_ROUND));
+			nB = _mm256_add_epi16(nC,CmykMaddAvx2(nM,nZero,CMYK_FIX_CB_B,0,CMYK_FIX_ROUND));
+			nR = _mm256_sub_epi16(nMax,_mm256_max_epi16(_mm256_min_epi16(nR,nMax),nZero));
+			nG = _mm256_sub_epi16(nMax,_mm256_max_epi16(_mm256_min_epi16(nG,nMax),nZero));
+			nB = _mm256_sub_epi16(nMax,_mm256_max_epi16(_mm256_min_epi16(nB,nMax),nZero));
+		} else {
+			nR = nC;
+			nG = nM;
+			nB = nY;
+		}
+		nR = CmykMulDiv255Avx2(nR,nK);
+		nG = CmykMulDiv255Avx2(nG,nK);
+		nB = CmykMulDiv255Avx2(nB,nK);
+		// Interleave to [B,G,R,0]: pixels 0-3,8-11 and 4-7,12-15
+		nBg = _mm256_or_si256(nB,_mm256_slli_epi16(nG,8));
+		nLo = _mm256_unpacklo_epi16(nBg,nR);
+		nHi = _mm256_unpackhi_epi16(nBg,nR);
+		_mm256_storeu_si256((__m256i*)&pnBgra[nInd*4+0], _mm256_permute2x128_si256(nLo,nHi,0x20));
+		_mm256_storeu_si256((__m256i*)&pnBgra[nInd*4+32],_mm256_permute2x128_si256(nLo,nHi,0x31));
+	}
+	_mm256_zeroupper();
+	CmykToRgbScalar(&pnC[nInd],&pnM[nInd],&pnY[nInd],&pnK[nInd],bYcck,nShift,nNum-nInd,&pnBgra[nInd*4]);
+}
+
+// See YccSampleSse2() and YccChromaSse2()
+static inline __m256i YccSampleAvx2(__m256i nVal,short nOfs,__m128i nShift)
+{
+	nVal = _mm256_sra_epi16(_mm256_adds_epi16(nVal,_mm256_set1_epi16(nOfs)),nShift);
+	return _mm256_max_epi16(_mm256_min_epi16(nVal,_mm256_set1_epi16(127)),_mm256_set1_epi16(-128));
+}
+
+static inline __m256i YccChromaAvx2(const short* pnVal,bool bHalf)
+{
+	if (bHalf) {
+		__m128i	nVal = _mm_loadu_si128((const __m128i*)pnVal);
+		return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(nVal,nVal)),
+			_mm_unpackhi_epi16(nVal,nVal),1);
+	}
+	return _mm256_loadu_si256((const __m256i*)pnVal);
+}
+
+static unsigned YccToRgbAvx2(const short* pnY,const short* pnCb,const short* pnCr,bool bChromaHalf,
+							const short* pnOfs,unsigned nShift,const unsigned* pnSel,
+							unsigned nNum,unsigned char* pnBgra)
+{
+	__m256i	nZero = _mm256_setzero_si256();
+	__m256i	nMax = _mm256_set1_epi16(255);
+	__m256i	nOfs = _mm256_set1_epi16(128);
+	__m256i	nOne = _mm256_set1_epi16(1);
+	__m128i	nShiftCnt = _mm_cvtsi32_si128(nShift);
+	__m256i	nSumAcc = _mm256_setzero_si256();
+	__m256i	nY,nCb,nCr,nBg,nLo,nHi;
+	__m256i	anVal[YCC_OUT_NUM];
+	__m128i	nSum;
+	unsigned	nInd;
+	unsigned	nIndC;
+	for (nInd=0;nInd+16<=nNum;nInd+=16) {
+		nIndC = (bChromaHalf) ? nInd/2 : nInd;
+		nY  = YccSampleAvx2(_mm256_loadu_si256((const __m256i*)&pnY[nInd]),pnOfs[0],nShiftCnt);
+		nCb = YccSampleAvx2(YccChromaAvx2(&pnCb[nIndC],bChromaHalf),pnOfs[1],nShiftCnt);
+		nCr = YccSampleAvx2(YccChromaAvx2(&pnCr[nIndC],bChromaHalf),pnOfs[2],nShiftCnt);
+		anVal[YCC_OUT_Y]  = _mm256_add_epi16(nY,nOfs);
+		anVal[YCC_OUT_CB] = _mm256_add_epi16(nCb,nOfs);
+		anVal[YCC_OUT_CR] = _mm256_add_epi16(nCr,nOfs);
+		anVal[YCC_OUT_R] = _mm256_add_epi16(anVal[YCC_OUT_Y],CmykMaddAvx2(nCr,nZero,CMYK_FIX_CR_R,0,0));
+		anVal[YCC_OUT_G] = _mm256_add_epi16(anVal[YCC_OUT_Y],CmykMaddAvx2(nCb,nCr,CMYK_FIX_CB_G,CMYK_FIX_CR_G,0));
+		anVal[YCC_OUT_B] = _mm256_add_epi16(anVal[YCC_OUT_Y],CmykMaddAvx2(nCb,nZero,CMYK_FIX_CB_B,0,0));
+		anVal[YCC_OUT_R] = _mm256_max_epi16(_mm256_min_epi16(anVal[YCC_OUT_R],nMax),nZero);
+		anVal[YCC_OUT_G] = _mm256_max_epi16(_mm256_min_epi16(anVal[YCC_OUT_G],nMax),nZero);
+		anVal[YCC_OUT_B] = _mm256_max_epi16(_mm256_min_epi16(anVal[YCC_OUT_B],nMax),nZero);
+		nSumAcc = _mm256_add_epi32(nSumAcc,_mm256_madd_epi16(anVal[YCC_OUT_Y],nOne));
+		// Interleave to [B,G,R,0]: pixels 0-3,8-11 and 4-7,12-15
+		nBg = _mm256_or_si256(anVal[pnSel[0]],_mm256_slli_epi16(anVal[pnSel[1]],8));
+		nLo = _mm256_unpacklo_epi16(nBg,anVal[pnSel[2]]);
+		nHi = _mm256_unpackhi_epi16(nBg,anVal[pnSel[2]]);
+		_mm256_storeu_si256((__m256i*)&pnBgra[nInd*4+0], _mm256_permute2x128_si256(nLo,nHi,0x20));
+		_mm256_storeu_si256((__m256i*)&pnBgra[nInd*4+32],_mm256_permute2x128_si256(nLo,nHi,0x31));
+	}
+	nSum = _mm_add_epi32(_mm256_castsi256_si128(nSumAcc),_mm256_extracti128_si256(nSumAcc,1));
+	_mm256_zeroupper();
+	nSum = _mm_add_epi32(nSum,_mm_srli_si128(nSum,8));
+	nSum = _mm_add_epi32(nSum,_mm_srli_si128(nSum,4));
+	nIndC = (bChromaHalf) ? nInd/2 : nInd;
+	return (unsigned)_mm_cvtsi128_si32(nSum) +
+		YccToRgbScalar(&pnY[nInd],&pnCb[nIndC],&pnCr[nIndC],bChromaHalf,pnOfs,nShift,pnSel,nNum-nInd,&pnBgra[nInd*4]);
+}
+
+
+// See YccStatsSse2()
+static void YccStatsAvx2(const short* pnY,const short* pnCb,const short* pnCr,
+							const int* pnOfs,unsigned nPrecShift,unsigned nNum,YccStats* psStats)
+{
+	const float	fConstRed   = STAT_CONST_RED;
+	const float	fConstGreen = STAT_CONST_GREEN;
+	const float	fConstBlue  = STAT_CONST_BLUE;
+	__m256i	nZero = _mm256_setzero_si256();
+	__m256i	nMax = _mm256_set1_epi32(255);
+	__m256i	nLevel = _mm256_set1_epi32(128);
+	__m256i	nRangeOfs = _mm256_set1_epi32(1024<<nPrecShift);
+	__m256i	nRangeDivM1 = _mm256_set1_epi32((8<<nPrecShift)-1);
+	__m128i	nRangeShift = _mm_cvtsi32_si128(3+nPrecShift);
+	__m128i	nPrecCnt = _mm_cvtsi32_si128(nPrecShift);
+	__m256i	nHistoMin = _mm256_set1_epi32(-1024);
+	__m256i	nHistoMax = _mm256_set1_epi32(1023);
+	__m256	fMultR = _mm256_set1_ps(2-2*fConstRed);
+	__m256	fMultB = _mm256_set1_ps(2-2*fConstBlue);
+	__m256	fRed = _mm256_set1_ps(fConstRed);
+	__m256	fGreen = _mm256_set1_ps(fConstGreen);
+	__m256	fBlue = _mm256_set1_ps(fConstBlue);
+	__m256	fLevel = _mm256_set1_ps(128);
+	__m256	fY,fCb,fCr,fR,fG,fB;
+	__m256i	nVal;
+	__m256i	anVal[YCC_STAT_NUM];
+	__m256i	anMin[YCC_STAT_NUM];
+	__m256i	anMax[YCC_STAT_NUM];
+	__m256i	anSum[YCC_STAT_NUM];
+	__m256i	anUnder[YCC_STAT_NUM];
+	__m256i	anOver[YCC_STAT_NUM];
+	int		anHisto[4][8];
+	unsigned	nInd;
+	for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+		anMin[nStat] = _mm256_set1_epi32(INT_MAX);
+		anMax[nStat] = _mm256_set1_epi32(INT_MIN);
+		anSum[nStat] = nZero;
+		anUnder[nStat] = nZero;
+		anOver[nStat] = nZero;
+	}
+	for (nInd=0;nInd+8<=nNum;nInd+=8) {
+		anVal[YCC_STAT_PRE_Y]  = _mm256_add_epi32(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&pnY[nInd])),
+			_mm256_set1_epi32(pnOfs[0]));
+		anVal[YCC_STAT_PRE_CB] = _mm256_add_epi32(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&pnCb[nInd])),
+			_mm256_set1_epi32(pnOfs[1]));
+		anVal[YCC_STAT_PRE_CR] = _mm256_add_epi32(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&pnCr[nInd])),
+			_mm256_set1_epi32(pnOfs[2]));
+		for (unsigned nChan=0;nChan<3;nChan++) {
+			nVal = _mm256_add_epi32(anVal[YCC_STAT_PRE_Y+nChan],nRangeOfs);
+			anVal[YCC_STAT_Y+nChan] = _mm256_sra_epi32(_mm256_add_epi32(nVal,
+				_mm256_and_si256(_mm256_srai_epi32(nVal,31),nRangeDivM1)),nRangeShift);
+		}
+
+		fY  = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_max_epi32(_mm256_min_epi32(anVal[YCC_STAT_Y],nMax),nZero),nLevel));
+		fCb = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_max_epi32(_mm256_min_epi32(anVal[YCC_STAT_CB],nMax),nZero),nLevel));
+		fCr = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_max_epi32(_mm256_min_epi32(anVal[YCC_STAT_CR],nMax),nZero),nLevel));
+		fR = _mm256_add_ps(_mm256_mul_ps(fCr,fMultR),fY);
+		fB = _mm256_add_ps(_mm256_mul_ps(fCb,fMultB),fY);
+		fG = _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(fY,_mm256_mul_ps(fBlue,fB)),_mm256_mul_ps(fRed,fR)),fGreen);
+		anVal[YCC_STAT_PRE_R] = _mm256_cvttps_epi32(_mm256_add_ps(fR,fLevel));
+		anVal[YCC_STAT_PRE_G] = _mm256_cvttps_epi32(_mm256_add_ps(fG,fLevel));
+		anVal[YCC_STAT_PRE_B] = _mm256_cvttps_epi32(_mm256_add_ps(fB,fLevel));
+		anVal[YCC_STAT_R] = _mm256_max_epi32(_mm256_min_epi32(anVal[YCC_STAT_PRE_R],nMax),nZero);
+		anVal[YCC_STAT_G] = _mm256_max_epi32(_mm256_min_epi32(anVal[YCC_STAT_PRE_G],nMax),nZero);
+		anVal[YCC_STAT_B] = _mm256_max_epi32(_mm256_min_epi32(anVal[YCC_STAT_PRE_B],nMax),nZero);
+
+		for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+			anMin[nStat] = _mm256_min_epi32(anMin[nStat],anVal[nStat]);
+			anMax[nStat] = _mm256_max_epi32(anMax[nStat],anVal[nStat]);
+			anSum[nStat] = _mm256_add_epi32(anSum[nStat],anVal[nStat]);
+		}
+		for (unsigned nChan=0;nChan<3;nChan++) {
+			anUnder[YCC_STAT_Y+nChan] = _mm256_sub_epi32(anUnder[YCC_STAT_Y+nChan],_mm256_cmpgt_epi32(nZero,anVal[YCC_STAT_Y+nChan]));
+			anOver[YCC_STAT_Y+nChan]  = _mm256_sub_epi32(anOver[YCC_STAT_Y+nChan],_mm256_cmpgt_epi32(anVal[YCC_STAT_Y+nChan],nMax));
+			anUnder[YCC_STAT_R+nChan] = _mm256_sub_epi32(anUnder[YCC_STAT_R+nChan],_mm256_cmpgt_epi32(nZero,anVal[YCC_STAT_PRE_R+nChan]));
+			anOver[YCC_STAT_R+nChan]  = _mm256_sub_epi32(anOver[YCC_STAT_R+nChan],_mm256_cmpgt_epi32(anVal[YCC_STAT_PRE_R+nChan],nMax));
+		}
+
+		_mm256_storeu_si256((__m256i*)anHisto[0],_mm256_max_epi32(_mm256_min_epi32(
+			_mm256_sra_epi32(anVal[YCC_STAT_PRE_Y],nPrecCnt),nHistoMax),nHistoMin));
+		_mm256_storeu_si256((__m256i*)anHisto[1],anVal[YCC_STAT_R]);
+		_mm256_storeu_si256((__m256i*)anHisto[2],anVal[YCC_STAT_G]);
+		_mm256_storeu_si256((__m256i*)anHisto[3],anVal[YCC_STAT_B]);
+		for (unsigned nLane=0;nLane<8;nLane++) {
+			psStats->anHistoY[anHisto[0][nLane]+1024]++;
+			psStats->anHistoR[anHisto[1][nLane]/(256/YCC_STAT_HISTO_BINS)]++;
+			psStats->anHistoG[anHisto[2][nLane]/(256/YCC_STAT_HISTO_BINS)]++;
+			psStats->anHistoB[anHisto[3][nLane]/(256/YCC_STAT_HISTO_BINS)]++;
+		}
+	}
+
+	int			anMinLane[YCC_STAT_NUM*8];
+	int			anMaxLane[YCC_STAT_NUM*8];
+	unsigned	anSumLane[YCC_STAT_NUM*8];
+	unsigned	anUnderLane[YCC_STAT_NUM*8];
+	unsigned	anOverLane[YCC_STAT_NUM*8];
+	for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+		_mm256_storeu_si256((__m256i*)&anMinLane[nStat*8],anMin[nStat]);
+		_mm256_storeu_si256((__m256i*)&anMaxLane[nStat*8],anMax[nStat]);
+		_mm256_storeu_si256((__m256i*)&anSumLane[nStat*8],anSum[nStat]);
+		_mm256_storeu_si256((__m256i*)&anUnderLane[nStat*8],anUnder[nStat]);
+		_mm256_storeu_si256((__m256i*)&anOverLane[nStat*8],anOver[nStat]);
+	}
+	_mm256_zeroupper();
+	YccStatsFold(anMinLane,anMaxLane,anSumLane,anUnderLane,anOverLane,8,psStats);
+	psStats->nCount += nInd;
+	YccStatsScalar(&pnY[nInd],&pnCb[nInd],&pnCr[nInd],pnOfs,nPrecShift,nNum-nInd,psStats);
+}
+
+
+// ---------------------------------------
+// Kernel selection
+// ---------------------------------------
+
+static const ImgDecodeKernels glb_asImgDecodeKernels[] = {
+	{ SIMD_LEVEL_SCALAR, DequantFloatScalar, IdctFloatScalar, IdctFloat2x2Scalar, IdctFloat4x4Scalar, IdctIntScalar, LevelShiftFloatScalar, LevelShiftIntScalar, CmykToRgbScalar, YccToRgbScalar, YccStatsScalar },
+	{ SIMD_LEVEL_SSE2,   DequantFloatSse2,   IdctFloatSse2,   IdctFloat2x2Scalar, IdctFloat4x4Scalar, IdctIntScalar, LevelShiftFloatSse2,   LevelShiftIntSse2,   CmykToRgbSse2,   YccToRgbSse2,   YccStatsSse2 },
+	{ SIMD_LEVEL_AVX2,   DequantFloatAvx2,   IdctFloatAvx2,   IdctFloat2x2Scalar, IdctFloat4x4Scalar, IdctIntScalar, LevelShiftFloatAvx2,   LevelShiftIntAvx2,   CmykToRgbAvx2,   YccToRgbAvx2,   YccStatsAvx2 },
+};
+
+// Determine the highest SIMD level supported by the CPU and OS
+// - AVX2 also requires the OS to save the YMM registers (OSXSAVE / XCR0)
+// - Not limited by SIMD_LEVEL_LIMIT
+//
+// RETURN:
+// - Highest supported SIMD level
+//
+teSimdLevel ImgDecodeSimdDetect()
+{
+	int			anInfo[4];
+	int			nIdMax;
+	bool		bSse2,bAvx,bOsYmm,bAvx2;
+
+	__cpuid(anInfo,0);
+	nIdMax = anInfo[0];
+	if (nIdMax < 1) {
+		return SIMD_LEVEL_SCALAR;
+	}
+
+	__cpuid(anInfo,1);
+	bSse2 = (anInfo[3] & (1<<26)) != 0;
+	bAvx = (anInfo[2] & (1<<28)) != 0;
+	bOsYmm = false;
+	if (anInfo[2] & (1<<27)) {
+		// OSXSAVE: check that XMM and YMM state are enabled
+		bOsYmm = (_xgetbv(0) & 0x6) == 0x6;
+	}
+
+	bAvx2 = false;
+	if (nIdMax >= 7) {
+		__cpuidex(anInfo,7,0);
+		bAvx2 = (anInfo[1] & (1<<5)) != 0;
+	}
+
+	if (bAvx && bOsYmm && bAvx2) {
+		return SIMD_LEVEL_AVX2;
+	} else if (bSse2) {
+		return SIMD_LEVEL_SSE2;
+	}
+	return SIMD_LEVEL_SCALAR;
+}
+
+// Select the kernel implementation
+// - CPU detection is only performed on the first call
+//
+// RETURN:
+// - Kernel table for the best supported SIMD level
+//
+const ImgDecodeKernels* ImgDecodeSimdInit()
+{
+	static const ImgDecodeKernels*	pKernels = NULL;
+
+	if (pKernels == NULL) {
+		teSimdLevel eLevel = ImgDecodeSimdDetect();
+#ifdef SIMD_LEVEL_LIMIT
+		if (eLevel > SIMD_LEVEL_LIMIT) {
+			eLevel = SIMD_LEVEL_LIMIT;
+		}
+#endif
+		pKernels = ImgDecodeSimdGet(eLevel);
+	}
+	return pKernels;
+}
+
+// Fetch the kernel table for a specific SIMD level
+// - No check is made that the CPU supports it
+//
+const ImgDecodeKernels* ImgDecodeSimdGet(teSimdLevel eLevel)
+{
+	return &glb_asImgDecodeKernels[eLevel];
+}
+
+CString ImgDecodeSimdName(teSimdLevel eLevel)
+{
+	switch (eLevel) {
+		case SIMD_LEVEL_SSE2:
+			return _T("SSE2");
+		case SIMD_LEVEL_AVX2:
+			return _T("AVX2");
+		default:
+			return _T("Scalar");
+	}
+}
+
+// AAN IDCT prescale factors
+// - 1 for k=0, sqrt(2)*cos(k*Pi/16) otherwise
+//
+static const double glb_adIdctAanScale[8] = {
+	1.0, 1.387039845, 1.306562965, 1.175875602,
+	1.0, 0.785694958, 0.541196100, 0.275899379
+};
+
+// Calculate the IDCT dequantization multipliers for a DQT entry
+// - The AAN IDCT requires its inputs to be prescaled. This is combined
+//   with the dequantization so that only one multiply per coefficient
+//   is needed in the IDCT
+// - The multipliers also include the x8 output scaling
+// - The DC multiplier is zero as the DC level is applied separately
+//   (see CimgDecode::SetFullRes)
+//
+// INPUT:
+// - nDqtVal				= DQT table value
+// - nCoeffInd				= Coefficient index (normal order)
+// OUTPUT:
+// - fMult					= Multiplier for pfnDequantFloat / pfnIdctFloat*
+// - nMult					= Multiplier for pfnIdctInt
+//
+void ImgDecodeIdctMult(unsigned nDqtVal,unsigned nCoeffInd,float& fMult,int& nMult)
+{
+	double	dMult = 0;
+	if (nCoeffInd != 0) {
+		dMult = nDqtVal * glb_adIdctAanScale[nCoeffInd/8] * glb_adIdctAanScale[nCoeffInd%8];
+	}
+	fMult = (float)dMult;
+	nMult = (int)(dMult*(1<<(IDCT_INT_MULT_BITS+IDCT_INT_DQT_BITS)) + 0.5);
+}
+
+// Fill the lookup table of the reference IDCT
+// - afLookup[yx][vu] = C(u)*C(v)*cos((2x+1)*u*Pi/16)*cos((2y+1)*v*Pi/16)
+// - This is 4k entries @ 4B each = 16KB
+//
+// OUTPUT:
+// - afLookup				= Lookup table
+//
+void ImgDecodeIdctRefInit(float afLookup[64][64])
+{
+	unsigned	nX,nY,nU,nV;
+	float		fCu,fCv;
+	float		fCosProd;
+
+	float		fPi			= (float)3.141592654;
+	float		fSqrtHalf	= (float)0.707106781;
+
+	for (nY=0;nY<8;nY++) {
+		for (nX=0;nX<8;nX++) {
+			for (nV=0;nV<8;nV++) {
+				for (nU=0;nU<8;nU++) {
+					fCu = (nU==0)?fSqrtHalf:1;
+					fCv = (nV==0)?fSqrtHalf:1;
+					fCosProd = (float)(cos((2*nX+1)*nU*fPi/16) * cos((2*nY+1)*nV*fPi/16));
+					afLookup[nY*8+nX][nV*8+nU] = fCu*fCv*fCosProd;
+				}
+			}
+		}
+	}
+}
+
+// Reference IDCT
+// - Direct matrix form of the IDCT (itu-t81.pdf, section A.3.3)
+// - Only used to verify the fast IDCT
+//
+// INPUT:
+// - afLookup				= Table from ImgDecodeIdctRefInit()
+// - pnCoef					= Quantized coefficients (normal order)
+// - pnDqt					= DQT table (normal order)
+// OUTPUT:
+// - pfBlock				= 8*s(yx) (without DC), as pfnIdctFloat
+//
+void ImgDecodeIdctRef(const float afLookup[64][64],const short* pnCoef,
+					  const unsigned short* pnDqt,float* pfBlock)
+{
+	unsigned	nYX,nVU;
+	float		fSum;
+
+	for (nYX=0;nYX<64;nYX++) {
+		fSum = 0;
+
+		// Skip DC coefficient!
+		for (nVU=1;nVU<64;nVU++) {
+			fSum += afLookup[nYX][nVU]*pnCoef[nVU]*pnDqt[nVU];
+		}
+		pfBlock[nYX] = fSum * 2;	// 8 * 1/4
+	}
+}
@@ -0,0 +1,173 @@
+// JPEGsnoop - JPEG Image Decoder & Analysis Utility
+// Copyright (C) 2017 - Calvin Hass
+// http://www.impulseadventure.com/photo/jpeg-snoop.html
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// ==========================================================================
+// MODULE DESCRIPTION:
+// - Per-block kernels used by the scan decoder (CimgDecode):
+//   dequantize, IDCT and level-shift / clamp
+// - Per-row color conversion of YCC / grayscale and 4-component
+//   (CMYK / YCCK) previews
+// - Per-row color statistics (histograms and clipping) of YCC previews
+// - IDCT prescale multipliers and the direct (matrix) reference IDCT
+// - Each kernel has a scalar, SSE2 and AVX2 implementation. The
+//   implementation is selected once from CPUID (ImgDecodeSimdInit)
+// - The scalar kernels are the reference. The SIMD kernels perform the
+//   same operations in the same order and must produce identical results
+//   (see SIMD_SELFCHECK in ImgDecode.cpp and test/TestImgDecodeSimd.cpp)
+//
+// ==========================================================================
+
+#ifndef _IMGDECODESIMD_H_
+#define _IMGDECODESIMD_H_
+
+// Flag: Limit the kernel selection (for debug / comparison)
+// - Define as one of the teSimdLevel values
+//#define SIMD_LEVEL_LIMIT	SIMD_LEVEL_SCALAR
+
+enum teSimdLevel {
+	SIMD_LEVEL_SCALAR,
+	SIMD_LEVEL_SSE2,
+	SIMD_LEVEL_AVX2
+};
+
+// Highest zigzag index that lies within the top-left corner of the block
+// - Zigzag indices 0..2 are within 2x2, and 0..9 are within 4x4
+#define IDCT_ZZ_MAX_2X2		2
+#define IDCT_ZZ_MAX_4X4		9
+
+// Fixed point IDCT precision
+// - The products are formed in 64 bits so that 12-bit precision
+//   images cannot overflow
+#define IDCT_INT_MULT_BITS	6	// Fraction bits in dequantized coefficients
+#define IDCT_INT_DQT_BITS	12	// Extra fraction bits in dequantization multipliers
+#define IDCT_INT_CONST_BITS	16	// Fraction bits in IDCT constants
+
+// Values that the YccToRgb kernel can store as B, G and R
+// (the preview channel selection, see CimgDecode::ChannelExtract)
+enum teYccOut {
+	YCC_OUT_R,
+	YCC_OUT_G,
+	YCC_OUT_B,
+	YCC_OUT_Y,
+	YCC_OUT_CB,
+	YCC_OUT_CR,
+	YCC_OUT_NUM
+};
+
+// Quantities of the color statistics (YccStats), in the order they are
+// computed by CimgDecode::ConvertYCCtoRGB
+enum teYccStat {
+	YCC_STAT_PRE_Y,		// Pre-ranged YCC (pixel map value plus preview shift)
+	YCC_STAT_PRE_CB,
+	YCC_STAT_PRE_CR,
+	YCC_STAT_Y,			// Ranged YCC before clipping
+	YCC_STAT_CB,
+	YCC_STAT_CR,
+	YCC_STAT_PRE_R,		// RGB before clipping (truncated)
+	YCC_STAT_PRE_G,
+	YCC_STAT_PRE_B,
+	YCC_STAT_R,			// RGB after clipping
+	YCC_STAT_G,
+	YCC_STAT_B,
+	YCC_STAT_NUM
+};
+
+#define YCC_STAT_HISTO_BINS		128		// RGB histogram bins (HISTO_BINS)
+#define YCC_STAT_HISTO_Y_BINS	2048	// Pre-ranged Y histogram bins (FULL_HISTO_BINS)
+
+// Color statistics accumulated by the YccStats kernel
+// - Clear with nMin = INT_MAX, nMax = INT_MIN and all else zero
+// - The sums wrap around as the 32-bit sums of CimgDecode::m_sHisto,
+//   so that they are the same in any order of accumulation
+// - anUnder / anOver count the samples clipped to 0..255 for
+//   YCC_STAT_Y, _CB, _CR (ranged YCC) and YCC_STAT_R, _G, _B
+typedef struct {
+	int			anMin[YCC_STAT_NUM];
+	int			anMax[YCC_STAT_NUM];
+	unsigned	anSum[YCC_STAT_NUM];
+	unsigned	anUnder[YCC_STAT_NUM];
+	unsigned	anOver[YCC_STAT_NUM];
+	unsigned	nCount;
+	unsigned	anHistoY[YCC_STAT_HISTO_Y_BINS];
+	unsigned	anHistoR[YCC_STAT_HISTO_BINS];
+	unsigned	anHistoG[YCC_STAT_HISTO_BINS];
+	unsigned	anHistoB[YCC_STAT_HISTO_BINS];
+} YccStats;
+
+// Kernel function table
+// - All blocks are 8x8 in normal (not zigzag) order
+typedef struct {
+	teSimdLevel	eLevel;
+
+	// Dequantize and prescale: pfBlock[i] = pnCoef[i] * pfMult[i]
+	void		(*pfnDequantFloat)(const short* pnCoef,const float* pfMult,float* pfBlock);
+	// 2-D AAN IDCT in place (columns then rows)
+	void		(*pfnIdctFloat)(float* pfBlock);
+	// Sparse dequantize and IDCT for blocks whose non-zero coefficients
+	// all lie in the top-left 2x2 or 4x4 corner (see IDCT_ZZ_MAX_*)
+	// - Same result as pfnDequantFloat + pfnIdctFloat
+	void		(*pfnIdctFloat2x2)(const short* pnCoef,const float* pfMult,float* pfBlock);
+	void		(*pfnIdctFloat4x4)(const short* pnCoef,const float* pfMult,float* pfBlock);
+	// Fixed point dequantize and 2-D AAN IDCT (pnMult from ImgDecodeIdctMult)
+	// - pnBlock is rounded to the units of pfnIdctFloat
+	void		(*pfnIdctInt)(const short* pnCoef,const int* pnMult,int* pnBlock);
+	// Level-shift and clamp to the pixel map:
+	//   pnPix[i] = Sat16( Sat16(Trunc(pfBlock[i])) + nDcOffset )
+	void		(*pfnLevelShiftFloat)(const float* pfBlock,short nDcOffset,short* pnPix);
+	// Fixed point version of pfnLevelShiftFloat
+	void		(*pfnLevelShiftInt)(const int* pnBlock,short nDcOffset,short* pnPix);
+	// Convert one row of a 4-component pixel map (inverted CMYK or YCCK,
+	// see CimgDecode::CalcChannelPreviewRowsCmyk) to 32-bit DIB pixels
+	// [B,G,R,0]. Each sample is ranged from the pixel map as in the YCC
+	// preview: Clamp((nVal>>nShift)+128), where nShift is 3 for 8-bit
+	// and 7 for 12-bit pixel maps
+	void		(*pfnCmykToRgb)(const short* pnC,const short* pnM,const short* pnY,const short* pnK,
+								bool bYcck,unsigned nShift,unsigned nNum,unsigned char* pnBgra);
+	// Convert one row of a YCC pixel map to 32-bit DIB pixels [B,G,R,0]
+	// - Each sample is offset by the preview level shift and ranged as in
+	//   CimgDecode::ConvertYCCtoRGBFastFloat: Clamp((nVal+pnOfs[c])>>nShift)
+	//   to -128..127. The fixed point conversion truncates as the float one.
+	// - bChromaHalf: pnCb and pnCr hold one sample per two pixels
+	// - pnSel[0..2] are the values (teYccOut) stored as B, G and R
+	// - Returns the sum of the ranged Y samples (0..255)
+	unsigned	(*pfnYccToRgb)(const short* pnY,const short* pnCb,const short* pnCr,bool bChromaHalf,
+								const short* pnOfs,unsigned nShift,const unsigned* pnSel,
+								unsigned nNum,unsigned char* pnBgra);
+	// Accumulate the color statistics of one row of a YCC pixel map
+	// - Each sample is offset by pnOfs[c] and converted exactly as by
+	//   CimgDecode::ConvertYCCtoRGB: ranged by truncating division
+	//   (nVal+(1024<<nPrecShift))/(8<<nPrecShift), clipped to 0..255 and
+	//   converted to RGB in single precision float
+	// - The Y histogram bin is Clamp(nVal>>nPrecShift) to -1024..1023
+	void		(*pfnYccStats)(const short* pnY,const short* pnCb,const short* pnCr,
+								const int* pnOfs,unsigned nPrecShift,unsigned nNum,YccStats* psStats);
+} ImgDecodeKernels;
+
+// Kernel selection
+teSimdLevel				ImgDecodeSimdDetect();
+const ImgDecodeKernels*	ImgDecodeSimdInit();
+const ImgDecodeKernels*	ImgDecodeSimdGet(teSimdLevel eLevel);
+CString					ImgDecodeSimdName(teSimdLevel eLevel);
+
+// IDCT support
+void	ImgDecodeIdctMult(unsigned nDqtVal,unsigned nCoeffInd,float& fMult,int& nMult);
+void	ImgDecodeIdctRefInit(float afLookup[64][64]);
+void	ImgDecodeIdctRef(const float afLookup[64][64],const short* pnCoef,
+						 const unsigned short* pnDqt,float* pfBlock);
+
+#endif
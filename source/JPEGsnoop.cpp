@@ -125,6 +125,14 @@ void CJPEGsnoopApp::CmdLineHelp()
 	strMsg += _T("   -ext_all           : Extract all from file\n");
 	strMsg += _T("   -ext_dht_avi       : Force insert DHT for AVI (-ext_all mode)\n");
 	strMsg += _T("   -scan              : Enables Scan Segment decode\n");
+	strMsg += _T("   -scan_scale <#>    : Scan Segment decode at 1/# size (1,2,4,8)\n");
+	strMsg += _T("   -scan_threads <#>  : Scan Segment decode threads (0=auto)\n");
+	strMsg += _T("   -lossless_map_max <#> : Largest lossless image kept in memory (MB)\n");
+	strMsg += _T("   -scan_mem_max <#>  : Scan Segment decoded in bands above this size (MB, 0=no limit)\n");
+	strMsg += _T("   -scan_ckpt <#>     : Scan Segment decoder checkpoint every # MCUs (0=none)\n");
+	strMsg += _T("   -scan_plane8       : Keep Scan Segment pixel planes as 8-bit samples after the decode\n");
+	strMsg += _T("   -scan_index        : Save Scan Segment decode to index file (<file>.jsi) and reuse it (DC only decode)\n");
+	strMsg += _T("   -bench_scan <#>    : Time the Scan Segment decode over # runs (-i only, result in log)\n");
 	strMsg += _T("   -maker             : Enables Makernote decode\n");
 	strMsg += _T("   -scandump          : Enables Scan Segment dumping\n");
 	strMsg += _T("   -histo_y           : Enables luminance histogram\n");
@@ -142,7 +150,7 @@ void CJPEGsnoopApp::CmdLineHelp()
 // Command-line parser class
 class CMyCommandParser : public CCommandLineInfo
 {
- 	typedef enum	{cla_idle,cla_input,cla_output,cla_err,cla_batchdir,cla_offset_pos} cla_e;
+ 	typedef enum	{cla_idle,cla_input,cla_output,cla_err,cla_batchdir,cla_offset_pos,cla_scan_scale,cla_scan_threads,cla_lossless_map_max,cla_scan_mem_max,cla_scan_ckpt,cla_bench_scan} cla_e;
 	int				index;
 	cla_e			next_arg;
 	CSnoopConfig*	m_pCfg;
@@ -242,6 +250,40 @@ public:
 					next_arg = cla_idle;
 					bCmdLineDetected = true;
 				}
+				else if (bFlag && !_tcscmp(pszParam,_T("scan_scale"))) {
+					next_arg = cla_scan_scale;
+					bCmdLineDetected = true;
+				}
+				else if (bFlag && !_tcscmp(pszParam,_T("scan_threads"))) {
+					next_arg = cla_scan_threads;
+					bCmdLineDetected = true;
+				}
+				else if (bFlag && !_tcscmp(pszParam,_T("lossless_map_max"))) {
+					next_arg = cla_lossless_map_max;
+					bCmdLineDetected = true;
+				}
+				else if (bFlag && !_tcscmp(pszParam,_T("scan_mem_max"))) {
+					next_arg = cla_scan_mem_max;
+					bCmdLineDetected = true;
+				}
+				else if (bFlag && !_tcscmp(pszParam,_T("scan_ckpt"))) {
+					next_arg = cla_scan_ckpt;
+					bCmdLineDetected = true;
+				}
+				else if (bFlag && !_tcscmp(pszParam,_T("bench_scan"))) {
+					next_arg = cla_bench_scan;
+					bCmdLineDetected = true;
+				}
+				else if (bFlag && !_tcscmp(pszParam,_T("scan_plane8"))) {
+					m_pCfg->bDecodeScanPlane8 = true;
+					next_arg = cla_idle;
+					bCmdLineDetected = true;
+				}
+				else if (bFlag && !_tcscmp(pszParam,_T("scan_index"))) {
+					m_pCfg->bDecodeScanIndex = true;
+					next_arg = cla_idle;
+					bCmdLineDetected = true;
+				}
 				else if (bFlag && !_tcscmp(pszParam,_T("maker"))) {
 					m_pCfg->bDecodeMaker = true;
 					next_arg = cla_idle;
@@ -378,6 +420,66 @@ public:
 				next_arg = cla_idle;
 				break;
 
+			case cla_scan_scale:
+				msg = _T("ScanScale=[");
+				msg += pszParam;
+				msg += _T("]");
+				// Convert the denominator (1/#) into the scale setting
+				next_arg = cla_err;
+				for (unsigned nScale=SCAN_SCALE_1;nScale<SCAN_SCALE_END;nScale++) {
+					if ((unsigned)_ttoi(pszParam) == (1u<<nScale)) {
+						m_pCfg->nDecodeScanScale = nScale;
+						next_arg = cla_idle;
+					}
+				}
+				if (next_arg == cla_err) {
+					strTmp.Format(_T("ERROR: Unsupported scan decode scale [1/%s]"),pszParam);
+					AfxMessageBox(strTmp);
+					m_nShellCommand = FileNothing;
+					m_pCfg->bCmdLineHelp = true;
+				}
+				break;
+
+			case cla_scan_threads:
+				msg = _T("ScanThreads=[");
+				msg += pszParam;
+				msg += _T("]");
+				m_pCfg->nDecodeScanThreads = _ttoi(pszParam);
+				next_arg = cla_idle;
+				break;
+
+			case cla_lossless_map_max:
+				msg = _T("LosslessMapMax=[");
+				msg += pszParam;
+				msg += _T("]");
+				m_pCfg->nDecodeLosslessMapMax = _ttoi(pszParam);
+				next_arg = cla_idle;
+				break;
+
+			case cla_scan_mem_max:
+				msg = _T("ScanMemMax=[");
+				msg += pszParam;
+				msg += _T("]");
+				m_pCfg->nDecodeScanMemMax = _ttoi(pszParam);
+				next_arg = cla_idle;
+				break;
+
+			case cla_scan_ckpt:
+				msg = _T("ScanCkpt=[");
+				msg += pszParam;
+				msg += _T("]");
+				m_pCfg->nDecodeScanCkptMcus = _ttoi(pszParam);
+				next_arg = cla_idle;
+				break;
+
+			case cla_bench_scan:
+				msg = _T("BenchScan=[");
+				msg += pszParam;
+				msg += _T("]");
+				m_pCfg->nCmdLineBenchRuns = _ttoi(pszParam);
+				next_arg = cla_idle;
+				break;
+
 			case cla_err:
 			default:
 				break;
@@ -669,7 +771,11 @@ void CJPEGsnoopApp::DoCmdLineCore()
 		// ===================================
 
 		// Process the file
-		bStatus = pSnoopCore->DoAnalyzeOffset(m_pAppConfig->strCmdLineOpenFname);
+		if (m_pAppConfig->nCmdLineBenchRuns > 0) {
+			bStatus = pSnoopCore->DoBenchScan(m_pAppConfig->strCmdLineOpenFname,m_pAppConfig->nCmdLineBenchRuns);
+		} else {
+			bStatus = pSnoopCore->DoAnalyzeOffset(m_pAppConfig->strCmdLineOpenFname);
+		}
 
 		if (!bStatus) {
 			// Issues during file open
@@ -755,6 +755,99 @@ BOOL CJPEGsnoopCore::DoAnalyzeOffset(CString strFname)
 	return bStatus;
 }
 
+// Benchmark the scan decode of a file
+// - The file is first analyzed once as in DoAnalyzeOffset(), which
+//   resolves the decode offset and loads the file into the OS cache
+// - The file is then analyzed nRuns times without and nRuns times with
+//   the scan decode. The difference between the fastest runs of each
+//   is the scan decode time (entropy decode, IDCT, color conversion
+//   and preview)
+// - The scan index is disabled so that every run decodes the scan
+// - The results are added to the end of the log of the last run, so
+//   that an arithmetic coded file and its Huffman coded equivalent can
+//   be compared (see test/BenchScan.bat)
+//
+// INPUT:
+// - strFname		= File to benchmark
+// - nRuns			= Number of timed runs with and without scan decode
+//
+// RETURN:
+// - Status from opening the file
+//
+BOOL CJPEGsnoopCore::DoBenchScan(CString strFname,unsigned nRuns)
+{
+	bool			bDecodeScanImg = m_pAppConfig->bDecodeScanImg;
+	bool			bDecodeScanIndex = m_pAppConfig->bDecodeScanIndex;
+	LARGE_INTEGER	nFreq,nTimeStart,nTimeEnd;
+	double			adMsMin[2];
+	double			adMsSum[2];
+	double			dMs;
+	bool			bProgressive,bArithmetic,bLossless;
+	BOOL			bStatus;
+	CString			strTmp;
+
+	ASSERT(nRuns > 0);
+
+	// Warm-up run, which also resolves the decode offset (nPosStart)
+	bStatus = DoAnalyzeOffset(strFname);
+	if (!bStatus) {
+		return bStatus;
+	}
+
+	bStatus = AnalyzeOpen();
+	if (!bStatus) {
+		return bStatus;
+	}
+
+	QueryPerformanceFrequency(&nFreq);
+	m_pAppConfig->bDecodeScanIndex = false;
+
+	// Pass 0: without scan decode, Pass 1: with scan decode
+	for (unsigned nPass=0;nPass<2;nPass++) {
+		m_pAppConfig->bDecodeScanImg = (nPass == 1);
+		adMsMin[nPass] = 0;
+		adMsSum[nPass] = 0;
+		for (unsigned nRun=0;nRun<nRuns;nRun++) {
+			// Force the scan decode to be redone
+			m_pJfifDec->ImgSrcChanged();
+
+			QueryPerformanceCounter(&nTimeStart);
+			AnalyzeFileDo();
+			QueryPerformanceCounter(&nTimeEnd);
+
+			dMs = (double)(nTimeEnd.QuadPart - nTimeStart.QuadPart) * 1000.0 / (double)nFreq.QuadPart;
+			if ((nRun == 0) || (dMs < adMsMin[nPass])) {
+				adMsMin[nPass] = dMs;
+			}
+			adMsSum[nPass] += dMs;
+		}
+	}
+
+	AnalyzeClose();
+	m_pAppConfig->bDecodeScanImg = bDecodeScanImg;
+	m_pAppConfig->bDecodeScanIndex = bDecodeScanIndex;
+
+	// Report the results after the log of the last run
+	m_pJfifDec->GetCodingMode(bProgressive,bArithmetic,bLossless);
+	glb_pDocLog->AddLine(_T(""));
+	glb_pDocLog->AddLineHdr(_T("*** Scan Decode Benchmark ***"));
+	strTmp.Format(_T("  Coding            = %s %s"),
+		(bArithmetic)?_T("Arithmetic"):_T("Huffman"),
+		(bLossless)?_T("lossless"):((bProgressive)?_T("progressive"):_T("sequential")));
+	glb_pDocLog->AddLine(strTmp);
+	strTmp.Format(_T("  Runs              = %u"),nRuns);
+	glb_pDocLog->AddLine(strTmp);
+	strTmp.Format(_T("  Parse only        = %.2f ms (min), %.2f ms (mean)"),adMsMin[0],adMsSum[0]/nRuns);
+	glb_pDocLog->AddLine(strTmp);
+	strTmp.Format(_T("  Parse and decode  = %.2f ms (min), %.2f ms (mean)"),adMsMin[1],adMsSum[1]/nRuns);
+	glb_pDocLog->AddLine(strTmp);
+	strTmp.Format(_T("  Scan decode       = %.2f ms (difference of min)"),adMsMin[1]-adMsMin[0]);
+	glb_pDocLog->AddLine(strTmp);
+	glb_pDocLog->AddLine(_T(""));
+
+	return bStatus;
+}
+
 // Process a file in the batch file list
 //
 // INPUT:
@@ -1293,9 +1386,29 @@ void CJPEGsnoopCore::I_GetImageSize(unsigned &nX,unsigned &nY)
 	m_pImgDec->GetImageSize(nX,nY);
 }
 
-void CJPEGsnoopCore::I_GetPixMapPtrs(short* &pMapY,short* &pMapCb,short* &pMapCr)
+void CJPEGsnoopCore::I_GetPixMapSize(unsigned &nX,unsigned &nY)
+{
+	m_pImgDec->GetPixMapSize(nX,nY);
+}
+
+bool CJPEGsnoopCore::I_GetPixMapRowYcc(unsigned nPixY,short* pnYcc)
+{
+	return m_pImgDec->GetPixMapRowYcc(nPixY,pnYcc);
+}
+
+bool CJPEGsnoopCore::I_DecodeScanRegion(CRect rectPix,unsigned char* pRgb)
+{
+	return m_pImgDec->DecodeScanRegion(rectPix,pRgb);
+}
+
+unsigned CJPEGsnoopCore::I_GetPixMapPrecision()
+{
+	return m_pImgDec->GetPixMapPrecision();
+}
+
+bool CJPEGsnoopCore::I_GetPixMapRowRgb16(unsigned nPixY,unsigned short* pnRgb)
 {
-	m_pImgDec->GetPixMapPtrs(pMapY,pMapCb,pMapCr);
+	return m_pImgDec->GetPixMapRowRgb16(nPixY,pnRgb);
 }
 
 void CJPEGsnoopCore::I_GetDetailVlc(bool &bDetail,unsigned &nX,unsigned &nY,unsigned &nLen)
@@ -1373,6 +1486,11 @@ void CJPEGsnoopCore::I_LookupFilePosPix(unsigned nPixX,unsigned nPixY, unsigned
 	m_pImgDec->LookupFilePosPix(nPixX,nPixY,nByte,nBit);
 }
 
+bool CJPEGsnoopCore::I_LookupMcuFilePos(unsigned nByte,unsigned nBit,CPoint &ptMcu,unsigned &nComp,CPoint &ptBlk)
+{
+	return m_pImgDec->LookupMcuFilePos(nByte,nBit,ptMcu,nComp,ptBlk);
+}
+
 void CJPEGsnoopCore::I_LookupBlkYCC(unsigned nBlkX,unsigned nBlkY,int &nY,int &nCb,int &nCr)
 {
 	m_pImgDec->LookupBlkYCC(nBlkX,nBlkY,nY,nCb,nCr);
@@ -1396,4 +1514,24 @@ void CJPEGsnoopCore::I_GetPreviewSize(unsigned &nX,unsigned &nY)
 bool CJPEGsnoopCore::I_IsPreviewReady()
 {
 	return m_pImgDec->IsPreviewReady();
+}
+
+bool CJPEGsnoopCore::I_GetLosslessInfo(unsigned &nSizeX,unsigned &nSizeY,unsigned &nNumComps,unsigned &nPrecision)
+{
+	return m_pImgDec->GetLosslessInfo(nSizeX,nSizeY,nNumComps,nPrecision);
+}
+
+bool CJPEGsnoopCore::I_LosslessRowsBegin()
+{
+	return m_pImgDec->LosslessRowsBegin();
+}
+
+unsigned CJPEGsnoopCore::I_LosslessRowsRead(unsigned short* pRows)
+{
+	return m_pImgDec->LosslessRowsRead(pRows);
+}
+
+void CJPEGsnoopCore::I_LosslessRowsEnd()
+{
+	m_pImgDec->LosslessRowsEnd();
 }
\ No newline at end of file
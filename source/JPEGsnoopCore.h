@@ -47,6 +47,7 @@ public:
 	void			AnalyzeClose();
 	BOOL			IsAnalyzed();
 	BOOL			DoAnalyzeOffset(CString strFname);
+	BOOL			DoBenchScan(CString strFname,unsigned nRuns);
 
 	void			DoLogSave(CString strLogName);
 
@@ -94,7 +95,11 @@ public:
 	CPoint			I_PixelToBlk(CPoint ptPix);
 	unsigned		I_McuXyToLinear(CPoint ptMcu);
 	void			I_GetImageSize(unsigned &nX,unsigned &nY);
-	void			I_GetPixMapPtrs(short* &pMapY,short* &pMapCb,short* &pMapCr);
+	void			I_GetPixMapSize(unsigned &nX,unsigned &nY);
+	bool			I_GetPixMapRowYcc(unsigned nPixY,short* pnYcc);
+	bool			I_DecodeScanRegion(CRect rectPix,unsigned char* pRgb);
+	unsigned		I_GetPixMapPrecision();
+	bool			I_GetPixMapRowRgb16(unsigned nPixY,unsigned short* pnRgb);
 	void			I_GetDetailVlc(bool &bDetail,unsigned &nX,unsigned &nY,unsigned &nLen);
 	void			I_SetDetailVlc(bool bDetail,unsigned nX,unsigned nY,unsigned nLen);	
 	unsigned		I_GetMarkerCount();
@@ -110,11 +115,16 @@ public:
 	void			I_GetBitmapPtr(unsigned char* &pBitmap);
 	void			I_LookupFilePosMcu(unsigned nMcuX,unsigned nMcuY, unsigned &nByte, unsigned &nBit);
 	void			I_LookupFilePosPix(unsigned nPixX,unsigned nPixY, unsigned &nByte, unsigned &nBit);
+	bool			I_LookupMcuFilePos(unsigned nByte,unsigned nBit,CPoint &ptMcu,unsigned &nComp,CPoint &ptBlk);
 	void			I_LookupBlkYCC(unsigned nBlkX,unsigned nBlkY,int &nY,int &nCb,int &nCr);
 	void			I_ViewOnDraw(CDC* pDC,CRect rectClient,CPoint ptScrolledPos,CFont* pFont, CSize &szNewScrollSize);
 	void			I_GetPreviewPos(unsigned &nX,unsigned &nY);
 	void			I_GetPreviewSize(unsigned &nX,unsigned &nY);
 	bool			I_IsPreviewReady();
+	bool			I_GetLosslessInfo(unsigned &nSizeX,unsigned &nSizeY,unsigned &nNumComps,unsigned &nPrecision);
+	bool			I_LosslessRowsBegin();
+	unsigned		I_LosslessRowsRead(unsigned short* pRows);
+	void			I_LosslessRowsEnd();
 
 	// Accessor wrappers for CwindowBuf
 	void			B_SetStatusBar(CStatusBar* pStatBar);
@@ -2036,9 +2036,7 @@ void CJPEGsnoopDoc::OnToolsExporttiff()
 
 	FileTiff		myTiff;
 	unsigned char*	pBitmapRgb = NULL;
-	short*			pBitmapYccY = NULL;
-	short*			pBitmapYccCb = NULL;
-	short*			pBitmapYccCr = NULL;
+	short*			pRowYcc = NULL;
 	unsigned char*	pBitmapSel8 = NULL;
 	unsigned short*	pBitmapSel16 = NULL;
 	
@@ -2057,9 +2055,10 @@ void CJPEGsnoopDoc::OnToolsExporttiff()
 	short			nValMaxCr = -32768;
 	short			nValMinCr = +32767;
 
-	m_pCore->I_GetImageSize(nSizeX,nSizeY);
+	// The pixel map may be smaller than the image (scaled decode)
+	m_pCore->I_GetPixMapSize(nSizeX,nSizeY);
 	m_pCore->I_GetBitmapPtr(pBitmapRgb);
-	m_pCore->I_GetPixMapPtrs(pBitmapYccY,pBitmapYccCb,pBitmapYccCr);
+	unsigned		nPixMapPrec = m_pCore->I_GetPixMapPrecision();
 	pBitmapSel8 = NULL;
 	pBitmapSel16 = NULL;
 
@@ -2090,6 +2089,14 @@ void CJPEGsnoopDoc::OnToolsExporttiff()
 		return;
 	}
 
+	// Lossless images are exported in RGB modes from the full
+	// precision samples rather than the preview
+	unsigned		nLlNumComps,nLlPrecision;
+	if ((!bModeYcc) && (m_pCore->I_GetLosslessInfo(nSizeX,nSizeY,nLlNumComps,nLlPrecision))) {
+		ExportTiffLossless(strFnameOut,bMode16b,nSizeX,nSizeY,nLlNumComps,nLlPrecision);
+		return;
+	}
+
 	// Create a separate bitmap array
 	if (bMode16b) {
 		pBitmapSel16 = new unsigned short[nSizeX*nSizeY*3];
@@ -2106,7 +2113,22 @@ void CJPEGsnoopDoc::OnToolsExporttiff()
 			return;
 		}
 	}
-	if (!bModeYcc) {
+	// 12-bit images are exported in 16-bit RGB mode from the full
+	// precision pixel maps rather than the preview
+	bool			bRgbFull = false;
+	if (bMode16b && (!bModeYcc) && (nPixMapPrec > 8)) {
+		bRgbFull = true;
+		for (unsigned nIndY=0;(bRgbFull)&&(nIndY<nSizeY);nIndY++) {
+			bRgbFull = m_pCore->I_GetPixMapRowRgb16(nIndY,&pBitmapSel16[nIndY*nSizeX*3]);
+		}
+		for (unsigned nInd=0;(bRgbFull)&&(nInd<nSizeX*nSizeY*3);nInd++) {
+			pBitmapSel16[nInd] = Swap16(pBitmapSel16[nInd]);
+		}
+	}
+
+	if (bRgbFull) {
+		// Already done
+	} else if (!bModeYcc) {
 		// RGB mode
 		for (unsigned nIndY=0;nIndY<nSizeY;nIndY++) {
 			for (unsigned nIndX=0;nIndX<nSizeX;nIndX++) {
@@ -2133,13 +2155,26 @@ void CJPEGsnoopDoc::OnToolsExporttiff()
 		}
 	} else {
 		// YCC mode
+		// - The pixel map is fetched a row at a time as the
+		//   component planes may be subsampled
+		pRowYcc = new short[nSizeX*3];
+		ASSERT(pRowYcc);
+		if (!pRowYcc) {
+			AfxMessageBox(_T("ERROR: Insufficient memory for export"));
+			delete [] pBitmapSel8;
+			return;
+		}
 		for (unsigned nIndY=0;nIndY<nSizeY;nIndY++) {
+			if (!m_pCore->I_GetPixMapRowYcc(nIndY,pRowYcc)) {
+				memset(pRowYcc,0,nSizeX*3*sizeof(short));
+			}
 			for (unsigned nIndX=0;nIndX<nSizeX;nIndX++) {
 				nOffsetDst = (nIndY*nSizeX+nIndX)*3;
-				nOffsetSrc = (nIndY*nSizeX+nIndX)*1;
-				nValY  = pBitmapYccY[nOffsetSrc];
-				nValCb = pBitmapYccCb[nOffsetSrc];
-				nValCr = pBitmapYccCr[nOffsetSrc];
+				nOffsetSrc = nIndX*3;
+				// Reduce 12-bit pixel maps to the 8-bit range
+				nValY  = pRowYcc[nOffsetSrc+0] >> (nPixMapPrec-8);
+				nValCb = pRowYcc[nOffsetSrc+1] >> (nPixMapPrec-8);
+				nValCr = pRowYcc[nOffsetSrc+2] >> (nPixMapPrec-8);
 
 				nValMinY = min(nValMinY,nValY);
 				nValMaxY = max(nValMaxY,nValY);
@@ -2180,6 +2215,10 @@ void CJPEGsnoopDoc::OnToolsExporttiff()
 		myTiff.WriteFile(strFnameOut,bModeYcc,bMode16b,(void*)pBitmapSel8,nSizeX,nSizeY);
 	}
 
+	if (pRowYcc) {
+		delete [] pRowYcc;
+		pRowYcc = NULL;
+	}
 	if (pBitmapSel8) {
 		delete [] pBitmapSel8;
 		pBitmapSel8 = NULL;
@@ -2191,6 +2230,91 @@ void CJPEGsnoopDoc::OnToolsExporttiff()
 
 }
 
+// Export a lossless image as an RGB TIFF
+// - The samples are scaled from their precision to the output depth.
+//   Single component images are written as gray RGB, otherwise the
+//   first three components are written as RGB
+// - The rows are written as they are read (or decoded again) from the
+//   image decoder, so only a few rows are held at a time
+//
+// INPUT:
+// - strFnameOut			= Output filename
+// - bMode16b				= 16-bit output (otherwise 8-bit)
+// - nSizeX, nSizeY			= Image dimensions
+// - nNumComps				= Number of components per pixel
+// - nPrecision				= Sample precision (bits)
+//
+void CJPEGsnoopDoc::ExportTiffLossless(CString strFnameOut,bool bMode16b,unsigned nSizeX,unsigned nSizeY,
+	unsigned nNumComps,unsigned nPrecision)
+{
+	FileTiff		myTiff;
+	unsigned short*	pLlRows = NULL;
+	unsigned char*	pBitmapSel8 = NULL;
+	unsigned short*	pBitmapSel16 = NULL;
+	unsigned		nNumRows;
+	unsigned		nOffsetSrc,nOffsetDst;
+	unsigned short	nValMax = (unsigned short)((1<<nPrecision)-1);
+	unsigned short	anVal[3];
+
+	// Channels taken from each pixel for R,G,B
+	unsigned		anCompSel[3] = { 0, 0, 0 };
+	if (nNumComps >= 3) {
+		anCompSel[1] = 1;
+		anCompSel[2] = 2;
+	}
+
+	pLlRows = new unsigned short[LL_ROWS_MAX*nSizeX*nNumComps];
+	if (bMode16b) {
+		pBitmapSel16 = new unsigned short[LL_ROWS_MAX*nSizeX*3];
+	} else {
+		pBitmapSel8 = new unsigned char[LL_ROWS_MAX*nSizeX*3];
+	}
+	if ((!pLlRows) || ((!pBitmapSel16) && (!pBitmapSel8))) {
+		AfxMessageBox(_T("ERROR: Insufficient memory for export"));
+	} else if (m_pCore->I_LosslessRowsBegin()) {
+		if (myTiff.WriteFileBegin(strFnameOut,false,bMode16b,nSizeX,nSizeY)) {
+			while ((nNumRows = m_pCore->I_LosslessRowsRead(pLlRows)) > 0) {
+				for (unsigned nInd=0;nInd<nNumRows*nSizeX;nInd++) {
+					nOffsetSrc = nInd*nNumComps;
+					nOffsetDst = nInd*3;
+					for (unsigned nChan=0;nChan<3;nChan++) {
+						anVal[nChan] = min(pLlRows[nOffsetSrc+anCompSel[nChan]],nValMax);
+						if (bMode16b) {
+							// Need to do endian byte-swap when outputting
+							// 16b values to disk.
+							pBitmapSel16[nOffsetDst+nChan] = Swap16(anVal[nChan] << (16-nPrecision));
+						} else if (nPrecision >= 8) {
+							pBitmapSel8[nOffsetDst+nChan] = (unsigned char)(anVal[nChan] >> (nPrecision-8));
+						} else {
+							pBitmapSel8[nOffsetDst+nChan] = (unsigned char)(anVal[nChan] << (8-nPrecision));
+						}
+					}
+				}
+				if (bMode16b) {
+					myTiff.WriteFileRows((void*)pBitmapSel16,nNumRows);
+				} else {
+					myTiff.WriteFileRows((void*)pBitmapSel8,nNumRows);
+				}
+			}
+			myTiff.WriteFileEnd();
+		}
+		m_pCore->I_LosslessRowsEnd();
+	}
+
+	if (pLlRows) {
+		delete [] pLlRows;
+		pLlRows = NULL;
+	}
+	if (pBitmapSel8) {
+		delete [] pBitmapSel8;
+		pBitmapSel8 = NULL;
+	}
+	if (pBitmapSel16) {
+		delete [] pBitmapSel16;
+		pBitmapSel16 = NULL;
+	}
+}
+
 // Menu enable status for Tools -> Export to TIFF
 void CJPEGsnoopDoc::OnUpdateToolsExporttiff(CCmdUI *pCmdUI)
 {
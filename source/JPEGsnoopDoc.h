@@ -131,6 +131,8 @@ public:
 private:
 	virtual void	DeleteContents();
 	void			RedrawLog();
+	void			ExportTiffLossless(CString strFnameOut,bool bMode16b,unsigned nSizeX,unsigned nSizeY,
+						unsigned nNumComps,unsigned nPrecision);
 
 public:
 	// OnOpenDocument() is public for View:OnDropFiles()
@@ -80,6 +80,8 @@ void CjfifDecode::Reset()
 	m_strComment			= _T("");
 	m_strSoftware			= _T("");
 	m_bImgProgressive		= false;
+	m_bImgArithmetic		= false;
+	m_bImgLossless			= false;
 	m_bImgSofUnsupported	= false;
 	_tcscpy_s(m_acApp0Identifier,_T(""));
 
@@ -326,6 +328,20 @@ bool CjfifDecode::GetDecodeStatus()
 	return m_bImgOK;
 }
 
+// Fetch the coding mode of the last analyzed frame (from the SOF marker)
+//
+// OUTPUT:
+// - bProgressive			= Progressive (SOF2 / SOF10)
+// - bArithmetic			= Arithmetic coded (SOF9 / SOF10)
+// - bLossless				= Lossless (SOF3)
+//
+void CjfifDecode::GetCodingMode(bool &bProgressive,bool &bArithmetic,bool &bLossless)
+{
+	bProgressive = m_bImgProgressive;
+	bArithmetic = m_bImgArithmetic;
+	bLossless = m_bImgLossless;
+}
+
 // Fetch a summary of the JFIF decoder results
 // These details are used in preparation of signature submission to the DB
 //
@@ -4747,6 +4763,9 @@ unsigned CjfifDecode::DecodeMarker()
 			// However, to keep it simple (and not depend on lossless mode),
 			// we will only check the maximal range
 			if (!ValidateValue(nDAC_Cs,0,255,_T("Conditioning table value <Cs>"),true,0)) return DECMARK_ERR;
+
+			bRet = m_pImgDec->SetDacEntry(nDAC_Tc,nDAC_Tb,nDAC_Cs);
+			DecodeErrCheck(bRet);
 		}
 		if (!ExpectMarkerEnd(nPosMarkerStart,nLength))
 			return DECMARK_ERR;
@@ -4821,16 +4840,26 @@ unsigned CjfifDecode::DecodeMarker()
 		m_bStateSof = true;
 
 		// Determine if this is a SOF mode that we support
-		// At this time, we only support Baseline DCT & Extended Sequential Baseline DCT
-		// (non-differential) with Huffman coding. Progressive, Lossless,
-		// Differential and Arithmetic coded modes are not supported.
+		// At this time, we only support Baseline DCT, Extended Sequential Baseline DCT
+		// and Progressive DCT (non-differential) with Huffman or Arithmetic coding,
+		// and Lossless (non-differential) with Huffman coding.
+		// Differential modes are not supported.
 		m_bImgSofUnsupported = true;
 		if (nCode == JFIF_SOF0) { m_bImgSofUnsupported = false; }
 		if (nCode == JFIF_SOF1) { m_bImgSofUnsupported = false; }
+		if (nCode == JFIF_SOF2) { m_bImgSofUnsupported = false; }
+		if (nCode == JFIF_SOF3) { m_bImgSofUnsupported = false; }
+		if (nCode == JFIF_SOF9) { m_bImgSofUnsupported = false; }
+		if (nCode == JFIF_SOF10) { m_bImgSofUnsupported = false; }
 
-		// For reference, note progressive scan files even though
-		// we don't currently support their decode
+		// Progressive and arithmetic coded scans are decoded into a coefficient
+		// buffer and the image is only reconstructed after the last scan
 		if (nCode == JFIF_SOF2) { m_bImgProgressive = true; }
+		if (nCode == JFIF_SOF10) { m_bImgProgressive = true; }
+		if ((nCode == JFIF_SOF9) || (nCode == JFIF_SOF10)) { m_bImgArithmetic = true; }
+		// Lossless scans predict each sample from its neighbours (no DCT)
+		if (nCode == JFIF_SOF3) { m_bImgLossless = true; }
+		m_pImgDec->SetArithCoding(m_bImgArithmetic);
 
 
 		nLength = Buf(m_nPos)*256 + Buf(m_nPos+1);	// Lf
@@ -4965,8 +4994,8 @@ unsigned CjfifDecode::DecodeMarker()
 				else if (nCompInd == SCAN_COMP_CR) {
 					strFull += _T(" (Chrom: Cr)");
 				}
-			} else if (m_nSofNumComps_Nf == 4) {
-				// Assume YCCK
+			} else if ((m_nSofNumComps_Nf == 4) && (m_nApp14ColTransform == APP14_COLXFM_YCCK)) {
+				// YCCK per APP14 color transform
 				if (nCompInd == 1) {
 					strFull += _T(" (Y)");
 				}
@@ -4979,12 +5008,29 @@ unsigned CjfifDecode::DecodeMarker()
 				else if (nCompInd == 4) {
 					strFull += _T(" (K)");
 				}
+			} else if (m_nSofNumComps_Nf == 4) {
+				// Assume CMYK
+				if (nCompInd == 1) {
+					strFull += _T(" (C)");
+				}
+				else if (nCompInd == 2) {
+					strFull += _T(" (M)");
+				}
+				else if (nCompInd == 3) {
+					strFull += _T(" (Y)");
+				}
+				else if (nCompInd == 4) {
+					strFull += _T(" (K)");
+				}
 			} else {
 				strFull += _T(" (???)");	// Unknown
 			}
 			m_pLog->AddLine(strFull);
 
 		}
+		if ((m_nSofNumComps_Nf == 4) && (m_nApp14ColTransform == APP14_COLXFM_UNSET)) {
+			m_pLog->AddLineWarn(_T("  NOTE: No APP14 (Adobe) marker. Assuming inverted CMYK"));
+		}
 
 		// Test for bad input, clean up if bad
 		for (unsigned nCompInd=1;((!m_bStateAbort)&&(nCompInd<=m_nSofNumComps_Nf));nCompInd++)
@@ -5142,6 +5188,13 @@ unsigned CjfifDecode::DecodeMarker()
 			return DECMARK_ERR;
 		}
 
+		// Progressive images and sequential images that spread their
+		// components over several scans are decoded scan by scan into
+		// a coefficient buffer (see CimgDecode::DecodeScanProg)
+		bool bScanMulti;
+		bScanMulti = m_bImgProgressive || m_bImgArithmetic || (m_nSosNumCompScan_Ns < m_nSofNumComps_Nf) ||
+			m_pImgDec->IsScanProgPending();
+
 		unsigned nSosCompSel_Cs;
 		unsigned nSosHuffTblSel;
 		unsigned nSosHuffTblSelDc_Td;
@@ -5161,6 +5214,25 @@ unsigned CjfifDecode::DecodeMarker()
 			bRet = m_pImgDec->SetDhtTables(nScanCompInd,nSosHuffTblSelDc_Td,nSosHuffTblSelAc_Ta);
 
 			DecodeErrCheck(bRet);
+
+			// These scans can carry any of the frame components, so
+			// locate the frame component index with the matching ID (Ci)
+			if (bScanMulti || m_bImgLossless) {
+				unsigned nCompIndMatch = 0;
+				for (unsigned nCompInd=1;nCompInd<=m_nSofNumComps_Nf;nCompInd++) {
+					if (m_anSofQuantCompId[nCompInd] == nSosCompSel_Cs) {
+						nCompIndMatch = nCompInd;
+						break;
+					}
+				}
+				if (nCompIndMatch == 0) {
+					strTmp.Format(_T("  ERROR: Scan component selector 0x%02X not found in SOF"),nSosCompSel_Cs);
+					m_pLog->AddLineErr(strTmp);
+				} else {
+					bRet = m_pImgDec->SetSosCompInd(nScanCompInd,nCompIndMatch);
+					DecodeErrCheck(bRet);
+				}
+			}
 		}
 
 
@@ -5173,6 +5245,15 @@ unsigned CjfifDecode::DecodeMarker()
 		strTmp.Format(_T("  Successive approximation = 0x%02X"),m_nSosSuccApprox_A);
 		m_pLog->AddLine(strTmp);
 
+		// Sequential scans always cover the full band
+		// - Lossless scans carry the predictor (Ss) and point transform (Al)
+		if (m_bImgProgressive || m_bImgLossless) {
+			m_pImgDec->SetSosProgress(m_nSosSpectralStart_Ss,m_nSosSpectralEnd_Se,
+				(m_nSosSuccApprox_A & 0xF0)>>4,(m_nSosSuccApprox_A & 0x0F));
+		} else {
+			m_pImgDec->SetSosProgress(0,63,0,0);
+		}
+
 		if (m_pAppConfig->bOutputScanDump) {
 			m_pLog->AddLine(_T(""));
 			m_pLog->AddLine(_T("  Scan Data: (after bitstuff removed)"));
@@ -5272,22 +5353,20 @@ unsigned CjfifDecode::DecodeMarker()
 		if (m_pAppConfig->bDecodeScanImg && m_bImgSofUnsupported) {
 			// SOF marker was of type we don't support, so skip decoding
 			m_pLog->AddLineWarn(_T("  NOTE: Scan parsing doesn't support this SOF mode."));
-#ifndef DEBUG_YCCK
-		} else if (m_pAppConfig->bDecodeScanImg && (m_nSofNumComps_Nf == 4)) {
-			m_pLog->AddLineWarn(_T("  NOTE: Scan parsing doesn't support CMYK files yet."));
-#endif
 		} else if (m_pAppConfig->bDecodeScanImg && !m_bImgSofUnsupported) {
 			if (!m_bStateSofOk) {
 				m_pLog->AddLineWarn(_T("  NOTE: Scan decode disabled as SOF not decoded."));
-			} else if (!m_bStateDqtOk) {
+			} else if ((!m_bStateDqtOk) && (!m_bImgLossless)) {
 				m_pLog->AddLineWarn(_T("  NOTE: Scan decode disabled as DQT not decoded."));
-			} else if (!m_bStateDhtOk) {
+			} else if ((!m_bStateDhtOk) && (!m_bImgArithmetic)) {
 				m_pLog->AddLineWarn(_T("  NOTE: Scan decode disabled as DHT not decoded."));
 
 			} else {
 				m_pLog->AddLine(_T(""));
 
 				// Set the primary image details
+				// - 4-component images are CMYK unless APP14 indicates YCCK
+				m_pImgDec->SetColorYcck(m_nApp14ColTransform == APP14_COLXFM_YCCK);
 				m_pImgDec->SetImageDetails(m_nSofSampsPerLine_X,m_nSofNumLines_Y,
 					m_nSofNumComps_Nf,m_nSosNumCompScan_Ns,m_nImgRstEn,m_nImgRstInterval);
 
@@ -5295,9 +5374,19 @@ unsigned CjfifDecode::DecodeMarker()
 				// changed, offset changed, scan option changed)
 				// TODO: In order to decode multiple scans, we will need to alter the
 				// way that m_pImgSrcDirty is set
+				// - A progressive or multi-scan sequential image is decoded
+				//   one scan at a time and is completed after the last scan
+				//   (see ProcessFile)
 				if (m_pImgSrcDirty) {
-					m_pImgDec->DecodeScanImg(nPosScanStart,true,false);
-					m_pImgSrcDirty = false;
+					if (m_bImgLossless) {
+						m_pImgDec->DecodeScanLossless(nPosScanStart,true,false);
+						m_pImgSrcDirty = false;
+					} else if (bScanMulti) {
+						m_pImgDec->DecodeScanProg(nPosScanStart,true);
+					} else {
+						m_pImgDec->DecodeScanImg(nPosScanStart,true,false);
+						m_pImgSrcDirty = false;
+					}
 				}
 			}
 
@@ -7450,6 +7539,14 @@ void CjfifDecode::ProcessFile(CFile* inFile)
 		}
 	}
 
+	// Reconstruct a progressive or multi-scan sequential image now that
+	// all of its scans have been decoded (even if the EOI was missing)
+	if (m_pImgDec->IsScanProgPending()) {
+		m_pLog->AddLine(_T(""));
+		m_pImgDec->DecodeScanProgEnd(true,false);
+		m_pImgSrcDirty = false;
+	}
+
 	// -----------------------------------------------------------
 	// Perform any other informational calculations that require all tables
 	// to be present.
@@ -157,6 +157,7 @@ public:
 	unsigned		GetDqtQuantStd(unsigned nInd);
 
 	bool			GetDecodeStatus();
+	void			GetCodingMode(bool &bProgressive,bool &bArithmetic,bool &bLossless);
 
 private:
 
@@ -316,6 +317,8 @@ private:
 	unsigned		m_nImgThumbSizeY;
 
 	bool			m_bImgProgressive;		// Progressive scan?
+	bool			m_bImgArithmetic;		// Arithmetic coded scan?
+	bool			m_bImgLossless;			// Lossless (predictive) scan?
 	bool			m_bImgSofUnsupported;	// SOF mode unsupported - skip SOI content
 
 	CString			m_strComment;			// Comment string
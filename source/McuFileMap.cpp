@@ -0,0 +1,324 @@
+// JPEGsnoop - JPEG Image Decoder & Analysis Utility
+// Copyright (C) 2017 - Calvin Hass
+// http://www.impulseadventure.com/photo/jpeg-snoop.html
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "stdafx.h"
+
+#include "McuFileMap.h"
+
+
+// Decode the difference to the previous MCU
+// - Zigzag mapped signed value, 7 bits per byte (low bits first)
+//
+// INPUT:
+// - pPool					= Difference pool
+// - nOfs					= Offset of the difference in the pool
+// OUTPUT:
+// - nOfs					= Offset of the next difference
+// RETURN:
+// - Difference (modulo 2^64)
+//
+static inline ULONGLONG GetDiff(const BYTE* pPool,unsigned &nOfs)
+{
+	ULONGLONG	nZz = 0;
+	for (unsigned nShift=0;;nShift+=7) {
+		BYTE	nByte = pPool[nOfs++];
+		nZz |= (ULONGLONG)(nByte & 0x7F) << nShift;
+		if ((nByte & 0x80) == 0) {
+			break;
+		}
+	}
+	return (nZz >> 1) ^ (0 - (nZz & 1));
+}
+
+// Constructor for the MCU file map
+// - The map is empty until Alloc()
+//
+CMcuFileMap::CMcuFileMap()
+{
+	m_nGroupNum = 0;
+	m_anAnchor = NULL;
+	m_anGroupOfs = NULL;
+	m_pPool = NULL;
+	m_nPoolSize = 0;
+	m_nMcuBegin = 0;
+	m_nMcuEnd = 0;
+	Clear();
+}
+
+CMcuFileMap::~CMcuFileMap()
+{
+	Free();
+}
+
+// Allocate the map for a range of MCUs
+//
+// INPUT:
+// - nMcuBegin				= First MCU of the map
+// - nMcuEnd				= MCU after the last one of the map
+// RETURN:
+// - False if there is not enough memory
+//
+bool CMcuFileMap::Alloc(unsigned nMcuBegin,unsigned nMcuEnd)
+{
+	Free();
+	m_nMcuBegin = nMcuBegin;
+	m_nMcuEnd = nMcuEnd;
+	m_nGroupNum = (nMcuEnd - nMcuBegin + MCU_MAP_GROUP-1) / MCU_MAP_GROUP;
+	m_anAnchor = new ULONGLONG[m_nGroupNum+1];
+	m_anGroupOfs = new unsigned[m_nGroupNum+1];
+	if ((!m_anAnchor) || (!m_anGroupOfs) || (!PoolReserve((nMcuEnd - nMcuBegin) * 2))) {
+		Free();
+		return false;
+	}
+	Clear();
+	return true;
+}
+
+// Release the map
+//
+void CMcuFileMap::Free()
+{
+	if (m_anAnchor) {
+		delete [] m_anAnchor;
+		m_anAnchor = NULL;
+	}
+	if (m_anGroupOfs) {
+		delete [] m_anGroupOfs;
+		m_anGroupOfs = NULL;
+	}
+	if (m_pPool) {
+		delete [] m_pPool;
+		m_pPool = NULL;
+	}
+	m_nGroupNum = 0;
+	m_nPoolSize = 0;
+	m_nMcuEnd = m_nMcuBegin;
+	Clear();
+}
+
+// Remove all MCU positions (keeping the allocation)
+//
+void CMcuFileMap::Clear()
+{
+	m_nMcuNext = m_nMcuBegin;
+	m_nBitPosLast = 0;
+	m_nPoolLen = 0;
+}
+
+// Ensure that the difference pool has space for more bytes
+// - The pool grows by doubling
+//
+// INPUT:
+// - nLen					= Number of bytes to be added
+// RETURN:
+// - False if there is not enough memory
+//
+bool CMcuFileMap::PoolReserve(unsigned nLen)
+{
+	if (m_nPoolLen + nLen <= m_nPoolSize) {
+		return true;
+	}
+	unsigned	nSize = max(max(m_nPoolSize*2,m_nPoolLen+nLen),(unsigned)1024);
+	BYTE*		pPool = new BYTE[nSize];
+	if (!pPool) {
+		return false;
+	}
+	if (m_pPool) {
+		memcpy(pPool,m_pPool,m_nPoolLen);
+		delete [] m_pPool;
+	}
+	m_pPool = pPool;
+	m_nPoolSize = nSize;
+	return true;
+}
+
+// Add the position of the next MCU
+//
+// INPUT:
+// - nBitPos				= Position of the MCU (bits)
+//
+void CMcuFileMap::Put(ULONGLONG nBitPos)
+{
+	unsigned	nInd = m_nMcuNext - m_nMcuBegin;
+	unsigned	nGroup = nInd / MCU_MAP_GROUP;
+
+	if (nInd % MCU_MAP_GROUP == 0) {
+		m_anAnchor[nGroup] = nBitPos;
+		m_anGroupOfs[nGroup] = m_nPoolLen;
+	} else {
+		if (!PoolReserve(MCU_MAP_VAL_MAX)) {
+			// Out of memory: the remaining MCUs are left unmapped
+			m_nMcuEnd = m_nMcuNext;
+			return;
+		}
+		// Zigzag map the signed difference, then 7 bits per byte
+		LONGLONG	nDiff = (LONGLONG)(nBitPos - m_nBitPosLast);
+		ULONGLONG	nZz = ((ULONGLONG)nDiff << 1) ^ ((nDiff < 0) ? ~(ULONGLONG)0 : 0);
+		while (nZz >= 0x80) {
+			m_pPool[m_nPoolLen++] = (BYTE)(nZz | 0x80);
+			nZz >>= 7;
+		}
+		m_pPool[m_nPoolLen++] = (BYTE)nZz;
+	}
+	m_nBitPosLast = nBitPos;
+	m_nMcuNext++;
+}
+
+// Set the position of an MCU
+// - MCUs must be set in increasing order. Any MCUs that were skipped
+//   are given the position of the last MCU set. An MCU that was
+//   already set is left unchanged.
+//
+// INPUT:
+// - nMcuXY					= MCU index
+// - nBitPos				= Position of the first bit of the MCU
+//
+void CMcuFileMap::Set(unsigned nMcuXY,ULONGLONG nBitPos)
+{
+	if ((nMcuXY < m_nMcuNext) || (nMcuXY >= m_nMcuEnd)) {
+		return;
+	}
+	while ((m_nMcuNext < nMcuXY) && (m_nMcuNext < m_nMcuEnd)) {
+		Put(m_nBitPosLast);
+	}
+	if (m_nMcuNext == nMcuXY) {
+		Put(nBitPos);
+	}
+}
+
+// Append the MCU positions of another map
+// - The other map covers the MCUs after those of this map
+//
+// INPUT:
+// - pSrc					= Map to append
+// - nBitPosFirst			= Position of the first MCU of pSrc (replaces
+//                            the position in pSrc)
+//
+void CMcuFileMap::Append(const CMcuFileMap* pSrc,ULONGLONG nBitPosFirst)
+{
+	for (unsigned nGroup=0;nGroup*MCU_MAP_GROUP<pSrc->m_nMcuNext-pSrc->m_nMcuBegin;nGroup++) {
+		unsigned	nMcuXY = pSrc->m_nMcuBegin + nGroup*MCU_MAP_GROUP;
+		unsigned	nMcuNum = pSrc->GroupMcuNum(nGroup);
+		unsigned	nOfs = pSrc->m_anGroupOfs[nGroup];
+		ULONGLONG	nBitPos = pSrc->m_anAnchor[nGroup];
+
+		for (unsigned nInd=0;nInd<nMcuNum;nInd++,nMcuXY++) {
+			if (nInd > 0) {
+				nBitPos += GetDiff(pSrc->m_pPool,nOfs);
+			}
+			Set(nMcuXY,(nMcuXY == pSrc->m_nMcuBegin) ? nBitPosFirst : nBitPos);
+		}
+	}
+}
+
+// Determine the number of MCUs written in a group
+//
+unsigned CMcuFileMap::GroupMcuNum(unsigned nGroup) const
+{
+	unsigned	nInd = nGroup * MCU_MAP_GROUP;
+	return min(m_nMcuNext - m_nMcuBegin - nInd,(unsigned)MCU_MAP_GROUP);
+}
+
+// Determine the position of the last MCU written in a group
+//
+ULONGLONG CMcuFileMap::GroupLast(unsigned nGroup) const
+{
+	return Get(m_nMcuBegin + nGroup*MCU_MAP_GROUP + GroupMcuNum(nGroup) - 1);
+}
+
+// Fetch the position of an MCU
+//
+// INPUT:
+// - nMcuXY					= MCU index
+// RETURN:
+// - Position of the first bit of the MCU (0 if not mapped)
+//
+ULONGLONG CMcuFileMap::Get(unsigned nMcuXY) const
+{
+	if ((nMcuXY < m_nMcuBegin) || (nMcuXY >= m_nMcuNext)) {
+		return 0;
+	}
+	unsigned	nInd = nMcuXY - m_nMcuBegin;
+	unsigned	nGroup = nInd / MCU_MAP_GROUP;
+	unsigned	nOfs = m_anGroupOfs[nGroup];
+	ULONGLONG	nBitPos = m_anAnchor[nGroup];
+
+	for (unsigned nDiff=0;nDiff<nInd%MCU_MAP_GROUP;nDiff++) {
+		nBitPos += GetDiff(m_pPool,nOfs);
+	}
+	return nBitPos;
+}
+
+// Find the MCU that contains a file position
+// - The MCU with the highest position not beyond nBitPos. Of several
+//   MCUs at the same position (skipped MCUs), the first is returned.
+// - The last MCU extends to the end of the file
+//
+// INPUT:
+// - nBitPos				= Position (bits)
+// OUTPUT:
+// - nMcuXY					= MCU index
+// RETURN:
+// - False if the position is before the first MCU (or the map is empty)
+//
+bool CMcuFileMap::Find(ULONGLONG nBitPos,unsigned &nMcuXY) const
+{
+	unsigned	nGroupUsed = (m_nMcuNext - m_nMcuBegin + MCU_MAP_GROUP-1) / MCU_MAP_GROUP;
+	if ((nGroupUsed == 0) || (nBitPos < m_anAnchor[0])) {
+		return false;
+	}
+
+	// Last group that starts at or before the position
+	unsigned	nLo = 0;
+	unsigned	nHi = nGroupUsed;
+	while (nHi - nLo > 1) {
+		unsigned	nMid = (nLo + nHi) / 2;
+		if (m_anAnchor[nMid] <= nBitPos) {
+			nLo = nMid;
+		} else {
+			nHi = nMid;
+		}
+	}
+
+	// Search the group. If the position is that of the first MCU of
+	// the group and the previous group ends with the same position
+	// (skipped MCUs), the first of those MCUs is in the previous group.
+	for (;;) {
+		unsigned	nMcuNum = GroupMcuNum(nLo);
+		unsigned	nOfs = m_anGroupOfs[nLo];
+		ULONGLONG	nBitPosCur = m_anAnchor[nLo];
+		ULONGLONG	nBitPosFound = nBitPosCur;
+		unsigned	nIndFound = 0;
+		for (unsigned nInd=1;nInd<nMcuNum;nInd++) {
+			nBitPosCur += GetDiff(m_pPool,nOfs);
+			if (nBitPosCur > nBitPos) {
+				break;
+			}
+			if (nBitPosCur > nBitPosFound) {
+				nBitPosFound = nBitPosCur;
+				nIndFound = nInd;
+			}
+		}
+		nMcuXY = m_nMcuBegin + nLo*MCU_MAP_GROUP + nIndFound;
+		if ((nIndFound > 0) || (nLo == 0) || (GroupLast(nLo-1) != nBitPosFound)) {
+			break;
+		}
+		nLo--;
+	}
+	return true;
+}
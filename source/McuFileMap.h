@@ -0,0 +1,75 @@
+// JPEGsnoop - JPEG Image Decoder & Analysis Utility
+// Copyright (C) 2017 - Calvin Hass
+// http://www.impulseadventure.com/photo/jpeg-snoop.html
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// ==========================================================================
+// CLASS DESCRIPTION:
+// - Map between the MCUs of a scan and their position in the file
+//   (the position of the first bit of each MCU)
+// - Positions are bit offsets from the start of the file (64-bit)
+// - MCUs are grouped (MCU_MAP_GROUP per group). Each group has the
+//   absolute position of its first MCU (the anchor). The other MCUs
+//   are stored as the difference to the previous MCU, variable length
+//   coded (typically 2 bytes per MCU).
+// - Forward lookup (MCU to position) decodes at most one group.
+//   Reverse lookup (position to MCU) is a binary search of the
+//   anchors followed by a search of one group.
+// - The map is written in MCU order. MCUs that are skipped are given
+//   the position of the previous MCU.
+//
+// ==========================================================================
+
+
+#pragma once
+
+#define MCU_MAP_GROUP		64			// MCUs per anchor
+#define MCU_MAP_VAL_MAX		10			// Longest variable length coded difference (bytes)
+
+class CMcuFileMap
+{
+public:
+	CMcuFileMap();
+	~CMcuFileMap();
+
+	bool		Alloc(unsigned nMcuBegin,unsigned nMcuEnd);
+	void		Free();
+	void		Clear();
+
+	void		Set(unsigned nMcuXY,ULONGLONG nBitPos);
+	void		Append(const CMcuFileMap* pSrc,ULONGLONG nBitPosFirst);
+	ULONGLONG	Get(unsigned nMcuXY) const;
+	bool		Find(ULONGLONG nBitPos,unsigned &nMcuXY) const;
+
+private:
+	void		Put(ULONGLONG nBitPos);
+	bool		PoolReserve(unsigned nLen);
+	ULONGLONG	GroupLast(unsigned nGroup) const;
+	unsigned	GroupMcuNum(unsigned nGroup) const;
+
+	unsigned	m_nMcuBegin;		// First MCU of the map
+	unsigned	m_nMcuEnd;			// MCU after the last one of the map
+	unsigned	m_nMcuNext;			// Next MCU to be written
+	ULONGLONG	m_nBitPosLast;		// Position of the last MCU written
+
+	unsigned	m_nGroupNum;		// Number of groups allocated
+	ULONGLONG*	m_anAnchor;			// Position of the first MCU of each group
+	unsigned*	m_anGroupOfs;		// Offset of the differences of each group in m_pPool
+
+	BYTE*		m_pPool;			// Differences to the previous MCU
+	unsigned	m_nPoolLen;			// Bytes used
+	unsigned	m_nPoolSize;		// Bytes allocated
+};
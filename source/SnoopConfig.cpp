@@ -52,6 +52,7 @@ CSnoopConfig::CSnoopConfig(void)
 
 	eCmdLineOffset = DEC_OFFSET_START;
 	nCmdLineOffsetPos = 0;
+	nCmdLineBenchRuns = 0;
 
 	bCmdLineHelp = false;
 
@@ -68,6 +69,14 @@ CSnoopConfig::CSnoopConfig(void)
 	bReprocessAuto = false;
 	bDecodeScanImg = true;
 	bDecodeScanImgAc = false;		// Coach message will be shown just in case
+	nDecodeScanScale = SCAN_SCALE_1;	// Full size scan image decode
+	nDecodeScanThreads = 0;			// One thread per CPU for parallel / pipelined scan decode
+	nDecodeLosslessMapMax = 512;	// Keep lossless images up to 512 MB in memory
+	nDecodeScanMemMax = 1024;		// Decode images in bands above 1 GB of pixel maps
+	nDecodeScanCkptMcus = 128;		// Checkpoint the entropy decoder every 128 MCUs
+	bDecodeScanPlane8 = false;		// Keep pixel planes at 16-bit (YCC adjust before clipping)
+	bDecodeScanIndex = false;		// Don't write scan index files unless requested
+	nPreviewCacheMax = 256;			// Keep up to 256 MB of previews in other channel modes
 	bSigSearch = true;
 
 	bOutputScanDump = false;		// Print snippet of scan data
@@ -209,6 +218,14 @@ void CSnoopConfig::RegistryLoad()
 	RegistryLoadBool(_T("General\\SigSearch"),      999,   bSigSearch);
 	RegistryLoadBool(_T("General\\DecScanImg"),     999,   bDecodeScanImg);
 	RegistryLoadBool(_T("General\\DecScanImgAc"),   999,   bDecodeScanImgAc);
+	RegistryLoadUint(_T("General\\DecScanScale"),   999,   nDecodeScanScale);
+	RegistryLoadUint(_T("General\\DecScanThreads"), 999,   nDecodeScanThreads);
+	RegistryLoadUint(_T("General\\DecLosslessMapMax"), 999, nDecodeLosslessMapMax);
+	RegistryLoadUint(_T("General\\DecScanMemMax"), 999,  nDecodeScanMemMax);
+	RegistryLoadUint(_T("General\\DecScanCkptMcus"), 999, nDecodeScanCkptMcus);
+	RegistryLoadBool(_T("General\\DecScanPlane8"), 999,  bDecodeScanPlane8);
+	RegistryLoadBool(_T("General\\DecScanIndex"), 999,  bDecodeScanIndex);
+	RegistryLoadUint(_T("General\\PreviewCacheMax"), 999, nPreviewCacheMax);
 
 	RegistryLoadBool(_T("General\\DumpScan"),       999,   bOutputScanDump);
 	RegistryLoadBool(_T("General\\DumpDHTExpand"),  999,   bOutputDHTexpand);
@@ -257,6 +274,14 @@ void CSnoopConfig::RegistryStore()
 	RegistryStoreBool( _T("General\\SigSearch"),      bSigSearch);
 	RegistryStoreBool( _T("General\\DecScanImg"),     bDecodeScanImg);
 	RegistryStoreBool( _T("General\\DecScanImgAc"),   bDecodeScanImgAc);
+	RegistryStoreUint( _T("General\\DecScanScale"),   nDecodeScanScale);
+	RegistryStoreUint( _T("General\\DecScanThreads"), nDecodeScanThreads);
+	RegistryStoreUint( _T("General\\DecLosslessMapMax"), nDecodeLosslessMapMax);
+	RegistryStoreUint( _T("General\\DecScanMemMax"),  nDecodeScanMemMax);
+	RegistryStoreUint( _T("General\\DecScanCkptMcus"), nDecodeScanCkptMcus);
+	RegistryStoreBool( _T("General\\DecScanPlane8"),  bDecodeScanPlane8);
+	RegistryStoreBool( _T("General\\DecScanIndex"),  bDecodeScanIndex);
+	RegistryStoreUint( _T("General\\PreviewCacheMax"), nPreviewCacheMax);
 
 	RegistryStoreBool( _T("General\\DumpScan"),       bOutputScanDump);
 	RegistryStoreBool( _T("General\\DumpDHTExpand"),  bOutputDHTexpand);
@@ -90,6 +90,7 @@ public:
 
 	teOffsetMode	eCmdLineOffset;		// Offset operating mode
 	unsigned long	nCmdLineOffsetPos;	// File offset for DEC_OFFSET_POS mode
+	unsigned	nCmdLineBenchRuns;		// Scan decode benchmark runs (0=no benchmark)
 
 	bool		bCmdLineHelp;			// Show command list
 
@@ -110,6 +111,14 @@ public:
 	bool		bSigSearch;				// Automatically search for comp signatures
 	bool		bDecodeScanImg;			// Scan image decode enabled
 	bool		bDecodeScanImgAc;		// When scan image decode, do full AC
+	unsigned	nDecodeScanScale;		// Scan image decode scale (teScanScale)
+	unsigned	nDecodeScanThreads;		// Scan image decode threads (0=auto, 1=no parallel decode)
+	unsigned	nDecodeLosslessMapMax;	// Largest lossless image kept in memory (MB, 0=never)
+	unsigned	nDecodeScanMemMax;		// Scan image decoded in bands above this size (MB, 0=no limit)
+	unsigned	nDecodeScanCkptMcus;	// Entropy decoder checkpoint every this many MCUs (0=none)
+	bool		bDecodeScanPlane8;		// Pixel planes of 8-bit images kept as clipped bytes after the preview (non-GUI only)
+	bool		bDecodeScanIndex;		// Scan decode results saved to an index file beside the image (loaded for DC only decodes)
+	unsigned	nPreviewCacheMax;		// Previews of other channel modes kept for switching back (MB, 0=none)
 	bool		bOutputScanDump;		// Do we dump a portion of scan data?
 	bool		bOutputDHTexpand;
 	bool		bDecodeMaker;
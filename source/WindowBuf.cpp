@@ -44,6 +44,7 @@ CwindowBuf::CwindowBuf()
 	}
 
 	m_pStatBar = NULL;
+	m_bBufMem = false;
 
 	Reset();
 
@@ -60,7 +61,7 @@ CwindowBuf::CwindowBuf()
 // Destructor deallocates buffers and overlays
 CwindowBuf::~CwindowBuf()
 {
-	if (m_pBuffer != NULL) {
+	if ((m_pBuffer != NULL) && (!m_bBufMem)) {
 		delete m_pBuffer;
 		m_pBuffer = NULL;
 		m_bBufOK = false;
@@ -126,6 +127,40 @@ void CwindowBuf::BufFileUnset()
 }
 
 
+// Use a block of memory as the buffer instead of a file
+// - The memory holds a copy of the file content from nStart
+//   and stays as the window for the life of the buffer. Reads
+//   outside of it fail as they would beyond the end of a file.
+// - Used to give each scan decode worker its own buffer
+//   (CimgDecode::DecodeScanParallel) since the file window
+//   can't be shared between threads
+// - The memory is not copied and remains owned by the caller
+//
+// INPUT:
+// - pData				= Copy of the file content
+// - nStart				= File offset of pData[0]
+// - nLen				= Number of bytes in pData
+// POST:
+// - m_pBuffer
+// - m_nBufWinStart
+// - m_nBufWinSize
+// - m_nPosEof
+//
+void CwindowBuf::BufMemSet(BYTE* pData,unsigned long nStart,unsigned long nLen)
+{
+	ASSERT(pData);
+	if (!m_bBufMem) {
+		delete [] m_pBuffer;
+	}
+	m_bBufMem = true;
+	m_pBuffer = pData;
+	m_pBufFile = NULL;
+	m_nBufWinStart = nStart;
+	m_nBufWinSize = nLen;
+	m_nPosEof = nStart + nLen;
+	m_bBufOK = true;
+}
+
 // Search for a value in the buffer from a given starting position
 // and direction, limited to a maximum search depth
 // - Search value can be 8-bit, 16-bit or 32-bit
@@ -351,6 +386,11 @@ bool CwindowBuf::BufSearchX(unsigned long nStartPos, BYTE* anSearchVal, unsigned
 void CwindowBuf::BufLoadWindow(unsigned long nPosition)
 {
 
+	// A memory buffer has a fixed window
+	if (m_bBufMem) {
+		return;
+	}
+
 	// We must not try to perform a seek command on a CFile that
 	// has already been closed, so we must check first.
 
@@ -651,7 +691,7 @@ inline BYTE CwindowBuf::Buf(unsigned long nOffset,bool bClean)
 	if (!m_pBufFile) {
 		// FIXME: Open file or provide error
 	}
-	ASSERT(m_pBufFile);
+	ASSERT(m_pBufFile || m_bBufMem);
 
 	// Allow for overlay buffer capability (if not in "clean" mode)
 	if (!bClean) {
@@ -713,6 +753,49 @@ inline BYTE CwindowBuf::Buf(unsigned long nOffset,bool bClean)
 	}
 }
 
+// Fetch a block of bytes from the managed window/cache
+// - Intended for bulk readers such as the scan decoder refill
+// - If the block lies within the current window and no enabled
+//   overlay spans it then it is copied directly, otherwise
+//   we fall back to the byte-wise Buf() access (which handles
+//   overlays, window reloads and overreads)
+//
+// INPUT:
+// - nOffset			File offset to fetch from (via cache)
+// - nLen				Number of bytes to fetch
+// OUTPUT:
+// - pDst				Destination array (at least nLen bytes)
+//
+void CwindowBuf::BufCopy(unsigned long nOffset,unsigned nLen,BYTE* pDst)
+{
+	long		nWinRel;
+	bool		bDirect;
+
+	ASSERT(pDst);
+
+	nWinRel = nOffset-m_nBufWinStart;
+	bDirect = (nWinRel >= 0) && (nWinRel+nLen <= m_nBufWinSize);
+
+	// Any overlay that spans the block requires the byte-wise path
+	for (unsigned nInd=0;(bDirect)&&(nInd<m_nOverlayNum);nInd++) {
+		if ((m_psOverlay[nInd]) && (m_psOverlay[nInd]->bEn)) {
+			if ((nOffset < m_psOverlay[nInd]->nStart + m_psOverlay[nInd]->nLen) &&
+				(nOffset+nLen > m_psOverlay[nInd]->nStart))
+			{
+				bDirect = false;
+			}
+		}
+	}
+
+	if (bDirect) {
+		memcpy(pDst,&m_pBuffer[nWinRel],nLen);
+	} else {
+		for (unsigned nInd=0;nInd<nLen;nInd++) {
+			pDst[nInd] = Buf(nOffset+nInd);
+		}
+	}
+}
+
 // Replaces the direct buffer access with a managed refillable window/cache.
 // - Supports 1/2/4 byte fetch
 // - No support for overlays
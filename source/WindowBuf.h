@@ -75,8 +75,10 @@ public:
 	void			BufLoadWindow(unsigned long nPosition);
 	void			BufFileSet(CFile* inFile);
 	void			BufFileUnset();
+	void			BufMemSet(BYTE* pData,unsigned long nStart,unsigned long nLen);
 	BYTE			Buf(unsigned long nOffset,bool bClean=false);
 	unsigned		BufX(unsigned long nOffset,unsigned nSz,bool bByteSwap=false);
+	void			BufCopy(unsigned long nOffset,unsigned nLen,BYTE* pDst);
 
 	unsigned char	BufRdAdv1(unsigned long &nOffset,bool bByteSwap);
 	unsigned short	BufRdAdv2(unsigned long &nOffset,bool bByteSwap);
@@ -113,6 +115,7 @@ private:
 private:
 	BYTE*			m_pBuffer;
 	CFile*			m_pBufFile;
+	bool			m_bBufMem;		// Window is a fixed memory block (BufMemSet)
 	unsigned long	m_nBufWinSize;
 	unsigned long	m_nBufWinStart;
 
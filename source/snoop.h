@@ -45,8 +45,6 @@
 //#define DEBUG_LOG_OUT
 #define DEBUG_EN		0
 
-//#define DEBUG_YCCK
-
 // Disable code that isn't fully implemented yet
 //#define TODO
 
@@ -165,6 +163,9 @@ enum teLandscape {
 
 enum teOffsetMode {DEC_OFFSET_START,DEC_OFFSET_SRCH1,DEC_OFFSET_SRCH2,DEC_OFFSET_POS};
 
+// Scaled scan decode: image dimensions are divided by (1<<scale)
+enum teScanScale {SCAN_SCALE_1,SCAN_SCALE_2,SCAN_SCALE_4,SCAN_SCALE_8,SCAN_SCALE_END};
+
 // Define a few coach messages
 
 #define COACH_REPROCESS_AUTO _T("You have changed a processing option. To see these changes, ")\
@@ -0,0 +1,37 @@
+@echo off
+rem JPEGsnoop - Scan decode benchmark
+rem - Compares the scan decode time of the Huffman and arithmetic coded
+rem   (sequential and progressive) equivalents of one image
+rem - The equivalents are made by lossless transcoding with jpegtran
+rem   (libjpeg 7 or later / libjpeg-turbo, on the PATH), so that all four
+rem   files decode to the same coefficients
+rem - Each file is timed by JPEGsnoop -bench_scan (see
+rem   CJPEGsnoopCore::DoBenchScan); the full logs are left in the
+rem   output directory
+rem - Not yet run: there are no reference timings for comparison
+rem
+rem Usage: BenchScan.bat <image.jpg> [runs]
+
+setlocal
+if "%~1"=="" (
+	echo Usage: BenchScan.bat ^<image.jpg^> [runs]
+	exit /b 1
+)
+set SRC=%~1
+set RUNS=%~2
+if "%RUNS%"=="" set RUNS=10
+set EXE=%~dp0..\x64\Release\JPEGsnoop.exe
+set OUT=%TEMP%\JPEGsnoopBench
+if not exist "%OUT%" mkdir "%OUT%"
+
+jpegtran -copy none -optimize "%SRC%" "%OUT%\huff_seq.jpg" || exit /b 1
+jpegtran -copy none -progressive "%SRC%" "%OUT%\huff_prog.jpg" || exit /b 1
+jpegtran -copy none -arithmetic "%SRC%" "%OUT%\arith_seq.jpg" || exit /b 1
+jpegtran -copy none -arithmetic -progressive "%SRC%" "%OUT%\arith_prog.jpg" || exit /b 1
+
+for %%F in (huff_seq huff_prog arith_seq arith_prog) do (
+	start "" /wait "%EXE%" -i "%OUT%\%%F.jpg" -o "%OUT%\%%F.txt" -scan -bench_scan %RUNS%
+	echo %%F:
+	findstr /C:"  Coding  " /C:"  Parse " /C:"  Scan decode  " "%OUT%\%%F.txt"
+)
+echo Logs in %OUT%
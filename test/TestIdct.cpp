@@ -0,0 +1,284 @@
+// JPEGsnoop - JPEG Image Decoder & Analysis Utility
+// Copyright (C) 2017 - Calvin Hass
+// http://www.impulseadventure.com/photo/jpeg-snoop.html
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// ==========================================================================
+// MODULE DESCRIPTION:
+// - IDCT accuracy test (console, built by "nmake tests")
+// - Feeds random and edge-case coefficient blocks through the AAN float
+//   IDCT (full and sparse), the fixed point AAN IDCT and the reference
+//   (matrix) IDCT used by CimgDecode::PrecalcIdct / DecodeIdctCalcRef
+// - The AAN results must agree with the reference to within the bounds
+//   used by CimgDecode::DecodeIdctCheck, relative to the block amplitude
+//   for 12-bit ranges
+// - Returns 0 if all blocks pass
+//
+// ==========================================================================
+
+#include "stdafx.h"
+#include "ImgDecodeSimd.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Error bounds in IDCT output units (1/8 of a sample)
+#define TEST_IDCT_ERR_FLOAT		0.1
+#define TEST_IDCT_ERR_INT		2.0
+// Additional error allowed per unit of the largest reference output
+// (float rounding at 12-bit amplitudes)
+#define TEST_IDCT_ERR_REL		1.0e-5
+
+#define TEST_IDCT_RAND_NUM		20000	// Random blocks per range
+
+// Coefficient ranges: largest dequantized coefficient magnitude
+// - 8-bit DCT coefficients are within +/-2047 and 12-bit within +/-32767
+static const int glb_anTestRange[] = { 16, 256, 2047, 32767 };
+#define TEST_RANGE_NUM	(sizeof(glb_anTestRange)/sizeof(glb_anTestRange[0]))
+
+// Luminance quantization table (itu-t81.pdf, Table K.1), normal order
+static const unsigned short glb_anDqtLum[64] = {
+	16, 11, 10, 16, 24, 40, 51, 61,
+	12, 12, 14, 19, 26, 58, 60, 55,
+	14, 13, 16, 24, 40, 57, 69, 56,
+	14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68,109,103, 77,
+	24, 35, 55, 64, 81,104,113, 92,
+	49, 64, 78, 87,103,121,120,101,
+	72, 92, 95, 98,112,100,103, 99
+};
+
+// Zigzag index of each normal order coefficient
+static const unsigned glb_anZigzag[64] = {
+	 0,  1,  5,  6, 14, 15, 27, 28,
+	 2,  4,  7, 13, 16, 26, 29, 42,
+	 3,  8, 12, 17, 25, 30, 41, 43,
+	 9, 11, 18, 24, 31, 40, 44, 53,
+	10, 19, 23, 32, 39, 45, 52, 54,
+	20, 22, 33, 38, 46, 51, 55, 60,
+	21, 34, 37, 47, 50, 56, 59, 61,
+	35, 36, 48, 49, 57, 58, 62, 63
+};
+
+static float		glb_afLookup[64][64];
+static unsigned		glb_nBlockNum = 0;		// Per range
+static unsigned		glb_nFailNum = 0;
+static double		glb_dErrMaxFloat = 0;
+static double		glb_dErrMaxInt = 0;
+static unsigned		glb_nRandState = 12345;
+
+// Deterministic random number (LCG) so that failures are repeatable
+static unsigned TestRand()
+{
+	glb_nRandState = glb_nRandState * 1103515245 + 12345;
+	return (glb_nRandState >> 8) & 0xFFFFFF;
+}
+
+// Random value in -nMax..nMax
+static int TestRandRange(int nMax)
+{
+	return (int)(TestRand() % (2*(unsigned)nMax+1)) - nMax;
+}
+
+// Compare two float blocks by value
+static bool TestBlockEqual(const float* pfA,const float* pfB)
+{
+	for (unsigned nInd=0;nInd<64;nInd++) {
+		if (pfA[nInd] != pfB[nInd]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Run one block through all of the IDCT paths and compare against
+// the reference
+//
+// INPUT:
+// - strName				= Test case name (for the failure report)
+// - pnCoef					= Quantized coefficients (normal order)
+// - pnDqt					= DQT table (normal order)
+//
+static void TestIdctBlock(const char* strName,const short* pnCoef,const unsigned short* pnDqt)
+{
+	const ImgDecodeKernels*	pKernels = ImgDecodeSimdGet(SIMD_LEVEL_SCALAR);
+	float		afMult[64];
+	int			anMult[64];
+	float		afRef[64];
+	float		afFloat[64];
+	float		afSparse[64];
+	int			anInt[64];
+	unsigned	nInd;
+	unsigned	nZzMax = 0;
+	double		dRefMax = 0;
+	double		dErrFloat = 0;
+	double		dErrInt = 0;
+	double		dErr;
+
+	for (nInd=0;nInd<64;nInd++) {
+		ImgDecodeIdctMult(pnDqt[nInd],nInd,afMult[nInd],anMult[nInd]);
+		if ((pnCoef[nInd] != 0) && (glb_anZigzag[nInd] > nZzMax)) {
+			nZzMax = glb_anZigzag[nInd];
+		}
+	}
+
+	ImgDecodeIdctRef(glb_afLookup,pnCoef,pnDqt,afRef);
+	pKernels->pfnDequantFloat(pnCoef,afMult,afFloat);
+	pKernels->pfnIdctFloat(afFloat);
+	pKernels->pfnIdctInt(pnCoef,anMult,anInt);
+
+	for (nInd=0;nInd<64;nInd++) {
+		if (fabs(afRef[nInd]) > dRefMax) {
+			dRefMax = fabs(afRef[nInd]);
+		}
+	}
+	for (nInd=0;nInd<64;nInd++) {
+		dErr = fabs(afFloat[nInd] - afRef[nInd]);
+		if (dErr > dErrFloat) {
+			dErrFloat = dErr;
+		}
+		dErr = fabs(anInt[nInd] - afRef[nInd]);
+		if (dErr > dErrInt) {
+			dErrInt = dErr;
+		}
+	}
+
+	// The sparse paths must give the same result as the full float IDCT
+	// - Compared by value as zero outputs may differ in sign
+	bool	bSparseOk = true;
+	if (nZzMax <= IDCT_ZZ_MAX_4X4) {
+		pKernels->pfnIdctFloat4x4(pnCoef,afMult,afSparse);
+		bSparseOk = TestBlockEqual(afSparse,afFloat);
+	}
+	if (bSparseOk && (nZzMax <= IDCT_ZZ_MAX_2X2)) {
+		pKernels->pfnIdctFloat2x2(pnCoef,afMult,afSparse);
+		bSparseOk = TestBlockEqual(afSparse,afFloat);
+	}
+
+	glb_nBlockNum++;
+	if (dErrFloat > glb_dErrMaxFloat) {
+		glb_dErrMaxFloat = dErrFloat;
+	}
+	if (dErrInt > glb_dErrMaxInt) {
+		glb_dErrMaxInt = dErrInt;
+	}
+
+	double	dRel = dRefMax * TEST_IDCT_ERR_REL;
+	if ((dErrFloat > TEST_IDCT_ERR_FLOAT + dRel) || (dErrInt > TEST_IDCT_ERR_INT + dRel) || !bSparseOk) {
+		glb_nFailNum++;
+		if (glb_nFailNum <= 10) {
+			printf("FAIL: %s: float err=%.4f int err=%.4f ref max=%.1f sparse=%s\n",
+				strName,dErrFloat,dErrInt,dRefMax,(bSparseOk)?"ok":"MISMATCH");
+		}
+	}
+}
+
+// Fill a DQT table with one value
+static void TestDqtFill(unsigned short* pnDqt,unsigned short nVal)
+{
+	for (unsigned nInd=0;nInd<64;nInd++) {
+		pnDqt[nInd] = nVal;
+	}
+}
+
+// Largest coefficient that keeps the dequantized value within nRange
+static int TestCoefMax(int nRange,unsigned short nDqt)
+{
+	return nRange / nDqt;
+}
+
+int main()
+{
+	unsigned short	anDqt[64];
+	short			anCoef[64];
+	unsigned		nRange,nInd,nPos,nIter;
+	int				nMax;
+
+	ImgDecodeIdctRefInit(glb_afLookup);
+
+	for (nRange=0;nRange<TEST_RANGE_NUM;nRange++) {
+		int	nLimit = glb_anTestRange[nRange];
+		glb_nBlockNum = 0;
+		glb_dErrMaxFloat = 0;
+		glb_dErrMaxInt = 0;
+
+		// Edge case: no AC coefficients
+		TestDqtFill(anDqt,1);
+		memset(anCoef,0,sizeof(anCoef));
+		anCoef[0] = (short)nLimit;
+		TestIdctBlock("DC only",anCoef,anDqt);
+
+		// Edge case: a single AC coefficient at each position, both signs,
+		// at the largest magnitude
+		for (nPos=1;nPos<64;nPos++) {
+			memset(anCoef,0,sizeof(anCoef));
+			anCoef[nPos] = (short)nLimit;
+			TestIdctBlock("Single +",anCoef,anDqt);
+			anCoef[nPos] = (short)-nLimit;
+			TestIdctBlock("Single -",anCoef,anDqt);
+		}
+
+		// Edge case: all coefficients set (at 1/8 of the range) with
+		// constant and alternating signs (worst case accumulation)
+		nMax = nLimit / 8;
+		for (nInd=0;nInd<64;nInd++) {
+			anCoef[nInd] = (short)nMax;
+		}
+		TestIdctBlock("All +",anCoef,anDqt);
+		for (nInd=0;nInd<64;nInd++) {
+			anCoef[nInd] = (short)(((nInd/8 + nInd%8) & 1) ? -nMax : nMax);
+		}
+		TestIdctBlock("Checkerboard",anCoef,anDqt);
+
+		// Random blocks, with a flat table of 1 and the luminance table
+		for (nIter=0;nIter<TEST_IDCT_RAND_NUM;nIter++) {
+			bool	bLum = (nIter & 1) != 0;
+			if (bLum) {
+				memcpy(anDqt,glb_anDqtLum,sizeof(anDqt));
+			} else {
+				TestDqtFill(anDqt,1);
+			}
+			// Vary the sparsity so that each IDCT path is exercised
+			unsigned	nZzLast = TestRand() % 64;
+			for (nInd=0;nInd<64;nInd++) {
+				anCoef[nInd] = 0;
+				if (glb_anZigzag[nInd] <= nZzLast) {
+					anCoef[nInd] = (short)TestRandRange(TestCoefMax(nLimit,anDqt[nInd]) / 4);
+				}
+			}
+			TestIdctBlock((bLum)?"Random (lum DQT)":"Random (flat DQT)",anCoef,anDqt);
+		}
+
+		// Random blocks with the largest 8-bit DQT value
+		TestDqtFill(anDqt,255);
+		nMax = TestCoefMax(nLimit,255);
+		if (nMax > 0) {
+			for (nIter=0;nIter<TEST_IDCT_RAND_NUM/10;nIter++) {
+				for (nInd=0;nInd<64;nInd++) {
+					anCoef[nInd] = (short)TestRandRange(nMax / 4);
+				}
+				TestIdctBlock("Random (DQT 255)",anCoef,anDqt);
+			}
+		}
+
+		printf("Range %5d: %u blocks, max error float=%.4f int=%.4f\n",
+			nLimit,glb_nBlockNum,glb_dErrMaxFloat,glb_dErrMaxInt);
+	}
+
+	printf("IDCT: %u failed\n",glb_nFailNum);
+	return (glb_nFailNum == 0) ? 0 : 1;
+}
@@ -0,0 +1,308 @@
+// JPEGsnoop - JPEG Image Decoder & Analysis Utility
+// Copyright (C) 2017 - Calvin Hass
+// http://www.impulseadventure.com/photo/jpeg-snoop.html
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+// ==========================================================================
+// MODULE DESCRIPTION:
+// - SIMD kernel equivalence test (console, built by "nmake tests")
+// - Runs every entry of the SSE2 and AVX2 kernel tables on the same
+//   random and edge-case inputs as the scalar table and compares the
+//   outputs byte for byte (memcmp)
+// - Levels that the CPU does not support (ImgDecodeSimdDetect) are
+//   skipped
+// - Returns 0 if all kernels match
+//
+// ==========================================================================
+
+#include "stdafx.h"
+#include "ImgDecodeSimd.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#define TEST_SIMD_ITER_NUM		20000	// Random inputs per kernel
+#define TEST_SIMD_ROW_MAX		300		// Longest row (covers the SIMD tails)
+#define TEST_SIMD_FILL			0xA5	// Output fill (detects unwritten / overrun bytes)
+
+// Zigzag index of each normal order coefficient
+static const unsigned glb_anZigzag[64] = {
+	 0,  1,  5,  6, 14, 15, 27, 28,
+	 2,  4,  7, 13, 16, 26, 29, 42,
+	 3,  8, 12, 17, 25, 30, 41, 43,
+	 9, 11, 18, 24, 31, 40, 44, 53,
+	10, 19, 23, 32, 39, 45, 52, 54,
+	20, 22, 33, 38, 46, 51, 55, 60,
+	21, 34, 37, 47, 50, 56, 59, 61,
+	35, 36, 48, 49, 57, 58, 62, 63
+};
+
+static const ImgDecodeKernels*	glb_pRef = NULL;
+static const ImgDecodeKernels*	glb_pTest = NULL;
+static const char*				glb_strLevel = "";
+static unsigned					glb_nFailNum = 0;
+static unsigned					glb_nRandState = 12345;
+
+// Deterministic random number (LCG) so that failures are repeatable
+static unsigned TestRand()
+{
+	glb_nRandState = glb_nRandState * 1103515245 + 12345;
+	return (glb_nRandState >> 8) & 0xFFFFFF;
+}
+
+// Random value in nMin..nMax
+static int TestRandRange(int nMin,int nMax)
+{
+	return (int)(TestRand() % (unsigned)(nMax-nMin+1)) + nMin;
+}
+
+// Random 16-bit sample, including the extremes
+static short TestRandSample(int nRange)
+{
+	switch (TestRand() % 64) {
+		case 0:
+			return SHRT_MAX;
+		case 1:
+			return SHRT_MIN;
+		default:
+			return (short)TestRandRange(-nRange,nRange);
+	}
+}
+
+// Compare the output of the kernel under test against the scalar one
+//
+// INPUT:
+// - strKernel				= Kernel name (for the failure report)
+// - nIter					= Iteration (for the failure report)
+// - pRef, pTest			= Outputs
+// - nSize					= Output size in bytes
+//
+static void TestCompare(const char* strKernel,unsigned nIter,const void* pRef,const void* pTest,unsigned nSize)
+{
+	if (memcmp(pRef,pTest,nSize) != 0) {
+		glb_nFailNum++;
+		if (glb_nFailNum <= 20) {
+			printf("FAIL: %s %s (iteration %u)\n",glb_strLevel,strKernel,nIter);
+		}
+	}
+}
+
+// Random quantized block whose last non-zero coefficient is at or
+// before zigzag index nZzLast
+static void TestRandBlock(short* pnCoef,unsigned nZzLast,int nRange)
+{
+	for (unsigned nInd=0;nInd<64;nInd++) {
+		pnCoef[nInd] = 0;
+		if (glb_anZigzag[nInd] <= nZzLast) {
+			pnCoef[nInd] = (short)TestRandRange(-nRange,nRange);
+		}
+	}
+}
+
+// Dequantize and IDCT kernels (float and fixed point, full and sparse)
+static void TestBlockKernels(unsigned nIter)
+{
+	short		anCoef[64];
+	float		afMult[64];
+	int			anMult[64];
+	float		afRef[64],afTest[64];
+	int			anRef[64],anTest[64];
+	unsigned	nInd;
+
+	// 8-bit and 12-bit coefficient ranges with random DQT tables
+	bool	b12bit = (nIter & 1) != 0;
+	for (nInd=0;nInd<64;nInd++) {
+		unsigned nDqt = (unsigned)TestRandRange(1,(b12bit)?16:255);
+		ImgDecodeIdctMult(nDqt,nInd,afMult[nInd],anMult[nInd]);
+	}
+	TestRandBlock(anCoef,TestRand()%64,(b12bit)?2047:127);
+
+	memset(afRef,TEST_SIMD_FILL,sizeof(afRef));
+	memset(afTest,TEST_SIMD_FILL,sizeof(afTest));
+	glb_pRef->pfnDequantFloat(anCoef,afMult,afRef);
+	glb_pTest->pfnDequantFloat(anCoef,afMult,afTest);
+	TestCompare("DequantFloat",nIter,afRef,afTest,sizeof(afRef));
+
+	// IDCT on the same (scalar) dequantized input
+	memcpy(afTest,afRef,sizeof(afTest));
+	glb_pRef->pfnIdctFloat(afRef);
+	glb_pTest->pfnIdctFloat(afTest);
+	TestCompare("IdctFloat",nIter,afRef,afTest,sizeof(afRef));
+
+	memset(anRef,TEST_SIMD_FILL,sizeof(anRef));
+	memset(anTest,TEST_SIMD_FILL,sizeof(anTest));
+	glb_pRef->pfnIdctInt(anCoef,anMult,anRef);
+	glb_pTest->pfnIdctInt(anCoef,anMult,anTest);
+	TestCompare("IdctInt",nIter,anRef,anTest,sizeof(anRef));
+
+	// Sparse blocks
+	TestRandBlock(anCoef,IDCT_ZZ_MAX_2X2,(b12bit)?2047:127);
+	glb_pRef->pfnIdctFloat2x2(anCoef,afMult,afRef);
+	glb_pTest->pfnIdctFloat2x2(anCoef,afMult,afTest);
+	TestCompare("IdctFloat2x2",nIter,afRef,afTest,sizeof(afRef));
+
+	TestRandBlock(anCoef,IDCT_ZZ_MAX_4X4,(b12bit)?2047:127);
+	glb_pRef->pfnIdctFloat4x4(anCoef,afMult,afRef);
+	glb_pTest->pfnIdctFloat4x4(anCoef,afMult,afTest);
+	TestCompare("IdctFloat4x4",nIter,afRef,afTest,sizeof(afRef));
+}
+
+// Level shift kernels, including values that saturate
+static void TestLevelShiftKernels(unsigned nIter)
+{
+	float		afBlock[64];
+	int			anBlock[64];
+	short		anRef[64],anTest[64];
+	unsigned	nInd;
+	short		nDcOffset = TestRandSample(4096);
+
+	for (nInd=0;nInd<64;nInd++) {
+		switch (TestRand() % 16) {
+			case 0:
+				afBlock[nInd] = 1.0e10f;
+				anBlock[nInd] = INT_MAX;
+				break;
+			case 1:
+				afBlock[nInd] = -1.0e10f;
+				anBlock[nInd] = INT_MIN;
+				break;
+			case 2:
+				anBlock[nInd] = TestRandRange(-100000,100000);
+				afBlock[nInd] = (float)anBlock[nInd] + 0.5f;
+				break;
+			default:
+				anBlock[nInd] = TestRandRange(-4096,4096);
+				afBlock[nInd] = (float)TestRandRange(-40960,40960) / 10;
+				break;
+		}
+	}
+
+	memset(anRef,TEST_SIMD_FILL,sizeof(anRef));
+	memset(anTest,TEST_SIMD_FILL,sizeof(anTest));
+	glb_pRef->pfnLevelShiftFloat(afBlock,nDcOffset,anRef);
+	glb_pTest->pfnLevelShiftFloat(afBlock,nDcOffset,anTest);
+	TestCompare("LevelShiftFloat",nIter,anRef,anTest,sizeof(anRef));
+
+	memset(anRef,TEST_SIMD_FILL,sizeof(anRef));
+	memset(anTest,TEST_SIMD_FILL,sizeof(anTest));
+	glb_pRef->pfnLevelShiftInt(anBlock,nDcOffset,anRef);
+	glb_pTest->pfnLevelShiftInt(anBlock,nDcOffset,anTest);
+	TestCompare("LevelShiftInt",nIter,anRef,anTest,sizeof(anRef));
+}
+
+// Clear the color statistics (see YccStats)
+static void TestStatsClear(YccStats* psStats)
+{
+	memset(psStats,0,sizeof(YccStats));
+	for (unsigned nStat=0;nStat<YCC_STAT_NUM;nStat++) {
+		psStats->anMin[nStat] = INT_MAX;
+		psStats->anMax[nStat] = INT_MIN;
+	}
+}
+
+// Per-row color conversion and statistics kernels
+static void TestRowKernels(unsigned nIter)
+{
+	static short			anC[TEST_SIMD_ROW_MAX],anM[TEST_SIMD_ROW_MAX];
+	static short			anY[TEST_SIMD_ROW_MAX],anK[TEST_SIMD_ROW_MAX];
+	static unsigned char	anRef[TEST_SIMD_ROW_MAX*4],anTest[TEST_SIMD_ROW_MAX*4];
+	static YccStats			sStatsRef,sStatsTest;
+	unsigned				nInd;
+
+	// Row length from 0 so that every SIMD tail length is covered
+	unsigned	nNum = TestRand() % (TEST_SIMD_ROW_MAX+1);
+	bool		b12bit = (nIter & 1) != 0;
+	int			nRange = (b12bit) ? 20000 : 1200;
+	for (nInd=0;nInd<TEST_SIMD_ROW_MAX;nInd++) {
+		anC[nInd] = TestRandSample(nRange);
+		anM[nInd] = TestRandSample(nRange);
+		anY[nInd] = TestRandSample(nRange);
+		anK[nInd] = TestRandSample(nRange);
+	}
+
+	// CMYK / YCCK
+	bool		bYcck = (TestRand() & 1) != 0;
+	unsigned	nShift = (b12bit) ? 7 : 3;
+	memset(anRef,TEST_SIMD_FILL,sizeof(anRef));
+	memset(anTest,TEST_SIMD_FILL,sizeof(anTest));
+	glb_pRef->pfnCmykToRgb(anC,anM,anY,anK,bYcck,nShift,nNum,anRef);
+	glb_pTest->pfnCmykToRgb(anC,anM,anY,anK,bYcck,nShift,nNum,anTest);
+	TestCompare("CmykToRgb",nIter,anRef,anTest,sizeof(anRef));
+
+	// YCC (anY, anC, anM as Y, Cb, Cr)
+	bool		bChromaHalf = (TestRand() & 1) != 0;
+	short		anOfs[3];
+	unsigned	anSel[3];
+	for (nInd=0;nInd<3;nInd++) {
+		anOfs[nInd] = (short)TestRandRange(-1000,1000);
+		anSel[nInd] = TestRand() % YCC_OUT_NUM;
+	}
+	if (TestRand() & 1) {
+		// Normal RGB preview
+		anSel[0] = YCC_OUT_B;
+		anSel[1] = YCC_OUT_G;
+		anSel[2] = YCC_OUT_R;
+	}
+	memset(anRef,TEST_SIMD_FILL,sizeof(anRef));
+	memset(anTest,TEST_SIMD_FILL,sizeof(anTest));
+	unsigned	nSumRef = glb_pRef->pfnYccToRgb(anY,anC,anM,bChromaHalf,anOfs,nShift,anSel,nNum,anRef);
+	unsigned	nSumTest = glb_pTest->pfnYccToRgb(anY,anC,anM,bChromaHalf,anOfs,nShift,anSel,nNum,anTest);
+	TestCompare("YccToRgb",nIter,anRef,anTest,sizeof(anRef));
+	TestCompare("YccToRgb (sum)",nIter,&nSumRef,&nSumTest,sizeof(nSumRef));
+
+	// Statistics, accumulated over two rows
+	int			anStatOfs[3];
+	unsigned	nPrecShift = (b12bit) ? 4 : 0;
+	for (nInd=0;nInd<3;nInd++) {
+		anStatOfs[nInd] = (TestRand() & 1) ? TestRandRange(-1000,1000) : 0;
+	}
+	TestStatsClear(&sStatsRef);
+	TestStatsClear(&sStatsTest);
+	glb_pRef->pfnYccStats(anY,anC,anM,anStatOfs,nPrecShift,nNum,&sStatsRef);
+	glb_pTest->pfnYccStats(anY,anC,anM,anStatOfs,nPrecShift,nNum,&sStatsTest);
+	glb_pRef->pfnYccStats(anK,anM,anC,anStatOfs,nPrecShift,nNum/2,&sStatsRef);
+	glb_pTest->pfnYccStats(anK,anM,anC,anStatOfs,nPrecShift,nNum/2,&sStatsTest);
+	TestCompare("YccStats",nIter,&sStatsRef,&sStatsTest,sizeof(YccStats));
+}
+
+int main()
+{
+	static const teSimdLevel	aeLevel[] = { SIMD_LEVEL_SSE2, SIMD_LEVEL_AVX2 };
+	static const char*			astrLevel[] = { "SSE2", "AVX2" };
+	teSimdLevel					eLevelMax = ImgDecodeSimdDetect();
+	unsigned					nLevel,nIter;
+
+	glb_pRef = ImgDecodeSimdGet(SIMD_LEVEL_SCALAR);
+	for (nLevel=0;nLevel<sizeof(aeLevel)/sizeof(aeLevel[0]);nLevel++) {
+		glb_strLevel = astrLevel[nLevel];
+		if (aeLevel[nLevel] > eLevelMax) {
+			printf("%s: skipped (not supported by the CPU)\n",glb_strLevel);
+			continue;
+		}
+		glb_pTest = ImgDecodeSimdGet(aeLevel[nLevel]);
+		glb_nRandState = 12345;
+		unsigned	nFailStart = glb_nFailNum;
+		for (nIter=0;nIter<TEST_SIMD_ITER_NUM;nIter++) {
+			TestBlockKernels(nIter);
+			TestLevelShiftKernels(nIter);
+			TestRowKernels(nIter);
+		}
+		printf("%s: %u iterations, %u mismatches\n",glb_strLevel,TEST_SIMD_ITER_NUM,glb_nFailNum-nFailStart);
+	}
+
+	return (glb_nFailNum == 0) ? 0 : 1;
+}